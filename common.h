@@ -31,3 +31,11 @@
   (((uint32_t)(d) << 24) | ((uint32_t)(c) << 16) | ((uint32_t)(b) << 8) | (uint32_t)(a))
 
 using byte = unsigned char;
+
+// lets GCC and Clang check a printf-style format string against its arguments. The indices count
+// from 1, including the implicit this of member functions
+#if defined(__GNUC__)
+#define PRINTF_FORMAT(fmtIndex, argIndex) __attribute__((format(printf, fmtIndex, argIndex)))
+#else
+#define PRINTF_FORMAT(fmtIndex, argIndex)
+#endif
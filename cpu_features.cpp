@@ -0,0 +1,90 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "cpu_features.h"
+
+#if DXILP_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+static CPUFeatures QueryCPUFeatures()
+{
+  CPUFeatures ret;
+
+#if DXILP_X86
+  unsigned int regs[4] = {};    // eax, ebx, ecx, edx
+
+#if defined(_MSC_VER)
+  __cpuid((int *)regs, 0);
+  const unsigned int maxLeaf = regs[0];
+  __cpuid((int *)regs, 1);
+#else
+  const unsigned int maxLeaf = __get_cpuid_max(0, 0);
+  __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+
+  ret.ssse3 = (regs[2] & (1U << 9)) != 0;
+
+  const bool osxsave = (regs[2] & (1U << 27)) != 0;
+  const bool avx = (regs[2] & (1U << 28)) != 0;
+
+  // AVX state must also be enabled by the OS, not just supported by the CPU
+  bool ymmEnabled = false;
+  if(osxsave && avx)
+  {
+#if defined(_MSC_VER)
+    ymmEnabled = (_xgetbv(0) & 0x6) == 0x6;
+#else
+    unsigned int xcr0lo = 0, xcr0hi = 0;
+    __asm__("xgetbv" : "=a"(xcr0lo), "=d"(xcr0hi) : "c"(0));
+    ymmEnabled = (xcr0lo & 0x6) == 0x6;
+#endif
+  }
+
+  if(maxLeaf >= 7)
+  {
+#if defined(_MSC_VER)
+    __cpuidex((int *)regs, 7, 0);
+#else
+    __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+
+    ret.bmi1 = (regs[1] & (1U << 3)) != 0;
+    ret.bmi2 = (regs[1] & (1U << 8)) != 0;
+    ret.avx2 = ymmEnabled && (regs[1] & (1U << 5)) != 0;
+  }
+#endif
+
+  return ret;
+}
+
+const CPUFeatures &GetCPUFeatures()
+{
+  static const CPUFeatures features = QueryCPUFeatures();
+  return features;
+}
@@ -0,0 +1,57 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define DXILP_X86 1
+#else
+#define DXILP_X86 0
+#endif
+
+// the 64-bit BMI intrinsics like _pext_u64 only exist when targeting x64, not 32-bit x86
+#if defined(_M_X64) || defined(__x86_64__)
+#define DXILP_X64 1
+#else
+#define DXILP_X64 0
+#endif
+
+// lets a function be compiled with instructions beyond the baseline, so it can be selected at
+// runtime. MSVC allows intrinsics anywhere so needs nothing.
+#if DXILP_X86 && defined(__GNUC__)
+#define DXILP_TARGET(isa) __attribute__((target(isa)))
+#else
+#define DXILP_TARGET(isa)
+#endif
+
+struct CPUFeatures
+{
+  bool ssse3 = false;
+  bool bmi1 = false;
+  bool bmi2 = false;
+  bool avx2 = false;
+};
+
+// queried once and cached
+const CPUFeatures &GetCPUFeatures();
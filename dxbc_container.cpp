@@ -0,0 +1,340 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxbc_container.h"
+#include <string.h>
+#include <algorithm>
+
+namespace DXBC
+{
+static size_t alignUp4(size_t length)
+{
+  return (length + 3) & ~size_t(3);
+}
+
+static void append(std::vector<byte> &out, const void *data, size_t length)
+{
+  out.insert(out.end(), (const byte *)data, (const byte *)data + length);
+}
+
+Container::Container(const void *bytes, size_t length)
+{
+  const byte *ptr = (const byte *)bytes;
+  const DXBCFileHeader *header = (const DXBCFileHeader *)ptr;
+
+  if(length < sizeof(*header) || header->fileLength != length ||
+     header->fourcc != MAKE_FOURCC('D', 'X', 'B', 'C'))
+    return;
+
+  // the chunk offsets must all fit in the file
+  if(header->numChunks > (length - sizeof(*header)) / sizeof(uint32_t))
+    return;
+
+  m_Bytes = ptr;
+  m_Length = length;
+  m_Header = header;
+}
+
+const DXBCChunkHeader *Container::GetChunk(uint32_t idx) const
+{
+  if(idx >= NumChunks())
+    return NULL;
+
+  const uint32_t *offsets = (const uint32_t *)(m_Header + 1);
+
+  const uint32_t offs = offsets[idx];
+
+  // chunks are always dword aligned, and the header and the data it claims to have must both be
+  // in bounds
+  if((offs & 0x3) != 0 || offs > m_Length || m_Length - offs < sizeof(DXBCChunkHeader))
+    return NULL;
+
+  const DXBCChunkHeader *chunk = (const DXBCChunkHeader *)(m_Bytes + offs);
+
+  if(chunk->dataLength > m_Length - offs - sizeof(DXBCChunkHeader))
+    return NULL;
+
+  return chunk;
+}
+
+const DXBCChunkHeader *Container::FindChunk(uint32_t fourcc) const
+{
+  for(uint32_t chunkIdx = 0; chunkIdx < NumChunks(); chunkIdx++)
+  {
+    const DXBCChunkHeader *chunk = GetChunk(chunkIdx);
+
+    if(chunk && chunk->fourcc == fourcc)
+      return chunk;
+  }
+
+  return NULL;
+}
+
+const DXBCChunkHeader *Container::FindBestDXILChunk() const
+{
+  // debug DXIL is always the best
+  const DXBCChunkHeader *ret = FindChunk(MAKE_FOURCC('I', 'L', 'D', 'B'));
+  if(!ret)
+    ret = FindChunk(MAKE_FOURCC('D', 'X', 'I', 'L'));
+  return ret;
+}
+
+ContainerWriter::ContainerWriter(const Container &source)
+{
+  if(!source.IsValid())
+    return;
+
+  for(uint32_t chunkIdx = 0; chunkIdx < source.NumChunks(); chunkIdx++)
+  {
+    const DXBCChunkHeader *chunk = source.GetChunk(chunkIdx);
+    if(!chunk)
+      return;
+
+    m_Chunks.push_back({chunk->fourcc, (const byte *)(chunk + 1), chunk->dataLength});
+  }
+
+  m_Header = *source.GetHeader();
+  m_Valid = true;
+}
+
+uint32_t ContainerWriter::Remove(uint32_t fourcc)
+{
+  const size_t count = m_Chunks.size();
+  m_Chunks.erase(std::remove_if(m_Chunks.begin(), m_Chunks.end(),
+                                [fourcc](const Chunk &chunk) { return chunk.fourcc == fourcc; }),
+                 m_Chunks.end());
+  return uint32_t(count - m_Chunks.size());
+}
+
+void ContainerWriter::Add(uint32_t fourcc, const void *data, size_t length)
+{
+  m_Chunks.push_back({fourcc, (const byte *)data, length});
+}
+
+void ContainerWriter::Set(uint32_t fourcc, const void *data, size_t length)
+{
+  for(size_t i = 0; i < m_Chunks.size(); i++)
+  {
+    if(m_Chunks[i].fourcc != fourcc)
+      continue;
+
+    m_Chunks[i].data = (const byte *)data;
+    m_Chunks[i].length = length;
+
+    // any later ones are dropped
+    m_Chunks.erase(std::remove_if(m_Chunks.begin() + i + 1, m_Chunks.end(),
+                                  [fourcc](const Chunk &chunk) { return chunk.fourcc == fourcc; }),
+                   m_Chunks.end());
+    return;
+  }
+
+  Add(fourcc, data, length);
+}
+
+bool ContainerWriter::Write(std::vector<byte> &out) const
+{
+  if(!m_Valid)
+    return false;
+
+  // the size is worked out first so the output is written in one go. Chunks start dword aligned,
+  // so each one's data is padded with zeroes
+  uint64_t fileLength = sizeof(DXBCFileHeader) + m_Chunks.size() * sizeof(uint32_t);
+  for(const Chunk &chunk : m_Chunks)
+  {
+    if(chunk.length > ~0U)
+      return false;
+    fileLength += sizeof(DXBCChunkHeader) + alignUp4(chunk.length);
+  }
+
+  if(fileLength > ~0U)
+    return false;
+
+  const size_t base = out.size();
+  out.reserve(base + size_t(fileLength));
+
+  DXBCFileHeader header = m_Header;
+  header.fileLength = uint32_t(fileLength);
+  header.numChunks = uint32_t(m_Chunks.size());
+  append(out, &header, sizeof(header));
+
+  uint32_t offset = uint32_t(sizeof(DXBCFileHeader) + m_Chunks.size() * sizeof(uint32_t));
+  for(const Chunk &chunk : m_Chunks)
+  {
+    append(out, &offset, sizeof(offset));
+    offset += uint32_t(sizeof(DXBCChunkHeader) + alignUp4(chunk.length));
+  }
+
+  for(const Chunk &chunk : m_Chunks)
+  {
+    const DXBCChunkHeader chunkHeader = {chunk.fourcc, uint32_t(chunk.length)};
+    append(out, &chunkHeader, sizeof(chunkHeader));
+    append(out, chunk.data, chunk.length);
+    out.resize(out.size() + alignUp4(chunk.length) - chunk.length, 0);
+  }
+
+  static const uint8_t zeroHash[sizeof(header.hashValue)] = {};
+  if(memcmp(m_Header.hashValue, zeroHash, sizeof(zeroHash)) != 0)
+  {
+    DXBCFileHeader *written = (DXBCFileHeader *)(out.data() + base);
+    ComputeContainerHash(written, size_t(fileLength), written->hashValue);
+  }
+
+  return true;
+}
+
+// the per-round shift amounts and additive constants, from RFC 1321
+static const uint32_t md5Shifts[4][4] = {
+    {7, 12, 17, 22}, {5, 9, 14, 20}, {4, 11, 16, 23}, {6, 10, 15, 21},
+};
+
+static const uint32_t md5Constants[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613,
+    0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193,
+    0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d,
+    0x02441453, 0xd8a1e681, 0xe7d3fbc8, 0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+    0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122,
+    0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665, 0xf4292244,
+    0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb,
+    0xeb86d391,
+};
+
+static void md5Block(uint32_t state[4], const byte *block)
+{
+  uint32_t words[16];
+  memcpy(words, block, sizeof(words));
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  for(uint32_t i = 0; i < 64; i++)
+  {
+    uint32_t f, w;
+    if(i < 16)
+    {
+      f = (b & c) | (~b & d);
+      w = i;
+    }
+    else if(i < 32)
+    {
+      f = (d & b) | (~d & c);
+      w = (5 * i + 1) % 16;
+    }
+    else if(i < 48)
+    {
+      f = b ^ c ^ d;
+      w = (3 * i + 5) % 16;
+    }
+    else
+    {
+      f = c ^ (b | ~d);
+      w = (7 * i) % 16;
+    }
+
+    f += a + md5Constants[i] + words[w];
+    const uint32_t shift = md5Shifts[i / 16][i % 4];
+
+    a = d;
+    d = c;
+    c = b;
+    b += (f << shift) | (f >> (32 - shift));
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+}
+
+void ComputeContainerHash(const void *bytes, size_t length, uint8_t hash[16])
+{
+  // the hash starts after the fourcc and itself
+  const size_t skip = sizeof(uint32_t) + sizeof(DXBCFileHeader::hashValue);
+  const byte *data = (const byte *)bytes + skip;
+  length -= skip;
+
+  uint32_t state[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+  const size_t whole = length & ~size_t(63);
+  for(size_t i = 0; i < whole; i += 64)
+    md5Block(state, data + i);
+
+  // unlike MD5 the bit count comes first in the last block, and a value derived from it last
+  const uint32_t numBits = uint32_t(length * 8);
+  const uint32_t lastWord = (numBits >> 2) | 1;
+  const size_t leftover = length - whole;
+
+  byte block[64] = {};
+  if(leftover >= 56)
+  {
+    // no room for the count, so it gets a block of its own
+    memcpy(block, data + whole, leftover);
+    block[leftover] = 0x80;
+    md5Block(state, block);
+
+    memset(block, 0, sizeof(block));
+    memcpy(block, &numBits, sizeof(numBits));
+  }
+  else
+  {
+    memcpy(block, &numBits, sizeof(numBits));
+    memcpy(block + sizeof(numBits), data + whole, leftover);
+    block[sizeof(numBits) + leftover] = 0x80;
+  }
+
+  memcpy(block + 60, &lastWord, sizeof(lastWord));
+  md5Block(state, block);
+
+  memcpy(hash, state, sizeof(state));
+}
+
+void ComputeMD5(const void *bytes, size_t length, uint8_t hash[16])
+{
+  const byte *data = (const byte *)bytes;
+
+  uint32_t state[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+  const size_t whole = length & ~size_t(63);
+  for(size_t i = 0; i < whole; i += 64)
+    md5Block(state, data + i);
+
+  const uint64_t numBits = uint64_t(length) * 8;
+  const size_t leftover = length - whole;
+
+  byte block[64] = {};
+  memcpy(block, data + whole, leftover);
+  block[leftover] = 0x80;
+
+  // no room for the count, so it gets a block of its own
+  if(leftover >= 56)
+  {
+    md5Block(state, block);
+    memset(block, 0, sizeof(block));
+  }
+
+  memcpy(block + 56, &numBits, sizeof(numBits));
+  md5Block(state, block);
+
+  memcpy(hash, state, sizeof(state));
+}
+};    // namespace DXBC
@@ -0,0 +1,115 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "common.h"
+
+struct DXBCFileHeader
+{
+  uint32_t fourcc;          // "DXBC"
+  uint8_t hashValue[16];    // see ComputeContainerHash, or all zeroes if never validated
+  uint16_t majorVersion;
+  uint16_t minorVersion;
+  uint32_t fileLength;
+  uint32_t numChunks;
+  // uint32 chunkOffsets[numChunks]; follows
+};
+
+struct DXBCChunkHeader
+{
+  uint32_t fourcc;
+  uint32_t dataLength;
+  // byte data[dataLength]; follows
+};
+
+namespace DXBC
+{
+// lightweight view over a container in memory. Doesn't copy or own any data, the chunk pointers
+// returned point directly into the bytes passed in.
+class Container
+{
+public:
+  Container(const void *bytes, size_t length);
+
+  bool IsValid() const { return m_Header != NULL; }
+  const DXBCFileHeader *GetHeader() const { return m_Header; }
+  uint32_t NumChunks() const { return m_Header ? m_Header->numChunks : 0; }
+  const DXBCChunkHeader *GetChunk(uint32_t idx) const;
+  const DXBCChunkHeader *FindChunk(uint32_t fourcc) const;
+
+  // returns the debug DXIL if it's present, otherwise the normal DXIL
+  const DXBCChunkHeader *FindBestDXILChunk() const;
+
+private:
+  const byte *m_Bytes = NULL;
+  size_t m_Length = 0;
+  const DXBCFileHeader *m_Header = NULL;
+};
+
+// writes a copy of a container with chunks dropped, added or replaced. Chunks keep their order,
+// with added ones at the end. Nothing is copied until the container is written, so the source
+// and any data given must outlive the writer.
+class ContainerWriter
+{
+public:
+  // starts with every chunk of the source. If the source is invalid, or any of its chunks are out
+  // of bounds, writing fails
+  explicit ContainerWriter(const Container &source);
+
+  uint32_t NumChunks() const { return uint32_t(m_Chunks.size()); }
+
+  // drops every chunk with this fourcc, returning how many there were
+  uint32_t Remove(uint32_t fourcc);
+  void Add(uint32_t fourcc, const void *data, size_t length);
+  // replaces the first chunk with this fourcc, dropping any others, or adds it if there's none
+  void Set(uint32_t fourcc, const void *data, size_t length);
+
+  // appends the new container. Its hash is recomputed unless the source's was all zeroes, so an
+  // unvalidated container never looks validated. Fails if it's too big for its length field
+  bool Write(std::vector<byte> &out) const;
+
+private:
+  struct Chunk
+  {
+    uint32_t fourcc;
+    const byte *data;
+    size_t length;
+  };
+
+  bool m_Valid = false;
+  DXBCFileHeader m_Header = {};
+  std::vector<Chunk> m_Chunks;
+};
+
+// the hash the validator stores in a container's header, covering everything after it. It's MD5
+// with the message length moved around in the padding, so a standard MD5 doesn't match
+void ComputeContainerHash(const void *bytes, size_t length, uint8_t hash[16]);
+
+// a standard MD5 of the bytes, for identifying containers by their contents whether or not they've
+// been validated
+void ComputeMD5(const void *bytes, size_t length, uint8_t hash[16]);
+};    // namespace DXBC
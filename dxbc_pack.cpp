@@ -0,0 +1,267 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxbc_pack.h"
+#include <string.h>
+#include <algorithm>
+#include "dxbc_container.h"
+#include "trace.h"
+
+namespace DXBC
+{
+static uint64_t alignUp(uint64_t offset, uint64_t alignment)
+{
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+PackWriter::~PackWriter()
+{
+  if(m_File)
+    fclose(m_File);
+}
+
+bool PackWriter::Open(const char *filename)
+{
+  m_File = fopen(filename, "wb");
+  if(!m_File)
+    return false;
+
+  // the header is filled in properly once the directory is written
+  DXBCPackHeader header = {};
+  m_Failed = fwrite(&header, sizeof(header), 1, m_File) != 1;
+  m_Offset = sizeof(header);
+  return !m_Failed;
+}
+
+bool PackWriter::WritePadding(size_t count)
+{
+  static const byte zeroes[DXBCPackAlignment] = {};
+
+  if(count > 0 && fwrite(zeroes, 1, count, m_File) != count)
+    m_Failed = true;
+  m_Offset += count;
+  return !m_Failed;
+}
+
+bool PackWriter::Add(const char *name, const void *bytes, size_t length)
+{
+  TRACE_SCOPE("PackWriter::Add");
+
+  if(!m_File || m_Failed)
+    return false;
+
+  Container container(bytes, length);
+  if(!container.IsValid())
+    return false;
+
+  if(!m_Names.insert(name).second)
+    return false;
+
+  if(!WritePadding(size_t(alignUp(m_Offset, DXBCPackAlignment) - m_Offset)))
+    return false;
+
+  PendingEntry pending;
+  pending.name = name;
+  pending.entry.offset = m_Offset;
+  pending.entry.length = uint32_t(length);
+  pending.entry.nameOffset = 0;
+  ComputeMD5(bytes, length, pending.entry.hash);
+
+  if(fwrite(bytes, 1, length, m_File) != length)
+  {
+    m_Failed = true;
+    return false;
+  }
+  m_Offset += length;
+
+  m_Entries.push_back(pending);
+  return true;
+}
+
+bool PackWriter::Finish()
+{
+  TRACE_SCOPE("PackWriter::Finish");
+
+  if(!m_File)
+    return false;
+
+  std::sort(m_Entries.begin(), m_Entries.end(),
+            [](const PendingEntry &a, const PendingEntry &b) { return a.name < b.name; });
+
+  std::vector<DXBCPackEntry> entries(m_Entries.size());
+  std::vector<uint32_t> hashOrder(m_Entries.size());
+  std::string names;
+
+  for(size_t i = 0; i < m_Entries.size(); i++)
+  {
+    entries[i] = m_Entries[i].entry;
+    entries[i].nameOffset = uint32_t(names.size());
+    names.append(m_Entries[i].name.c_str(), m_Entries[i].name.size() + 1);
+    hashOrder[i] = uint32_t(i);
+  }
+
+  std::stable_sort(hashOrder.begin(), hashOrder.end(), [&entries](uint32_t a, uint32_t b) {
+    return memcmp(entries[a].hash, entries[b].hash, sizeof(entries[a].hash)) < 0;
+  });
+
+  if(names.size() > 0xffffffffU)
+    m_Failed = true;
+
+  // the directory is 8-byte aligned so the mapped entries can be read in place
+  WritePadding(size_t(alignUp(m_Offset, 8) - m_Offset));
+
+  DXBCPackHeader header = {};
+  header.fourcc = MAKE_FOURCC('D', 'X', 'P', 'K');
+  header.version = DXBCPackVersion;
+  header.numEntries = uint32_t(entries.size());
+  header.namesLength = uint32_t(names.size());
+  header.directoryOffset = m_Offset;
+
+  if(!m_Failed && !entries.empty() &&
+     (fwrite(entries.data(), sizeof(DXBCPackEntry), entries.size(), m_File) != entries.size() ||
+      fwrite(hashOrder.data(), sizeof(uint32_t), hashOrder.size(), m_File) != hashOrder.size() ||
+      fwrite(names.data(), 1, names.size(), m_File) != names.size()))
+    m_Failed = true;
+
+  if(!m_Failed &&
+     (fseek(m_File, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, m_File) != 1))
+    m_Failed = true;
+
+  if(fclose(m_File) != 0)
+    m_Failed = true;
+  m_File = NULL;
+
+  return !m_Failed;
+}
+
+PackReader::PackReader(const void *bytes, size_t length)
+{
+  const byte *ptr = (const byte *)bytes;
+  const DXBCPackHeader *header = (const DXBCPackHeader *)ptr;
+
+  if(length < sizeof(*header) || header->fourcc != MAKE_FOURCC('D', 'X', 'P', 'K') ||
+     header->version != DXBCPackVersion)
+    return;
+
+  // the whole directory must fit in the file, and be aligned to read in place
+  const uint64_t directorySize =
+      uint64_t(header->numEntries) * (sizeof(DXBCPackEntry) + sizeof(uint32_t)) +
+      header->namesLength;
+  if((header->directoryOffset & 0x7) != 0 || header->directoryOffset > length ||
+     directorySize > length - header->directoryOffset)
+    return;
+
+  const byte *directory = ptr + header->directoryOffset;
+  const char *names = (const char *)(directory + uint64_t(header->numEntries) *
+                                                     (sizeof(DXBCPackEntry) + sizeof(uint32_t)));
+
+  // every name is terminated as long as the last one is
+  if(header->namesLength > 0 && names[header->namesLength - 1] != 0)
+    return;
+  if(header->namesLength == 0 && header->numEntries > 0)
+    return;
+
+  m_Bytes = ptr;
+  m_Header = header;
+  m_Entries = (const DXBCPackEntry *)directory;
+  m_HashOrder = (const uint32_t *)(m_Entries + header->numEntries);
+  m_Names = names;
+}
+
+const char *PackReader::GetName(const DXBCPackEntry &entry) const
+{
+  if(entry.nameOffset >= m_Header->namesLength)
+    return NULL;
+
+  return m_Names + entry.nameOffset;
+}
+
+const byte *PackReader::GetData(const DXBCPackEntry &entry) const
+{
+  // containers are all before the directory
+  if(entry.offset > m_Header->directoryOffset ||
+     entry.length > m_Header->directoryOffset - entry.offset)
+    return NULL;
+
+  return m_Bytes + entry.offset;
+}
+
+const DXBCPackEntry *PackReader::Find(const char *name) const
+{
+  uint32_t lo = 0, hi = NumEntries();
+  while(lo < hi)
+  {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    const char *midName = GetName(m_Entries[mid]);
+    if(!midName)
+      return NULL;
+
+    const int cmp = strcmp(midName, name);
+    if(cmp == 0)
+      return &m_Entries[mid];
+    else if(cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return NULL;
+}
+
+const DXBCPackEntry *PackReader::FindByHash(const uint8_t hash[16]) const
+{
+  uint32_t lo = 0, hi = NumEntries();
+  while(lo < hi)
+  {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    const uint32_t idx = m_HashOrder[mid];
+    if(idx >= NumEntries())
+      return NULL;
+
+    const int cmp = memcmp(m_Entries[idx].hash, hash, sizeof(m_Entries[idx].hash));
+    if(cmp == 0)
+      return &m_Entries[idx];
+    else if(cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return NULL;
+}
+
+void PackReader::ForEach(
+    uint32_t first, uint32_t count,
+    const std::function<void(const char *name, const byte *data, size_t length)> &func) const
+{
+  const uint32_t end = first + std::min(count, NumEntries() - std::min(first, NumEntries()));
+  for(uint32_t i = first; i < end; i++)
+  {
+    const char *name = GetName(m_Entries[i]);
+    const byte *data = GetData(m_Entries[i]);
+    if(name && data)
+      func(name, data, m_Entries[i].length);
+  }
+}
+};    // namespace DXBC
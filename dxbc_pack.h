@@ -0,0 +1,142 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "common.h"
+
+// a pack is a single file holding many containers, so a whole shader cache costs one open and one
+// mapping rather than a file each. It's laid out as:
+//
+//   DXBCPackHeader
+//   each container, starting on a DXBCPackAlignment boundary so it can be mapped on its own
+//   DXBCPackEntry[numEntries], sorted by name
+//   uint32_t[numEntries] of entry indices, sorted by container MD5
+//   the names, each NUL terminated
+//
+// the directory goes last so containers can be written out as they're added.
+struct DXBCPackHeader
+{
+  uint32_t fourcc;    // "DXPK"
+  uint32_t version;
+  uint32_t numEntries;
+  uint32_t namesLength;
+  uint64_t directoryOffset;
+};
+
+struct DXBCPackEntry
+{
+  uint64_t offset;
+  uint32_t length;
+  uint32_t nameOffset;
+  // DXBC::ComputeMD5 of the container's bytes, so identical containers match even if they were
+  // never validated and the hash in their header is zeroed or stale
+  uint8_t hash[16];
+};
+
+// version 1 indexed the hash from each container's header instead
+static const uint32_t DXBCPackVersion = 2;
+static const uint32_t DXBCPackAlignment = 4096;
+
+namespace DXBC
+{
+// writes a pack, streaming containers out as they're added. Only the directory is kept in memory
+// until Finish.
+class PackWriter
+{
+public:
+  PackWriter() {}
+  ~PackWriter();
+
+  PackWriter(const PackWriter &) = delete;
+  PackWriter &operator=(const PackWriter &) = delete;
+
+  bool Open(const char *filename);
+
+  // returns false if the bytes aren't a container, the name is already in the pack, or the write
+  // failed
+  bool Add(const char *name, const void *bytes, size_t length);
+
+  // writes the directory and closes the file. Returns false if anything failed to write, in which
+  // case the file is incomplete
+  bool Finish();
+
+private:
+  struct PendingEntry
+  {
+    std::string name;
+    DXBCPackEntry entry;
+  };
+
+  bool WritePadding(size_t count);
+
+  FILE *m_File = NULL;
+  uint64_t m_Offset = 0;
+  bool m_Failed = false;
+  std::vector<PendingEntry> m_Entries;
+  std::unordered_set<std::string> m_Names;
+};
+
+// a view over a pack in memory, e.g. from a MappedFile. Nothing is copied, so containers point
+// straight into the bytes, which must outlive the reader and be 8-byte aligned.
+class PackReader
+{
+public:
+  PackReader(const void *bytes, size_t length);
+
+  bool IsValid() const { return m_Header != NULL; }
+  uint32_t NumEntries() const { return m_Header ? m_Header->numEntries : 0; }
+
+  // entries are in name order
+  const DXBCPackEntry &GetEntry(uint32_t idx) const { return m_Entries[idx]; }
+  // NULL if the entry's name or container are out of bounds
+  const char *GetName(const DXBCPackEntry &entry) const;
+  const byte *GetData(const DXBCPackEntry &entry) const;
+
+  // binary searches of the directory. NULL if there's no such entry. Identical containers added
+  // under different names share an MD5, in which case any of them is returned
+  const DXBCPackEntry *Find(const char *name) const;
+  const DXBCPackEntry *FindByHash(const uint8_t hash[16]) const;
+
+  // calls func with each container in [first, first + count) in name order, skipping any that are
+  // out of bounds
+  void ForEach(uint32_t first, uint32_t count,
+               const std::function<void(const char *name, const byte *data, size_t length)> &func)
+      const;
+
+private:
+  const byte *m_Bytes = NULL;
+  const DXBCPackHeader *m_Header = NULL;
+  const DXBCPackEntry *m_Entries = NULL;
+  const uint32_t *m_HashOrder = NULL;
+  const char *m_Names = NULL;
+};
+};    // namespace DXBC
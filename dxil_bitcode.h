@@ -0,0 +1,231 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+// the block and record codes in LLVM bitcode, as used by DXIL. The values match the LLVM 3.7
+// bitcode that DXIL is based on, with a few later codes for naming records in dumps.
+
+namespace DXIL
+{
+enum class KnownBlocks : uint32_t
+{
+  BLOCKINFO = 0,
+
+  // 1-7 reserved,
+
+  MODULE_BLOCK = 8,
+  PARAMATTR_BLOCK = 9,
+  PARAMATTR_GROUP_BLOCK = 10,
+  CONSTANTS_BLOCK = 11,
+  FUNCTION_BLOCK = 12,
+  TYPE_SYMTAB_BLOCK = 13,
+  VALUE_SYMTAB_BLOCK = 14,
+  METADATA_BLOCK = 15,
+  METADATA_ATTACHMENT = 16,
+  TYPE_BLOCK = 17,
+};
+
+enum class ModuleRecord : uint32_t
+{
+  VERSION = 1,
+  TRIPLE = 2,
+  DATALAYOUT = 3,
+  SECTIONNAME = 5,
+  GLOBALVAR = 7,
+  FUNCTION = 8,
+  ALIAS_OLD = 9,
+  VSTOFFSET = 13,
+  ALIAS = 14,
+};
+
+enum class ConstantsRecord : uint32_t
+{
+  SETTYPE = 1,
+  CONST_NULL = 2,
+  UNDEF = 3,
+  INTEGER = 4,
+  WIDE_INTEGER = 5,
+  FLOAT = 6,
+  AGGREGATE = 7,
+  STRING = 8,
+  CSTRING = 9,
+  CE_BINOP = 10,
+  CE_CAST = 11,
+  CE_GEP = 12,
+  CE_SELECT = 13,
+  CE_EXTRACTELT = 14,
+  CE_INSERTELT = 15,
+  CE_SHUFFLEVEC = 16,
+  CE_CMP = 17,
+  INLINEASM = 18,
+  CE_SHUFVEC_EX = 19,
+  CE_INBOUNDS_GEP = 20,
+  BLOCKADDRESS = 21,
+  DATA = 22,
+};
+
+enum class FunctionRecord : uint32_t
+{
+  DECLAREBLOCKS = 1,
+  INST_BINOP = 2,
+  INST_CAST = 3,
+  INST_GEP_OLD = 4,
+  INST_SELECT = 5,
+  INST_EXTRACTELT = 6,
+  INST_INSERTELT = 7,
+  INST_SHUFFLEVEC = 8,
+  INST_CMP = 9,
+  INST_RET = 10,
+  INST_BR = 11,
+  INST_SWITCH = 12,
+  INST_INVOKE = 13,
+  INST_UNREACHABLE = 15,
+  INST_PHI = 16,
+  INST_ALLOCA = 19,
+  INST_LOAD = 20,
+  INST_VAARG = 23,
+  INST_STORE_OLD = 24,
+  INST_EXTRACTVAL = 26,
+  INST_INSERTVAL = 27,
+  INST_CMP2 = 28,
+  INST_VSELECT = 29,
+  INST_INBOUNDS_GEP_OLD = 30,
+  INST_INDIRECTBR = 31,
+  DEBUG_LOC_AGAIN = 33,
+  INST_CALL = 34,
+  DEBUG_LOC = 35,
+  INST_FENCE = 36,
+  INST_CMPXCHG_OLD = 37,
+  INST_ATOMICRMW = 38,
+  INST_RESUME = 39,
+  INST_LANDINGPAD_OLD = 40,
+  INST_LOADATOMIC = 41,
+  INST_STOREATOMIC_OLD = 42,
+  INST_GEP = 43,
+  INST_STORE = 44,
+  INST_STOREATOMIC = 45,
+  INST_CMPXCHG = 46,
+  INST_LANDINGPAD = 47,
+  INST_CLEANUPRET = 48,
+  INST_CATCHRET = 49,
+  INST_CATCHPAD = 50,
+  INST_CLEANUPPAD = 51,
+  INST_CATCHSWITCH = 52,
+  OPERAND_BUNDLE = 55,
+  INST_UNOP = 56,
+  INST_CALLBR = 57,
+};
+
+// records in a function block that aren't instructions themselves. Debug locations and operand
+// bundles describe the instruction before them
+inline bool IsInstructionRecord(uint32_t recordID)
+{
+  switch(FunctionRecord(recordID))
+  {
+    case FunctionRecord::DECLAREBLOCKS:
+    case FunctionRecord::DEBUG_LOC:
+    case FunctionRecord::DEBUG_LOC_AGAIN:
+    case FunctionRecord::OPERAND_BUNDLE: return false;
+    default: return true;
+  }
+}
+
+enum class ValueSymtabRecord : uint32_t
+{
+  ENTRY = 1,
+  BBENTRY = 2,
+  FNENTRY = 3,
+  COMBINED_ENTRY = 5,
+};
+
+enum class MetaDataRecord : uint32_t
+{
+  STRING_OLD = 1,
+  VALUE = 2,
+  NODE = 3,
+  NAME = 4,
+  DISTINCT_NODE = 5,
+  KIND = 6,
+  LOCATION = 7,
+  OLD_NODE = 8,
+  OLD_FN_NODE = 9,
+  NAMED_NODE = 10,
+  ATTACHMENT = 11,
+  GENERIC_DEBUG = 12,
+  SUBRANGE = 13,
+  ENUMERATOR = 14,
+  BASIC_TYPE = 15,
+  FILE = 16,
+  DERIVED_TYPE = 17,
+  COMPOSITE_TYPE = 18,
+  SUBROUTINE_TYPE = 19,
+  COMPILE_UNIT = 20,
+  SUBPROGRAM = 21,
+  LEXICAL_BLOCK = 22,
+  LEXICAL_BLOCK_FILE = 23,
+  NAMESPACE = 24,
+  TEMPLATE_TYPE = 25,
+  TEMPLATE_VALUE = 26,
+  GLOBAL_VAR = 27,
+  LOCAL_VAR = 28,
+  EXPRESSION = 29,
+  OBJC_PROPERTY = 30,
+  IMPORTED_ENTITY = 31,
+  MODULE = 32,
+  MACRO = 33,
+  MACRO_FILE = 34,
+  STRINGS = 35,
+  GLOBAL_DECL_ATTACHMENT = 36,
+  GLOBAL_VAR_EXPR = 37,
+  INDEX_OFFSET = 38,
+  INDEX = 39,
+  LABEL = 40,
+  COMMON_BLOCK = 44,
+};
+
+enum class TypeRecord : uint32_t
+{
+  NUMENTRY = 1,
+  VOID = 2,
+  FLOAT = 3,
+  DOUBLE = 4,
+  LABEL = 5,
+  OPAQUE = 6,
+  INTEGER = 7,
+  POINTER = 8,
+  FUNCTION_OLD = 9,
+  HALF = 10,
+  ARRAY = 11,
+  VECTOR = 12,
+  METADATA = 16,
+  STRUCT_ANON = 18,
+  STRUCT_NAME = 19,
+  STRUCT_NAMED = 20,
+  FUNCTION = 21,
+  TOKEN = 22,
+};
+};    // namespace DXIL
@@ -0,0 +1,546 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxil_cfg.h"
+#include <algorithm>
+#include "dxil_module.h"
+#include "dxil_output.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+namespace DXIL
+{
+// walks the graph from root depth-first, giving the nodes reached in reverse postorder and each
+// node's position in that order, or NoID for nodes that weren't reached
+static void reversePostOrder(const std::vector<uint32_t> &offsets,
+                             const std::vector<uint32_t> &edges, uint32_t root,
+                             std::vector<uint32_t> &order, std::vector<uint32_t> &number)
+{
+  const uint32_t numNodes = uint32_t(offsets.size() - 1);
+
+  order.clear();
+  number.assign(numNodes, NoID);
+  if(root >= numNodes)
+    return;
+
+  // nodes on the stack are marked as visited with a number that's replaced at the end
+  struct Visit
+  {
+    uint32_t node;
+    uint32_t nextEdge;
+  };
+  std::vector<Visit> stack;
+
+  number[root] = 0;
+  stack.push_back({root, offsets[root]});
+
+  while(!stack.empty())
+  {
+    Visit &v = stack.back();
+    if(v.nextEdge == offsets[v.node + 1])
+    {
+      order.push_back(v.node);
+      stack.pop_back();
+      continue;
+    }
+
+    const uint32_t next = edges[v.nextEdge++];
+    if(number[next] == NoID)
+    {
+      number[next] = 0;
+      stack.push_back({next, offsets[next]});
+    }
+  }
+
+  // the nodes were added in postorder
+  const uint32_t numReached = uint32_t(order.size());
+  for(uint32_t i = 0; i < numReached / 2; i++)
+    std::swap(order[i], order[numReached - 1 - i]);
+  for(uint32_t i = 0; i < numReached; i++)
+    number[order[i]] = i;
+}
+
+// Cooper, Harvey and Kennedy's "A Simple, Fast Dominance Algorithm". Everything is by position in
+// the reverse postorder, where a node's dominators always come before it, so the two fingers
+// walking up to a common dominator just chase whichever is further along. Gives each node's
+// immediate dominator's position, with the root as its own
+static void immediateDominators(const std::vector<uint32_t> &order,
+                                const std::vector<uint32_t> &number,
+                                const std::vector<uint32_t> &predOffsets,
+                                const std::vector<uint32_t> &preds, std::vector<uint32_t> &idom)
+{
+  idom.assign(order.size(), NoID);
+  if(order.empty())
+    return;
+
+  idom[0] = 0;
+
+  bool changed = true;
+  while(changed)
+  {
+    changed = false;
+
+    for(uint32_t i = 1; i < order.size(); i++)
+    {
+      const uint32_t node = order[i];
+      uint32_t newIdom = NoID;
+
+      for(uint32_t e = predOffsets[node]; e < predOffsets[node + 1]; e++)
+      {
+        uint32_t pred = number[preds[e]];
+        if(pred == NoID || idom[pred] == NoID)
+          continue;
+
+        if(newIdom == NoID)
+        {
+          newIdom = pred;
+          continue;
+        }
+
+        while(pred != newIdom)
+        {
+          while(pred > newIdom)
+            pred = idom[pred];
+          while(newIdom > pred)
+            newIdom = idom[newIdom];
+        }
+      }
+
+      if(newIdom != idom[i])
+      {
+        idom[i] = newIdom;
+        changed = true;
+      }
+    }
+  }
+}
+
+void ControlFlowGraph::NumberTree(const std::vector<uint32_t> &idom, std::vector<TreeRange> &ranges)
+{
+  const uint32_t numNodes = uint32_t(idom.size());
+  ranges.assign(numNodes, TreeRange{NoID, NoID});
+  if(numNodes == 0)
+    return;
+
+  // children of each node, flattened the same way as the edges. Parents always come first
+  std::vector<uint32_t> offsets(numNodes + 1, 0);
+  for(uint32_t i = 1; i < numNodes; i++)
+    offsets[idom[i] + 1]++;
+  for(uint32_t i = 0; i < numNodes; i++)
+    offsets[i + 1] += offsets[i];
+
+  std::vector<uint32_t> children(numNodes - 1);
+  std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+  for(uint32_t i = 1; i < numNodes; i++)
+    children[cursor[idom[i]]++] = i;
+
+  struct Visit
+  {
+    uint32_t node;
+    uint32_t nextChild;
+  };
+  std::vector<Visit> stack;
+
+  uint32_t pre = 0, post = 0;
+  ranges[0].pre = pre++;
+  stack.push_back({0, offsets[0]});
+
+  while(!stack.empty())
+  {
+    Visit &v = stack.back();
+    if(v.nextChild == offsets[v.node + 1])
+    {
+      ranges[v.node].post = post++;
+      stack.pop_back();
+      continue;
+    }
+
+    const uint32_t child = children[v.nextChild++];
+    ranges[child].pre = pre++;
+    stack.push_back({child, offsets[child]});
+  }
+}
+
+ControlFlowGraph::ControlFlowGraph(const Function &func)
+{
+  TRACE_SCOPE_ARG("Build control flow graph", "global", func.global);
+
+  BuildEdges(func);
+  BuildOrder();
+  BuildDominators();
+  BuildPostDominators();
+  BuildLoops();
+}
+
+void ControlFlowGraph::BuildEdges(const Function &func)
+{
+  const uint32_t numBlocks = uint32_t(func.blocks.size());
+  const uint32_t numInstructions = uint32_t(func.instructions.size());
+  const uint32_t numOperands = uint32_t(func.operands.size());
+
+  m_SuccOffsets.reserve(numBlocks + 1);
+  m_SuccOffsets.push_back(0);
+
+  // the last block each block was added as a successor of, so switches with several cases going
+  // to the same block only add it once
+  std::vector<uint32_t> lastPred(numBlocks, NoID);
+
+  for(uint32_t b = 0; b < numBlocks; b++)
+  {
+    const uint32_t end = b + 1 < numBlocks ? func.blocks[b + 1] : numInstructions;
+
+    // a body that failed to decode can end without a terminator, which leaves the block without
+    // successors
+    if(end > func.blocks[b] && end <= numInstructions)
+    {
+      const Instruction &term = func.instructions[end - 1];
+      if((term.op == Opcode::Br || term.op == Opcode::Switch) && term.firstOperand <= numOperands &&
+         term.numOperands <= numOperands - term.firstOperand)
+      {
+        for(uint32_t o = term.firstOperand; o < term.firstOperand + term.numOperands; o++)
+        {
+          const Operand &op = func.operands[o];
+          if(op.kind != Operand::Block || op.id >= numBlocks || lastPred[op.id] == b)
+            continue;
+
+          lastPred[op.id] = b;
+          m_Succs.push_back(op.id);
+        }
+      }
+    }
+
+    m_SuccOffsets.push_back(uint32_t(m_Succs.size()));
+  }
+
+  // predecessors are counted then filled in, as with the def-use graph
+  m_PredOffsets.assign(numBlocks + 1, 0);
+  for(uint32_t succ : m_Succs)
+    m_PredOffsets[succ + 1]++;
+  for(uint32_t b = 0; b < numBlocks; b++)
+    m_PredOffsets[b + 1] += m_PredOffsets[b];
+
+  m_Preds.resize(m_Succs.size());
+  std::vector<uint32_t> &cursor = lastPred;
+  cursor.assign(m_PredOffsets.begin(), m_PredOffsets.end() - 1);
+  for(uint32_t b = 0; b < numBlocks; b++)
+    for(uint32_t e = m_SuccOffsets[b]; e < m_SuccOffsets[b + 1]; e++)
+      m_Preds[cursor[m_Succs[e]]++] = b;
+}
+
+void ControlFlowGraph::BuildOrder()
+{
+  reversePostOrder(m_SuccOffsets, m_Succs, 0, m_RPO, m_RPONumber);
+}
+
+void ControlFlowGraph::BuildDominators()
+{
+  const uint32_t numBlocks = NumBlocks();
+
+  std::vector<uint32_t> idom;
+  immediateDominators(m_RPO, m_RPONumber, m_PredOffsets, m_Preds, idom);
+
+  std::vector<TreeRange> ranges;
+  NumberTree(idom, ranges);
+
+  m_IDom.assign(numBlocks, NoID);
+  m_DomRange.assign(numBlocks, TreeRange{NoID, NoID});
+  for(uint32_t i = 0; i < m_RPO.size(); i++)
+  {
+    if(i > 0)
+      m_IDom[m_RPO[i]] = m_RPO[idom[i]];
+    m_DomRange[m_RPO[i]] = ranges[i];
+  }
+}
+
+void ControlFlowGraph::BuildPostDominators()
+{
+  const uint32_t numBlocks = NumBlocks();
+  const uint32_t exit = numBlocks;
+
+  // the reverse graph of the reachable blocks, with an extra node for the exit that leads to
+  // every block without successors
+  std::vector<uint32_t> succOffsets, succs, predOffsets, preds;
+  succOffsets.reserve(numBlocks + 2);
+  predOffsets.reserve(numBlocks + 2);
+  succOffsets.push_back(0);
+  predOffsets.push_back(0);
+
+  for(uint32_t b = 0; b < numBlocks; b++)
+  {
+    if(IsReachable(b))
+    {
+      for(uint32_t e = m_PredOffsets[b]; e < m_PredOffsets[b + 1]; e++)
+        if(IsReachable(m_Preds[e]))
+          succs.push_back(m_Preds[e]);
+
+      for(uint32_t e = m_SuccOffsets[b]; e < m_SuccOffsets[b + 1]; e++)
+        preds.push_back(m_Succs[e]);
+      if(m_SuccOffsets[b] == m_SuccOffsets[b + 1])
+        preds.push_back(exit);
+    }
+
+    succOffsets.push_back(uint32_t(succs.size()));
+    predOffsets.push_back(uint32_t(preds.size()));
+  }
+
+  for(uint32_t b = 0; b < numBlocks; b++)
+    if(IsReachable(b) && m_SuccOffsets[b] == m_SuccOffsets[b + 1])
+      succs.push_back(b);
+  succOffsets.push_back(uint32_t(succs.size()));
+  predOffsets.push_back(uint32_t(preds.size()));
+
+  std::vector<uint32_t> order, number;
+  reversePostOrder(succOffsets, succs, exit, order, number);
+
+  std::vector<uint32_t> idom;
+  immediateDominators(order, number, predOffsets, preds, idom);
+
+  std::vector<TreeRange> ranges;
+  NumberTree(idom, ranges);
+
+  m_IPostDom.assign(numBlocks, NoID);
+  m_PostDomRange.assign(numBlocks, TreeRange{NoID, NoID});
+  for(uint32_t i = 1; i < order.size(); i++)
+  {
+    const uint32_t ipdom = order[idom[i]];
+    m_IPostDom[order[i]] = ipdom == exit ? NoID : ipdom;
+    m_PostDomRange[order[i]] = ranges[i];
+  }
+}
+
+void ControlFlowGraph::BuildLoops()
+{
+  const uint32_t numBlocks = NumBlocks();
+
+  m_LoopOf.assign(numBlocks, NoID);
+
+  // loops are found innermost first by visiting headers in postorder, as in LLVM's LoopInfo.
+  // Walking back from the back edges claims every block not already in a loop, and jumps over
+  // loops that were already found, making them nested loops of this one
+  std::vector<Loop> found;
+  std::vector<uint32_t> work;
+
+  for(uint32_t i = uint32_t(m_RPO.size()); i-- > 0;)
+  {
+    const uint32_t header = m_RPO[i];
+
+    work.clear();
+    for(uint32_t pred : GetPredecessors(header))
+      if(Dominates(header, pred))
+        work.push_back(pred);
+
+    if(work.empty())
+      continue;
+
+    const uint32_t loop = uint32_t(found.size());
+    found.push_back(Loop{header, NoID, 0, 0, 0, 0});
+    m_LoopOf[header] = loop;
+
+    while(!work.empty())
+    {
+      const uint32_t block = work.back();
+      work.pop_back();
+
+      uint32_t inner = m_LoopOf[block];
+      if(inner == NoID)
+      {
+        m_LoopOf[block] = loop;
+        for(uint32_t pred : GetPredecessors(block))
+          if(IsReachable(pred))
+            work.push_back(pred);
+        continue;
+      }
+
+      while(found[inner].parent != NoID)
+        inner = found[inner].parent;
+      if(inner == loop)
+        continue;
+
+      found[inner].parent = loop;
+      for(uint32_t pred : GetPredecessors(found[inner].header))
+        if(IsReachable(pred))
+          work.push_back(pred);
+    }
+  }
+
+  const uint32_t numLoops = uint32_t(found.size());
+  if(numLoops == 0)
+    return;
+
+  // renumber the loops in preorder, with siblings in the order their headers come in the reverse
+  // postorder. Loops were found in the opposite order so their children are added backwards
+  std::vector<uint32_t> childOffsets(numLoops + 2, 0);
+  for(const Loop &l : found)
+    childOffsets[(l.parent == NoID ? numLoops : l.parent) + 1]++;
+  for(uint32_t l = 0; l <= numLoops; l++)
+    childOffsets[l + 1] += childOffsets[l];
+
+  std::vector<uint32_t> children(numLoops);
+  std::vector<uint32_t> cursor(childOffsets.begin(), childOffsets.end() - 1);
+  for(uint32_t l = numLoops; l-- > 0;)
+    children[cursor[found[l].parent == NoID ? numLoops : found[l].parent]++] = l;
+
+  std::vector<uint32_t> renumber(numLoops, NoID);
+  m_Loops.reserve(numLoops);
+
+  struct Visit
+  {
+    uint32_t loop;
+    uint32_t nextChild;
+  };
+  std::vector<Visit> stack;
+  stack.push_back({numLoops, childOffsets[numLoops]});
+
+  while(!stack.empty())
+  {
+    Visit &v = stack.back();
+    if(v.nextChild == childOffsets[v.loop + 1])
+    {
+      stack.pop_back();
+      continue;
+    }
+
+    const uint32_t child = children[v.nextChild++];
+    Loop l = found[child];
+    l.parent = v.loop == numLoops ? NoID : renumber[v.loop];
+    l.depth = l.parent == NoID ? 1 : m_Loops[l.parent].depth + 1;
+    renumber[child] = uint32_t(m_Loops.size());
+    m_Loops.push_back(l);
+
+    stack.push_back({child, childOffsets[child]});
+  }
+
+  for(uint32_t l = 0; l < numLoops; l++)
+    m_Loops[l].endLoop = l + 1;
+  for(uint32_t l = numLoops; l-- > 0;)
+    if(m_Loops[l].parent != NoID && m_Loops[l].endLoop > m_Loops[m_Loops[l].parent].endLoop)
+      m_Loops[m_Loops[l].parent].endLoop = m_Loops[l].endLoop;
+
+  // blocks grouped by their innermost loop, in reverse postorder within each. With the loops in
+  // preorder that puts every block of a loop and its nested loops together, header first
+  std::vector<uint32_t> blockOffsets(numLoops + 1, 0);
+  for(uint32_t b = 0; b < numBlocks; b++)
+  {
+    if(m_LoopOf[b] != NoID)
+    {
+      m_LoopOf[b] = renumber[m_LoopOf[b]];
+      blockOffsets[m_LoopOf[b] + 1]++;
+    }
+  }
+  for(uint32_t l = 0; l < numLoops; l++)
+    blockOffsets[l + 1] += blockOffsets[l];
+
+  m_LoopBlocks.resize(blockOffsets[numLoops]);
+  cursor.assign(blockOffsets.begin(), blockOffsets.end() - 1);
+  for(uint32_t block : m_RPO)
+    if(m_LoopOf[block] != NoID)
+      m_LoopBlocks[cursor[m_LoopOf[block]]++] = block;
+
+  for(uint32_t l = 0; l < numLoops; l++)
+  {
+    m_Loops[l].firstBlock = blockOffsets[l];
+    m_Loops[l].numBlocks = blockOffsets[m_Loops[l].endLoop] - blockOffsets[l];
+  }
+}
+
+static void printBlocks(Output &out, const char *prefix, BlockList blocks)
+{
+  if(blocks.empty())
+    return;
+
+  out.Write(prefix);
+  for(uint32_t b : blocks)
+    out.Printf(" bb%u", b);
+}
+
+static void printFunction(const Module &module, uint32_t index, StringOutput &out)
+{
+  const Function &func = module.GetFunctions()[index];
+  const ControlFlowGraph cfg(func);
+
+  const std::vector<Loop> &loops = cfg.GetLoops();
+  const uint32_t numBlocks = cfg.NumBlocks();
+
+  const std::vector<GlobalValue> &globals = module.GetGlobals();
+  out.Printf("function %u", index);
+  if(func.global < globals.size() && !globals[func.global].name.empty())
+    out.Printf(" (@%s)", globals[func.global].name.c_str());
+  out.Printf(": %u blocks, %u edges, %u loops\n", numBlocks, cfg.NumEdges(),
+             (uint32_t)loops.size());
+
+  for(uint32_t b = 0; b < numBlocks; b++)
+  {
+    out.Printf("  bb%u:", b);
+    if(!cfg.IsReachable(b))
+      out.Write(" unreachable");
+
+    printBlocks(out, " preds", cfg.GetPredecessors(b));
+    printBlocks(out, " succs", cfg.GetSuccessors(b));
+    if(cfg.GetImmediateDominator(b) != NoID)
+      out.Printf(" idom bb%u", cfg.GetImmediateDominator(b));
+    if(cfg.GetImmediatePostDominator(b) != NoID)
+      out.Printf(" ipdom bb%u", cfg.GetImmediatePostDominator(b));
+    if(cfg.GetLoop(b) != NoID)
+      out.Printf(" loop %u", cfg.GetLoop(b));
+    out.Write("\n");
+  }
+
+  const uint32_t *loopBlocks = cfg.GetLoopBlocks().data();
+  for(uint32_t l = 0; l < loops.size(); l++)
+  {
+    const Loop &loop = loops[l];
+    out.Printf("  loop %u: depth %u", l, loop.depth);
+    if(loop.parent != NoID)
+      out.Printf(" in loop %u", loop.parent);
+    out.Printf(", header bb%u", loop.header);
+    printBlocks(out, ", blocks", BlockList{loopBlocks + loop.firstBlock,
+                                           loopBlocks + loop.firstBlock + loop.numBlocks});
+    out.Write("\n");
+  }
+}
+
+void PrintControlFlow(const Module &module, Output &out, ThreadPool *pool)
+{
+  TRACE_SCOPE("Print control flow");
+
+  // as with disassembly, every function goes into its own buffer so they can be analysed in any
+  // order and printed in module order
+  std::vector<StringOutput> texts(module.GetFunctions().size());
+
+  auto print = [&](size_t i) { printFunction(module, uint32_t(i), texts[i]); };
+
+  if(pool)
+  {
+    pool->ParallelFor(texts.size(), print);
+  }
+  else
+  {
+    for(size_t i = 0; i < texts.size(); i++)
+      print(i);
+  }
+
+  for(const StringOutput &text : texts)
+    out.Write(text.GetString().c_str(), text.GetString().size());
+}
+};    // namespace DXIL
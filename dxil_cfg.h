@@ -0,0 +1,181 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DXIL
+{
+class Module;
+class Output;
+class ThreadPool;
+struct Function;
+
+// basic blocks by index in the function
+struct BlockList
+{
+  const uint32_t *first;
+  const uint32_t *last;
+
+  const uint32_t *begin() const { return first; }
+  const uint32_t *end() const { return last; }
+  size_t size() const { return size_t(last - first); }
+  bool empty() const { return first == last; }
+};
+
+// a natural loop, found from the back edges to its header
+struct Loop
+{
+  uint32_t header;
+  // the innermost loop containing this one, or ~0U
+  uint32_t parent;
+  // 1 for outermost loops
+  uint32_t depth;
+  // loops are numbered so that a loop's nested loops come straight after it, up to here
+  uint32_t endLoop;
+  // this loop's blocks including those of nested loops, at [firstBlock, firstBlock + numBlocks)
+  // in GetLoopBlocks(). The header is first, then the blocks only in this loop
+  uint32_t firstBlock;
+  uint32_t numBlocks;
+};
+
+// the control flow of one function, from the terminator that ends each block. Edges are stored as
+// flat arrays of successors and predecessors with an offset per block. Block 0 is the entry.
+//
+// blocks that can't be reached from the entry have edges but are left out of everything else:
+// they have no reverse postorder number, dominators or loops.
+//
+// nothing is shared between graphs, so functions can be analysed on as many threads as there are.
+class ControlFlowGraph
+{
+public:
+  // the function isn't referenced once this returns
+  explicit ControlFlowGraph(const Function &func);
+
+  uint32_t NumBlocks() const { return uint32_t(m_SuccOffsets.size() - 1); }
+  uint32_t NumEdges() const { return uint32_t(m_Succs.size()); }
+
+  // each block listed once, even if the terminator names it more than once. Empty for blocks out
+  // of range
+  BlockList GetSuccessors(uint32_t block) const { return list(m_SuccOffsets, m_Succs, block); }
+  BlockList GetPredecessors(uint32_t block) const { return list(m_PredOffsets, m_Preds, block); }
+
+  // the blocks reachable from the entry, in reverse postorder
+  const std::vector<uint32_t> &GetReversePostOrder() const { return m_RPO; }
+  // a block's position in that order, or ~0U if it's unreachable
+  uint32_t GetRPONumber(uint32_t block) const { return lookup(m_RPONumber, block); }
+  bool IsReachable(uint32_t block) const { return GetRPONumber(block) != ~0U; }
+
+  // ~0U for the entry, and blocks that are unreachable
+  uint32_t GetImmediateDominator(uint32_t block) const { return lookup(m_IDom, block); }
+  // every block dominates itself
+  bool Dominates(uint32_t a, uint32_t b) const { return encloses(m_DomRange, a, b); }
+
+  // post-dominators are found as if every block ending the function led to one exit. ~0U for
+  // blocks only post-dominated by that exit, and for blocks that never reach it
+  uint32_t GetImmediatePostDominator(uint32_t block) const { return lookup(m_IPostDom, block); }
+  bool PostDominates(uint32_t a, uint32_t b) const { return encloses(m_PostDomRange, a, b); }
+
+  // loops are only found from back edges, to a header that dominates where they come from, so
+  // irreducible cycles entered at more than one block aren't loops here
+  const std::vector<Loop> &GetLoops() const { return m_Loops; }
+  const std::vector<uint32_t> &GetLoopBlocks() const { return m_LoopBlocks; }
+  // the innermost loop containing a block, or ~0U
+  uint32_t GetLoop(uint32_t block) const { return lookup(m_LoopOf, block); }
+  // 0 for blocks outside of any loop
+  uint32_t GetLoopDepth(uint32_t block) const
+  {
+    const uint32_t loop = GetLoop(block);
+    return loop == ~0U ? 0 : m_Loops[loop].depth;
+  }
+  bool LoopContains(uint32_t loop, uint32_t block) const
+  {
+    const uint32_t inner = GetLoop(block);
+    return loop < m_Loops.size() && inner >= loop && inner < m_Loops[loop].endLoop;
+  }
+
+private:
+  // a node's preorder and postorder number in a dominator tree, so that ancestors can be found by
+  // comparing intervals
+  struct TreeRange
+  {
+    uint32_t pre;
+    uint32_t post;
+  };
+
+  void BuildEdges(const Function &func);
+  void BuildOrder();
+  void BuildDominators();
+  void BuildPostDominators();
+  void BuildLoops();
+
+  static void NumberTree(const std::vector<uint32_t> &idom, std::vector<TreeRange> &ranges);
+
+  static BlockList list(const std::vector<uint32_t> &offsets, const std::vector<uint32_t> &edges,
+                        uint32_t block)
+  {
+    if(block + 1 >= offsets.size())
+      return BlockList{NULL, NULL};
+    const uint32_t *e = edges.data();
+    return BlockList{e + offsets[block], e + offsets[block + 1]};
+  }
+
+  static uint32_t lookup(const std::vector<uint32_t> &values, uint32_t block)
+  {
+    return block < values.size() ? values[block] : ~0U;
+  }
+
+  static bool encloses(const std::vector<TreeRange> &ranges, uint32_t a, uint32_t b)
+  {
+    if(a >= ranges.size() || b >= ranges.size() || ranges[a].pre == ~0U || ranges[b].pre == ~0U)
+      return false;
+    return ranges[a].pre <= ranges[b].pre && ranges[b].post <= ranges[a].post;
+  }
+
+  // NumBlocks() + 1 offsets, block b's edges are [offsets[b], offsets[b + 1])
+  std::vector<uint32_t> m_SuccOffsets;
+  std::vector<uint32_t> m_Succs;
+  std::vector<uint32_t> m_PredOffsets;
+  std::vector<uint32_t> m_Preds;
+
+  std::vector<uint32_t> m_RPO;
+  std::vector<uint32_t> m_RPONumber;
+
+  std::vector<uint32_t> m_IDom;
+  std::vector<TreeRange> m_DomRange;
+  std::vector<uint32_t> m_IPostDom;
+  std::vector<TreeRange> m_PostDomRange;
+
+  std::vector<Loop> m_Loops;
+  std::vector<uint32_t> m_LoopBlocks;
+  std::vector<uint32_t> m_LoopOf;
+};
+
+// prints each function's blocks with their edges, dominators and loops. If pool is set the
+// functions are analysed on it concurrently, and printed in module order either way
+void PrintControlFlow(const Module &module, Output &out, ThreadPool *pool = NULL);
+};    // namespace DXIL
@@ -0,0 +1,97 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxil_defuse.h"
+#include "dxil_module.h"
+#include "trace.h"
+
+namespace DXIL
+{
+DefUseGraph::DefUseGraph(const Function &func)
+{
+  TRACE_SCOPE_ARG("Build def-use graph", "global", func.global);
+
+  const uint32_t numValues = func.firstValue + uint32_t(func.values.size());
+
+  // the first pass counts each value's users into the slot after its own, so that summing the
+  // counts leaves every value's first offset in its own slot
+  m_Offsets.assign(size_t(numValues) + 1, 0);
+
+  // the last instruction counted as using each value, so that an instruction using the same value
+  // in several operands is only counted once
+  std::vector<uint32_t> lastUser(numValues, NoID);
+
+  const Operand *operands = func.operands.data();
+  const uint32_t numOperands = uint32_t(func.operands.size());
+  const uint32_t numInstructions = uint32_t(func.instructions.size());
+
+  for(uint32_t i = 0; i < numInstructions; i++)
+  {
+    const Instruction &inst = func.instructions[i];
+    if(inst.firstOperand > numOperands || inst.numOperands > numOperands - inst.firstOperand)
+      continue;
+
+    for(uint32_t o = inst.firstOperand; o < inst.firstOperand + inst.numOperands; o++)
+    {
+      const Operand &op = operands[o];
+      if(op.kind != Operand::Value || op.id >= numValues || lastUser[op.id] == i)
+        continue;
+
+      lastUser[op.id] = i;
+      m_Offsets[op.id + 1]++;
+    }
+  }
+
+  for(uint32_t v = 0; v < numValues; v++)
+    m_Offsets[v + 1] += m_Offsets[v];
+
+  // the second pass fills users in instruction order, advancing each value's cursor. Every cursor
+  // starts at the value's offset and finishes at the next value's
+  m_Users.resize(m_Offsets[numValues]);
+  std::vector<uint32_t> &cursor = lastUser;
+  cursor.assign(m_Offsets.begin(), m_Offsets.end() - 1);
+
+  uint32_t *users = m_Users.data();
+
+  for(uint32_t i = 0; i < numInstructions; i++)
+  {
+    const Instruction &inst = func.instructions[i];
+    if(inst.firstOperand > numOperands || inst.numOperands > numOperands - inst.firstOperand)
+      continue;
+
+    for(uint32_t o = inst.firstOperand; o < inst.firstOperand + inst.numOperands; o++)
+    {
+      const Operand &op = operands[o];
+      if(op.kind != Operand::Value || op.id >= numValues)
+        continue;
+
+      uint32_t &pos = cursor[op.id];
+      if(pos != m_Offsets[op.id] && users[pos - 1] == i)
+        continue;
+
+      users[pos++] = i;
+    }
+  }
+}
+};    // namespace DXIL
@@ -0,0 +1,83 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DXIL
+{
+struct Function;
+
+// the instructions using one value, as indices into the function's instructions
+struct UserList
+{
+  const uint32_t *first;
+  const uint32_t *last;
+
+  const uint32_t *begin() const { return first; }
+  const uint32_t *end() const { return last; }
+  size_t size() const { return size_t(last - first); }
+  bool empty() const { return first == last; }
+};
+
+// which instructions in a function use each value. Values are numbered as in the bitcode, so
+// globals and module constants come first, then the function's arguments, constants and
+// instructions. Only uses by the function's own instructions are recorded.
+//
+// the users of every value are stored back to back in one array, with the offset each value's
+// users start at in another, so finding a value's users is a lookup and walking them is linear.
+class DefUseGraph
+{
+public:
+  // the function isn't referenced once this returns
+  explicit DefUseGraph(const Function &func);
+
+  // one past the highest value ID in the function
+  uint32_t NumValues() const { return uint32_t(m_Offsets.size() - 1); }
+  uint32_t NumUses() const { return uint32_t(m_Users.size()); }
+
+  // in instruction order, each instruction listed once however many of its operands use the
+  // value. Empty for IDs out of range
+  UserList GetUsers(uint32_t valueID) const
+  {
+    if(valueID >= NumValues())
+      return UserList{NULL, NULL};
+    const uint32_t *users = m_Users.data();
+    return UserList{users + m_Offsets[valueID], users + m_Offsets[valueID + 1]};
+  }
+
+  bool HasUsers(uint32_t valueID) const
+  {
+    return valueID < NumValues() && m_Offsets[valueID] != m_Offsets[valueID + 1];
+  }
+
+private:
+  // NumValues() + 1 entries, value v's users are [m_Offsets[v], m_Offsets[v + 1]) in m_Users
+  std::vector<uint32_t> m_Offsets;
+  std::vector<uint32_t> m_Users;
+};
+};    // namespace DXIL
@@ -0,0 +1,1296 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxil_disasm.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "dxil_bitcode.h"
+#include "dxil_inspect.h"
+#include "dxil_module.h"
+#include "dxil_output.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+namespace DXIL
+{
+#define IS_KNOWN(val, KnownID) (decltype(KnownID)(val) == KnownID)
+
+// constant expressions can nest, but only so far in anything well-formed
+static const int MaxConstantDepth = 32;
+
+static void appendUInt(std::string &s, uint64_t v)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%" PRIu64, v);
+  s += buf;
+}
+
+static void appendInt(std::string &s, int64_t v)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%" PRId64, v);
+  s += buf;
+}
+
+static void appendDouble(std::string &s, double d)
+{
+  char buf[64];
+
+  // like LLVM, use the exponent form only when it reads back as exactly the same value
+  if(isfinite(d))
+  {
+    snprintf(buf, sizeof(buf), "%e", d);
+    if(strtod(buf, NULL) == d)
+    {
+      s += buf;
+      return;
+    }
+  }
+
+  uint64_t bits = 0;
+  memcpy(&bits, &d, sizeof(bits));
+  snprintf(buf, sizeof(buf), "0x%016" PRIX64, bits);
+  s += buf;
+}
+
+// names are printed bare if they only use the characters LLVM allows, otherwise they're quoted
+static void appendName(std::string &s, char prefix, const std::string &name)
+{
+  s += prefix;
+
+  bool bare = !name.empty() && !(name[0] >= '0' && name[0] <= '9');
+  for(char c : name)
+  {
+    if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' ||
+         c == '$' || c == '.' || c == '_'))
+      bare = false;
+  }
+
+  if(bare)
+  {
+    s += name;
+    return;
+  }
+
+  s += '"';
+  for(char c : name)
+  {
+    if(c == '"' || c == '\\' || c < 0x20 || c > 0x7e)
+    {
+      char buf[4];
+      snprintf(buf, sizeof(buf), "\\%02X", (unsigned char)c);
+      s += buf;
+    }
+    else
+    {
+      s += c;
+    }
+  }
+  s += '"';
+}
+
+static void appendSlot(std::string &s, char prefix, uint32_t slot)
+{
+  s += prefix;
+  appendUInt(s, slot);
+}
+
+static const char *linkageName(uint32_t linkage)
+{
+  switch(linkage)
+  {
+    case 1:
+    case 16: return "weak ";
+    case 2: return "appending ";
+    case 3: return "internal ";
+    case 4:
+    case 18: return "linkonce ";
+    case 7: return "extern_weak ";
+    case 8: return "common ";
+    case 9:
+    case 13:
+    case 14: return "private ";
+    case 10:
+    case 17: return "weak_odr ";
+    case 11:
+    case 19: return "linkonce_odr ";
+    case 12: return "available_externally ";
+    default: break;
+  }
+
+  // external, including the old dllimport/dllexport forms
+  return "";
+}
+
+static const char *orderingName(uint32_t ordering)
+{
+  static const char *names[] = {
+      "", "unordered", "monotonic", "acquire", "release", "acq_rel", "seq_cst",
+  };
+
+  return ordering < sizeof(names) / sizeof(names[0]) ? names[ordering] : "<invalid ordering>";
+}
+
+static const char *predicateName(uint32_t predicate)
+{
+  static const char *fcmp[] = {
+      "false", "oeq", "ogt", "oge", "olt", "ole", "one", "ord",
+      "uno",   "ueq", "ugt", "uge", "ult", "ule", "une", "true",
+  };
+  static const char *icmp[] = {
+      "eq", "ne", "ugt", "uge", "ult", "ule", "sgt", "sge", "slt", "sle",
+  };
+
+  if(predicate < 16)
+    return fcmp[predicate];
+  if(predicate >= 32 && predicate < 42)
+    return icmp[predicate - 32];
+
+  return "<invalid predicate>";
+}
+
+static const char *atomicOpName(uint32_t op)
+{
+  static const char *names[] = {
+      "xchg", "add", "sub", "and", "nand", "or", "xor", "max", "min", "umax", "umin",
+  };
+
+  return op < sizeof(names) / sizeof(names[0]) ? names[op] : "<invalid operation>";
+}
+
+class Disassembler
+{
+public:
+  Disassembler(const Module &m) : m(m), types(m.GetTypes()) { NameGlobals(); }
+
+  void Header(std::string &s) const;
+  void Globals(std::string &s) const;
+  void Declaration(std::string &s, const GlobalValue &g) const;
+  void Definition(std::string &s, const Function &f) const;
+
+private:
+  const Module &m;
+  const std::vector<Type> &types;
+
+  // "@name" or "@N" for each global, numbered like LLVM does for unnamed ones
+  std::vector<std::string> globalRefs;
+
+  // the names of one function's values and blocks while it's being printed
+  struct Locals
+  {
+    std::vector<std::string> values;
+    std::vector<std::string> blocks;
+  };
+
+  void NameGlobals();
+  void NameLocals(const Function &f, Locals &locals) const;
+
+  void AppendType(std::string &s, uint32_t type) const;
+  void AppendValue(std::string &s, const Function *f, const Locals *locals, uint32_t id,
+                   int depth = 0) const;
+  void AppendTypedValue(std::string &s, const Function *f, const Locals *locals,
+                        uint32_t id) const;
+  void AppendConstant(std::string &s, const Function *f, const Constant &c, int depth) const;
+  void AppendElement(std::string &s, uint32_t type, uint64_t raw) const;
+  void AppendInstruction(std::string &s, const Function &f, const Locals &locals,
+                         const Instruction &inst) const;
+  void AppendPrototype(std::string &s, const GlobalValue &g, const Locals *locals) const;
+
+  uint32_t ValueType(const Function *f, uint32_t id) const
+  {
+    if(f)
+    {
+      const Value *v = m.GetValue(*f, id);
+      return v ? v->type : NoID;
+    }
+    return id < m.GetValues().size() ? m.GetValues()[id].type : NoID;
+  }
+};
+
+void Disassembler::NameGlobals()
+{
+  const std::vector<GlobalValue> &globals = m.GetGlobals();
+  globalRefs.resize(globals.size());
+
+  // unnamed variables are numbered first, then aliases and then functions
+  uint32_t slot = 0;
+  const ValueKind order[] = {ValueKind::GlobalVariable, ValueKind::Alias, ValueKind::Function};
+  for(ValueKind kind : order)
+  {
+    for(size_t i = 0; i < globals.size(); i++)
+    {
+      if(globals[i].kind != kind)
+        continue;
+
+      if(globals[i].name.empty())
+        appendSlot(globalRefs[i], '@', slot++);
+      else
+        appendName(globalRefs[i], '@', globals[i].name);
+    }
+  }
+}
+
+void Disassembler::NameLocals(const Function &f, Locals &locals) const
+{
+  // unnamed arguments are numbered first, then each block and the values within it in order
+  locals.values.resize(f.values.size());
+  locals.blocks.resize(f.blocks.size());
+
+  uint32_t slot = 0;
+
+  auto name = [&](std::string &ref, const std::vector<std::string> &names, size_t i) {
+    if(i < names.size() && !names[i].empty())
+      appendName(ref, '%', names[i]);
+    else
+      appendSlot(ref, '%', slot++);
+  };
+
+  for(uint32_t i = 0; i < f.numArgs && i < f.values.size(); i++)
+    name(locals.values[i], f.valueNames, i);
+
+  for(size_t b = 0; b < f.blocks.size(); b++)
+  {
+    name(locals.blocks[b], f.blockNames, b);
+
+    const size_t end = b + 1 < f.blocks.size() ? f.blocks[b + 1] : f.instructions.size();
+    for(size_t i = f.blocks[b]; i < end; i++)
+    {
+      const uint32_t id = f.instructions[i].value;
+      if(id != NoID)
+        name(locals.values[id - f.firstValue], f.valueNames, id - f.firstValue);
+    }
+  }
+}
+
+void Disassembler::AppendType(std::string &s, uint32_t type) const
+{
+  if(type >= types.size())
+  {
+    s += "<invalid type>";
+    return;
+  }
+
+  const Type &t = types[type];
+
+  switch(t.kind)
+  {
+    case Type::Unknown: s += "<unknown type>"; break;
+    case Type::Void: s += "void"; break;
+    case Type::Label: s += "label"; break;
+    case Type::Metadata: s += "metadata"; break;
+    case Type::Float:
+      if(t.bitWidth == 16)
+        s += "half";
+      else if(t.bitWidth == 32)
+        s += "float";
+      else
+        s += "double";
+      break;
+    case Type::Integer:
+      s += 'i';
+      appendUInt(s, t.bitWidth);
+      break;
+    case Type::Pointer:
+      // pointers to pointers only go as deep as the type table, which has no cycles without a
+      // named struct in the way
+      if(t.inner == type)
+      {
+        s += "<invalid type>";
+        break;
+      }
+      AppendType(s, t.inner);
+      if(t.addrSpace)
+      {
+        s += " addrspace(";
+        appendUInt(s, t.addrSpace);
+        s += ')';
+      }
+      s += '*';
+      break;
+    case Type::Array:
+    case Type::Vector:
+      s += t.kind == Type::Array ? '[' : '<';
+      appendUInt(s, t.count);
+      s += " x ";
+      if(t.inner == type)
+        s += "<invalid type>";
+      else
+        AppendType(s, t.inner);
+      s += t.kind == Type::Array ? ']' : '>';
+      break;
+    case Type::Struct:
+      if(!t.name.empty())
+      {
+        appendName(s, '%', t.name);
+        break;
+      }
+      s += t.packed ? "<{" : "{";
+      for(size_t i = 0; i < t.members.size(); i++)
+      {
+        s += i == 0 ? " " : ", ";
+        if(t.members[i] == type)
+          s += "<invalid type>";
+        else
+          AppendType(s, t.members[i]);
+      }
+      s += t.members.empty() ? "}" : " }";
+      if(t.packed)
+        s += '>';
+      break;
+    case Type::Function:
+      if(t.inner == type)
+        s += "<invalid type>";
+      else
+        AppendType(s, t.inner);
+      s += " (";
+      for(size_t i = 0; i < t.members.size(); i++)
+      {
+        if(i > 0)
+          s += ", ";
+        if(t.members[i] == type)
+          s += "<invalid type>";
+        else
+          AppendType(s, t.members[i]);
+      }
+      if(t.vararg)
+        s += t.members.empty() ? "..." : ", ...";
+      s += ')';
+      break;
+  }
+}
+
+void Disassembler::AppendElement(std::string &s, uint32_t type, uint64_t raw) const
+{
+  const Type *t = type < types.size() ? &types[type] : NULL;
+
+  if(t && t->kind == Type::Float)
+  {
+    if(t->bitWidth == 16)
+    {
+      char buf[16];
+      snprintf(buf, sizeof(buf), "0xH%04X", uint32_t(raw & 0xffff));
+      s += buf;
+    }
+    else if(t->bitWidth == 32)
+    {
+      float f;
+      uint32_t bits = uint32_t(raw);
+      memcpy(&f, &bits, sizeof(f));
+      appendDouble(s, f);
+    }
+    else
+    {
+      double d;
+      memcpy(&d, &raw, sizeof(d));
+      appendDouble(s, d);
+    }
+  }
+  else if(t && t->kind == Type::Integer && t->bitWidth == 1)
+  {
+    s += raw & 1 ? "true" : "false";
+  }
+  else if(t && t->kind == Type::Integer && t->bitWidth > 1 && t->bitWidth < 64)
+  {
+    // sign-extend from the integer's width
+    const uint32_t shift = 64 - t->bitWidth;
+    appendInt(s, int64_t(raw << shift) >> shift);
+  }
+  else
+  {
+    appendInt(s, int64_t(raw));
+  }
+}
+
+void Disassembler::AppendConstant(std::string &s, const Function *f, const Constant &c,
+                                  int depth) const
+{
+  const LLVMBC::OpList &ops = c.record->ops;
+  const Type *t = c.type < types.size() ? &types[c.type] : NULL;
+
+  switch(ConstantsRecord(c.record->id))
+  {
+    case ConstantsRecord::CONST_NULL:
+      if(!t)
+        s += "<invalid constant>";
+      else if(t->kind == Type::Pointer)
+        s += "null";
+      else if(t->kind == Type::Integer || t->kind == Type::Float)
+        AppendElement(s, c.type, 0);
+      else
+        s += "zeroinitializer";
+      return;
+    case ConstantsRecord::UNDEF: s += "undef"; return;
+    case ConstantsRecord::INTEGER:
+    case ConstantsRecord::WIDE_INTEGER:
+      if(ops.empty())
+        break;
+      // wide integers only print their low word
+      if(t && t->kind == Type::Integer && t->bitWidth == 1)
+        s += DecodeSigned(ops[0]) ? "true" : "false";
+      else
+        appendInt(s, DecodeSigned(ops[0]));
+      return;
+    case ConstantsRecord::FLOAT:
+      if(ops.empty())
+        break;
+      AppendElement(s, c.type, ops[0]);
+      return;
+    case ConstantsRecord::STRING:
+    case ConstantsRecord::CSTRING:
+    {
+      s += "c\"";
+      for(uint64_t ch : ops)
+      {
+        if(ch < 0x20 || ch > 0x7e || ch == '"' || ch == '\\')
+        {
+          char buf[4];
+          snprintf(buf, sizeof(buf), "\\%02X", uint32_t(ch & 0xff));
+          s += buf;
+        }
+        else
+        {
+          s += char(ch);
+        }
+      }
+      if(IS_KNOWN(c.record->id, ConstantsRecord::CSTRING))
+        s += "\\00";
+      s += '"';
+      return;
+    }
+    case ConstantsRecord::AGGREGATE:
+    case ConstantsRecord::DATA:
+    {
+      if(!t)
+        break;
+
+      const char *open = "[", *close = "]";
+      if(t->kind == Type::Struct)
+      {
+        open = t->packed ? "<{ " : "{ ";
+        close = t->packed ? " }>" : " }";
+      }
+      else if(t->kind == Type::Vector)
+      {
+        open = "<";
+        close = ">";
+      }
+
+      s += open;
+      for(size_t i = 0; i < ops.size(); i++)
+      {
+        if(i > 0)
+          s += ", ";
+
+        if(IS_KNOWN(c.record->id, ConstantsRecord::DATA))
+        {
+          // the elements are stored directly
+          AppendType(s, t->inner);
+          s += ' ';
+          AppendElement(s, t->inner, ops[i]);
+        }
+        else
+        {
+          const uint32_t id = uint32_t(ops[i]);
+          AppendType(s, ValueType(f, id));
+          s += ' ';
+          AppendValue(s, f, NULL, id, depth + 1);
+        }
+      }
+      s += close;
+      return;
+    }
+    case ConstantsRecord::CE_CAST:
+    {
+      // [opcode, opty, opval]
+      if(ops.size() < 3)
+        break;
+
+      static const char *casts[] = {
+          "trunc",  "zext",    "sext",     "fptoui",   "fptosi",  "uitofp",       "sitofp",
+          "fptrunc", "fpext",  "ptrtoint", "inttoptr", "bitcast", "addrspacecast",
+      };
+      if(ops[0] >= sizeof(casts) / sizeof(casts[0]))
+        break;
+
+      s += casts[ops[0]];
+      s += " (";
+      AppendType(s, uint32_t(ops[1]));
+      s += ' ';
+      AppendValue(s, f, NULL, uint32_t(ops[2]), depth + 1);
+      s += " to ";
+      AppendType(s, c.type);
+      s += ')';
+      return;
+    }
+    case ConstantsRecord::CE_GEP:
+    case ConstantsRecord::CE_INBOUNDS_GEP:
+    {
+      // [pointee type?, (type, value)...]
+      size_t first = ops.size() % 2;
+      if(ops.size() < 2 + first)
+        break;
+
+      s += "getelementptr ";
+      if(IS_KNOWN(c.record->id, ConstantsRecord::CE_INBOUNDS_GEP))
+        s += "inbounds ";
+      s += '(';
+      if(first)
+      {
+        AppendType(s, uint32_t(ops[0]));
+      }
+      else
+      {
+        const uint32_t ptrType = uint32_t(ops[0]);
+        AppendType(s, ptrType < types.size() ? types[ptrType].inner : NoID);
+      }
+      for(size_t i = first; i + 1 < ops.size(); i += 2)
+      {
+        s += ", ";
+        AppendType(s, uint32_t(ops[i]));
+        s += ' ';
+        AppendValue(s, f, NULL, uint32_t(ops[i + 1]), depth + 1);
+      }
+      s += ')';
+      return;
+    }
+    case ConstantsRecord::CE_BINOP:
+    {
+      // [opcode, lhs, rhs, flags?]
+      if(ops.size() < 3 || ops[0] > 12)
+        break;
+
+      static const char *intOps[] = {
+          "add", "sub", "mul", "udiv", "sdiv", "urem", "srem",
+          "shl", "lshr", "ashr", "and", "or", "xor",
+      };
+      static const char *floatOps[] = {
+          "fadd", "fsub", "fmul", NULL, "fdiv", NULL, "frem", NULL, NULL, NULL, NULL, NULL, NULL,
+      };
+
+      const char *name = m.IsFloat(c.type) ? floatOps[ops[0]] : intOps[ops[0]];
+      if(!name)
+        break;
+
+      s += name;
+      s += " (";
+      AppendType(s, c.type);
+      s += ' ';
+      AppendValue(s, f, NULL, uint32_t(ops[1]), depth + 1);
+      s += ", ";
+      AppendType(s, c.type);
+      s += ' ';
+      AppendValue(s, f, NULL, uint32_t(ops[2]), depth + 1);
+      s += ')';
+      return;
+    }
+    case ConstantsRecord::CE_CMP:
+    {
+      // [opty, lhs, rhs, predicate]
+      if(ops.size() < 4)
+        break;
+
+      s += ops[3] < 32 ? "fcmp " : "icmp ";
+      s += predicateName(uint32_t(ops[3]));
+      s += " (";
+      AppendType(s, uint32_t(ops[0]));
+      s += ' ';
+      AppendValue(s, f, NULL, uint32_t(ops[1]), depth + 1);
+      s += ", ";
+      AppendType(s, uint32_t(ops[0]));
+      s += ' ';
+      AppendValue(s, f, NULL, uint32_t(ops[2]), depth + 1);
+      s += ')';
+      return;
+    }
+    default: break;
+  }
+
+  s += "<unsupported constant ";
+  appendUInt(s, c.record->id);
+  s += '>';
+}
+
+void Disassembler::AppendValue(std::string &s, const Function *f, const Locals *locals, uint32_t id,
+                               int depth) const
+{
+  if(depth > MaxConstantDepth)
+  {
+    s += "<invalid constant>";
+    return;
+  }
+
+  const Value *v = NULL;
+  if(f)
+    v = m.GetValue(*f, id);
+  else if(id < m.GetValues().size())
+    v = &m.GetValues()[id];
+
+  if(!v)
+  {
+    s += "<invalid value>";
+    return;
+  }
+
+  switch(v->kind)
+  {
+    case ValueKind::GlobalVariable:
+    case ValueKind::Function:
+    case ValueKind::Alias: s += globalRefs[v->index]; return;
+    case ValueKind::Constant:
+    {
+      const bool local = f && id >= f->firstValue;
+      const Constant &c = local ? f->constants[v->index] : m.GetConstants()[v->index];
+      AppendConstant(s, local ? f : NULL, c, depth);
+      return;
+    }
+    case ValueKind::Argument:
+    case ValueKind::Instruction:
+      if(f && locals)
+      {
+        s += locals->values[id - f->firstValue];
+        return;
+      }
+      break;
+  }
+
+  s += "<invalid value>";
+}
+
+void Disassembler::AppendTypedValue(std::string &s, const Function *f, const Locals *locals,
+                                    uint32_t id) const
+{
+  AppendType(s, ValueType(f, id));
+  s += ' ';
+  AppendValue(s, f, locals, id);
+}
+
+void Disassembler::Header(std::string &s) const
+{
+  const Program &program = m.GetProgram();
+
+  char buf[128];
+  snprintf(buf, sizeof(buf), "; %s Shader, compiled under SM%u.%u\n",
+           ShaderTypeName(program.GetShaderType()), program.GetShaderModelMajor(),
+           program.GetShaderModelMinor());
+  s += buf;
+
+  if(program.GetDebugName())
+  {
+    s += "; shader debug name: ";
+    s += program.GetDebugName();
+    s += '\n';
+  }
+
+  if(m.GetError())
+  {
+    s += "; module couldn't be fully decoded: ";
+    s += m.GetError();
+    s += '\n';
+  }
+
+  s += '\n';
+
+  if(!m.GetDataLayout().empty())
+    s += "target datalayout = \"" + m.GetDataLayout() + "\"\n";
+  if(!m.GetTriple().empty())
+    s += "target triple = \"" + m.GetTriple() + "\"\n";
+
+  bool anyStructs = false;
+  for(const Type &t : types)
+  {
+    if(t.kind != Type::Struct || t.name.empty())
+      continue;
+
+    if(!anyStructs)
+      s += '\n';
+    anyStructs = true;
+
+    appendName(s, '%', t.name);
+    s += " = type ";
+
+    // opaque structs have no members and no body record
+    if(t.members.empty() && !t.packed)
+    {
+      s += "opaque\n";
+      continue;
+    }
+
+    s += t.packed ? "<{ " : "{ ";
+    for(size_t i = 0; i < t.members.size(); i++)
+    {
+      if(i > 0)
+        s += ", ";
+      AppendType(s, t.members[i]);
+    }
+    s += t.packed ? " }>\n" : " }\n";
+  }
+}
+
+void Disassembler::Globals(std::string &s) const
+{
+  const std::vector<GlobalValue> &globals = m.GetGlobals();
+
+  bool any = false;
+  for(size_t i = 0; i < globals.size(); i++)
+  {
+    const GlobalValue &g = globals[i];
+    if(g.kind == ValueKind::Function)
+      continue;
+
+    if(!any)
+      s += '\n';
+    any = true;
+
+    s += globalRefs[i];
+    s += " = ";
+
+    if(g.kind == ValueKind::Alias)
+    {
+      s += linkageName(g.linkage);
+      s += "alias ";
+      AppendType(s, g.valueType);
+      s += ", ";
+      AppendTypedValue(s, NULL, NULL, g.initializer);
+      s += '\n';
+      continue;
+    }
+
+    s += g.isDeclaration && !g.linkage ? "external " : linkageName(g.linkage);
+
+    const uint32_t addrSpace = g.type < types.size() ? types[g.type].addrSpace : 0;
+    if(addrSpace)
+    {
+      s += "addrspace(";
+      appendUInt(s, addrSpace);
+      s += ") ";
+    }
+
+    s += g.isConstant ? "constant " : "global ";
+    AppendType(s, g.valueType);
+
+    if(!g.isDeclaration)
+    {
+      s += ' ';
+      AppendValue(s, NULL, NULL, g.initializer);
+    }
+
+    if(g.align)
+    {
+      s += ", align ";
+      appendUInt(s, g.align);
+    }
+
+    s += '\n';
+  }
+}
+
+void Disassembler::AppendPrototype(std::string &s, const GlobalValue &g, const Locals *locals) const
+{
+  const Type &t = types[g.valueType];
+
+  AppendType(s, t.inner);
+  s += ' ';
+  s += globalRefs[&g - m.GetGlobals().data()];
+  s += '(';
+  for(size_t i = 0; i < t.members.size(); i++)
+  {
+    if(i > 0)
+      s += ", ";
+    AppendType(s, t.members[i]);
+    if(locals && i < locals->values.size())
+    {
+      s += ' ';
+      s += locals->values[i];
+    }
+  }
+  if(t.vararg)
+    s += t.members.empty() ? "..." : ", ...";
+  s += ')';
+}
+
+void Disassembler::Declaration(std::string &s, const GlobalValue &g) const
+{
+  s += "\ndeclare ";
+  s += linkageName(g.linkage);
+  AppendPrototype(s, g, NULL);
+  s += '\n';
+}
+
+void Disassembler::Definition(std::string &s, const Function &f) const
+{
+  TRACE_SCOPE_ARG("Disassemble function", "global", f.global);
+
+  const GlobalValue &g = m.GetGlobals()[f.global];
+
+  Locals locals;
+  NameLocals(f, locals);
+
+  s += "\ndefine ";
+  s += linkageName(g.linkage);
+  AppendPrototype(s, g, &locals);
+  s += " {\n";
+
+  for(size_t b = 0; b < f.blocks.size(); b++)
+  {
+    // the entry block's label is only printed if it has a name, like LLVM does
+    if(b > 0)
+      s += '\n';
+    if(b > 0 || (b < f.blockNames.size() && !f.blockNames[b].empty()))
+    {
+      s += locals.blocks[b].c_str() + 1;
+      s += ":\n";
+    }
+
+    const size_t end = b + 1 < f.blocks.size() ? f.blocks[b + 1] : f.instructions.size();
+    for(size_t i = f.blocks[b]; i < end; i++)
+      AppendInstruction(s, f, locals, f.instructions[i]);
+  }
+
+  if(f.error)
+  {
+    s += "  ; couldn't decode the rest of the function: ";
+    s += f.error;
+    s += '\n';
+  }
+
+  s += "}\n";
+}
+
+void Disassembler::AppendInstruction(std::string &s, const Function &f, const Locals &locals,
+                                     const Instruction &inst) const
+{
+  const Operand *ops = f.operands.data() + inst.firstOperand;
+  const uint32_t numOps = inst.numOperands;
+
+  auto typedOp = [&](uint32_t i) {
+    if(i < numOps && ops[i].kind == Operand::Value)
+      AppendTypedValue(s, &f, &locals, ops[i].id);
+    else
+      s += "<invalid operand>";
+  };
+  auto untypedOp = [&](uint32_t i) {
+    if(i < numOps && ops[i].kind == Operand::Value)
+      AppendValue(s, &f, &locals, ops[i].id);
+    else
+      s += "<invalid operand>";
+  };
+  auto blockOp = [&](uint32_t i, bool withLabel) {
+    if(withLabel)
+      s += "label ";
+    if(i < numOps && ops[i].kind == Operand::Block && ops[i].id < locals.blocks.size())
+      s += locals.blocks[ops[i].id];
+    else
+      s += "<invalid block>";
+  };
+  auto align = [&]() {
+    if(inst.align)
+    {
+      s += ", align ";
+      appendUInt(s, inst.align);
+    }
+  };
+  auto ordering = [&](uint32_t shift) {
+    s += orderingName((inst.flags >> shift) & MemoryOrderingMask);
+  };
+
+  s += "  ";
+  if(inst.value != NoID)
+  {
+    s += locals.values[inst.value - f.firstValue];
+    s += " = ";
+  }
+
+  switch(inst.op)
+  {
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::Mul:
+    case Opcode::Shl:
+      s += OpcodeName(inst.op);
+      if(inst.flags & 0x1)
+        s += " nuw";
+      if(inst.flags & 0x2)
+        s += " nsw";
+      s += ' ';
+      typedOp(0);
+      s += ", ";
+      untypedOp(1);
+      break;
+    case Opcode::UDiv:
+    case Opcode::SDiv:
+    case Opcode::LShr:
+    case Opcode::AShr:
+      s += OpcodeName(inst.op);
+      if(inst.flags & 0x1)
+        s += " exact";
+      s += ' ';
+      typedOp(0);
+      s += ", ";
+      untypedOp(1);
+      break;
+    case Opcode::FAdd:
+    case Opcode::FSub:
+    case Opcode::FMul:
+    case Opcode::FDiv:
+    case Opcode::FRem:
+    case Opcode::FCmp:
+      s += OpcodeName(inst.op);
+      // unsafe algebra implies all the others
+      if(inst.flags & 0x1)
+      {
+        s += " fast";
+      }
+      else
+      {
+        if(inst.flags & 0x2)
+          s += " nnan";
+        if(inst.flags & 0x4)
+          s += " ninf";
+        if(inst.flags & 0x8)
+          s += " nsz";
+        if(inst.flags & 0x10)
+          s += " arcp";
+      }
+      if(inst.op == Opcode::FCmp)
+      {
+        s += ' ';
+        s += predicateName(inst.predicate);
+      }
+      s += ' ';
+      typedOp(0);
+      s += ", ";
+      untypedOp(1);
+      break;
+    case Opcode::URem:
+    case Opcode::SRem:
+    case Opcode::And:
+    case Opcode::Or:
+    case Opcode::Xor:
+      s += OpcodeName(inst.op);
+      s += ' ';
+      typedOp(0);
+      s += ", ";
+      untypedOp(1);
+      break;
+    case Opcode::ICmp:
+      s += "icmp ";
+      s += predicateName(inst.predicate);
+      s += ' ';
+      typedOp(0);
+      s += ", ";
+      untypedOp(1);
+      break;
+    case Opcode::Trunc:
+    case Opcode::ZExt:
+    case Opcode::SExt:
+    case Opcode::FPToUI:
+    case Opcode::FPToSI:
+    case Opcode::UIToFP:
+    case Opcode::SIToFP:
+    case Opcode::FPTrunc:
+    case Opcode::FPExt:
+    case Opcode::PtrToInt:
+    case Opcode::IntToPtr:
+    case Opcode::BitCast:
+    case Opcode::AddrSpaceCast:
+      s += OpcodeName(inst.op);
+      s += ' ';
+      typedOp(0);
+      s += " to ";
+      AppendType(s, inst.type);
+      break;
+    case Opcode::Ret:
+      s += "ret ";
+      if(numOps == 0)
+        s += "void";
+      for(uint32_t i = 0; i < numOps; i++)
+      {
+        if(i > 0)
+          s += ", ";
+        typedOp(i);
+      }
+      break;
+    case Opcode::Br:
+      s += "br ";
+      if(numOps == 1)
+      {
+        blockOp(0, true);
+      }
+      else
+      {
+        typedOp(0);
+        s += ", ";
+        blockOp(1, true);
+        s += ", ";
+        blockOp(2, true);
+      }
+      break;
+    case Opcode::Switch:
+      s += "switch ";
+      typedOp(0);
+      s += ", ";
+      blockOp(1, true);
+      s += " [\n";
+      for(uint32_t i = 2; i + 1 < numOps; i += 2)
+      {
+        s += "    ";
+        typedOp(i);
+        s += ", ";
+        blockOp(i + 1, true);
+        s += '\n';
+      }
+      s += "  ]";
+      break;
+    case Opcode::Unreachable: s += "unreachable"; break;
+    case Opcode::Phi:
+      s += "phi ";
+      AppendType(s, inst.type);
+      for(uint32_t i = 0; i + 1 < numOps; i += 2)
+      {
+        s += i == 0 ? " [ " : ", [ ";
+        untypedOp(i);
+        s += ", ";
+        blockOp(i + 1, false);
+        s += " ]";
+      }
+      break;
+    case Opcode::Select:
+      s += "select ";
+      typedOp(0);
+      s += ", ";
+      typedOp(1);
+      s += ", ";
+      typedOp(2);
+      break;
+    case Opcode::ExtractElement:
+      s += "extractelement ";
+      typedOp(0);
+      s += ", ";
+      typedOp(1);
+      break;
+    case Opcode::InsertElement:
+    case Opcode::ShuffleVector:
+      s += OpcodeName(inst.op);
+      s += ' ';
+      typedOp(0);
+      s += ", ";
+      typedOp(1);
+      s += ", ";
+      typedOp(2);
+      break;
+    case Opcode::ExtractValue:
+    case Opcode::InsertValue:
+      s += OpcodeName(inst.op);
+      s += ' ';
+      for(uint32_t i = 0; i < numOps; i++)
+      {
+        if(i > 0)
+          s += ", ";
+        if(ops[i].kind == Operand::Literal)
+          appendUInt(s, ops[i].id);
+        else
+          typedOp(i);
+      }
+      break;
+    case Opcode::Alloca:
+    {
+      s += "alloca ";
+      AppendType(s, inst.auxType);
+      // a single element is the default
+      int64_t count = 0;
+      if(numOps > 0 && !(m.GetConstantInt(f, ops[0].id, count) && count == 1))
+      {
+        s += ", ";
+        typedOp(0);
+      }
+      align();
+      break;
+    }
+    case Opcode::Load:
+      s += "load ";
+      if(inst.flags & (MemoryOrderingMask << MemoryOrderingShift))
+        s += "atomic ";
+      if(inst.flags & MemoryVolatile)
+        s += "volatile ";
+      AppendType(s, inst.type);
+      s += ", ";
+      typedOp(0);
+      if(inst.flags & (MemoryOrderingMask << MemoryOrderingShift))
+      {
+        s += (inst.flags & MemorySingleThread) ? " singlethread " : " ";
+        ordering(MemoryOrderingShift);
+      }
+      align();
+      break;
+    case Opcode::Store:
+      s += "store ";
+      if(inst.flags & (MemoryOrderingMask << MemoryOrderingShift))
+        s += "atomic ";
+      if(inst.flags & MemoryVolatile)
+        s += "volatile ";
+      typedOp(0);
+      s += ", ";
+      typedOp(1);
+      if(inst.flags & (MemoryOrderingMask << MemoryOrderingShift))
+      {
+        s += (inst.flags & MemorySingleThread) ? " singlethread " : " ";
+        ordering(MemoryOrderingShift);
+      }
+      align();
+      break;
+    case Opcode::GetElementPtr:
+      s += "getelementptr ";
+      if(inst.flags & 0x1)
+        s += "inbounds ";
+      AppendType(s, inst.auxType);
+      for(uint32_t i = 0; i < numOps; i++)
+      {
+        s += ", ";
+        typedOp(i);
+      }
+      break;
+    case Opcode::Call:
+    {
+      if(inst.flags & (1 << 14))
+        s += "musttail ";
+      else if(inst.flags & 0x1)
+        s += "tail ";
+      s += "call ";
+
+      // varargs functions need the whole type to be unambiguous
+      const Type &funcType = types[inst.auxType];
+      if(funcType.vararg)
+        AppendType(s, inst.auxType);
+      else
+        AppendType(s, funcType.inner);
+      s += ' ';
+      untypedOp(0);
+      s += '(';
+      for(uint32_t i = 1; i < numOps; i++)
+      {
+        if(i > 1)
+          s += ", ";
+        if(ops[i].kind == Operand::Metadata)
+        {
+          s += "metadata !";
+          appendUInt(s, ops[i].id);
+        }
+        else if(ops[i].kind == Operand::Block)
+        {
+          blockOp(i, true);
+        }
+        else
+        {
+          typedOp(i);
+        }
+      }
+      s += ')';
+      break;
+    }
+    case Opcode::Fence:
+      s += "fence ";
+      if(inst.flags & MemorySingleThread)
+        s += "singlethread ";
+      ordering(MemoryOrderingShift);
+      break;
+    case Opcode::AtomicRMW:
+      s += "atomicrmw ";
+      if(inst.flags & MemoryVolatile)
+        s += "volatile ";
+      s += atomicOpName(inst.predicate);
+      s += ' ';
+      typedOp(0);
+      s += ", ";
+      typedOp(1);
+      s += (inst.flags & MemorySingleThread) ? " singlethread " : " ";
+      ordering(MemoryOrderingShift);
+      break;
+    case Opcode::CmpXchg:
+      s += "cmpxchg ";
+      if(inst.flags & MemoryWeak)
+        s += "weak ";
+      if(inst.flags & MemoryVolatile)
+        s += "volatile ";
+      typedOp(0);
+      s += ", ";
+      typedOp(1);
+      s += ", ";
+      typedOp(2);
+      s += (inst.flags & MemorySingleThread) ? " singlethread " : " ";
+      ordering(MemoryOrderingShift);
+      s += ' ';
+      ordering(MemoryFailureOrderingShift);
+      break;
+    case Opcode::Unknown: s += "<unknown instruction>"; break;
+  }
+
+  s += '\n';
+}
+
+void Disassemble(const Module &module, Output &out, ThreadPool *pool)
+{
+  TRACE_SCOPE("Disassemble");
+
+  Disassembler disasm(module);
+
+  std::string s;
+  disasm.Header(s);
+  disasm.Globals(s);
+  out.Write(s.c_str(), s.size());
+
+  // every function is formatted into its own buffer, so they can be done in any order and then
+  // written out in module order
+  const std::vector<GlobalValue> &globals = module.GetGlobals();
+  std::vector<std::string> texts(globals.size());
+
+  auto format = [&](size_t i) {
+    const GlobalValue &g = globals[i];
+    if(g.kind != ValueKind::Function)
+      return;
+
+    if(g.function == NoID)
+      disasm.Declaration(texts[i], g);
+    else
+      disasm.Definition(texts[i], module.GetFunctions()[g.function]);
+  };
+
+  if(pool)
+  {
+    pool->ParallelFor(globals.size(), format);
+  }
+  else
+  {
+    for(size_t i = 0; i < globals.size(); i++)
+      format(i);
+  }
+
+  for(const std::string &text : texts)
+    out.Write(text.c_str(), text.size());
+}
+};    // namespace DXIL
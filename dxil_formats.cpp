@@ -0,0 +1,444 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxil_formats.h"
+#include <string.h>
+#include <string>
+#include <vector>
+#include "dxil_inspect.h"
+#include "dxil_output.h"
+#include "llvm_decoder.h"
+
+namespace DXIL
+{
+// buffers small writes and flushes them to the output in large chunks
+class JSONWriter
+{
+public:
+  JSONWriter(Output &out) : m_Out(out) { m_Buffer.reserve(FlushSize + 256); }
+  ~JSONWriter() { Flush(); }
+
+  void Raw(const char *str, size_t length)
+  {
+    m_Buffer.append(str, length);
+    if(m_Buffer.size() >= FlushSize)
+      Flush();
+  }
+  void Raw(const char *str) { Raw(str, strlen(str)); }
+
+  void UInt(uint64_t val)
+  {
+    char str[20];
+    size_t pos = sizeof(str);
+    do
+    {
+      str[--pos] = char('0' + val % 10);
+      val /= 10;
+    } while(val);
+
+    Raw(str + pos, sizeof(str) - pos);
+  }
+
+  void String(const char *str, size_t length)
+  {
+    static const char hex[] = "0123456789abcdef";
+
+    m_Buffer.push_back('"');
+    for(size_t i = 0; i < length; i++)
+    {
+      const unsigned char c = (unsigned char)str[i];
+      if(c == '"' || c == '\\')
+      {
+        m_Buffer.push_back('\\');
+        m_Buffer.push_back(char(c));
+      }
+      // escape anything that isn't printable ASCII, treating high bytes as latin-1 so the result
+      // is always valid UTF-8
+      else if(c < 0x20 || c >= 0x7f)
+      {
+        const char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+        m_Buffer.append(esc, 6);
+      }
+      else
+      {
+        m_Buffer.push_back(char(c));
+      }
+    }
+    m_Buffer.push_back('"');
+
+    if(m_Buffer.size() >= FlushSize)
+      Flush();
+  }
+  void String(const char *str) { String(str, strlen(str)); }
+
+  void Base64(const byte *data, size_t length)
+  {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    m_Buffer.push_back('"');
+    for(size_t i = 0; i < length; i += 3)
+    {
+      const uint32_t rem = uint32_t(length - i);
+      const uint32_t v = (uint32_t(data[i]) << 16) | (rem > 1 ? uint32_t(data[i + 1]) << 8 : 0) |
+                         (rem > 2 ? uint32_t(data[i + 2]) : 0);
+
+      m_Buffer.push_back(table[(v >> 18) & 0x3f]);
+      m_Buffer.push_back(table[(v >> 12) & 0x3f]);
+      m_Buffer.push_back(rem > 1 ? table[(v >> 6) & 0x3f] : '=');
+      m_Buffer.push_back(rem > 2 ? table[v & 0x3f] : '=');
+
+      if(m_Buffer.size() >= FlushSize)
+        Flush();
+    }
+    m_Buffer.push_back('"');
+  }
+
+  void Flush()
+  {
+    if(!m_Buffer.empty())
+      m_Out.Write(m_Buffer.data(), m_Buffer.size());
+    m_Buffer.clear();
+  }
+
+private:
+  static const size_t FlushSize = 64 * 1024;
+
+  Output &m_Out;
+  std::string m_Buffer;
+};
+
+static void writeJSONNode(JSONWriter &json, uint32_t parentBlock,
+                          const LLVMBC::BlockOrRecord &node)
+{
+  const char *name = node.IsBlock() ? BlockName(node.id) : RecordName(parentBlock, node.id);
+
+  json.Raw(node.IsBlock() ? "{\"type\":\"block\",\"id\":" : "{\"type\":\"record\",\"id\":");
+  json.UInt(node.id);
+
+  if(name)
+  {
+    json.Raw(",\"name\":");
+    json.String(name);
+  }
+
+  if(node.IsBlock())
+  {
+    json.Raw(",\"numWords\":");
+    json.UInt(node.blockDwordLength);
+    json.Raw(",\"children\":[");
+
+    for(size_t i = 0; i < node.children.size(); i++)
+    {
+      if(i > 0)
+        json.Raw(",");
+      writeJSONNode(json, node.id, node.children[i]);
+    }
+
+    json.Raw("]}");
+    return;
+  }
+
+  json.Raw(",\"ops\":[");
+  for(size_t i = 0; i < node.ops.size(); i++)
+  {
+    if(i > 0)
+      json.Raw(",");
+    json.UInt(node.ops[i]);
+  }
+  json.Raw("]");
+
+  if(node.blob)
+  {
+    json.Raw(",\"blob\":");
+    json.Base64(node.blob, node.blobLength);
+  }
+
+  json.Raw("}");
+}
+
+void WriteJSON(const Program &program, Output &out)
+{
+  if(program.GetStatus().Failed())
+    return;
+
+  JSONWriter json(out);
+
+  json.Raw("{\"shaderType\":");
+  json.String(ShaderTypeName(program.GetShaderType()));
+  json.Raw(",\"shaderModel\":{\"major\":");
+  json.UInt(program.GetShaderModelMajor());
+  json.Raw(",\"minor\":");
+  json.UInt(program.GetShaderModelMinor());
+  json.Raw("},\"features\":");
+  json.UInt(uint64_t(program.GetFeatures()));
+
+  if(program.GetDebugName())
+  {
+    json.Raw(",\"debugName\":");
+    json.String(program.GetDebugName());
+  }
+
+  json.Raw(",\"module\":");
+  writeJSONNode(json, 0, program.GetRoot());
+  json.Raw("}\n");
+}
+
+static size_t align4(size_t length)
+{
+  return (length + 3) & ~size_t(3);
+}
+
+// sizes are computed up front so each node can be written with its length before its children.
+// They're stored in the same pre-order that the nodes are written in.
+static uint64_t measureBinaryNode(const LLVMBC::BlockOrRecord &node, std::vector<uint64_t> &sizes)
+{
+  const size_t idx = sizes.size();
+  sizes.push_back(0);
+
+  uint64_t size = sizeof(BinaryNodeHeader);
+
+  if(node.IsBlock())
+  {
+    size += sizeof(uint32_t);
+    for(const LLVMBC::BlockOrRecord &child : node.children)
+      size += measureBinaryNode(child, sizes);
+  }
+  else
+  {
+    size += align4(node.ops.size() * node.ops.Width());
+    if(node.blob)
+      size += sizeof(uint32_t) + align4(node.blobLength);
+  }
+
+  sizes[idx] = size;
+  return size;
+}
+
+static void writeBinaryNode(Output &out, const LLVMBC::BlockOrRecord &node,
+                            const std::vector<uint64_t> &sizes, size_t &sizeIdx)
+{
+  static const char padding[4] = {};
+
+  BinaryNodeHeader header = {};
+  header.id = node.id;
+  header.length = uint32_t(sizes[sizeIdx++]);
+
+  if(node.IsBlock())
+  {
+    header.flags = BinaryNode_Block;
+    header.count = uint32_t(node.children.size());
+    out.Write((const char *)&header, sizeof(header));
+    out.Write((const char *)&node.blockDwordLength, sizeof(uint32_t));
+
+    for(const LLVMBC::BlockOrRecord &child : node.children)
+      writeBinaryNode(out, child, sizes, sizeIdx);
+
+    return;
+  }
+
+  header.flags = node.blob ? BinaryNode_HasBlob : 0;
+  header.opWidth = uint8_t(node.ops.Width());
+  header.count = uint32_t(node.ops.size());
+  out.Write((const char *)&header, sizeof(header));
+
+  // the ops are already stored narrowed, so they go out as-is
+  const size_t opBytes = node.ops.size() * node.ops.Width();
+  out.Write((const char *)node.ops.Data(), opBytes);
+  out.Write(padding, align4(opBytes) - opBytes);
+
+  if(node.blob)
+  {
+    const uint32_t blobLength = uint32_t(node.blobLength);
+    out.Write((const char *)&blobLength, sizeof(blobLength));
+    out.Write((const char *)node.blob, node.blobLength);
+    out.Write(padding, align4(node.blobLength) - node.blobLength);
+  }
+}
+
+bool WriteBinary(const Program &program, Output &out)
+{
+  if(program.GetStatus().Failed())
+    return false;
+
+  std::vector<uint64_t> sizes;
+  const uint64_t totalLength =
+      sizeof(BinaryDumpHeader) + measureBinaryNode(program.GetRoot(), sizes);
+
+  if(totalLength > UINT32_MAX)
+    return false;
+
+  BinaryDumpHeader header = {};
+  header.magic = BinaryDumpMagic;
+  header.version = BinaryDumpVersion;
+  header.shaderType = program.GetShaderType();
+  header.shaderModelMajor = uint8_t(program.GetShaderModelMajor());
+  header.shaderModelMinor = uint8_t(program.GetShaderModelMinor());
+  header.totalLength = uint32_t(totalLength);
+  header.features = uint64_t(program.GetFeatures());
+  out.Write((const char *)&header, sizeof(header));
+
+  size_t sizeIdx = 0;
+  writeBinaryNode(out, program.GetRoot(), sizes, sizeIdx);
+
+  return true;
+}
+
+BinaryNode::BinaryNode(const byte *node, const byte *end)
+{
+  BinaryNodeHeader header;
+
+  if(node >= end || size_t(end - node) < sizeof(header))
+    return;
+
+  memcpy(&header, node, sizeof(header));
+
+  if(header.length < sizeof(header) || header.length % 4 != 0 ||
+     header.length > size_t(end - node))
+    return;
+
+  const size_t payload = header.length - sizeof(header);
+
+  if(header.flags & BinaryNode_Block)
+  {
+    if(payload < sizeof(uint32_t))
+      return;
+  }
+  else
+  {
+    if(header.opWidth != 1 && header.opWidth != 2 && header.opWidth != 4 && header.opWidth != 8)
+      return;
+
+    const uint64_t opBytes = (uint64_t(header.count) * header.opWidth + 3) & ~uint64_t(3);
+    if(opBytes > payload)
+      return;
+
+    if(header.flags & BinaryNode_HasBlob)
+    {
+      if(payload - opBytes < sizeof(uint32_t))
+        return;
+
+      const byte *blob = node + sizeof(header) + opBytes;
+      uint32_t blobLength = 0;
+      memcpy(&blobLength, blob, sizeof(blobLength));
+
+      if(align4(blobLength) > payload - opBytes - sizeof(uint32_t))
+        return;
+
+      m_Blob = blob + sizeof(uint32_t);
+      m_BlobLength = blobLength;
+    }
+  }
+
+  m_Node = node;
+  m_End = end;
+  m_Header = header;
+}
+
+uint32_t BinaryNode::GetBlockDwordLength() const
+{
+  if(!IsBlock())
+    return 0;
+
+  uint32_t ret;
+  memcpy(&ret, m_Node + sizeof(BinaryNodeHeader), sizeof(ret));
+  return ret;
+}
+
+BinaryNode BinaryNode::FirstChild() const
+{
+  if(NumChildren() == 0)
+    return BinaryNode();
+
+  return BinaryNode(m_Node + sizeof(BinaryNodeHeader) + sizeof(uint32_t), m_Node + m_Header.length);
+}
+
+BinaryNode BinaryNode::NextSibling() const
+{
+  if(!IsValid())
+    return BinaryNode();
+
+  return BinaryNode(m_Node + m_Header.length, m_End);
+}
+
+const byte *BinaryNode::GetOpData() const
+{
+  return IsRecord() ? m_Node + sizeof(BinaryNodeHeader) : NULL;
+}
+
+uint64_t BinaryNode::GetOp(size_t i) const
+{
+  if(i >= NumOps())
+    return 0;
+
+  const byte *data = GetOpData() + i * m_Header.opWidth;
+
+  switch(m_Header.opWidth)
+  {
+    case 1: return data[0];
+    case 2:
+    {
+      uint16_t ret;
+      memcpy(&ret, data, sizeof(ret));
+      return ret;
+    }
+    case 4:
+    {
+      uint32_t ret;
+      memcpy(&ret, data, sizeof(ret));
+      return ret;
+    }
+    default:
+    {
+      uint64_t ret;
+      memcpy(&ret, data, sizeof(ret));
+      return ret;
+    }
+  }
+}
+
+BinaryDump::BinaryDump(const void *bytes, size_t length)
+{
+  BinaryDumpHeader header;
+
+  if(bytes == NULL || length < sizeof(header))
+    return;
+
+  memcpy(&header, bytes, sizeof(header));
+
+  if(header.magic != BinaryDumpMagic || header.version != BinaryDumpVersion ||
+     header.totalLength < sizeof(header) || header.totalLength > length)
+    return;
+
+  m_Bytes = (const byte *)bytes;
+  m_Header = header;
+}
+
+BinaryNode BinaryDump::GetRoot() const
+{
+  if(!IsValid())
+    return BinaryNode();
+
+  return BinaryNode(m_Bytes + sizeof(BinaryDumpHeader), m_Bytes + m_Header.totalLength);
+}
+};    // namespace DXIL
@@ -0,0 +1,145 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+
+namespace DXIL
+{
+class Output;
+class Program;
+
+// machine-readable alternatives to the text dump, both written straight to the output. JSON is
+// written in a single pass. Binary first measures every node, keeping one size per node, so that
+// each can be written with its length ahead of its children.
+
+// one JSON document per program, with blocks and records nested as they are in the bitcode. The
+// document is followed by a newline so that several can be streamed one per line.
+void WriteJSON(const Program &program, Output &out);
+
+// the compact binary format below. Returns false, having written nothing, if the program is too
+// large to be represented.
+bool WriteBinary(const Program &program, Output &out);
+
+// all values are little-endian and every node is a multiple of 4 bytes, so a mapped dump can be
+// walked in place without parsing.
+//
+// file:   BinaryDumpHeader, then the root node
+// node:   BinaryNodeHeader, then
+//   block:  uint32_t blockDwordLength, then each child node in order
+//   record: count values of opWidth bytes each, padded to 4 bytes. If it has a blob, then the
+//           uint32_t blob length and the blob bytes, padded to 4 bytes.
+static const uint32_t BinaryDumpMagic = MAKE_FOURCC('D', 'X', 'B', 'D');
+static const uint16_t BinaryDumpVersion = 1;
+
+struct BinaryDumpHeader
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t shaderType;
+  uint8_t shaderModelMajor;
+  uint8_t shaderModelMinor;
+  uint16_t reserved;
+  // including this header, so that dumps can be concatenated
+  uint32_t totalLength;
+  uint64_t features;
+};
+
+enum BinaryNodeFlags : uint8_t
+{
+  BinaryNode_Block = 0x1,
+  BinaryNode_HasBlob = 0x2,
+};
+
+struct BinaryNodeHeader
+{
+  uint32_t id;
+  uint8_t flags;
+  uint8_t opWidth;    // 1, 2, 4 or 8 for records
+  uint16_t reserved;
+  // the whole node in bytes, including this header and any children
+  uint32_t length;
+  // the number of children for a block, or ops for a record
+  uint32_t count;
+};
+
+// a bounds-checked view of one node in a binary dump. Any node that doesn't fit within its parent
+// is invalid, as are all of its children and siblings.
+class BinaryNode
+{
+public:
+  BinaryNode() {}
+
+  bool IsValid() const { return m_Node != NULL; }
+  bool IsBlock() const { return (m_Header.flags & BinaryNode_Block) != 0; }
+  bool IsRecord() const { return IsValid() && !IsBlock(); }
+  uint32_t GetID() const { return m_Header.id; }
+
+  // blocks only. Children are walked in order from the first with NextSibling
+  uint32_t GetBlockDwordLength() const;
+  uint32_t NumChildren() const { return IsBlock() ? m_Header.count : 0; }
+  BinaryNode FirstChild() const;
+  BinaryNode NextSibling() const;
+
+  // records only. The ops can be read in place at their stored width
+  uint32_t NumOps() const { return IsRecord() ? m_Header.count : 0; }
+  size_t GetOpWidth() const { return m_Header.opWidth; }
+  const byte *GetOpData() const;
+  uint64_t GetOp(size_t i) const;
+  const byte *GetBlob() const { return m_Blob; }
+  size_t GetBlobLength() const { return m_BlobLength; }
+
+private:
+  friend class BinaryDump;
+  BinaryNode(const byte *node, const byte *end);
+
+  const byte *m_Node = NULL;
+  // the end of the parent, for finding siblings
+  const byte *m_End = NULL;
+  BinaryNodeHeader m_Header = {};
+  const byte *m_Blob = NULL;
+  uint32_t m_BlobLength = 0;
+};
+
+// a view over a binary dump in memory, e.g. from a MappedFile. Doesn't copy anything, so the
+// bytes must outlive it and any nodes from it.
+class BinaryDump
+{
+public:
+  BinaryDump(const void *bytes, size_t length);
+
+  bool IsValid() const { return m_Bytes != NULL; }
+  const BinaryDumpHeader &GetHeader() const { return m_Header; }
+  // where the next dump starts, if several were concatenated
+  size_t GetLength() const { return m_Header.totalLength; }
+  BinaryNode GetRoot() const;
+
+private:
+  const byte *m_Bytes = NULL;
+  BinaryDumpHeader m_Header = {};
+};
+};    // namespace DXIL
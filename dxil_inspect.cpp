@@ -24,489 +24,342 @@
 
 #include "dxil_inspect.h"
 #include <ctype.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include <string>
+#include <utility>
+#include <vector>
 #include "common.h"
+#include "dxbc_container.h"
+#include "dxil_bitcode.h"
+#include "dxil_disasm.h"
+#include "dxil_formats.h"
+#include "dxil_module.h"
+#include "dxil_output.h"
 #include "llvm_decoder.h"
-
-// hack so we can dump everything together
-extern DXIL::DebugName *debug_name;
-extern DXIL::Features features;
+#include "trace.h"
 
 namespace DXIL
 {
-struct ProgramHeader
-{
-  uint16_t ProgramVersion;
-  uint16_t ProgramType;
-  uint32_t SizeInUint32;     // Size in uint32_t units including this header.
-  uint32_t DxilMagic;        // 0x4C495844, ASCII "DXIL".
-  uint32_t DxilVersion;      // DXIL version.
-  uint32_t BitcodeOffset;    // Offset to LLVM bitcode (from DxilMagic).
-  uint32_t BitcodeSize;      // Size of LLVM bitcode.
-};
-
-enum class KnownBlocks : uint32_t
-{
-  BLOCKINFO = 0,
-
-  // 1-7 reserved,
-
-  MODULE_BLOCK = 8,
-  PARAMATTR_BLOCK = 9,
-  PARAMATTR_GROUP_BLOCK = 10,
-  CONSTANTS_BLOCK = 11,
-  FUNCTION_BLOCK = 12,
-  TYPE_SYMTAB_BLOCK = 13,
-  VALUE_SYMTAB_BLOCK = 14,
-  METADATA_BLOCK = 15,
-  METADATA_ATTACHMENT = 16,
-  TYPE_BLOCK = 17,
-};
-
-enum class ModuleRecord : uint32_t
-{
-  VERSION = 1,
-  TRIPLE = 2,
-  DATALAYOUT = 3,
-  FUNCTION = 8,
-};
-
-enum class ConstantsRecord : uint32_t
-{
-  SETTYPE = 1,
-  CONST_NULL = 2,
-  UNDEF = 3,
-  INTEGER = 4,
-  WIDE_INTEGER = 5,
-  FLOAT = 6,
-  AGGREGATE = 7,
-  STRING = 8,
-  DATA = 22,
-};
-
-enum class FunctionRecord : uint32_t
-{
-  DECLAREBLOCKS = 1,
-  INST_BINOP = 2,
-  INST_CAST = 3,
-  INST_GEP_OLD = 4,
-  INST_SELECT = 5,
-  INST_EXTRACTELT = 6,
-  INST_INSERTELT = 7,
-  INST_SHUFFLEVEC = 8,
-  INST_CMP = 9,
-  INST_RET = 10,
-  INST_BR = 11,
-  INST_SWITCH = 12,
-  INST_INVOKE = 13,
-  INST_UNREACHABLE = 15,
-  INST_PHI = 16,
-  INST_ALLOCA = 19,
-  INST_LOAD = 20,
-  INST_VAARG = 23,
-  INST_STORE_OLD = 24,
-  INST_EXTRACTVAL = 26,
-  INST_INSERTVAL = 27,
-  INST_CMP2 = 28,
-  INST_VSELECT = 29,
-  INST_INBOUNDS_GEP_OLD = 30,
-  INST_INDIRECTBR = 31,
-  DEBUG_LOC_AGAIN = 33,
-  INST_CALL = 34,
-  DEBUG_LOC = 35,
-  INST_FENCE = 36,
-  INST_CMPXCHG_OLD = 37,
-  INST_ATOMICRMW = 38,
-  INST_RESUME = 39,
-  INST_LANDINGPAD_OLD = 40,
-  INST_LOADATOMIC = 41,
-  INST_STOREATOMIC_OLD = 42,
-  INST_GEP = 43,
-  INST_STORE = 44,
-  INST_STOREATOMIC = 45,
-  INST_CMPXCHG = 46,
-  INST_LANDINGPAD = 47,
-  INST_CLEANUPRET = 48,
-  INST_CATCHRET = 49,
-  INST_CATCHPAD = 50,
-  INST_CLEANUPPAD = 51,
-  INST_CATCHSWITCH = 52,
-  OPERAND_BUNDLE = 55,
-  INST_UNOP = 56,
-  INST_CALLBR = 57,
-};
-
-enum class ValueSymtabRecord : uint32_t
+const char *BlockName(uint32_t blockID)
 {
-  ENTRY = 1,
-  BBENTRY = 2,
-  FNENTRY = 3,
-  COMBINED_ENTRY = 5,
-};
+  const char *name = NULL;
 
-enum class MetaDataRecord : uint32_t
-{
-  STRING_OLD = 1,
-  VALUE = 2,
-  NODE = 3,
-  NAME = 4,
-  DISTINCT_NODE = 5,
-  KIND = 6,
-  LOCATION = 7,
-  OLD_NODE = 8,
-  OLD_FN_NODE = 9,
-  NAMED_NODE = 10,
-  ATTACHMENT = 11,
-  GENERIC_DEBUG = 12,
-  SUBRANGE = 13,
-  ENUMERATOR = 14,
-  BASIC_TYPE = 15,
-  FILE = 16,
-  DERIVED_TYPE = 17,
-  COMPOSITE_TYPE = 18,
-  SUBROUTINE_TYPE = 19,
-  COMPILE_UNIT = 20,
-  SUBPROGRAM = 21,
-  LEXICAL_BLOCK = 22,
-  LEXICAL_BLOCK_FILE = 23,
-  NAMESPACE = 24,
-  TEMPLATE_TYPE = 25,
-  TEMPLATE_VALUE = 26,
-  GLOBAL_VAR = 27,
-  LOCAL_VAR = 28,
-  EXPRESSION = 29,
-  OBJC_PROPERTY = 30,
-  IMPORTED_ENTITY = 31,
-  MODULE = 32,
-  MACRO = 33,
-  MACRO_FILE = 34,
-  STRINGS = 35,
-  GLOBAL_DECL_ATTACHMENT = 36,
-  GLOBAL_VAR_EXPR = 37,
-  INDEX_OFFSET = 38,
-  INDEX = 39,
-  LABEL = 40,
-  COMMON_BLOCK = 44,
-};
+  // GetBlockName in BitcodeAnalyzer.cpp
+  switch(KnownBlocks(blockID))
+  {
+    case KnownBlocks::BLOCKINFO: name = "BLOCKINFO"; break;
+    case KnownBlocks::MODULE_BLOCK: name = "MODULE_BLOCK"; break;
+    case KnownBlocks::PARAMATTR_BLOCK: name = "PARAMATTR_BLOCK"; break;
+    case KnownBlocks::PARAMATTR_GROUP_BLOCK: name = "PARAMATTR_GROUP_BLOCK"; break;
+    case KnownBlocks::CONSTANTS_BLOCK: name = "CONSTANTS_BLOCK"; break;
+    case KnownBlocks::FUNCTION_BLOCK: name = "FUNCTION_BLOCK"; break;
+    case KnownBlocks::TYPE_SYMTAB_BLOCK: name = "TYPE_SYMTAB_BLOCK"; break;
+    case KnownBlocks::VALUE_SYMTAB_BLOCK: name = "VALUE_SYMTAB_BLOCK"; break;
+    case KnownBlocks::METADATA_BLOCK: name = "METADATA_BLOCK"; break;
+    case KnownBlocks::METADATA_ATTACHMENT: name = "METADATA_ATTACHMENT"; break;
+    case KnownBlocks::TYPE_BLOCK: name = "TYPE_BLOCK"; break;
+    default: break;
+  }
 
-enum class TypeRecord : uint32_t
-{
-  NUMENTRY = 1,
-  VOID = 2,
-  FLOAT = 3,
-  DOUBLE = 4,
-  LABEL = 5,
-  OPAQUE = 6,
-  INTEGER = 7,
-  POINTER = 8,
-  FUNCTION_OLD = 9,
-  HALF = 10,
-  ARRAY = 11,
-  VECTOR = 12,
-  METADATA = 16,
-  STRUCT_ANON = 18,
-  STRUCT_NAME = 19,
-  STRUCT_NAMED = 20,
-  FUNCTION = 21,
-  TOKEN = 22,
-};
+  return name;
+}
 
-static void printName(uint32_t parentBlock, const LLVMBC::BlockOrRecord &block)
+const char *RecordName(uint32_t blockID, uint32_t recordID)
 {
   const char *name = NULL;
 
-  if(block.IsBlock())
-  {
-    // GetBlockName in BitcodeAnalyzer.cpp
-    switch(KnownBlocks(block.id))
-    {
-      case KnownBlocks::BLOCKINFO: name = "BLOCKINFO"; break;
-      case KnownBlocks::MODULE_BLOCK: name = "MODULE_BLOCK"; break;
-      case KnownBlocks::PARAMATTR_BLOCK: name = "PARAMATTR_BLOCK"; break;
-      case KnownBlocks::PARAMATTR_GROUP_BLOCK: name = "PARAMATTR_GROUP_BLOCK"; break;
-      case KnownBlocks::CONSTANTS_BLOCK: name = "CONSTANTS_BLOCK"; break;
-      case KnownBlocks::FUNCTION_BLOCK: name = "FUNCTION_BLOCK"; break;
-      case KnownBlocks::TYPE_SYMTAB_BLOCK: name = "TYPE_SYMTAB_BLOCK"; break;
-      case KnownBlocks::VALUE_SYMTAB_BLOCK: name = "VALUE_SYMTAB_BLOCK"; break;
-      case KnownBlocks::METADATA_BLOCK: name = "METADATA_BLOCK"; break;
-      case KnownBlocks::METADATA_ATTACHMENT: name = "METADATA_ATTACHMENT"; break;
-      case KnownBlocks::TYPE_BLOCK: name = "TYPE_BLOCK"; break;
-      default: break;
-    }
-  }
-  else
-  {
 #define STRINGISE_RECORD(a) \
   case decltype(code)::a: name = #a; break;
 
-    // GetCodeName in BitcodeAnalyzer.cpp
-    switch(KnownBlocks(parentBlock))
+  // GetCodeName in BitcodeAnalyzer.cpp
+  switch(KnownBlocks(blockID))
+  {
+    case KnownBlocks::BLOCKINFO:
     {
-      case KnownBlocks::MODULE_BLOCK:
+      switch(recordID)
       {
-        ModuleRecord code = ModuleRecord(block.id);
-        switch(code)
-        {
-          STRINGISE_RECORD(VERSION);
-          STRINGISE_RECORD(TRIPLE);
-          STRINGISE_RECORD(DATALAYOUT);
-          STRINGISE_RECORD(FUNCTION);
-          default: break;
-        }
-        break;
+        case 1: name = "SETBID"; break;
+        case 2: name = "BLOCKNAME"; break;
+        case 3: name = "SETRECORDNAME"; break;
+        default: break;
       }
-      case KnownBlocks::PARAMATTR_BLOCK:
-      case KnownBlocks::PARAMATTR_GROUP_BLOCK: name = "ENTRY"; break;
-      case KnownBlocks::CONSTANTS_BLOCK:
+      break;
+    }
+    case KnownBlocks::MODULE_BLOCK:
+    {
+      ModuleRecord code = ModuleRecord(recordID);
+      switch(code)
       {
-        ConstantsRecord code = ConstantsRecord(block.id);
-        switch(code)
-        {
-          STRINGISE_RECORD(SETTYPE);
-          STRINGISE_RECORD(UNDEF);
-          STRINGISE_RECORD(INTEGER);
-          STRINGISE_RECORD(WIDE_INTEGER);
-          STRINGISE_RECORD(FLOAT);
-          STRINGISE_RECORD(AGGREGATE);
-          STRINGISE_RECORD(STRING);
-          STRINGISE_RECORD(DATA);
-          case ConstantsRecord::CONST_NULL: name = "NULL"; break;
-          default: break;
-        }
-        break;
+        STRINGISE_RECORD(VERSION);
+        STRINGISE_RECORD(TRIPLE);
+        STRINGISE_RECORD(DATALAYOUT);
+        STRINGISE_RECORD(FUNCTION);
+        default: break;
       }
-      case KnownBlocks::FUNCTION_BLOCK:
+      break;
+    }
+    case KnownBlocks::PARAMATTR_BLOCK:
+    case KnownBlocks::PARAMATTR_GROUP_BLOCK: name = "ENTRY"; break;
+    case KnownBlocks::CONSTANTS_BLOCK:
+    {
+      ConstantsRecord code = ConstantsRecord(recordID);
+      switch(code)
       {
-        FunctionRecord code = FunctionRecord(block.id);
-        switch(code)
-        {
-          STRINGISE_RECORD(DECLAREBLOCKS);
-          STRINGISE_RECORD(INST_BINOP);
-          STRINGISE_RECORD(INST_CAST);
-          STRINGISE_RECORD(INST_GEP_OLD);
-          STRINGISE_RECORD(INST_SELECT);
-          STRINGISE_RECORD(INST_EXTRACTELT);
-          STRINGISE_RECORD(INST_INSERTELT);
-          STRINGISE_RECORD(INST_SHUFFLEVEC);
-          STRINGISE_RECORD(INST_CMP);
-          STRINGISE_RECORD(INST_RET);
-          STRINGISE_RECORD(INST_BR);
-          STRINGISE_RECORD(INST_SWITCH);
-          STRINGISE_RECORD(INST_INVOKE);
-          STRINGISE_RECORD(INST_UNREACHABLE);
-          STRINGISE_RECORD(INST_PHI);
-          STRINGISE_RECORD(INST_ALLOCA);
-          STRINGISE_RECORD(INST_LOAD);
-          STRINGISE_RECORD(INST_VAARG);
-          STRINGISE_RECORD(INST_STORE_OLD);
-          STRINGISE_RECORD(INST_EXTRACTVAL);
-          STRINGISE_RECORD(INST_INSERTVAL);
-          STRINGISE_RECORD(INST_CMP2);
-          STRINGISE_RECORD(INST_VSELECT);
-          STRINGISE_RECORD(INST_INBOUNDS_GEP_OLD);
-          STRINGISE_RECORD(INST_INDIRECTBR);
-          STRINGISE_RECORD(DEBUG_LOC_AGAIN);
-          STRINGISE_RECORD(INST_CALL);
-          STRINGISE_RECORD(DEBUG_LOC);
-          STRINGISE_RECORD(INST_FENCE);
-          STRINGISE_RECORD(INST_CMPXCHG_OLD);
-          STRINGISE_RECORD(INST_ATOMICRMW);
-          STRINGISE_RECORD(INST_RESUME);
-          STRINGISE_RECORD(INST_LANDINGPAD_OLD);
-          STRINGISE_RECORD(INST_LOADATOMIC);
-          STRINGISE_RECORD(INST_STOREATOMIC_OLD);
-          STRINGISE_RECORD(INST_GEP);
-          STRINGISE_RECORD(INST_STORE);
-          STRINGISE_RECORD(INST_STOREATOMIC);
-          STRINGISE_RECORD(INST_CMPXCHG);
-          STRINGISE_RECORD(INST_LANDINGPAD);
-          STRINGISE_RECORD(INST_CLEANUPRET);
-          STRINGISE_RECORD(INST_CATCHRET);
-          STRINGISE_RECORD(INST_CATCHPAD);
-          STRINGISE_RECORD(INST_CLEANUPPAD);
-          STRINGISE_RECORD(INST_CATCHSWITCH);
-          STRINGISE_RECORD(OPERAND_BUNDLE);
-          STRINGISE_RECORD(INST_UNOP);
-          STRINGISE_RECORD(INST_CALLBR);
-          default: break;
-        }
-        break;
+        STRINGISE_RECORD(SETTYPE);
+        STRINGISE_RECORD(UNDEF);
+        STRINGISE_RECORD(INTEGER);
+        STRINGISE_RECORD(WIDE_INTEGER);
+        STRINGISE_RECORD(FLOAT);
+        STRINGISE_RECORD(AGGREGATE);
+        STRINGISE_RECORD(STRING);
+        STRINGISE_RECORD(DATA);
+        case ConstantsRecord::CONST_NULL: name = "NULL"; break;
+        default: break;
       }
-      case KnownBlocks::VALUE_SYMTAB_BLOCK:
+      break;
+    }
+    case KnownBlocks::FUNCTION_BLOCK:
+    {
+      FunctionRecord code = FunctionRecord(recordID);
+      switch(code)
       {
-        ValueSymtabRecord code = ValueSymtabRecord(block.id);
-        switch(code)
-        {
-          STRINGISE_RECORD(ENTRY);
-          STRINGISE_RECORD(BBENTRY);
-          STRINGISE_RECORD(FNENTRY);
-          STRINGISE_RECORD(COMBINED_ENTRY);
-          default: break;
-        }
-        break;
+        STRINGISE_RECORD(DECLAREBLOCKS);
+        STRINGISE_RECORD(INST_BINOP);
+        STRINGISE_RECORD(INST_CAST);
+        STRINGISE_RECORD(INST_GEP_OLD);
+        STRINGISE_RECORD(INST_SELECT);
+        STRINGISE_RECORD(INST_EXTRACTELT);
+        STRINGISE_RECORD(INST_INSERTELT);
+        STRINGISE_RECORD(INST_SHUFFLEVEC);
+        STRINGISE_RECORD(INST_CMP);
+        STRINGISE_RECORD(INST_RET);
+        STRINGISE_RECORD(INST_BR);
+        STRINGISE_RECORD(INST_SWITCH);
+        STRINGISE_RECORD(INST_INVOKE);
+        STRINGISE_RECORD(INST_UNREACHABLE);
+        STRINGISE_RECORD(INST_PHI);
+        STRINGISE_RECORD(INST_ALLOCA);
+        STRINGISE_RECORD(INST_LOAD);
+        STRINGISE_RECORD(INST_VAARG);
+        STRINGISE_RECORD(INST_STORE_OLD);
+        STRINGISE_RECORD(INST_EXTRACTVAL);
+        STRINGISE_RECORD(INST_INSERTVAL);
+        STRINGISE_RECORD(INST_CMP2);
+        STRINGISE_RECORD(INST_VSELECT);
+        STRINGISE_RECORD(INST_INBOUNDS_GEP_OLD);
+        STRINGISE_RECORD(INST_INDIRECTBR);
+        STRINGISE_RECORD(DEBUG_LOC_AGAIN);
+        STRINGISE_RECORD(INST_CALL);
+        STRINGISE_RECORD(DEBUG_LOC);
+        STRINGISE_RECORD(INST_FENCE);
+        STRINGISE_RECORD(INST_CMPXCHG_OLD);
+        STRINGISE_RECORD(INST_ATOMICRMW);
+        STRINGISE_RECORD(INST_RESUME);
+        STRINGISE_RECORD(INST_LANDINGPAD_OLD);
+        STRINGISE_RECORD(INST_LOADATOMIC);
+        STRINGISE_RECORD(INST_STOREATOMIC_OLD);
+        STRINGISE_RECORD(INST_GEP);
+        STRINGISE_RECORD(INST_STORE);
+        STRINGISE_RECORD(INST_STOREATOMIC);
+        STRINGISE_RECORD(INST_CMPXCHG);
+        STRINGISE_RECORD(INST_LANDINGPAD);
+        STRINGISE_RECORD(INST_CLEANUPRET);
+        STRINGISE_RECORD(INST_CATCHRET);
+        STRINGISE_RECORD(INST_CATCHPAD);
+        STRINGISE_RECORD(INST_CLEANUPPAD);
+        STRINGISE_RECORD(INST_CATCHSWITCH);
+        STRINGISE_RECORD(OPERAND_BUNDLE);
+        STRINGISE_RECORD(INST_UNOP);
+        STRINGISE_RECORD(INST_CALLBR);
+        default: break;
+      }
+      break;
+    }
+    case KnownBlocks::VALUE_SYMTAB_BLOCK:
+    {
+      ValueSymtabRecord code = ValueSymtabRecord(recordID);
+      switch(code)
+      {
+        STRINGISE_RECORD(ENTRY);
+        STRINGISE_RECORD(BBENTRY);
+        STRINGISE_RECORD(FNENTRY);
+        STRINGISE_RECORD(COMBINED_ENTRY);
+        default: break;
       }
-      case KnownBlocks::METADATA_BLOCK:
+      break;
+    }
+    case KnownBlocks::METADATA_BLOCK:
+    {
+      MetaDataRecord code = MetaDataRecord(recordID);
+      switch(code)
       {
-        MetaDataRecord code = MetaDataRecord(block.id);
-        switch(code)
-        {
-          STRINGISE_RECORD(STRING_OLD);
-          STRINGISE_RECORD(VALUE);
-          STRINGISE_RECORD(NODE);
-          STRINGISE_RECORD(NAME);
-          STRINGISE_RECORD(DISTINCT_NODE);
-          STRINGISE_RECORD(KIND);
-          STRINGISE_RECORD(LOCATION);
-          STRINGISE_RECORD(OLD_NODE);
-          STRINGISE_RECORD(OLD_FN_NODE);
-          STRINGISE_RECORD(NAMED_NODE);
-          STRINGISE_RECORD(ATTACHMENT);
-          STRINGISE_RECORD(GENERIC_DEBUG);
-          STRINGISE_RECORD(SUBRANGE);
-          STRINGISE_RECORD(ENUMERATOR);
-          STRINGISE_RECORD(BASIC_TYPE);
-          STRINGISE_RECORD(FILE);
-          STRINGISE_RECORD(DERIVED_TYPE);
-          STRINGISE_RECORD(COMPOSITE_TYPE);
-          STRINGISE_RECORD(SUBROUTINE_TYPE);
-          STRINGISE_RECORD(COMPILE_UNIT);
-          STRINGISE_RECORD(SUBPROGRAM);
-          STRINGISE_RECORD(LEXICAL_BLOCK);
-          STRINGISE_RECORD(LEXICAL_BLOCK_FILE);
-          STRINGISE_RECORD(NAMESPACE);
-          STRINGISE_RECORD(TEMPLATE_TYPE);
-          STRINGISE_RECORD(TEMPLATE_VALUE);
-          STRINGISE_RECORD(GLOBAL_VAR);
-          STRINGISE_RECORD(LOCAL_VAR);
-          STRINGISE_RECORD(EXPRESSION);
-          STRINGISE_RECORD(OBJC_PROPERTY);
-          STRINGISE_RECORD(IMPORTED_ENTITY);
-          STRINGISE_RECORD(MODULE);
-          STRINGISE_RECORD(MACRO);
-          STRINGISE_RECORD(MACRO_FILE);
-          STRINGISE_RECORD(STRINGS);
-          STRINGISE_RECORD(GLOBAL_DECL_ATTACHMENT);
-          STRINGISE_RECORD(GLOBAL_VAR_EXPR);
-          STRINGISE_RECORD(INDEX_OFFSET);
-          STRINGISE_RECORD(INDEX);
-          STRINGISE_RECORD(LABEL);
-          STRINGISE_RECORD(COMMON_BLOCK);
-          default: break;
-        }
-        break;
+        STRINGISE_RECORD(STRING_OLD);
+        STRINGISE_RECORD(VALUE);
+        STRINGISE_RECORD(NODE);
+        STRINGISE_RECORD(NAME);
+        STRINGISE_RECORD(DISTINCT_NODE);
+        STRINGISE_RECORD(KIND);
+        STRINGISE_RECORD(LOCATION);
+        STRINGISE_RECORD(OLD_NODE);
+        STRINGISE_RECORD(OLD_FN_NODE);
+        STRINGISE_RECORD(NAMED_NODE);
+        STRINGISE_RECORD(ATTACHMENT);
+        STRINGISE_RECORD(GENERIC_DEBUG);
+        STRINGISE_RECORD(SUBRANGE);
+        STRINGISE_RECORD(ENUMERATOR);
+        STRINGISE_RECORD(BASIC_TYPE);
+        STRINGISE_RECORD(FILE);
+        STRINGISE_RECORD(DERIVED_TYPE);
+        STRINGISE_RECORD(COMPOSITE_TYPE);
+        STRINGISE_RECORD(SUBROUTINE_TYPE);
+        STRINGISE_RECORD(COMPILE_UNIT);
+        STRINGISE_RECORD(SUBPROGRAM);
+        STRINGISE_RECORD(LEXICAL_BLOCK);
+        STRINGISE_RECORD(LEXICAL_BLOCK_FILE);
+        STRINGISE_RECORD(NAMESPACE);
+        STRINGISE_RECORD(TEMPLATE_TYPE);
+        STRINGISE_RECORD(TEMPLATE_VALUE);
+        STRINGISE_RECORD(GLOBAL_VAR);
+        STRINGISE_RECORD(LOCAL_VAR);
+        STRINGISE_RECORD(EXPRESSION);
+        STRINGISE_RECORD(OBJC_PROPERTY);
+        STRINGISE_RECORD(IMPORTED_ENTITY);
+        STRINGISE_RECORD(MODULE);
+        STRINGISE_RECORD(MACRO);
+        STRINGISE_RECORD(MACRO_FILE);
+        STRINGISE_RECORD(STRINGS);
+        STRINGISE_RECORD(GLOBAL_DECL_ATTACHMENT);
+        STRINGISE_RECORD(GLOBAL_VAR_EXPR);
+        STRINGISE_RECORD(INDEX_OFFSET);
+        STRINGISE_RECORD(INDEX);
+        STRINGISE_RECORD(LABEL);
+        STRINGISE_RECORD(COMMON_BLOCK);
+        default: break;
       }
-      case KnownBlocks::TYPE_BLOCK:
+      break;
+    }
+    case KnownBlocks::TYPE_BLOCK:
+    {
+      TypeRecord code = TypeRecord(recordID);
+      switch(code)
       {
-        TypeRecord code = TypeRecord(block.id);
-        switch(code)
-        {
-          STRINGISE_RECORD(NUMENTRY);
-          STRINGISE_RECORD(VOID);
-          STRINGISE_RECORD(FLOAT);
-          STRINGISE_RECORD(DOUBLE);
-          STRINGISE_RECORD(LABEL);
-          STRINGISE_RECORD(OPAQUE);
-          STRINGISE_RECORD(INTEGER);
-          STRINGISE_RECORD(POINTER);
-          STRINGISE_RECORD(FUNCTION_OLD);
-          STRINGISE_RECORD(HALF);
-          STRINGISE_RECORD(ARRAY);
-          STRINGISE_RECORD(VECTOR);
-          STRINGISE_RECORD(METADATA);
-          STRINGISE_RECORD(STRUCT_ANON);
-          STRINGISE_RECORD(STRUCT_NAME);
-          STRINGISE_RECORD(STRUCT_NAMED);
-          STRINGISE_RECORD(FUNCTION);
-          STRINGISE_RECORD(TOKEN);
-          default: break;
-        }
-        break;
+        STRINGISE_RECORD(NUMENTRY);
+        STRINGISE_RECORD(VOID);
+        STRINGISE_RECORD(FLOAT);
+        STRINGISE_RECORD(DOUBLE);
+        STRINGISE_RECORD(LABEL);
+        STRINGISE_RECORD(OPAQUE);
+        STRINGISE_RECORD(INTEGER);
+        STRINGISE_RECORD(POINTER);
+        STRINGISE_RECORD(FUNCTION_OLD);
+        STRINGISE_RECORD(HALF);
+        STRINGISE_RECORD(ARRAY);
+        STRINGISE_RECORD(VECTOR);
+        STRINGISE_RECORD(METADATA);
+        STRINGISE_RECORD(STRUCT_ANON);
+        STRINGISE_RECORD(STRUCT_NAME);
+        STRINGISE_RECORD(STRUCT_NAMED);
+        STRINGISE_RECORD(FUNCTION);
+        STRINGISE_RECORD(TOKEN);
+        default: break;
       }
+      break;
     }
+    default: break;
   }
 
+  return name;
+}
+
+static void printName(Output &out, uint32_t parentBlock, const LLVMBC::BlockOrRecord &block)
+{
+  const char *name = block.IsBlock() ? BlockName(block.id) : RecordName(parentBlock, block.id);
+
   // fallback
   if(name)
   {
-    printf("%s", name);
+    out.Printf("%s", name);
   }
   else
   {
     if(block.IsBlock())
-      printf("BLOCK%d", block.id);
+      out.Printf("BLOCK%d", block.id);
     else
-      printf("RECORD%d", block.id);
+      out.Printf("RECORD%d", block.id);
   }
 }
 
-static void dumpRecord(uint32_t parentBlock, const LLVMBC::BlockOrRecord &record, int indent)
+static void dumpRecord(Output &out, uint32_t parentBlock, const LLVMBC::BlockOrRecord &record,
+                       int indent)
 {
-  printf("%*s", indent, "");
-  printf("<");
-  printName(parentBlock, record);
+  out.Printf("%*s", indent, "");
+  out.Printf("<");
+  printName(out, parentBlock, record);
 
   if(KnownBlocks(parentBlock) == KnownBlocks::METADATA_BLOCK &&
      (MetaDataRecord(record.id) == MetaDataRecord::STRING_OLD ||
       MetaDataRecord(record.id) == MetaDataRecord::NAME ||
       MetaDataRecord(record.id) == MetaDataRecord::KIND))
   {
-    printf(" record string = '");
+    out.Printf(" record string = '");
     for(size_t i = 0; i < record.ops.size(); i++)
     {
       if(record.ops[i] == '\'')
-        printf("\\'");
+        out.Printf("\\'");
       else if(record.ops[i] == '\\')
-        printf("\\\\");
+        out.Printf("\\\\");
       else if(isprint(char(record.ops[i])))
-        printf("%c", char(record.ops[i]));
+        out.Printf("%c", char(record.ops[i]));
       else
-        printf("\\x%02x", (uint32_t)record.ops[i]);
+        out.Printf("\\x%02x", (uint32_t)record.ops[i]);
     }
-    printf("'");
+    out.Printf("'");
   }
   else
   {
     for(size_t i = 0; i < record.ops.size(); i++)
-      printf(" op%u=%llu", (uint32_t)i, record.ops[i]);
+      out.Printf(" op%u=%llu", (uint32_t)i, (unsigned long long)record.ops[i]);
   }
 
   if(record.blob)
-    printf(" with blob of %u bytes", (uint32_t)record.blobLength);
+    out.Printf(" with blob of %u bytes", (uint32_t)record.blobLength);
 
-  printf("/>\n");
+  out.Printf("/>\n");
 }
 
-static void dumpBlock(const LLVMBC::BlockOrRecord &block, int indent)
+static void dumpBlock(Output &out, const LLVMBC::BlockOrRecord &block, int indent)
 {
-  printf("%*s", indent, "");
+  out.Printf("%*s", indent, "");
   if(block.children.empty() || KnownBlocks(block.id) == KnownBlocks::BLOCKINFO)
   {
-    printf("<");
-    printName(0, block);
-    printf("/>\n");
+    out.Printf("<");
+    printName(out, 0, block);
+    out.Printf("/>\n");
     return;
   }
 
-  printf("<");
-  printName(0, block);
-  printf(" NumWords=%u>\n", block.blockDwordLength);
+  out.Printf("<");
+  printName(out, 0, block);
+  out.Printf(" NumWords=%u>\n", block.blockDwordLength);
 
   for(const LLVMBC::BlockOrRecord &child : block.children)
   {
     if(child.IsBlock())
-      dumpBlock(child, indent + 2);
+      dumpBlock(out, child, indent + 2);
     else
-      dumpRecord(block.id, child, indent + 2);
+      dumpRecord(out, block.id, child, indent + 2);
   }
 
-  printf("%*s", indent, "");
-  printf("</");
-  printName(0, block);
-  printf(">\n");
+  out.Printf("%*s", indent, "");
+  out.Printf("</");
+  printName(out, 0, block);
+  out.Printf(">\n");
 }
 
-static std::string getString(const std::vector<uint64_t> &ops, size_t i = 0)
+static std::string getString(const LLVMBC::OpList &ops, size_t i = 0)
 {
   std::string ret;
   ret.reserve(ops.size());
@@ -553,36 +406,226 @@ static std::string getString(const std::vector<uint64_t> &ops, size_t i = 0)
   return ret;
 }
 
-Program::Program(const void *bytes, size_t length)
+const char *ShaderTypeName(uint16_t programType)
+{
+  const char *shaderName[] = {
+      "Pixel",      "Vertex",  "Geometry",      "Hull",         "Domain",
+      "Compute",    "Library", "RayGeneration", "Intersection", "AnyHit",
+      "ClosestHit", "Miss",    "Callable",      "Mesh",         "Amplification",
+  };
+
+  if(programType < sizeof(shaderName) / sizeof(shaderName[0]))
+    return shaderName[programType];
+
+  return "Unknown";
+}
+
+// blocks that a function block can contain, so functions need to be looked inside for them
+static bool canNestInFunction(uint32_t blockID)
 {
+  switch(KnownBlocks(blockID))
+  {
+    case KnownBlocks::BLOCKINFO:
+    case KnownBlocks::MODULE_BLOCK:
+    case KnownBlocks::PARAMATTR_BLOCK:
+    case KnownBlocks::PARAMATTR_GROUP_BLOCK:
+    case KnownBlocks::FUNCTION_BLOCK:
+    case KnownBlocks::TYPE_SYMTAB_BLOCK:
+    case KnownBlocks::TYPE_BLOCK: return false;
+    default: break;
+  }
+
+  return true;
+}
+
+// applies a ProgramFilter during one decode. Function blocks are counted as they're entered, in
+// the same order they're dumped.
+class ProgramDecodeFilter : public LLVMBC::DecodeFilter
+{
+public:
+  ProgramDecodeFilter(const ProgramFilter &filter) : m_Filter(filter)
+  {
+    for(uint32_t id : m_Filter.blocks)
+      if(canNestInFunction(id) && !m_Filter.moduleLevel)
+        m_DescendFunctions = true;
+  }
+
+  LLVMBC::BlockAction EnterBlock(uint32_t blockID, uint32_t parentID,
+                                 LLVMBC::BlockAction parentAction) override
+  {
+    using LLVMBC::BlockAction;
+
+    const bool scoped = (m_Filter.function != ~0U);
+    const bool wanted = m_Filter.blocks.empty() || contains(m_Filter.blocks, blockID);
+
+    if(KnownBlocks(blockID) == KnownBlocks::FUNCTION_BLOCK)
+    {
+      const uint32_t index = m_NumFunctions++;
+
+      if(scoped)
+      {
+        if(index != m_Filter.function)
+          return BlockAction::Skip;
+        return wanted ? BlockAction::Decode : BlockAction::Descend;
+      }
+
+      if(wanted || parentAction == BlockAction::Decode)
+        return BlockAction::Decode;
+      return m_DescendFunctions ? BlockAction::Descend : BlockAction::Skip;
+    }
+
+    if(parentAction == BlockAction::Decode)
+      return BlockAction::Decode;
+
+    // the module is always entered, to find what's wanted inside it
+    if(parentID == ~0U)
+      return wanted && !scoped ? BlockAction::Decode : BlockAction::Descend;
+
+    // with a function selected, nothing outside of it is wanted
+    if(scoped && KnownBlocks(parentID) != KnownBlocks::FUNCTION_BLOCK)
+      return BlockAction::Skip;
+
+    return wanted ? BlockAction::Decode : BlockAction::Skip;
+  }
+
+  bool KeepRecord(uint32_t blockID, uint32_t recordID) override
+  {
+    // codes mean something different in each block, so only apply them to the blocks asked for
+    if(m_Filter.records.empty())
+      return true;
+    if(!m_Filter.blocks.empty() && !contains(m_Filter.blocks, blockID))
+      return true;
+    return contains(m_Filter.records, recordID);
+  }
+
+private:
+  static bool contains(const std::vector<uint32_t> &ids, uint32_t id)
+  {
+    return std::find(ids.begin(), ids.end(), id) != ids.end();
+  }
+
+  const ProgramFilter &m_Filter;
+  bool m_DescendFunctions = false;
+  uint32_t m_NumFunctions = 0;
+};
+
+Program::Program(const DXBC::Container &container, LLVMBC::BitcodeStats *stats,
+                 const ProgramFilter *filter)
+{
+  const DXBCChunkHeader *dxil = container.FindBestDXILChunk();
+
+  if(!dxil)
+  {
+    m_Status.error = LLVMBC::DecodeError::InvalidContainer;
+    return;
+  }
+
+  const DXBCChunkHeader *chunk = container.FindChunk(MAKE_FOURCC('S', 'F', 'I', '0'));
+  if(chunk && chunk->dataLength >= sizeof(m_Features))
+    memcpy(&m_Features, chunk + 1, sizeof(m_Features));
+
+  chunk = container.FindChunk(MAKE_FOURCC('I', 'L', 'D', 'N'));
+  if(chunk)
+    m_DebugName = DebugName(chunk + 1, chunk->dataLength).name;
+
+  Decode(dxil + 1, dxil->dataLength, stats, filter);
+}
+
+Program::Program(const void *bytes, size_t length, LLVMBC::BitcodeStats *stats,
+                 const ProgramFilter *filter)
+{
+  Decode(bytes, length, stats, filter);
+}
+
+void Program::Decode(const void *bytes, size_t length, LLVMBC::BitcodeStats *stats,
+                     const ProgramFilter *filter)
+{
+  TRACE_SCOPE("Program::Decode");
+
   const byte *ptr = (const byte *)bytes;
   const ProgramHeader *header = (const ProgramHeader *)ptr;
-  assert(header->DxilMagic == MAKE_FOURCC('D', 'X', 'I', 'L'));
+
+  // the bitcode offset is relative to the magic, and it must all be in bounds
+  const size_t magicOffset = offsetof(ProgramHeader, DxilMagic);
+  if(length < sizeof(ProgramHeader) || header->DxilMagic != MAKE_FOURCC('D', 'X', 'I', 'L') ||
+     header->BitcodeOffset > length - magicOffset ||
+     header->BitcodeSize > length - magicOffset - header->BitcodeOffset)
+  {
+    m_Status.error = LLVMBC::DecodeError::InvalidContainer;
+    return;
+  }
+
+  m_Header = header;
+  m_ShaderType = header->ProgramType;
+  m_Filtered = filter != NULL;
+  m_ShaderModelMajor = (header->ProgramVersion & 0xf0) >> 4;
+  m_ShaderModelMinor = header->ProgramVersion & 0xf;
 
   const byte *bitcode = ((const byte *)&header->DxilMagic) + header->BitcodeOffset;
-  assert(bitcode + header->BitcodeSize == ptr + length);
 
   LLVMBC::BitcodeReader reader(bitcode, header->BitcodeSize);
+  reader.SetStats(stats);
 
-  LLVMBC::BlockOrRecord root = reader.ReadToplevelBlock();
+  const ProgramFilter noFilter;
+  ProgramDecodeFilter decodeFilter(filter ? *filter : noFilter);
+  if(filter)
+    reader.SetFilter(&decodeFilter);
 
-  // the top-level block should be MODULE_BLOCK
-  assert(KnownBlocks(root.id) == KnownBlocks::MODULE_BLOCK);
+  m_Root = reader.ReadToplevelBlock();
 
-  // we should have consumed all bits, only one top-level block
-  assert(reader.AtEndOfStream());
+  m_Status = reader.GetStatus();
+  if(m_Status.Failed())
+  {
+    m_Root = LLVMBC::BlockOrRecord();
+    return;
+  }
 
-  const char *shaderName[] = {
-      "Pixel",      "Vertex",  "Geometry",      "Hull",         "Domain",
-      "Compute",    "Library", "RayGeneration", "Intersection", "AnyHit",
-      "ClosestHit", "Miss",    "Callable",      "Mesh",         "Amplification",
-  };
+  // the top-level block should be MODULE_BLOCK, and we should have consumed all bits with only one
+  // top-level block
+  if(KnownBlocks(m_Root.id) != KnownBlocks::MODULE_BLOCK || !reader.AtEndOfStream())
+  {
+    m_Status.error = LLVMBC::DecodeError::InvalidModule;
+    m_Root = LLVMBC::BlockOrRecord();
+    return;
+  }
+}
+
+bool Program::Dump(Output &out, DumpFormat format, ThreadPool *pool) const
+{
+  if(m_Status.Failed())
+    return false;
 
-  printf("; %s Shader, compiled under SM%u.%u\n", shaderName[header->ProgramType],
-         (header->ProgramVersion & 0xf0) >> 4, header->ProgramVersion & 0xf);
+  TRACE_SCOPE("Program::Dump");
 
-  if(debug_name)
-    printf("; shader debug name: %s\n;\n", debug_name->name);
+  switch(format)
+  {
+    case DumpFormat::Text: DumpText(out); return true;
+    case DumpFormat::JSON: WriteJSON(*this, out); return true;
+    case DumpFormat::Binary: return WriteBinary(*this, out);
+    case DumpFormat::Disassembly:
+    {
+      // anything filtered out would leave holes in the value numbering
+      if(m_Filtered)
+        return false;
+
+      Module module(*this, pool);
+      Disassemble(module, out, pool);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void Program::DumpText(Output &out) const
+{
+  const LLVMBC::BlockOrRecord &root = m_Root;
+
+  out.Printf("; %s Shader, compiled under SM%u.%u\n", ShaderTypeName(m_ShaderType),
+             m_ShaderModelMajor, m_ShaderModelMinor);
+
+  if(m_DebugName)
+    out.Printf("; shader debug name: %s\n;\n", m_DebugName);
 
   // Input signature and Output signature haven't changed.
   // Pipeline Runtime Information we have decoded just not implemented here
@@ -591,27 +634,31 @@ Program::Program(const void *bytes, size_t length)
 
 #define IS_KNOWN(val, KnownID) (decltype(KnownID)(val) == KnownID)
 
-  const LLVMBC::BlockOrRecord *metadata = NULL;
-
   for(const LLVMBC::BlockOrRecord &rootblock : root.children)
   {
     if(rootblock.IsRecord() && IS_KNOWN(rootblock.id, ModuleRecord::TRIPLE))
     {
-      printf("target triple = \"%s\"\n", getString(rootblock.ops).c_str());
+      out.Printf("target triple = \"%s\"\n", getString(rootblock.ops).c_str());
     }
     else if(rootblock.IsRecord() && IS_KNOWN(rootblock.id, ModuleRecord::DATALAYOUT))
     {
-      printf("target datalayout = \"%s\"\n", getString(rootblock.ops).c_str());
+      out.Printf("target datalayout = \"%s\"\n", getString(rootblock.ops).c_str());
     }
     else if(rootblock.IsBlock() && IS_KNOWN(rootblock.id, KnownBlocks::VALUE_SYMTAB_BLOCK))
     {
       for(const LLVMBC::BlockOrRecord &symtab : rootblock.children)
       {
-        printf("function %llu is \"%s\"\n", symtab.ops[0], getString(symtab.ops, 1).c_str());
+        if(symtab.ops.empty())
+          continue;
+
+        out.Printf("function %llu is \"%s\"\n", (unsigned long long)symtab.ops[0],
+                   getString(symtab.ops, 1).c_str());
       }
     }
     else if(rootblock.IsBlock() && IS_KNOWN(rootblock.id, KnownBlocks::METADATA_BLOCK))
     {
+      TRACE_SCOPE("Dump metadata");
+
       for(size_t i = 0; i < rootblock.children.size(); i++)
       {
         const LLVMBC::BlockOrRecord &meta = rootblock.children[i];
@@ -619,175 +666,276 @@ Program::Program(const void *bytes, size_t length)
         {
           std::string metaName = getString(meta.ops);
           i++;
+          if(i >= rootblock.children.size() ||
+             !IS_KNOWN(rootblock.children[i].id, MetaDataRecord::NAMED_NODE))
+          {
+            out.Printf("!%s = <missing named node>\n", metaName.c_str());
+            continue;
+          }
           const LLVMBC::BlockOrRecord &namedNode = rootblock.children[i];
-          assert(IS_KNOWN(namedNode.id, MetaDataRecord::NAMED_NODE));
 
-          printf("!%s = !{", metaName.c_str());
+          out.Printf("!%s = !{", metaName.c_str());
           bool first = true;
           for(uint64_t op : namedNode.ops)
           {
             if(!first)
-              printf(", ");
-            printf("%llu", op);
+              out.Printf(", ");
+            out.Printf("%llu", (unsigned long long)op);
             first = false;
           }
-          printf("}\n");
+          out.Printf("}\n");
         }
         else
         {
-          if(IS_KNOWN(meta.id, MetaDataRecord::KIND))
+          if(IS_KNOWN(meta.id, MetaDataRecord::KIND) && !meta.ops.empty())
           {
-            printf("Kind[%llu] = %s\n", meta.ops[0], getString(meta.ops, 1).c_str());
+            out.Printf("Kind[%llu] = %s\n", (unsigned long long)meta.ops[0],
+                       getString(meta.ops, 1).c_str());
             continue;
           }
 
-          printf("!%u = ", (uint32_t)i);
+          out.Printf("!%u = ", (uint32_t)i);
 
           auto getMetaString = [&rootblock](uint64_t id) -> std::string {
+            if(id > rootblock.children.size())
+              return "<invalid>";
             return id ? getString(rootblock.children[id - 1].ops) : "NULL";
           };
 
           if(IS_KNOWN(meta.id, MetaDataRecord::STRING_OLD))
           {
-            printf("\"%s\"", getString(meta.ops).c_str());
+            out.Printf("\"%s\"", getString(meta.ops).c_str());
           }
-          else if(IS_KNOWN(meta.id, MetaDataRecord::FILE))
+          else if(IS_KNOWN(meta.id, MetaDataRecord::FILE) && meta.ops.size() >= 3)
           {
             if(meta.ops[0])
-              printf("distinct ");
+              out.Printf("distinct ");
 
-            printf("!DIFile(");
-            printf("filename: \"%s\"", getMetaString(meta.ops[1]).c_str());
-            printf(", directory: \"%s\"", getMetaString(meta.ops[2]).c_str());
-            printf(")");
+            out.Printf("!DIFile(");
+            out.Printf("filename: \"%s\"", getMetaString(meta.ops[1]).c_str());
+            out.Printf(", directory: \"%s\"", getMetaString(meta.ops[2]).c_str());
+            out.Printf(")");
           }
           else if(IS_KNOWN(meta.id, MetaDataRecord::NODE) ||
                   IS_KNOWN(meta.id, MetaDataRecord::DISTINCT_NODE))
           {
             if(IS_KNOWN(meta.id, MetaDataRecord::DISTINCT_NODE))
-              printf("distinct ");
+              out.Printf("distinct ");
 
-            printf("!{");
+            out.Printf("!{");
             bool first = true;
             for(uint64_t op : meta.ops)
             {
               if(!first)
-                printf(", ");
-              printf("!%llu", op - 1);
+                out.Printf(", ");
+              out.Printf("!%llu", (unsigned long long)(op - 1));
               first = false;
             }
-            printf("}");
+            out.Printf("}");
           }
           else if(IS_KNOWN(meta.id, MetaDataRecord::BASIC_TYPE))
           {
-            printf("!DIBasicType(");
-            printf(")");
+            out.Printf("!DIBasicType(");
+            out.Printf(")");
           }
           else if(IS_KNOWN(meta.id, MetaDataRecord::DERIVED_TYPE))
           {
-            printf("!DIDerivedType(");
-            printf(")");
+            out.Printf("!DIDerivedType(");
+            out.Printf(")");
           }
           else if(IS_KNOWN(meta.id, MetaDataRecord::COMPOSITE_TYPE))
           {
-            printf("!DICompositeType(");
-            printf(")");
+            out.Printf("!DICompositeType(");
+            out.Printf(")");
           }
           else if(IS_KNOWN(meta.id, MetaDataRecord::SUBROUTINE_TYPE))
           {
-            printf("!DISubroutineType(");
-            printf(")");
+            out.Printf("!DISubroutineType(");
+            out.Printf(")");
           }
           else if(IS_KNOWN(meta.id, MetaDataRecord::TEMPLATE_TYPE))
           {
-            printf("!DITemplateTypeParameter(");
-            printf(")");
+            out.Printf("!DITemplateTypeParameter(");
+            out.Printf(")");
           }
           else if(IS_KNOWN(meta.id, MetaDataRecord::TEMPLATE_VALUE))
           {
-            printf("!DITemplateValueParameter(");
-            printf(")");
+            out.Printf("!DITemplateValueParameter(");
+            out.Printf(")");
           }
           else if(IS_KNOWN(meta.id, MetaDataRecord::SUBPROGRAM))
           {
-            printf("!DISubprogram(");
-            printf(")");
+            out.Printf("!DISubprogram(");
+            out.Printf(")");
           }
           else if(IS_KNOWN(meta.id, MetaDataRecord::LOCATION))
           {
-            printf("!DILocation(");
-            printf(")");
+            out.Printf("!DILocation(");
+            out.Printf(")");
           }
           else if(IS_KNOWN(meta.id, MetaDataRecord::LOCAL_VAR))
           {
-            printf("!DILocalVariable(");
-            printf(")");
+            out.Printf("!DILocalVariable(");
+            out.Printf(")");
           }
-          else if(IS_KNOWN(meta.id, MetaDataRecord::VALUE))
+          else if(IS_KNOWN(meta.id, MetaDataRecord::VALUE) && meta.ops.size() >= 2)
           {
             // need to decode CONSTANTS_BLOCK and TYPE_BLOCK for this
-            printf("!{values[%llu] interpreted as types[%llu]}", meta.ops[1], meta.ops[0]);
+            out.Printf("!{values[%llu] interpreted as types[%llu]}",
+                       (unsigned long long)meta.ops[1], (unsigned long long)meta.ops[0]);
           }
           else if(IS_KNOWN(meta.id, MetaDataRecord::EXPRESSION))
           {
             // don't decode this yet
-            printf("!DIExpression(");
+            out.Printf("!DIExpression(");
             bool first = true;
             for(uint64_t op : meta.ops)
             {
               if(!first)
-                printf(", ");
-              printf("%llu", op);
+                out.Printf(", ");
+              out.Printf("%llu", (unsigned long long)op);
               first = false;
             }
-            printf(")");
+            out.Printf(")");
           }
-          else if(IS_KNOWN(meta.id, MetaDataRecord::COMPILE_UNIT))
+          else if(IS_KNOWN(meta.id, MetaDataRecord::COMPILE_UNIT) && meta.ops.size() >= 14)
           {
             // should be at least 14 parameters
-            assert(meta.ops.size() >= 14);
 
             // we expect it to be marked as distinct, but we'll always treat it that way
             if(meta.ops[0])
-              printf("distinct ");
+              out.Printf("distinct ");
             else
-              printf("distinct? ");
+              out.Printf("distinct? ");
 
-            printf("!DICompileUnit(");
+            out.Printf("!DICompileUnit(");
             {
-              printf("language: %s",
-                     meta.ops[1] == 0x4 ? "DW_LANG_C_plus_plus" : "DW_LANG_unknown");
-              printf(", file: !%llu", meta.ops[2] - 1);
-              printf(", producer: \"%s\"", getMetaString(meta.ops[3]).c_str());
-              printf(", isOptimized: %s", meta.ops[4] ? "true" : "false");
-              printf(", flags: \"%s\"", getMetaString(meta.ops[5]).c_str());
-              printf(", runtimeVersion: %llu", meta.ops[6]);
-              printf(", splitDebugFilename: \"%s\"", getMetaString(meta.ops[7]).c_str());
-              printf(", emissionKind: %llu", meta.ops[8]);
-              printf(", enums: !%llu", meta.ops[9] - 1);
-              printf(", retainedTypes: !%llu", meta.ops[10] - 1);
-              printf(", subprograms: !%llu", meta.ops[11] - 1);
-              printf(", globals: !%llu", meta.ops[12] - 1);
-              printf(", imports: !%llu", meta.ops[13] - 1);
+              out.Printf("language: %s",
+                         meta.ops[1] == 0x4 ? "DW_LANG_C_plus_plus" : "DW_LANG_unknown");
+              out.Printf(", file: !%llu", (unsigned long long)(meta.ops[2] - 1));
+              out.Printf(", producer: \"%s\"", getMetaString(meta.ops[3]).c_str());
+              out.Printf(", isOptimized: %s", meta.ops[4] ? "true" : "false");
+              out.Printf(", flags: \"%s\"", getMetaString(meta.ops[5]).c_str());
+              out.Printf(", runtimeVersion: %llu", (unsigned long long)meta.ops[6]);
+              out.Printf(", splitDebugFilename: \"%s\"", getMetaString(meta.ops[7]).c_str());
+              out.Printf(", emissionKind: %llu", (unsigned long long)meta.ops[8]);
+              out.Printf(", enums: !%llu", (unsigned long long)(meta.ops[9] - 1));
+              out.Printf(", retainedTypes: !%llu", (unsigned long long)(meta.ops[10] - 1));
+              out.Printf(", subprograms: !%llu", (unsigned long long)(meta.ops[11] - 1));
+              out.Printf(", globals: !%llu", (unsigned long long)(meta.ops[12] - 1));
+              out.Printf(", imports: !%llu", (unsigned long long)(meta.ops[13] - 1));
               if(meta.ops.size() >= 15)
-                printf(", dwoId: 0x%llu", meta.ops[14]);
+                out.Printf(", dwoId: 0x%llu", (unsigned long long)meta.ops[14]);
             }
-            printf(")");
+            out.Printf(")");
           }
           else
           {
-            assert(false && "unhandled metadata type");
+            // unhandled or malformed metadata type
+            out.Printf("<unhandled record %u>", meta.id);
           }
 
-          printf("\n");
+          out.Printf("\n");
         }
       }
     }
 
-    printf("\n");
+    out.Printf("\n");
+  }
+
+  TRACE_SCOPE("Dump blocks");
+
+  dumpBlock(out, root, 0);
+}
+
+static const char *builtinAbbrevName(size_t abbrevID)
+{
+  switch(abbrevID)
+  {
+    case 0: return "END_BLOCK";
+    case 1: return "ENTER_SUBBLOCK";
+    case 2: return "DEFINE_ABBREV";
+    case 3: return "UNABBREV_RECORD";
+    default: break;
   }
 
-  dumpBlock(root, 0);
+  return NULL;
+}
+
+void PrintStats(const LLVMBC::BitcodeStats &stats, Output &out)
+{
+  const double totalBits = stats.totalBits ? double(stats.totalBits) : 1.0;
+
+  out.Printf("Summary: %llu modules, %llu bits (%.1f bytes)\n",
+             (unsigned long long)stats.numModules, (unsigned long long)stats.totalBits,
+             double(stats.totalBits) / 8.0);
+
+  for(const auto &it : stats.blocks)
+  {
+    const uint32_t blockID = it.first;
+    const LLVMBC::BlockStats &block = it.second;
+
+    const char *blockName = BlockName(blockID);
+
+    out.Printf("\nBlock ID %u (%s):\n", blockID, blockName ? blockName : "unknown");
+    out.Printf("  Instances: %llu\n", (unsigned long long)block.count);
+    out.Printf("  Total size: %llu bits (%.1f bytes), %.2f%% of all modules\n",
+               (unsigned long long)block.bits, double(block.bits) / 8.0,
+               100.0 * double(block.bits) / totalBits);
+    if(block.count)
+      out.Printf("  Average size: %.1f bits\n", double(block.bits) / double(block.count));
+
+    if(!block.records.empty())
+    {
+      // most expensive first
+      std::vector<std::pair<uint32_t, LLVMBC::RecordStats>> records(block.records.begin(),
+                                                                    block.records.end());
+      std::stable_sort(records.begin(), records.end(),
+                       [](const std::pair<uint32_t, LLVMBC::RecordStats> &a,
+                          const std::pair<uint32_t, LLVMBC::RecordStats> &b) {
+                         return a.second.bits > b.second.bits;
+                       });
+
+      out.Printf("  Records:\n");
+      out.Printf("  %10s %12s %9s %8s %8s  %s\n", "Count", "Bits", "b/Rec", "% Abbrev", "Avg Ops",
+                 "Record");
+
+      for(const std::pair<uint32_t, LLVMBC::RecordStats> &rec : records)
+      {
+        const LLVMBC::RecordStats &r = rec.second;
+        const double count = r.count ? double(r.count) : 1.0;
+
+        out.Printf("  %10llu %12llu %9.1f %8.2f %8.2f  ", (unsigned long long)r.count,
+                   (unsigned long long)r.bits, double(r.bits) / count,
+                   100.0 * double(r.abbreviated) / count, double(r.numOps) / count);
+
+        const char *recordName = RecordName(blockID, rec.first);
+        if(recordName)
+          out.Printf("%s\n", recordName);
+        else
+          out.Printf("RECORD%u\n", rec.first);
+      }
+    }
+
+    if(!block.abbrevUses.empty())
+    {
+      out.Printf("  Abbrev uses:\n");
+      out.Printf("  %10s %12s\n", "ID", "Count");
+
+      for(size_t i = 0; i < block.abbrevUses.size(); i++)
+      {
+        if(block.abbrevUses[i] == 0)
+          continue;
+
+        out.Printf("  %10u %12llu", (uint32_t)i, (unsigned long long)block.abbrevUses[i]);
+
+        const char *abbrevName = builtinAbbrevName(i);
+        if(abbrevName)
+          out.Printf("  %s", abbrevName);
+        out.Printf("\n");
+      }
+    }
+  }
 }
 
 struct ILDNHeader
@@ -801,6 +949,15 @@ DebugName::DebugName(const void *bytes, size_t length)
 {
   const ILDNHeader *header = (const ILDNHeader *)bytes;
 
+  // the name must be NULL terminated within the chunk
+  const size_t nameOffset = offsetof(ILDNHeader, Name);
+  if(length <= nameOffset || !memchr(header->Name, 0, length - nameOffset))
+  {
+    flags = 0;
+    name = "";
+    return;
+  }
+
   flags = header->Flags;
   name = header->Name;
 }
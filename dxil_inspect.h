@@ -24,10 +24,21 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
+#include <vector>
+#include "llvm_decoder.h"
+
+namespace DXBC
+{
+class Container;
+};
 
 namespace DXIL
 {
+class Output;
+class ThreadPool;
+
 enum class Features : uint64_t
 {
   Double_precision_floating_point = 1 << 0,
@@ -54,16 +65,114 @@ enum class Features : uint64_t
   Sampler_feedback = 1 << 21,
 };
 
+struct ProgramHeader
+{
+  uint16_t ProgramVersion;
+  uint16_t ProgramType;
+  uint32_t SizeInUint32;     // Size in uint32_t units including this header.
+  uint32_t DxilMagic;        // 0x4C495844, ASCII "DXIL".
+  uint32_t DxilVersion;      // DXIL version.
+  uint32_t BitcodeOffset;    // Offset to LLVM bitcode (from DxilMagic).
+  uint32_t BitcodeSize;      // Size of LLVM bitcode.
+};
+
+const char *ShaderTypeName(uint16_t programType);
+
+enum class DumpFormat
+{
+  // human-readable, in the style of llvm-bcanalyzer -dump
+  Text,
+  // see dxil_formats.h
+  JSON,
+  Binary,
+  // LLVM assembly, decoded through a Module. Not available for filtered programs
+  Disassembly,
+};
+
+// restricts a program to the part of it that's wanted. Blocks that are left out are skipped over
+// by their length rather than decoded, so narrow queries on large programs stay fast.
+struct ProgramFilter
+{
+  // only blocks with these IDs, and everything inside them. Empty for all blocks
+  std::vector<uint32_t> blocks;
+  // only records with these codes in the blocks listed above, or in every block if none are.
+  // Blocks nested inside listed ones keep all their records. Empty for all records
+  std::vector<uint32_t> records;
+  // if set, only this function block (by index in the module) is kept, and blocks inside it
+  uint32_t function = ~0U;
+  // if set, only blocks directly in the module are kept. Function blocks are skipped over even if
+  // blocks that can also be in them, like METADATA_BLOCK, are wanted
+  bool moduleLevel = false;
+};
+
+// names of known blocks, and records within them. NULL if not known
+const char *BlockName(uint32_t blockID);
+const char *RecordName(uint32_t blockID, uint32_t recordID);
+
+// prints where the bits go in the modules the statistics were gathered over
+void PrintStats(const LLVMBC::BitcodeStats &stats, Output &out);
+
+// a decoded DXIL program. Holds no global or shared state, so independent programs can be decoded
+// and dumped concurrently on different threads. Blobs and the debug name point into the bytes
+// the program was decoded from, so those must outlive it.
 class Program
 {
 public:
-  Program(const void *bytes, size_t length);
+  // decodes the best DXIL program in the container, along with the chunks that describe it. If
+  // stats is set, bitcode statistics are accumulated into it while decoding. If filter is set, only
+  // the parts of the program it selects are decoded.
+  Program(const DXBC::Container &container, LLVMBC::BitcodeStats *stats = NULL,
+          const ProgramFilter *filter = NULL);
+  // decodes a bare DXIL program, without any container
+  Program(const void *bytes, size_t length, LLVMBC::BitcodeStats *stats = NULL,
+          const ProgramFilter *filter = NULL);
+
+  // if decoding failed, nothing is dumped
+  LLVMBC::DecodeStatus GetStatus() const { return m_Status; }
+
+  uint16_t GetShaderType() const { return m_ShaderType; }
+  uint32_t GetShaderModelMajor() const { return m_ShaderModelMajor; }
+  uint32_t GetShaderModelMinor() const { return m_ShaderModelMinor; }
+  Features GetFeatures() const { return m_Features; }
+  const char *GetDebugName() const { return m_DebugName; }
+  const LLVMBC::BlockOrRecord &GetRoot() const { return m_Root; }
+  // only part of the program is decoded if a filter was given
+  bool IsFiltered() const { return m_Filtered; }
+
+  // the program's header within the bytes it was decoded from, or NULL if it was invalid
+  const ProgramHeader *GetHeader() const { return m_Header; }
+  const byte *GetBitcode() const
+  {
+    return m_Header ? (const byte *)&m_Header->DxilMagic + m_Header->BitcodeOffset : NULL;
+  }
+  size_t GetBitcodeSize() const { return m_Header ? m_Header->BitcodeSize : 0; }
+
+  // returns false if nothing could be dumped
+  // if pool is set, formats that can split the work per function run it there
+  bool Dump(Output &out, DumpFormat format = DumpFormat::Text, ThreadPool *pool = NULL) const;
 
 private:
+  void Decode(const void *bytes, size_t length, LLVMBC::BitcodeStats *stats,
+              const ProgramFilter *filter);
+  void DumpText(Output &out) const;
+
+  LLVMBC::DecodeStatus m_Status;
+
+  uint16_t m_ShaderType = 0;
+  uint32_t m_ShaderModelMajor = 0;
+  uint32_t m_ShaderModelMinor = 0;
+  Features m_Features = Features(0);
+  const char *m_DebugName = NULL;
+  const ProgramHeader *m_Header = NULL;
+  // decoded with a filter, so parts of the module may be missing
+  bool m_Filtered = false;
+
+  LLVMBC::BlockOrRecord m_Root;
 };
 
 struct DebugName
 {
+  // if the chunk is malformed, name is empty
   DebugName(const void *bytes, size_t length);
 
   uint16_t flags;
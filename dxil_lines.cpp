@@ -0,0 +1,307 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxil_lines.h"
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include "dxil_bitcode.h"
+#include "dxil_inspect.h"
+#include "dxil_metadata.h"
+#include "dxil_output.h"
+#include "trace.h"
+
+namespace DXIL
+{
+#define IS_KNOWN(val, KnownID) (decltype(KnownID)(val) == KnownID)
+
+static const uint32_t NoLocation = ~0U;
+
+static bool isSeparator(char c)
+{
+  return c == '/' || c == '\\';
+}
+
+static bool isAbsolute(const std::string &path)
+{
+  return (!path.empty() && isSeparator(path[0])) ||
+         (path.size() >= 2 && path[1] == ':' && isalpha((unsigned char)path[0]));
+}
+
+// the same file can be spelled with either separator, in DXC's output on Windows
+static bool pathMatches(const std::string &path, const char *file)
+{
+  const size_t len = strlen(file);
+  if(len == 0 || len > path.size())
+    return false;
+
+  const size_t start = path.size() - len;
+  if(start > 0 && !isSeparator(path[start - 1]))
+    return false;
+
+  for(size_t i = 0; i < len; i++)
+  {
+    const char a = path[start + i], b = file[i];
+    if(a != b && !(isSeparator(a) && isSeparator(b)))
+      return false;
+  }
+
+  return true;
+}
+
+LineTable::LineTable(const Program &program)
+{
+  TRACE_SCOPE("Build line table");
+
+  const LLVMBC::BlockOrRecord &root = program.GetRoot();
+  MetadataIndex metadata(root);
+
+  // scopes and files in the module's metadata are shared between functions, so each is only
+  // resolved once. The same file can also be described in several functions' metadata
+  std::map<uint32_t, uint32_t> fileIndices;
+  std::map<uint32_t, uint32_t> scopeFiles;
+  std::map<std::string, uint32_t> pathIndices;
+
+  auto addFile = [&](uint32_t fileID) -> uint32_t {
+    auto it = fileIndices.find(fileID);
+    if(it != fileIndices.end())
+      return it->second;
+
+    // [distinct, filename, directory, ...]
+    uint32_t index = NoLocation;
+    const LLVMBC::BlockOrRecord *file = metadata.GetNode(fileID);
+    if(file && IS_KNOWN(file->id, MetaDataRecord::FILE))
+    {
+      SourceFile f;
+      metadata.GetString(MetadataIndex::OptionalRef(*file, 1), f.filename);
+      metadata.GetString(MetadataIndex::OptionalRef(*file, 2), f.directory);
+
+      if(f.directory.empty() || isAbsolute(f.filename))
+        f.path = f.filename;
+      else if(isSeparator(f.directory.back()))
+        f.path = f.directory + f.filename;
+      else
+        f.path = f.directory + "/" + f.filename;
+
+      auto path = pathIndices.insert(std::make_pair(f.path, uint32_t(m_Files.size())));
+      if(path.second)
+        m_Files.push_back(f);
+      index = path.first->second;
+    }
+
+    fileIndices[fileID] = index;
+    return index;
+  };
+
+  auto scopeFile = [&](uint32_t scopeID) -> uint32_t {
+    auto it = scopeFiles.find(scopeID);
+    if(it != scopeFiles.end())
+      return it->second;
+
+    uint32_t index = NoLocation;
+    const LLVMBC::BlockOrRecord *scope = metadata.GetNode(scopeID);
+    if(scope)
+    {
+      switch(MetaDataRecord(scope->id))
+      {
+        case MetaDataRecord::FILE: index = addFile(scopeID); break;
+        // [distinct, scope, name, linkageName, file, ...]
+        case MetaDataRecord::SUBPROGRAM:
+          index = addFile(MetadataIndex::OptionalRef(*scope, 4));
+          break;
+        // [distinct, scope, file, ...]
+        case MetaDataRecord::LEXICAL_BLOCK:
+        case MetaDataRecord::LEXICAL_BLOCK_FILE:
+          index = addFile(MetadataIndex::OptionalRef(*scope, 2));
+          break;
+        default: break;
+      }
+    }
+
+    scopeFiles[scopeID] = index;
+    return index;
+  };
+
+  for(const LLVMBC::BlockOrRecord &block : root.children)
+  {
+    if(!block.IsBlock() || !IS_KNOWN(block.id, KnownBlocks::FUNCTION_BLOCK))
+      continue;
+
+    TRACE_SCOPE_ARG("Function lines", "function", m_Functions.size());
+
+    // forget anything resolved from the last function's own metadata
+    metadata.SetFunction(&block);
+    fileIndices.erase(fileIndices.lower_bound(metadata.NumModuleEntries()), fileIndices.end());
+    scopeFiles.erase(scopeFiles.lower_bound(metadata.NumModuleEntries()), scopeFiles.end());
+
+    const uint32_t function = uint32_t(m_Functions.size());
+    m_Functions.push_back(FunctionLines());
+    FunctionLines &lines = m_Functions.back();
+
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>, uint32_t> locationIndices;
+
+    // the last location given, which DEBUG_LOC_AGAIN repeats, and the end of the last range
+    uint32_t last = NoLocation;
+    uint32_t end = 0;
+
+    auto locate = [&](uint32_t location) {
+      // a location before any instruction, or a second one for the same instruction, is ignored
+      if(lines.numInstructions == 0 || lines.numInstructions - 1 < end)
+        return;
+
+      const uint32_t instruction = lines.numInstructions - 1;
+      if(lines.ranges.empty() || lines.ranges.back().location != location || end != instruction)
+      {
+        if(end < instruction)
+          lines.ranges.push_back({end, NoLocation});
+        lines.ranges.push_back({instruction, location});
+      }
+      end = instruction + 1;
+    };
+
+    for(const LLVMBC::BlockOrRecord &record : block.children)
+    {
+      if(record.IsBlock())
+        continue;
+
+      if(IsInstructionRecord(record.id))
+      {
+        lines.numInstructions++;
+      }
+      else if(IS_KNOWN(record.id, FunctionRecord::DEBUG_LOC) && record.ops.size() >= 4)
+      {
+        // [line, column, scope, inlinedAt, ...]
+        SourceLocation loc;
+        loc.line = uint32_t(record.ops[0]);
+        loc.column = uint32_t(record.ops[1]);
+        loc.scope = MetadataIndex::OptionalRef(record, 2);
+        loc.inlinedAt = MetadataIndex::OptionalRef(record, 3);
+
+        auto key = std::make_tuple(loc.line, loc.column, loc.scope, loc.inlinedAt);
+        auto it = locationIndices.find(key);
+        if(it == locationIndices.end())
+        {
+          loc.file = loc.scope == ~0U ? NoLocation : scopeFile(loc.scope);
+          it = locationIndices.insert(std::make_pair(key, uint32_t(lines.locations.size()))).first;
+          lines.locations.push_back(loc);
+        }
+
+        last = it->second;
+        locate(last);
+      }
+      else if(IS_KNOWN(record.id, FunctionRecord::DEBUG_LOC_AGAIN) && last != NoLocation)
+      {
+        locate(last);
+      }
+    }
+
+    if(!lines.ranges.empty() && end < lines.numInstructions)
+      lines.ranges.push_back({end, NoLocation});
+
+    for(size_t i = 0; i < lines.ranges.size(); i++)
+    {
+      const LineRange &range = lines.ranges[i];
+      if(range.location == NoLocation)
+        continue;
+
+      const SourceLocation &loc = lines.locations[range.location];
+      if(loc.file == NoLocation)
+        continue;
+
+      const uint32_t rangeEnd =
+          i + 1 < lines.ranges.size() ? lines.ranges[i + 1].firstInstruction : end;
+      m_ByLine.push_back({loc.file, loc.line, {function, range.firstInstruction, rangeEnd}});
+    }
+  }
+
+  std::sort(m_ByLine.begin(), m_ByLine.end());
+}
+
+const SourceLocation *LineTable::Find(uint32_t function, uint32_t instruction) const
+{
+  if(function >= m_Functions.size())
+    return NULL;
+
+  const FunctionLines &lines = m_Functions[function];
+  if(instruction >= lines.numInstructions)
+    return NULL;
+
+  auto it = std::upper_bound(
+      lines.ranges.begin(), lines.ranges.end(), instruction,
+      [](uint32_t inst, const LineRange &range) { return inst < range.firstInstruction; });
+  if(it == lines.ranges.begin())
+    return NULL;
+
+  --it;
+  return it->location == NoLocation ? NULL : &lines.locations[it->location];
+}
+
+void LineTable::FindInstructions(const char *file, uint32_t line,
+                                 std::vector<InstructionRange> &instructions) const
+{
+  for(uint32_t f = 0; f < m_Files.size(); f++)
+  {
+    if(!pathMatches(m_Files[f].path, file))
+      continue;
+
+    LineEntry key = {f, line, {0, 0, 0}};
+    for(auto it = std::lower_bound(m_ByLine.begin(), m_ByLine.end(), key);
+        it != m_ByLine.end() && it->file == f && it->line == line; ++it)
+      instructions.push_back(it->instructions);
+  }
+}
+
+void PrintLineTable(const LineTable &table, Output &out)
+{
+  const std::vector<SourceFile> &files = table.GetFiles();
+  const std::vector<FunctionLines> &functions = table.GetFunctions();
+
+  for(size_t f = 0; f < functions.size(); f++)
+  {
+    const FunctionLines &lines = functions[f];
+    out.Printf("function %u: %u instructions, %u ranges, %u locations\n", (uint32_t)f,
+               lines.numInstructions, (uint32_t)lines.ranges.size(),
+               (uint32_t)lines.locations.size());
+
+    for(size_t r = 0; r < lines.ranges.size(); r++)
+    {
+      const LineRange &range = lines.ranges[r];
+      if(range.location == NoLocation)
+        continue;
+
+      const uint32_t end = r + 1 < lines.ranges.size() ? lines.ranges[r + 1].firstInstruction
+                                                       : lines.numInstructions;
+      const SourceLocation &loc = lines.locations[range.location];
+      const char *path = loc.file < files.size() ? files[loc.file].path.c_str() : "<unknown file>";
+
+      out.Printf("  [%u, %u) %s:%u:%u", range.firstInstruction, end, path, loc.line, loc.column);
+      if(loc.inlinedAt != ~0U)
+        out.Printf(" inlined at !%u", loc.inlinedAt);
+      out.Printf("\n");
+    }
+  }
+}
+};    // namespace DXIL
@@ -0,0 +1,129 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace DXIL
+{
+class Output;
+class Program;
+
+struct SourceFile
+{
+  std::string filename;
+  std::string directory;
+  // the directory and filename joined, unless the filename is already absolute
+  std::string path;
+};
+
+struct SourceLocation
+{
+  // index into the table's files, or ~0U if the scope doesn't lead to a file
+  uint32_t file;
+  uint32_t line;
+  uint32_t column;
+  // metadata IDs of the scope and of the location this was inlined at, or ~0U for none
+  uint32_t scope;
+  uint32_t inlinedAt;
+};
+
+// consecutive instructions with the same location are stored as one range, which runs up to the
+// start of the next range
+struct LineRange
+{
+  uint32_t firstInstruction;
+  // index into the function's locations, or ~0U for instructions without one
+  uint32_t location;
+};
+
+struct FunctionLines
+{
+  uint32_t numInstructions = 0;
+  // sorted by first instruction
+  std::vector<LineRange> ranges;
+  // each distinct location once
+  std::vector<SourceLocation> locations;
+};
+
+// instructions by index within one function, [first, end)
+struct InstructionRange
+{
+  uint32_t function;
+  uint32_t first;
+  uint32_t end;
+};
+
+// maps instructions to source locations and back, from the DEBUG_LOC records in each function
+// block. Functions are numbered by their body's position in the module, and instructions by
+// their position in the body, matching the module decoder.
+class LineTable
+{
+public:
+  // the program needs its module metadata and function blocks, and nothing else
+  explicit LineTable(const Program &program);
+
+  const std::vector<SourceFile> &GetFiles() const { return m_Files; }
+  const std::vector<FunctionLines> &GetFunctions() const { return m_Functions; }
+
+  // the location of an instruction, or NULL if it has none
+  const SourceLocation *Find(uint32_t function, uint32_t instruction) const;
+
+  // every run of instructions on a line, in files whose path is file or ends with /file. Ordered
+  // by file then function
+  void FindInstructions(const char *file, uint32_t line,
+                        std::vector<InstructionRange> &instructions) const;
+
+private:
+  struct LineEntry
+  {
+    uint32_t file;
+    uint32_t line;
+    InstructionRange instructions;
+
+    bool operator<(const LineEntry &o) const
+    {
+      if(file != o.file)
+        return file < o.file;
+      if(line != o.line)
+        return line < o.line;
+      if(instructions.function != o.instructions.function)
+        return instructions.function < o.instructions.function;
+      return instructions.first < o.instructions.first;
+    }
+  };
+
+  std::vector<SourceFile> m_Files;
+  std::vector<FunctionLines> m_Functions;
+  // every range with a location, sorted by file and line for reverse lookups
+  std::vector<LineEntry> m_ByLine;
+};
+
+// prints each function's ranges with their locations
+void PrintLineTable(const LineTable &table, Output &out);
+};    // namespace DXIL
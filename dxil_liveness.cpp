@@ -0,0 +1,472 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxil_liveness.h"
+#include <string.h>
+#include "cpu_features.h"
+#include "dxil_cfg.h"
+#include "dxil_module.h"
+#include "dxil_output.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#if DXILP_X86
+#include <immintrin.h>
+#endif
+
+namespace DXIL
+{
+// types nest, but only so far in anything well-formed
+static const int MaxTypeDepth = 32;
+
+static const uint32_t WordBits = 64;
+
+// dst |= src
+static void unionScalar(uint64_t *dst, const uint64_t *src, size_t numWords)
+{
+  for(size_t i = 0; i < numWords; i++)
+    dst[i] |= src[i];
+}
+
+// in = upward | (out & ~defs), returning whether in changed
+static bool transferScalar(uint64_t *in, const uint64_t *upward, const uint64_t *out,
+                           const uint64_t *defs, size_t numWords)
+{
+  uint64_t changed = 0;
+  for(size_t i = 0; i < numWords; i++)
+  {
+    const uint64_t next = upward[i] | (out[i] & ~defs[i]);
+    changed |= next ^ in[i];
+    in[i] = next;
+  }
+  return changed != 0;
+}
+
+#if DXILP_X86
+DXILP_TARGET("avx2")
+static void unionAVX2(uint64_t *dst, const uint64_t *src, size_t numWords)
+{
+  size_t i = 0;
+  for(; i + 4 <= numWords; i += 4)
+  {
+    const __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+    const __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(d, s));
+  }
+
+  unionScalar(dst + i, src + i, numWords - i);
+}
+
+DXILP_TARGET("avx2")
+static bool transferAVX2(uint64_t *in, const uint64_t *upward, const uint64_t *out,
+                         const uint64_t *defs, size_t numWords)
+{
+  __m256i changed = _mm256_setzero_si256();
+
+  size_t i = 0;
+  for(; i + 4 <= numWords; i += 4)
+  {
+    const __m256i u = _mm256_loadu_si256((const __m256i *)(upward + i));
+    const __m256i o = _mm256_loadu_si256((const __m256i *)(out + i));
+    const __m256i d = _mm256_loadu_si256((const __m256i *)(defs + i));
+    const __m256i prev = _mm256_loadu_si256((const __m256i *)(in + i));
+
+    // andnot negates its first operand
+    const __m256i next = _mm256_or_si256(u, _mm256_andnot_si256(d, o));
+    changed = _mm256_or_si256(changed, _mm256_xor_si256(next, prev));
+    _mm256_storeu_si256((__m256i *)(in + i), next);
+  }
+
+  const bool tailChanged =
+      transferScalar(in + i, upward + i, out + i, defs + i, numWords - i);
+  return !_mm256_testz_si256(changed, changed) || tailChanged;
+}
+#endif
+
+static void unionWords(uint64_t *dst, const uint64_t *src, size_t numWords)
+{
+#if DXILP_X86
+  if(GetCPUFeatures().avx2)
+    return unionAVX2(dst, src, numWords);
+#endif
+
+  unionScalar(dst, src, numWords);
+}
+
+static bool transferWords(uint64_t *in, const uint64_t *upward, const uint64_t *out,
+                          const uint64_t *defs, size_t numWords)
+{
+#if DXILP_X86
+  if(GetCPUFeatures().avx2)
+    return transferAVX2(in, upward, out, defs, numWords);
+#endif
+
+  return transferScalar(in, upward, out, defs, numWords);
+}
+
+static inline void setBit(uint64_t *set, uint32_t bit)
+{
+  set[bit / WordBits] |= 1ULL << (bit % WordBits);
+}
+
+static inline void clearBit(uint64_t *set, uint32_t bit)
+{
+  set[bit / WordBits] &= ~(1ULL << (bit % WordBits));
+}
+
+static inline bool testBit(const uint64_t *set, uint32_t bit)
+{
+  return (set[bit / WordBits] >> (bit % WordBits)) & 1;
+}
+
+static uint32_t registerWidth(const std::vector<Type> &types, uint32_t type, int depth)
+{
+  if(type >= types.size() || depth > MaxTypeDepth)
+    return 0;
+
+  const Type &t = types[type];
+  uint64_t width = 0;
+
+  switch(t.kind)
+  {
+    case Type::Integer:
+    case Type::Float: width = t.bitWidth == 0 ? 1 : (t.bitWidth + 31) / 32; break;
+    case Type::Pointer: width = 1; break;
+    case Type::Array:
+    case Type::Vector: width = t.count * registerWidth(types, t.inner, depth + 1); break;
+    case Type::Struct:
+      for(uint32_t member : t.members)
+        width += registerWidth(types, member, depth + 1);
+      break;
+    default: break;
+  }
+
+  // anything this big is nonsense anyway, but keep sums of it from overflowing
+  return width > 0xffffff ? 0xffffff : uint32_t(width);
+}
+
+uint32_t RegisterWidth(const Module &module, uint32_t type)
+{
+  return registerWidth(module.GetTypes(), type, 0);
+}
+
+Liveness::Liveness(const Module &module, const Function &func, const ControlFlowGraph &cfg)
+{
+  TRACE_SCOPE_ARG("Liveness", "global", func.global);
+
+  m_FirstValue = func.firstValue;
+
+  m_Bits.assign(func.values.size(), NoID);
+  for(uint32_t i = 0; i < func.values.size(); i++)
+  {
+    const ValueKind kind = func.values[i].kind;
+    if(kind == ValueKind::Argument || kind == ValueKind::Instruction)
+    {
+      m_Bits[i] = uint32_t(m_Tracked.size());
+      m_Tracked.push_back(func.firstValue + i);
+    }
+  }
+
+  m_NumWords = uint32_t((m_Tracked.size() + WordBits - 1) / WordBits);
+
+  // with nothing to track nothing is ever live
+  if(m_NumWords == 0)
+    return;
+
+  std::vector<uint64_t> upwardUses, defs, phiUses;
+  ComputeBlockSets(func, cfg, upwardUses, defs, phiUses);
+  Solve(cfg, upwardUses, defs, phiUses);
+  MeasurePressure(module, func, cfg);
+}
+
+uint32_t Liveness::BitOf(uint32_t valueID) const
+{
+  if(valueID < m_FirstValue || valueID - m_FirstValue >= m_Bits.size())
+    return NoID;
+  return m_Bits[valueID - m_FirstValue];
+}
+
+bool Liveness::test(const std::vector<uint64_t> &sets, uint32_t block, uint32_t valueID) const
+{
+  if(size_t(block) * m_NumWords >= sets.size())
+    return false;
+
+  const uint32_t bit = BitOf(valueID);
+  return bit != NoID && testBit(sets.data() + size_t(block) * m_NumWords, bit);
+}
+
+// the range of instructions in a block, which a failed decode can leave short
+static void blockRange(const Function &func, uint32_t block, uint32_t &first, uint32_t &end)
+{
+  const uint32_t numInstructions = uint32_t(func.instructions.size());
+  first = func.blocks[block];
+  end = block + 1 < func.blocks.size() ? func.blocks[block + 1] : numInstructions;
+  if(end > numInstructions)
+    end = numInstructions;
+  if(first > end)
+    first = end;
+}
+
+void Liveness::ComputeBlockSets(const Function &func, const ControlFlowGraph &cfg,
+                                std::vector<uint64_t> &upwardUses, std::vector<uint64_t> &defs,
+                                std::vector<uint64_t> &phiUses)
+{
+  const uint32_t numBlocks = cfg.NumBlocks();
+  const size_t setsSize = size_t(numBlocks) * m_NumWords;
+  const uint32_t numOperands = uint32_t(func.operands.size());
+
+  upwardUses.assign(setsSize, 0);
+  defs.assign(setsSize, 0);
+  phiUses.assign(setsSize, 0);
+
+  for(uint32_t b = 0; b < numBlocks; b++)
+  {
+    uint64_t *upward = upwardUses.data() + size_t(b) * m_NumWords;
+    uint64_t *def = defs.data() + size_t(b) * m_NumWords;
+
+    uint32_t first = 0, end = 0;
+    blockRange(func, b, first, end);
+
+    for(uint32_t i = first; i < end; i++)
+    {
+      const Instruction &inst = func.instructions[i];
+      if(inst.firstOperand > numOperands || inst.numOperands > numOperands - inst.firstOperand)
+        continue;
+
+      const Operand *ops = func.operands.data() + inst.firstOperand;
+
+      if(inst.op == Opcode::Phi)
+      {
+        // incoming values are used at the end of the block they come from
+        for(uint32_t o = 0; o + 1 < inst.numOperands; o += 2)
+        {
+          const uint32_t bit = BitOf(ops[o].id);
+          if(ops[o].kind == Operand::Value && bit != NoID && ops[o + 1].id < numBlocks)
+            setBit(phiUses.data() + size_t(ops[o + 1].id) * m_NumWords, bit);
+        }
+      }
+      else
+      {
+        for(uint32_t o = 0; o < inst.numOperands; o++)
+        {
+          const uint32_t bit = ops[o].kind == Operand::Value ? BitOf(ops[o].id) : NoID;
+          if(bit != NoID && !testBit(def, bit))
+            setBit(upward, bit);
+        }
+      }
+
+      const uint32_t bit = inst.value != NoID ? BitOf(inst.value) : NoID;
+      if(bit != NoID)
+        setBit(def, bit);
+    }
+  }
+}
+
+void Liveness::Solve(const ControlFlowGraph &cfg, const std::vector<uint64_t> &upwardUses,
+                     const std::vector<uint64_t> &defs, const std::vector<uint64_t> &phiUses)
+{
+  const size_t setsSize = size_t(cfg.NumBlocks()) * m_NumWords;
+  const std::vector<uint32_t> &rpo = cfg.GetReversePostOrder();
+
+  // the live-in sets leave out the block's own phis, so that they can be unioned straight into the
+  // predecessors' live-out sets. The phis are added once pressure is measured
+  m_LiveIn.assign(setsSize, 0);
+  m_LiveOut.assign(setsSize, 0);
+
+  // visiting in postorder gets most of the way in one pass, with another for each loop nesting
+  bool changed = true;
+  while(changed)
+  {
+    changed = false;
+
+    for(size_t i = rpo.size(); i-- > 0;)
+    {
+      const size_t offset = size_t(rpo[i]) * m_NumWords;
+      uint64_t *out = m_LiveOut.data() + offset;
+
+      memcpy(out, phiUses.data() + offset, m_NumWords * sizeof(uint64_t));
+      for(uint32_t succ : cfg.GetSuccessors(rpo[i]))
+        if(cfg.IsReachable(succ))
+          unionWords(out, m_LiveIn.data() + size_t(succ) * m_NumWords, m_NumWords);
+
+      if(transferWords(m_LiveIn.data() + offset, upwardUses.data() + offset, out,
+                       defs.data() + offset, m_NumWords))
+        changed = true;
+    }
+  }
+}
+
+void Liveness::MeasurePressure(const Module &module, const Function &func,
+                               const ControlFlowGraph &cfg)
+{
+  const std::vector<Type> &types = module.GetTypes();
+  const uint32_t numOperands = uint32_t(func.operands.size());
+
+  std::vector<uint32_t> widths(m_Tracked.size());
+  for(uint32_t bit = 0; bit < m_Tracked.size(); bit++)
+    widths[bit] = registerWidth(types, func.values[m_Tracked[bit] - m_FirstValue].type, 0);
+
+  uint64_t maxLive = 0, maxPressure = 0;
+  auto record = [&](uint64_t live, uint64_t pressure, uint32_t instruction) {
+    if(live > maxLive)
+      maxLive = live;
+    if(pressure > maxPressure)
+    {
+      maxPressure = pressure;
+      m_MaxPressureInstruction = instruction;
+    }
+  };
+
+  std::vector<uint64_t> live(m_NumWords);
+
+  for(uint32_t b : cfg.GetReversePostOrder())
+  {
+    // walk back from the end of the block, where what's live is known
+    memcpy(live.data(), m_LiveOut.data() + size_t(b) * m_NumWords,
+           m_NumWords * sizeof(uint64_t));
+
+    uint64_t count = 0, pressure = 0;
+    for(uint32_t w = 0; w < m_NumWords; w++)
+    {
+      uint32_t bit = w * WordBits;
+      for(uint64_t word = live[w]; word; word >>= 1, bit++)
+      {
+        if(word & 1)
+        {
+          count++;
+          pressure += widths[bit];
+        }
+      }
+    }
+
+    uint32_t first = 0, end = 0;
+    blockRange(func, b, first, end);
+
+    uint32_t i = end;
+    for(; i > first; i--)
+    {
+      const Instruction &inst = func.instructions[i - 1];
+      if(inst.op == Opcode::Phi)
+        break;
+
+      // the result is live where it's defined, even if nothing uses it
+      const uint32_t def = inst.value != NoID ? BitOf(inst.value) : NoID;
+      if(def != NoID && testBit(live.data(), def))
+      {
+        record(count, pressure, i - 1);
+        clearBit(live.data(), def);
+        count--;
+        pressure -= widths[def];
+      }
+      else if(def != NoID)
+      {
+        record(count + 1, pressure + widths[def], i - 1);
+      }
+      else
+      {
+        record(count, pressure, i - 1);
+      }
+
+      if(inst.firstOperand > numOperands || inst.numOperands > numOperands - inst.firstOperand)
+        continue;
+
+      const Operand *ops = func.operands.data() + inst.firstOperand;
+      for(uint32_t o = 0; o < inst.numOperands; o++)
+      {
+        const uint32_t bit = ops[o].kind == Operand::Value ? BitOf(ops[o].id) : NoID;
+        if(bit != NoID && !testBit(live.data(), bit))
+        {
+          setBit(live.data(), bit);
+          count++;
+          pressure += widths[bit];
+        }
+      }
+    }
+
+    // phis all take their values on entry to the block, so their results are live together with
+    // everything live into it. Any that are used are already counted, and are live-in
+    for(; i > first; i--)
+    {
+      const uint32_t def = BitOf(func.instructions[i - 1].value);
+      if(def == NoID)
+        continue;
+
+      if(testBit(live.data(), def))
+      {
+        setBit(m_LiveIn.data() + size_t(b) * m_NumWords, def);
+      }
+      else
+      {
+        count++;
+        pressure += widths[def];
+      }
+    }
+
+    if(first < end)
+      record(count, pressure, first);
+  }
+
+  m_MaxLive = maxLive > 0xffffffff ? 0xffffffff : uint32_t(maxLive);
+  m_MaxPressure = maxPressure > 0xffffffff ? 0xffffffff : uint32_t(maxPressure);
+}
+
+static void printFunction(const Module &module, uint32_t index, StringOutput &out)
+{
+  const Function &func = module.GetFunctions()[index];
+  const ControlFlowGraph cfg(func);
+  const Liveness liveness(module, func, cfg);
+
+  const std::vector<GlobalValue> &globals = module.GetGlobals();
+  out.Printf("function %u", index);
+  if(func.global < globals.size() && !globals[func.global].name.empty())
+    out.Printf(" (@%s)", globals[func.global].name.c_str());
+  out.Printf(": %u values, at most %u live in %u registers", liveness.NumTrackedValues(),
+             liveness.GetMaxLive(), liveness.GetMaxPressure());
+  if(liveness.GetMaxPressureInstruction() != NoID)
+    out.Printf(" at instruction %u", liveness.GetMaxPressureInstruction());
+  out.Write("\n");
+}
+
+void PrintRegisterPressure(const Module &module, Output &out, ThreadPool *pool)
+{
+  TRACE_SCOPE("Print register pressure");
+
+  std::vector<StringOutput> texts(module.GetFunctions().size());
+
+  auto print = [&](size_t i) { printFunction(module, uint32_t(i), texts[i]); };
+
+  if(pool)
+  {
+    pool->ParallelFor(texts.size(), print);
+  }
+  else
+  {
+    for(size_t i = 0; i < texts.size(); i++)
+      print(i);
+  }
+
+  for(const StringOutput &text : texts)
+    out.Write(text.GetString().c_str(), text.GetString().size());
+}
+};    // namespace DXIL
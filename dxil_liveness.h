@@ -0,0 +1,102 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DXIL
+{
+class ControlFlowGraph;
+class Module;
+class Output;
+class ThreadPool;
+struct Function;
+
+// which values are live into and out of each block of a function, and how many are live at once.
+// Only arguments and instruction results are tracked, constants and globals are never live.
+//
+// liveness follows SSA form: a phi's result is live into its own block, and each of its incoming
+// values is live out of the block it comes from, not into the phi's block. Unreachable blocks have
+// nothing live.
+//
+// sets are bitsets over the tracked values, packed into words, with the same number of words for
+// every block so that each set is a slice of one flat array.
+class Liveness
+{
+public:
+  // the graph must be of this function. Nothing is referenced once this returns
+  Liveness(const Module &module, const Function &func, const ControlFlowGraph &cfg);
+
+  uint32_t NumTrackedValues() const { return uint32_t(m_Tracked.size()); }
+
+  // false for values that aren't tracked
+  bool IsLiveIn(uint32_t block, uint32_t valueID) const { return test(m_LiveIn, block, valueID); }
+  bool IsLiveOut(uint32_t block, uint32_t valueID) const { return test(m_LiveOut, block, valueID); }
+
+  // the most values live at any instruction, counting its result even if it's never used
+  uint32_t GetMaxLive() const { return m_MaxLive; }
+  // the same weighted by each value's size in 32-bit registers, so a float4 counts as 4 and a
+  // double as 2
+  uint32_t GetMaxPressure() const { return m_MaxPressure; }
+  // an instruction where the most registers are live, or ~0U if nothing is ever live
+  uint32_t GetMaxPressureInstruction() const { return m_MaxPressureInstruction; }
+
+private:
+  // the value's bit in the sets, or ~0U if it isn't tracked
+  uint32_t BitOf(uint32_t valueID) const;
+  bool test(const std::vector<uint64_t> &sets, uint32_t block, uint32_t valueID) const;
+
+  void ComputeBlockSets(const Function &func, const ControlFlowGraph &cfg,
+                        std::vector<uint64_t> &upwardUses, std::vector<uint64_t> &defs,
+                        std::vector<uint64_t> &phiUses);
+  void Solve(const ControlFlowGraph &cfg, const std::vector<uint64_t> &upwardUses,
+             const std::vector<uint64_t> &defs, const std::vector<uint64_t> &phiUses);
+  void MeasurePressure(const Module &module, const Function &func, const ControlFlowGraph &cfg);
+
+  uint32_t m_FirstValue = 0;
+  // for each of the function's values, its bit in the sets or ~0U if it isn't tracked
+  std::vector<uint32_t> m_Bits;
+  // each tracked value's ID, by bit
+  std::vector<uint32_t> m_Tracked;
+
+  uint32_t m_NumWords = 0;
+  std::vector<uint64_t> m_LiveIn;
+  std::vector<uint64_t> m_LiveOut;
+
+  uint32_t m_MaxLive = 0;
+  uint32_t m_MaxPressure = 0;
+  uint32_t m_MaxPressureInstruction = ~0U;
+};
+
+// how many 32-bit registers a value of this type takes, rounding each scalar up to a whole
+// register. Pointers take one, and types without values none
+uint32_t RegisterWidth(const Module &module, uint32_t type);
+
+// prints the peak liveness of each function. If pool is set the functions are analysed on it
+// concurrently, and printed in module order either way
+void PrintRegisterPressure(const Module &module, Output &out, ThreadPool *pool = NULL);
+};    // namespace DXIL
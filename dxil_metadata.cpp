@@ -0,0 +1,208 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxil_metadata.h"
+#include <string.h>
+#include "dxil_bitcode.h"
+#include "llvm_bitreader.h"
+#include "trace.h"
+
+namespace DXIL
+{
+#define IS_KNOWN(val, KnownID) (decltype(KnownID)(val) == KnownID)
+
+static std::string getString(const LLVMBC::OpList &ops)
+{
+  std::string ret;
+  ret.resize(ops.size());
+  for(size_t i = 0; i < ops.size(); i++)
+    ret[i] = char(ops[i]);
+  return ret;
+}
+
+MetadataIndex::MetadataIndex(const LLVMBC::BlockOrRecord &root)
+{
+  TRACE_SCOPE("Index metadata");
+
+  for(const LLVMBC::BlockOrRecord &child : root.children)
+  {
+    if(child.IsBlock() && IS_KNOWN(child.id, KnownBlocks::METADATA_BLOCK))
+      Add(child);
+  }
+
+  m_NumModuleEntries = Size();
+  m_ModuleFailed = m_Failed;
+}
+
+void MetadataIndex::SetFunction(const LLVMBC::BlockOrRecord *functionBlock)
+{
+  m_Entries.resize(m_NumModuleEntries);
+  m_Failed = m_ModuleFailed;
+
+  if(!functionBlock)
+    return;
+
+  for(const LLVMBC::BlockOrRecord &child : functionBlock->children)
+  {
+    if(child.IsBlock() && IS_KNOWN(child.id, KnownBlocks::METADATA_BLOCK))
+      Add(child);
+  }
+}
+
+void MetadataIndex::Add(const LLVMBC::BlockOrRecord &block)
+{
+  const LLVMBC::BlockOrRecord *name = NULL;
+
+  for(const LLVMBC::BlockOrRecord &record : block.children)
+  {
+    if(record.IsBlock() || m_Failed)
+      continue;
+
+    switch(MetaDataRecord(record.id))
+    {
+      // these don't define any metadata
+      case MetaDataRecord::KIND:
+      case MetaDataRecord::ATTACHMENT:
+      case MetaDataRecord::GLOBAL_DECL_ATTACHMENT:
+      case MetaDataRecord::INDEX_OFFSET:
+      case MetaDataRecord::INDEX: break;
+      case MetaDataRecord::NAME: name = &record; break;
+      case MetaDataRecord::NAMED_NODE:
+        // the name is in the record just before
+        if(name)
+          m_Named.push_back(std::make_pair(getString(name->ops), &record));
+        name = NULL;
+        break;
+      case MetaDataRecord::STRINGS:
+      {
+        // [count, offset] with a blob of the string lengths as VBR6s, then the characters from
+        // offset onwards
+        if(record.ops.size() < 2 || !record.blob || record.ops[1] > record.blobLength)
+        {
+          m_Failed = true;
+          break;
+        }
+
+        const uint64_t count = record.ops[0];
+        const size_t charsOffset = size_t(record.ops[1]);
+
+        // every length takes at least 6 bits, which bounds the count before anything is allocated
+        if(count > charsOffset * 8 / 6)
+        {
+          m_Failed = true;
+          break;
+        }
+
+        LLVMBC::BitReader lengths(record.blob, charsOffset);
+        size_t offset = charsOffset;
+        for(uint64_t i = 0; i < count; i++)
+        {
+          const uint32_t length = lengths.vbr<uint32_t>(6);
+          if(lengths.Failed() || length > record.blobLength - offset)
+          {
+            m_Failed = true;
+            break;
+          }
+
+          m_Entries.push_back({&record, uint32_t(offset), length});
+          offset += length;
+        }
+        break;
+      }
+      default: m_Entries.push_back({&record, 0, 0}); break;
+    }
+  }
+}
+
+const LLVMBC::BlockOrRecord *MetadataIndex::GetNode(uint32_t id) const
+{
+  if(id >= m_Entries.size())
+    return NULL;
+
+  const LLVMBC::BlockOrRecord *record = m_Entries[id].record;
+  if(IS_KNOWN(record->id, MetaDataRecord::STRING_OLD) ||
+     IS_KNOWN(record->id, MetaDataRecord::STRINGS))
+    return NULL;
+
+  return record;
+}
+
+bool MetadataIndex::GetString(uint32_t id, std::string &str) const
+{
+  if(id >= m_Entries.size())
+    return false;
+
+  const Entry &entry = m_Entries[id];
+  if(IS_KNOWN(entry.record->id, MetaDataRecord::STRING_OLD))
+  {
+    str = getString(entry.record->ops);
+    return true;
+  }
+  else if(IS_KNOWN(entry.record->id, MetaDataRecord::STRINGS))
+  {
+    str.assign((const char *)entry.record->blob + entry.offset, entry.length);
+    return true;
+  }
+
+  return false;
+}
+
+bool MetadataIndex::GetStringData(uint32_t id, const char *&data, size_t &length) const
+{
+  if(id >= m_Entries.size())
+    return false;
+
+  const Entry &entry = m_Entries[id];
+  if(IS_KNOWN(entry.record->id, MetaDataRecord::STRING_OLD))
+  {
+    // one character per operand, which are packed as bytes as long as they all fit
+    const LLVMBC::OpList &ops = entry.record->ops;
+    if(ops.Width() != 1)
+      return false;
+
+    data = (const char *)ops.Data();
+    length = ops.size();
+    return true;
+  }
+  else if(IS_KNOWN(entry.record->id, MetaDataRecord::STRINGS))
+  {
+    data = (const char *)entry.record->blob + entry.offset;
+    length = entry.length;
+    return true;
+  }
+
+  return false;
+}
+
+const LLVMBC::OpList *MetadataIndex::GetNamed(const char *name) const
+{
+  for(const std::pair<std::string, const LLVMBC::BlockOrRecord *> &named : m_Named)
+  {
+    if(named.first == name)
+      return &named.second->ops;
+  }
+
+  return NULL;
+}
+};    // namespace DXIL
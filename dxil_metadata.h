@@ -0,0 +1,90 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "llvm_decoder.h"
+
+namespace DXIL
+{
+// resolves metadata IDs in the module's metadata blocks to the records that define them. Nothing
+// is copied out of the records, so the program they were decoded from must outlive this.
+class MetadataIndex
+{
+public:
+  explicit MetadataIndex(const LLVMBC::BlockOrRecord &root);
+
+  // metadata only used in one function can be in that function's own metadata block, numbered on
+  // from the module's. This indexes a function's metadata in place of the last function's, or
+  // goes back to only the module's with NULL
+  void SetFunction(const LLVMBC::BlockOrRecord *functionBlock);
+
+  uint32_t Size() const { return uint32_t(m_Entries.size()); }
+  uint32_t NumModuleEntries() const { return m_NumModuleEntries; }
+
+  // if the metadata blocks were malformed, what's been indexed up to that point is still valid
+  bool Failed() const { return m_Failed; }
+
+  // the record defining a node. NULL for strings and IDs out of range
+  const LLVMBC::BlockOrRecord *GetNode(uint32_t id) const;
+
+  // false if the ID isn't a string
+  bool GetString(uint32_t id, std::string &str) const;
+  // the same without copying, pointing at the characters where they were decoded. Not NUL
+  // terminated. False if the ID isn't a string, or its characters aren't stored as bytes
+  bool GetStringData(uint32_t id, const char *&data, size_t &length) const;
+
+  // the operands of the named node, which are metadata IDs. NULL if there's no such node
+  const LLVMBC::OpList *GetNamed(const char *name) const;
+
+  // record operands that refer to other metadata store ID + 1, with 0 for none. Returns ~0U for
+  // none, or if the operand is missing
+  static uint32_t OptionalRef(const LLVMBC::BlockOrRecord &record, size_t op)
+  {
+    return op < record.ops.size() && record.ops[op] ? uint32_t(record.ops[op] - 1) : ~0U;
+  }
+
+private:
+  void Add(const LLVMBC::BlockOrRecord &block);
+
+  struct Entry
+  {
+    const LLVMBC::BlockOrRecord *record;
+    // for strings packed into a METADATA_STRINGS blob, where in the blob this one is
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  std::vector<Entry> m_Entries;
+  uint32_t m_NumModuleEntries = 0;
+  bool m_ModuleFailed = false;
+  std::vector<std::pair<std::string, const LLVMBC::BlockOrRecord *>> m_Named;
+  bool m_Failed = false;
+};
+};    // namespace DXIL
@@ -0,0 +1,1377 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxil_module.h"
+#include "dxil_bitcode.h"
+#include "dxil_inspect.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+namespace DXIL
+{
+#define IS_KNOWN(val, KnownID) (decltype(KnownID)(val) == KnownID)
+
+static std::string getString(const LLVMBC::OpList &ops, size_t first)
+{
+  std::string ret;
+  if(first < ops.size())
+    ret.reserve(ops.size() - first);
+  for(size_t i = first; i < ops.size(); i++)
+    ret.push_back(char(ops[i]));
+  return ret;
+}
+
+static uint32_t decodeAlign(uint64_t encoded)
+{
+  // stored as log2 + 1, with 0 for no alignment
+  encoded &= 0x1f;
+  return encoded == 0 || encoded > 32 ? 0 : uint32_t(1ULL << (encoded - 1));
+}
+
+const char *OpcodeName(Opcode op)
+{
+  switch(op)
+  {
+    case Opcode::Unknown: break;
+    case Opcode::Ret: return "ret";
+    case Opcode::Br: return "br";
+    case Opcode::Switch: return "switch";
+    case Opcode::Unreachable: return "unreachable";
+    case Opcode::Add: return "add";
+    case Opcode::FAdd: return "fadd";
+    case Opcode::Sub: return "sub";
+    case Opcode::FSub: return "fsub";
+    case Opcode::Mul: return "mul";
+    case Opcode::FMul: return "fmul";
+    case Opcode::UDiv: return "udiv";
+    case Opcode::SDiv: return "sdiv";
+    case Opcode::FDiv: return "fdiv";
+    case Opcode::URem: return "urem";
+    case Opcode::SRem: return "srem";
+    case Opcode::FRem: return "frem";
+    case Opcode::Shl: return "shl";
+    case Opcode::LShr: return "lshr";
+    case Opcode::AShr: return "ashr";
+    case Opcode::And: return "and";
+    case Opcode::Or: return "or";
+    case Opcode::Xor: return "xor";
+    case Opcode::Alloca: return "alloca";
+    case Opcode::Load: return "load";
+    case Opcode::Store: return "store";
+    case Opcode::GetElementPtr: return "getelementptr";
+    case Opcode::Fence: return "fence";
+    case Opcode::CmpXchg: return "cmpxchg";
+    case Opcode::AtomicRMW: return "atomicrmw";
+    case Opcode::Trunc: return "trunc";
+    case Opcode::ZExt: return "zext";
+    case Opcode::SExt: return "sext";
+    case Opcode::FPToUI: return "fptoui";
+    case Opcode::FPToSI: return "fptosi";
+    case Opcode::UIToFP: return "uitofp";
+    case Opcode::SIToFP: return "sitofp";
+    case Opcode::FPTrunc: return "fptrunc";
+    case Opcode::FPExt: return "fpext";
+    case Opcode::PtrToInt: return "ptrtoint";
+    case Opcode::IntToPtr: return "inttoptr";
+    case Opcode::BitCast: return "bitcast";
+    case Opcode::AddrSpaceCast: return "addrspacecast";
+    case Opcode::ICmp: return "icmp";
+    case Opcode::FCmp: return "fcmp";
+    case Opcode::Phi: return "phi";
+    case Opcode::Call: return "call";
+    case Opcode::Select: return "select";
+    case Opcode::ExtractElement: return "extractelement";
+    case Opcode::InsertElement: return "insertelement";
+    case Opcode::ShuffleVector: return "shufflevector";
+    case Opcode::ExtractValue: return "extractvalue";
+    case Opcode::InsertValue: return "insertvalue";
+  }
+
+  return "unknown";
+}
+
+// the encodings in INST_BINOP and CE_BINOP, which share codes between integer and float operations
+static Opcode decodeBinaryOp(uint64_t code, bool isFloat)
+{
+  switch(code)
+  {
+    case 0: return isFloat ? Opcode::FAdd : Opcode::Add;
+    case 1: return isFloat ? Opcode::FSub : Opcode::Sub;
+    case 2: return isFloat ? Opcode::FMul : Opcode::Mul;
+    case 3: return isFloat ? Opcode::Unknown : Opcode::UDiv;
+    case 4: return isFloat ? Opcode::FDiv : Opcode::SDiv;
+    case 5: return isFloat ? Opcode::Unknown : Opcode::URem;
+    case 6: return isFloat ? Opcode::FRem : Opcode::SRem;
+    case 7: return isFloat ? Opcode::Unknown : Opcode::Shl;
+    case 8: return isFloat ? Opcode::Unknown : Opcode::LShr;
+    case 9: return isFloat ? Opcode::Unknown : Opcode::AShr;
+    case 10: return isFloat ? Opcode::Unknown : Opcode::And;
+    case 11: return isFloat ? Opcode::Unknown : Opcode::Or;
+    case 12: return isFloat ? Opcode::Unknown : Opcode::Xor;
+    default: break;
+  }
+
+  return Opcode::Unknown;
+}
+
+static Opcode decodeCastOp(uint64_t code)
+{
+  static const Opcode casts[] = {
+      Opcode::Trunc,   Opcode::ZExt,     Opcode::SExt,     Opcode::FPToUI, Opcode::FPToSI,
+      Opcode::UIToFP,  Opcode::SIToFP,   Opcode::FPTrunc,  Opcode::FPExt,  Opcode::PtrToInt,
+      Opcode::IntToPtr, Opcode::BitCast, Opcode::AddrSpaceCast,
+  };
+
+  if(code < sizeof(casts) / sizeof(casts[0]))
+    return casts[code];
+
+  return Opcode::Unknown;
+}
+
+static void ParseFunction(const Module &m, Function &f);
+
+Module::Module(const Program &program, ThreadPool *pool) : m_Program(program)
+{
+  TRACE_SCOPE("Module::Module");
+
+  if(program.GetStatus().Failed())
+  {
+    m_Error = "Program wasn't decoded";
+    return;
+  }
+
+  const LLVMBC::BlockOrRecord &root = program.GetRoot();
+
+  // the definitions, in the same order as the function blocks with their bodies
+  std::vector<uint32_t> bodies;
+
+  for(const LLVMBC::BlockOrRecord &child : root.children)
+  {
+    if(child.IsBlock())
+    {
+      if(IS_KNOWN(child.id, KnownBlocks::TYPE_BLOCK))
+      {
+        ParseTypes(child);
+      }
+      else if(IS_KNOWN(child.id, KnownBlocks::CONSTANTS_BLOCK))
+      {
+        ParseConstants(child, m_Constants, m_Values);
+      }
+      else if(IS_KNOWN(child.id, KnownBlocks::VALUE_SYMTAB_BLOCK))
+      {
+        ParseSymbols(child);
+      }
+      else if(IS_KNOWN(child.id, KnownBlocks::FUNCTION_BLOCK))
+      {
+        Function func;
+        func.block = &child;
+        m_Functions.push_back(func);
+      }
+      continue;
+    }
+
+    if(IS_KNOWN(child.id, ModuleRecord::VERSION) && !child.ops.empty())
+    {
+      m_Version = uint32_t(child.ops[0]);
+    }
+    else if(IS_KNOWN(child.id, ModuleRecord::TRIPLE))
+    {
+      m_Triple = getString(child.ops, 0);
+    }
+    else if(IS_KNOWN(child.id, ModuleRecord::DATALAYOUT))
+    {
+      m_DataLayout = getString(child.ops, 0);
+    }
+    else if(IS_KNOWN(child.id, ModuleRecord::GLOBALVAR) ||
+            IS_KNOWN(child.id, ModuleRecord::FUNCTION) ||
+            IS_KNOWN(child.id, ModuleRecord::ALIAS) || IS_KNOWN(child.id, ModuleRecord::ALIAS_OLD))
+    {
+      ParseGlobal(child);
+
+      if(!m_Globals.empty() && m_Globals.back().kind == ValueKind::Function &&
+         !m_Globals.back().isDeclaration)
+        bodies.push_back(uint32_t(m_Globals.size() - 1));
+    }
+
+    if(m_Error)
+      return;
+  }
+
+  if(m_Error)
+    return;
+
+  if(bodies.size() != m_Functions.size())
+  {
+    m_Error = "Function bodies don't match the function definitions";
+    m_Functions.clear();
+    return;
+  }
+
+  for(size_t i = 0; i < bodies.size(); i++)
+  {
+    m_Functions[i].global = bodies[i];
+    m_Globals[bodies[i]].function = uint32_t(i);
+  }
+
+  // each function only reads the module-level state, which is complete by now
+  auto parseFunction = [this](size_t i) { ParseFunction(*this, m_Functions[i]); };
+
+  if(pool)
+  {
+    pool->ParallelFor(m_Functions.size(), parseFunction);
+  }
+  else
+  {
+    for(size_t i = 0; i < m_Functions.size(); i++)
+      parseFunction(i);
+  }
+}
+
+const Value *Module::GetValue(const Function &func, uint32_t valueID) const
+{
+  if(valueID < m_Values.size())
+    return &m_Values[valueID];
+
+  if(valueID >= func.firstValue && valueID - func.firstValue < func.values.size())
+    return &func.values[valueID - func.firstValue];
+
+  return NULL;
+}
+
+const Constant *Module::GetConstant(const Function &func, uint32_t valueID) const
+{
+  const Value *value = GetValue(func, valueID);
+  if(!value || value->kind != ValueKind::Constant)
+    return NULL;
+
+  if(valueID < m_Values.size())
+    return &m_Constants[value->index];
+
+  return &func.constants[value->index];
+}
+
+bool Module::GetConstantInt(const Function &func, uint32_t valueID, int64_t &value) const
+{
+  const Constant *c = GetConstant(func, valueID);
+  if(!c)
+    return false;
+
+  if(IS_KNOWN(c->record->id, ConstantsRecord::INTEGER) && !c->record->ops.empty())
+  {
+    value = DecodeSigned(c->record->ops[0]);
+    return true;
+  }
+  else if(IS_KNOWN(c->record->id, ConstantsRecord::CONST_NULL))
+  {
+    value = 0;
+    return true;
+  }
+
+  return false;
+}
+
+uint32_t Module::PointerTo(uint32_t type, uint32_t addrSpace) const
+{
+  auto it = m_PointerTypes.find(std::make_pair(type, addrSpace));
+  if(it == m_PointerTypes.end())
+    return NoID;
+  return it->second;
+}
+
+uint32_t Module::FindType(const Type &type) const
+{
+  // only used for the few results that need an anonymous type to be found by structure, like
+  // vector compares
+  for(size_t i = 0; i < m_Types.size(); i++)
+  {
+    const Type &t = m_Types[i];
+    if(t.kind == type.kind && t.bitWidth == type.bitWidth && t.count == type.count &&
+       t.inner == type.inner && t.packed == type.packed && t.members == type.members &&
+       t.name.empty())
+      return uint32_t(i);
+  }
+
+  return NoID;
+}
+
+bool Module::IsFloat(uint32_t type) const
+{
+  if(type >= m_Types.size())
+    return false;
+
+  const Type &t = m_Types[type];
+  if(t.kind == Type::Vector && t.inner < m_Types.size())
+    return m_Types[t.inner].kind == Type::Float;
+
+  return t.kind == Type::Float;
+}
+
+void Module::ParseTypes(const LLVMBC::BlockOrRecord &block)
+{
+  std::string pendingName;
+
+  for(const LLVMBC::BlockOrRecord &record : block.children)
+  {
+    if(record.IsBlock())
+      continue;
+
+    const LLVMBC::OpList &ops = record.ops;
+
+    Type t;
+
+    switch(TypeRecord(record.id))
+    {
+      case TypeRecord::NUMENTRY:
+        if(!ops.empty() && ops[0] < block.blockDwordLength * 32ULL)
+          m_Types.reserve((size_t)ops[0]);
+        continue;
+      case TypeRecord::STRUCT_NAME: pendingName = getString(ops, 0); continue;
+      case TypeRecord::VOID: t.kind = Type::Void; break;
+      case TypeRecord::HALF:
+        t.kind = Type::Float;
+        t.bitWidth = 16;
+        break;
+      case TypeRecord::FLOAT:
+        t.kind = Type::Float;
+        t.bitWidth = 32;
+        break;
+      case TypeRecord::DOUBLE:
+        t.kind = Type::Float;
+        t.bitWidth = 64;
+        break;
+      case TypeRecord::LABEL: t.kind = Type::Label; break;
+      case TypeRecord::METADATA: t.kind = Type::Metadata; break;
+      case TypeRecord::INTEGER:
+        // there's no i0, so one without a width is left unknown
+        if(!ops.empty() && ops[0] != 0 && ops[0] <= UINT32_MAX)
+        {
+          t.kind = Type::Integer;
+          t.bitWidth = uint32_t(ops[0]);
+        }
+        break;
+      case TypeRecord::POINTER:
+        t.kind = Type::Pointer;
+        if(!ops.empty())
+          t.inner = uint32_t(ops[0]);
+        if(ops.size() > 1)
+          t.addrSpace = uint32_t(ops[1]);
+        break;
+      case TypeRecord::ARRAY:
+      case TypeRecord::VECTOR:
+        t.kind = IS_KNOWN(record.id, TypeRecord::ARRAY) ? Type::Array : Type::Vector;
+        if(ops.size() >= 2)
+        {
+          t.count = ops[0];
+          t.inner = uint32_t(ops[1]);
+        }
+        break;
+      case TypeRecord::OPAQUE:
+        t.kind = Type::Struct;
+        t.name.swap(pendingName);
+        break;
+      case TypeRecord::STRUCT_ANON:
+      case TypeRecord::STRUCT_NAMED:
+        t.kind = Type::Struct;
+        t.packed = !ops.empty() && ops[0] != 0;
+        for(size_t i = 1; i < ops.size(); i++)
+          t.members.push_back(uint32_t(ops[i]));
+        if(IS_KNOWN(record.id, TypeRecord::STRUCT_NAMED))
+          t.name.swap(pendingName);
+        break;
+      case TypeRecord::FUNCTION_OLD:
+      case TypeRecord::FUNCTION:
+      {
+        // the old form has an unused attribute ID after the vararg flag
+        const size_t first = IS_KNOWN(record.id, TypeRecord::FUNCTION_OLD) ? 2 : 1;
+        t.kind = Type::Function;
+        t.vararg = !ops.empty() && ops[0] != 0;
+        if(ops.size() > first)
+          t.inner = uint32_t(ops[first]);
+        for(size_t i = first + 1; i < ops.size(); i++)
+          t.members.push_back(uint32_t(ops[i]));
+        break;
+      }
+      default:
+        // anything else takes a type ID but isn't used by DXIL
+        break;
+    }
+
+    m_Types.push_back(t);
+  }
+
+  // only named structs can be referred to before they're defined, which is the only way to build a
+  // recursive type. Any other forward reference could make a cycle that walking the type never
+  // gets out of, so it's dropped
+  for(uint32_t i = 0; i < m_Types.size(); i++)
+  {
+    Type &t = m_Types[i];
+
+    auto check = [this, i](uint32_t &ref) {
+      if(ref != NoID && ref >= i &&
+         (ref >= m_Types.size() || m_Types[ref].kind != Type::Struct || m_Types[ref].name.empty()))
+        ref = NoID;
+    };
+
+    check(t.inner);
+    for(uint32_t &member : t.members)
+      check(member);
+
+    if(t.kind == Type::Pointer)
+      m_PointerTypes[std::make_pair(t.inner, t.addrSpace)] = i;
+    else if(t.kind == Type::Integer && t.bitWidth == 1 && m_BoolType == NoID)
+      m_BoolType = i;
+  }
+}
+
+void Module::ParseGlobal(const LLVMBC::BlockOrRecord &record)
+{
+  // from version 2 names are in a string table, and each record starts with its offset and size
+  const size_t base = m_Version >= 2 ? 2 : 0;
+  const LLVMBC::OpList &ops = record.ops;
+
+  auto op = [&ops, base](size_t i) -> uint64_t {
+    return base + i < ops.size() ? ops[base + i] : 0;
+  };
+
+  if(ops.size() < base + 3)
+  {
+    m_Error = "Malformed global value record";
+    return;
+  }
+
+  GlobalValue g;
+
+  if(IS_KNOWN(record.id, ModuleRecord::GLOBALVAR))
+  {
+    // [type, isconst | explicittype << 1 | addrspace << 2, initid, linkage, alignment, ...]
+    g.kind = ValueKind::GlobalVariable;
+
+    uint32_t addrSpace = 0;
+    if(op(1) & 0x2)
+    {
+      g.valueType = uint32_t(op(0));
+      addrSpace = uint32_t(op(1) >> 2);
+    }
+    else if(op(0) < m_Types.size())
+    {
+      // the old form gives the pointer type instead
+      g.valueType = m_Types[(size_t)op(0)].inner;
+      addrSpace = m_Types[(size_t)op(0)].addrSpace;
+    }
+
+    g.isConstant = (op(1) & 0x1) != 0;
+    g.isDeclaration = op(2) == 0;
+    g.initializer = op(2) == 0 ? NoID : uint32_t(op(2) - 1);
+    g.linkage = uint32_t(op(3));
+    g.align = decodeAlign(op(4));
+    g.type = PointerTo(g.valueType, addrSpace);
+  }
+  else if(IS_KNOWN(record.id, ModuleRecord::FUNCTION))
+  {
+    // [type, callingconv, isproto, linkage, paramattr, alignment, ...]
+    g.kind = ValueKind::Function;
+
+    g.valueType = uint32_t(op(0));
+    // older bitcode gives the pointer to the function type
+    if(g.valueType < m_Types.size() && m_Types[g.valueType].kind == Type::Pointer)
+      g.valueType = m_Types[g.valueType].inner;
+
+    g.isDeclaration = op(2) != 0;
+    g.linkage = uint32_t(op(3));
+    g.align = decodeAlign(op(5));
+    g.type = PointerTo(g.valueType, 0);
+  }
+  else if(IS_KNOWN(record.id, ModuleRecord::ALIAS))
+  {
+    // [valuetype, addrspace, aliasee, linkage, ...]
+    g.kind = ValueKind::Alias;
+    g.valueType = uint32_t(op(0));
+    g.initializer = uint32_t(op(2));
+    g.linkage = ops.size() > base + 3 ? uint32_t(op(3)) : 0;
+    g.type = PointerTo(g.valueType, uint32_t(op(1)));
+  }
+  else
+  {
+    // [pointertype, aliasee, linkage, ...]
+    g.kind = ValueKind::Alias;
+    g.type = uint32_t(op(0));
+    if(g.type < m_Types.size())
+      g.valueType = m_Types[g.type].inner;
+    g.initializer = uint32_t(op(1));
+    g.linkage = uint32_t(op(2));
+  }
+
+  if(g.valueType >= m_Types.size() || g.type == NoID)
+  {
+    m_Error = "Global value has an invalid type";
+    return;
+  }
+
+  Value v;
+  v.kind = g.kind;
+  v.type = g.type;
+  v.index = uint32_t(m_Globals.size());
+  m_Values.push_back(v);
+
+  m_Globals.push_back(g);
+}
+
+void Module::ParseConstants(const LLVMBC::BlockOrRecord &block, std::vector<Constant> &constants,
+                            std::vector<Value> &values) const
+{
+  uint32_t type = NoID;
+
+  for(const LLVMBC::BlockOrRecord &record : block.children)
+  {
+    if(record.IsBlock())
+      continue;
+
+    if(IS_KNOWN(record.id, ConstantsRecord::SETTYPE))
+    {
+      type = record.ops.empty() ? NoID : uint32_t(record.ops[0]);
+      continue;
+    }
+
+    // every other record is one value of the current type, even ones we don't understand
+    Constant c;
+    c.type = type;
+    c.record = &record;
+
+    Value v;
+    v.kind = ValueKind::Constant;
+    v.type = type;
+    v.index = uint32_t(constants.size());
+
+    constants.push_back(c);
+    values.push_back(v);
+  }
+}
+
+void Module::ParseSymbols(const LLVMBC::BlockOrRecord &block)
+{
+  for(const LLVMBC::BlockOrRecord &record : block.children)
+  {
+    if(record.IsBlock() || record.ops.empty())
+      continue;
+
+    // [valueid, name...] or [valueid, offset, name...]. With a string table there's no name
+    size_t nameStart = 1;
+    if(IS_KNOWN(record.id, ValueSymtabRecord::FNENTRY))
+      nameStart = 2;
+    else if(!IS_KNOWN(record.id, ValueSymtabRecord::ENTRY))
+      continue;
+
+    const uint64_t valueID = record.ops[0];
+    if(valueID >= m_Values.size() || nameStart >= record.ops.size())
+      continue;
+
+    const Value &v = m_Values[(size_t)valueID];
+    if(v.kind == ValueKind::GlobalVariable || v.kind == ValueKind::Function ||
+       v.kind == ValueKind::Alias)
+      m_Globals[v.index].name = getString(record.ops, nameStart);
+  }
+}
+
+// decodes one function body. Only writes to the function, so different functions can be decoded
+// concurrently
+class FunctionParser
+{
+public:
+  FunctionParser(const Module &m, Function &f) : m(m), f(f), types(m.m_Types) {}
+
+  void Parse();
+
+private:
+  const Module &m;
+  Function &f;
+  const std::vector<Type> &types;
+
+  // IDs are relative to the next value from version 1 on, which is all DXIL
+  bool relative = true;
+  uint32_t nextValue = 0;
+
+  // the record being decoded, and the next op to read
+  const LLVMBC::OpList *ops = NULL;
+  size_t cursor = 0;
+
+  Instruction inst;
+
+  void fail(const char *error)
+  {
+    if(!f.error)
+      f.error = error;
+  }
+
+  bool atEnd() const { return cursor >= ops->size(); }
+  bool next(uint64_t &val)
+  {
+    if(atEnd())
+    {
+      fail("Instruction record is truncated");
+      return false;
+    }
+    val = (*ops)[cursor++];
+    return true;
+  }
+
+  uint32_t typeOf(uint32_t valueID) const
+  {
+    const Value *v = m.GetValue(f, valueID);
+    return v ? v->type : NoID;
+  }
+
+  bool validType(uint32_t type) const { return type < types.size(); }
+  const Type &type(uint32_t id) const { return types[id]; }
+
+  uint32_t absolute(uint64_t id) const { return relative ? nextValue - uint32_t(id) : uint32_t(id); }
+
+  // a value whose type is known from context
+  bool value(uint32_t &valueID)
+  {
+    uint64_t id = 0;
+    if(!next(id))
+      return false;
+    valueID = absolute(id);
+    return true;
+  }
+
+  // a value, followed by its type only if it's a forward reference
+  bool valueAndType(uint32_t &valueID, uint32_t &valueType)
+  {
+    if(!value(valueID))
+      return false;
+
+    if(valueID < nextValue)
+    {
+      valueType = typeOf(valueID);
+    }
+    else
+    {
+      uint64_t t = 0;
+      if(!next(t))
+        return false;
+      valueType = uint32_t(t);
+    }
+
+    if(!validType(valueType))
+    {
+      fail("Operand has an invalid type");
+      return false;
+    }
+
+    return true;
+  }
+
+  void addOperand(Operand::Kind kind, uint32_t id)
+  {
+    Operand o;
+    o.kind = kind;
+    o.id = id;
+    f.operands.push_back(o);
+    inst.numOperands++;
+  }
+
+  bool decode(const LLVMBC::BlockOrRecord &record);
+  uint32_t indexType(uint32_t aggregate, uint64_t index) const;
+  uint32_t boolLike(uint32_t operandType) const;
+};
+
+uint32_t FunctionParser::indexType(uint32_t aggregate, uint64_t index) const
+{
+  if(!validType(aggregate))
+    return NoID;
+
+  const Type &t = type(aggregate);
+  if(t.kind == Type::Struct)
+    return index < t.members.size() ? t.members[(size_t)index] : NoID;
+  if(t.kind == Type::Array || t.kind == Type::Vector)
+    return t.inner;
+
+  return NoID;
+}
+
+uint32_t FunctionParser::boolLike(uint32_t operandType) const
+{
+  // comparisons of vectors give a vector of bools
+  if(validType(operandType) && type(operandType).kind == Type::Vector)
+  {
+    Type vec;
+    vec.kind = Type::Vector;
+    vec.count = type(operandType).count;
+    vec.inner = m.m_BoolType;
+    return m.FindType(vec);
+  }
+
+  return m.m_BoolType;
+}
+
+void FunctionParser::Parse()
+{
+  relative = m.m_Version >= 1;
+
+  const GlobalValue &global = m.m_Globals[f.global];
+  const Type &funcType = types[global.valueType];
+
+  f.firstValue = m.NumModuleValues();
+  nextValue = f.firstValue;
+
+  if(funcType.kind != Type::Function)
+  {
+    fail("Function has an invalid type");
+    return;
+  }
+
+  f.numArgs = uint32_t(funcType.members.size());
+  for(uint32_t i = 0; i < f.numArgs; i++)
+  {
+    Value v;
+    v.kind = ValueKind::Argument;
+    v.type = funcType.members[i];
+    v.index = i;
+    f.values.push_back(v);
+    nextValue++;
+  }
+
+  uint32_t numBlocks = 0;
+  bool inBlock = false;
+
+  // names can only be applied once all values exist
+  const LLVMBC::BlockOrRecord *symbols = NULL;
+
+  for(const LLVMBC::BlockOrRecord &child : f.block->children)
+  {
+    if(child.IsBlock())
+    {
+      if(IS_KNOWN(child.id, KnownBlocks::CONSTANTS_BLOCK))
+      {
+        const size_t first = f.values.size();
+        m.ParseConstants(child, f.constants, f.values);
+        nextValue += uint32_t(f.values.size() - first);
+      }
+      else if(IS_KNOWN(child.id, KnownBlocks::VALUE_SYMTAB_BLOCK))
+      {
+        symbols = &child;
+      }
+      continue;
+    }
+
+    if(IS_KNOWN(child.id, FunctionRecord::DECLAREBLOCKS))
+    {
+      // every block has at least one instruction
+      numBlocks = child.ops.empty() ? 0 : uint32_t(child.ops[0]);
+      if(child.ops.empty() || child.ops[0] > f.block->children.size())
+      {
+        fail("Invalid number of blocks");
+        break;
+      }
+      f.blocks.reserve(numBlocks);
+      continue;
+    }
+
+    // only instructions are decoded here, debug locations and the rest are left in the records
+    if(!IsInstructionRecord(child.id))
+      continue;
+
+    if(!inBlock)
+    {
+      f.blocks.push_back(uint32_t(f.instructions.size()));
+      inBlock = true;
+    }
+
+    inst = Instruction();
+    inst.firstOperand = uint32_t(f.operands.size());
+
+    if(!decode(child))
+    {
+      fail("Unsupported instruction");
+      break;
+    }
+
+    if(inst.type != NoID && type(inst.type).kind != Type::Void)
+    {
+      inst.value = nextValue++;
+
+      Value v;
+      v.kind = ValueKind::Instruction;
+      v.type = inst.type;
+      v.index = uint32_t(f.instructions.size());
+      f.values.push_back(v);
+    }
+    else
+    {
+      inst.type = NoID;
+    }
+
+    f.instructions.push_back(inst);
+
+    switch(inst.op)
+    {
+      case Opcode::Ret:
+      case Opcode::Br:
+      case Opcode::Switch:
+      case Opcode::Unreachable: inBlock = false; break;
+      default: break;
+    }
+  }
+
+  if(!f.error && f.blocks.size() != numBlocks)
+    fail("Number of blocks doesn't match the declaration");
+
+  if(symbols)
+  {
+    f.valueNames.resize(f.values.size());
+    f.blockNames.resize(f.blocks.size());
+
+    for(const LLVMBC::BlockOrRecord &record : symbols->children)
+    {
+      if(record.IsBlock() || record.ops.empty())
+        continue;
+
+      const uint64_t id = record.ops[0];
+
+      if(IS_KNOWN(record.id, ValueSymtabRecord::ENTRY) && id >= f.firstValue &&
+         id - f.firstValue < f.valueNames.size())
+        f.valueNames[(size_t)(id - f.firstValue)] = getString(record.ops, 1);
+      else if(IS_KNOWN(record.id, ValueSymtabRecord::BBENTRY) && id < f.blockNames.size())
+        f.blockNames[(size_t)id] = getString(record.ops, 1);
+    }
+  }
+}
+
+static void ParseFunction(const Module &m, Function &f)
+{
+  FunctionParser(m, f).Parse();
+}
+
+bool FunctionParser::decode(const LLVMBC::BlockOrRecord &record)
+{
+  ops = &record.ops;
+  cursor = 0;
+
+  uint32_t a = 0, b = 0, c = 0;
+  uint32_t aType = NoID, bType = NoID;
+  uint64_t lit = 0;
+
+  switch(FunctionRecord(record.id))
+  {
+    case FunctionRecord::INST_BINOP:
+    {
+      // [lhs, rhs, opcode, flags?]
+      if(!valueAndType(a, aType) || !value(b) || !next(lit))
+        return false;
+      inst.op = decodeBinaryOp(lit, m.IsFloat(aType));
+      if(!atEnd())
+        inst.flags = uint32_t((*ops)[cursor]);
+      inst.type = aType;
+      addOperand(Operand::Value, a);
+      addOperand(Operand::Value, b);
+      break;
+    }
+    case FunctionRecord::INST_CAST:
+    {
+      // [op, destty, castopc]
+      uint64_t destType = 0;
+      if(!valueAndType(a, aType) || !next(destType) || !next(lit))
+        return false;
+      inst.op = decodeCastOp(lit);
+      inst.type = uint32_t(destType);
+      addOperand(Operand::Value, a);
+      break;
+    }
+    case FunctionRecord::INST_GEP_OLD:
+    case FunctionRecord::INST_INBOUNDS_GEP_OLD:
+    case FunctionRecord::INST_GEP:
+    {
+      // [inbounds, ty, ptr, indices...], or just [ptr, indices...] in the old forms
+      inst.op = Opcode::GetElementPtr;
+      if(IS_KNOWN(record.id, FunctionRecord::INST_GEP))
+      {
+        uint64_t inbounds = 0, sourceType = 0;
+        if(!next(inbounds) || !next(sourceType))
+          return false;
+        inst.flags = uint32_t(inbounds);
+        inst.auxType = uint32_t(sourceType);
+      }
+      else
+      {
+        inst.flags = IS_KNOWN(record.id, FunctionRecord::INST_INBOUNDS_GEP_OLD) ? 1 : 0;
+      }
+
+      if(!valueAndType(a, aType))
+        return false;
+      addOperand(Operand::Value, a);
+
+      if(type(aType).kind != Type::Pointer)
+        return false;
+      if(inst.auxType == NoID)
+        inst.auxType = type(aType).inner;
+
+      // the first index steps over the pointer, the rest index into the type
+      uint32_t result = inst.auxType;
+      bool first = true;
+      while(!atEnd())
+      {
+        if(!valueAndType(b, bType))
+          return false;
+        addOperand(Operand::Value, b);
+
+        if(!first)
+        {
+          int64_t index = 0;
+          if(validType(result) && type(result).kind == Type::Struct &&
+             !m.GetConstantInt(f, b, index))
+            return false;
+          result = indexType(result, uint64_t(index));
+        }
+        first = false;
+      }
+
+      inst.type = m.PointerTo(result, type(aType).addrSpace);
+      if(inst.type == NoID)
+        return false;
+      break;
+    }
+    case FunctionRecord::INST_SELECT:
+    case FunctionRecord::INST_VSELECT:
+    {
+      // [trueval, falseval, cond], with the condition's type only given in the new form
+      if(!valueAndType(a, aType) || !value(b))
+        return false;
+      if(IS_KNOWN(record.id, FunctionRecord::INST_VSELECT))
+      {
+        if(!valueAndType(c, bType))
+          return false;
+      }
+      else if(!value(c))
+      {
+        return false;
+      }
+      inst.op = Opcode::Select;
+      inst.type = aType;
+      addOperand(Operand::Value, c);
+      addOperand(Operand::Value, a);
+      addOperand(Operand::Value, b);
+      break;
+    }
+    case FunctionRecord::INST_EXTRACTELT:
+    {
+      // [vec, index]
+      if(!valueAndType(a, aType) || !valueAndType(b, bType))
+        return false;
+      inst.op = Opcode::ExtractElement;
+      inst.type = type(aType).kind == Type::Vector ? type(aType).inner : NoID;
+      addOperand(Operand::Value, a);
+      addOperand(Operand::Value, b);
+      break;
+    }
+    case FunctionRecord::INST_INSERTELT:
+    {
+      // [vec, element, index]
+      if(!valueAndType(a, aType) || !value(b) || !valueAndType(c, bType))
+        return false;
+      inst.op = Opcode::InsertElement;
+      inst.type = aType;
+      addOperand(Operand::Value, a);
+      addOperand(Operand::Value, b);
+      addOperand(Operand::Value, c);
+      break;
+    }
+    case FunctionRecord::INST_SHUFFLEVEC:
+    {
+      // [vec1, vec2, mask]
+      if(!valueAndType(a, aType) || !value(b) || !value(c))
+        return false;
+      const uint32_t maskType = typeOf(c);
+      if(!validType(maskType) || type(aType).kind != Type::Vector)
+        return false;
+      Type vec;
+      vec.kind = Type::Vector;
+      vec.count = type(maskType).count;
+      vec.inner = type(aType).inner;
+      inst.op = Opcode::ShuffleVector;
+      inst.type = m.FindType(vec);
+      addOperand(Operand::Value, a);
+      addOperand(Operand::Value, b);
+      addOperand(Operand::Value, c);
+      break;
+    }
+    case FunctionRecord::INST_CMP:
+    case FunctionRecord::INST_CMP2:
+    {
+      // [lhs, rhs, predicate, flags?]
+      if(!valueAndType(a, aType) || !value(b) || !next(lit))
+        return false;
+      inst.op = m.IsFloat(aType) ? Opcode::FCmp : Opcode::ICmp;
+      inst.predicate = uint32_t(lit);
+      if(!atEnd())
+        inst.flags = uint32_t((*ops)[cursor]);
+      inst.type = boolLike(aType);
+      addOperand(Operand::Value, a);
+      addOperand(Operand::Value, b);
+      break;
+    }
+    case FunctionRecord::INST_RET:
+    {
+      // [] or [value...]
+      inst.op = Opcode::Ret;
+      while(!atEnd())
+      {
+        if(!valueAndType(a, aType))
+          return false;
+        addOperand(Operand::Value, a);
+      }
+      break;
+    }
+    case FunctionRecord::INST_BR:
+    {
+      // [bb] or [truebb, falsebb, cond]
+      uint64_t trueBlock = 0, falseBlock = 0;
+      inst.op = Opcode::Br;
+      if(!next(trueBlock))
+        return false;
+      if(!atEnd())
+      {
+        if(!next(falseBlock) || !value(a))
+          return false;
+        addOperand(Operand::Value, a);
+        addOperand(Operand::Block, uint32_t(trueBlock));
+        addOperand(Operand::Block, uint32_t(falseBlock));
+      }
+      else
+      {
+        addOperand(Operand::Block, uint32_t(trueBlock));
+      }
+      break;
+    }
+    case FunctionRecord::INST_SWITCH:
+    {
+      // [opty, cond, defaultbb, (caseval, bb)...] where the case values are absolute IDs
+      uint64_t condType = 0, defaultBlock = 0;
+      if(!next(condType) || !value(a) || !next(defaultBlock))
+        return false;
+      // the magic number marks the newer form for wide case ranges, which DXIL never uses
+      if((condType >> 16) == 0x4B5)
+        return false;
+      inst.op = Opcode::Switch;
+      addOperand(Operand::Value, a);
+      addOperand(Operand::Block, uint32_t(defaultBlock));
+      while(!atEnd())
+      {
+        uint64_t caseValue = 0, caseBlock = 0;
+        if(!next(caseValue) || !next(caseBlock))
+          return false;
+        addOperand(Operand::Value, uint32_t(caseValue));
+        addOperand(Operand::Block, uint32_t(caseBlock));
+      }
+      break;
+    }
+    case FunctionRecord::INST_UNREACHABLE: inst.op = Opcode::Unreachable; break;
+    case FunctionRecord::INST_PHI:
+    {
+      // [ty, (value, bb)...] with signed relative values, since they can be forward references.
+      // Newer bitcode may add fast-math flags on the end
+      uint64_t phiType = 0;
+      if(!next(phiType))
+        return false;
+      inst.op = Opcode::Phi;
+      inst.type = uint32_t(phiType);
+      const size_t end = ops->size() - ((ops->size() - 1) % 2);
+      while(cursor < end)
+      {
+        const int64_t rel = DecodeSigned((*ops)[cursor++]);
+        const uint32_t id = relative ? uint32_t(int64_t(nextValue) - rel) : uint32_t(rel);
+        addOperand(Operand::Value, id);
+        addOperand(Operand::Block, uint32_t((*ops)[cursor++]));
+      }
+      if(end < ops->size())
+        inst.flags = uint32_t((*ops)[end]);
+      break;
+    }
+    case FunctionRecord::INST_ALLOCA:
+    {
+      // [instty, opty, size, align] where size is an absolute ID
+      uint64_t instType = 0, sizeType = 0, size = 0, align = 0;
+      if(!next(instType) || !next(sizeType) || !next(size) || !next(align))
+        return false;
+      inst.op = Opcode::Alloca;
+      inst.align = decodeAlign(align);
+      // bit 6 marks that the type is the allocated type, not the pointer to it
+      if(align & 0x40)
+      {
+        inst.auxType = uint32_t(instType);
+        inst.type = m.PointerTo(inst.auxType, 0);
+      }
+      else
+      {
+        inst.type = uint32_t(instType);
+        inst.auxType = validType(inst.type) ? type(inst.type).inner : NoID;
+      }
+      addOperand(Operand::Value, uint32_t(size));
+      break;
+    }
+    case FunctionRecord::INST_LOAD:
+    case FunctionRecord::INST_LOADATOMIC:
+    {
+      // [ptr, ty?, align, vol] then [ordering, synchscope] for atomics
+      const bool atomic = IS_KNOWN(record.id, FunctionRecord::INST_LOADATOMIC);
+      if(!valueAndType(a, aType))
+        return false;
+      inst.op = Opcode::Load;
+      if(cursor + (atomic ? 5 : 3) == ops->size())
+      {
+        uint64_t loadType = 0;
+        next(loadType);
+        inst.type = uint32_t(loadType);
+      }
+      else
+      {
+        inst.type = type(aType).inner;
+      }
+      uint64_t align = 0, vol = 0;
+      if(!next(align) || !next(vol))
+        return false;
+      inst.align = decodeAlign(align);
+      if(vol)
+        inst.flags |= MemoryVolatile;
+      if(atomic)
+      {
+        uint64_t ordering = 0, scope = 0;
+        if(!next(ordering) || !next(scope))
+          return false;
+        inst.flags |= uint32_t(ordering & MemoryOrderingMask) << MemoryOrderingShift;
+        if(scope == 0)
+          inst.flags |= MemorySingleThread;
+      }
+      addOperand(Operand::Value, a);
+      break;
+    }
+    case FunctionRecord::INST_STORE_OLD:
+    case FunctionRecord::INST_STORE:
+    case FunctionRecord::INST_STOREATOMIC_OLD:
+    case FunctionRecord::INST_STOREATOMIC:
+    {
+      // [ptr, val, align, vol] then [ordering, synchscope] for atomics. The value's type is only
+      // given in the newer forms
+      const bool atomic = IS_KNOWN(record.id, FunctionRecord::INST_STOREATOMIC_OLD) ||
+                          IS_KNOWN(record.id, FunctionRecord::INST_STOREATOMIC);
+      if(!valueAndType(a, aType))
+        return false;
+      if(IS_KNOWN(record.id, FunctionRecord::INST_STORE) ||
+         IS_KNOWN(record.id, FunctionRecord::INST_STOREATOMIC))
+      {
+        if(!valueAndType(b, bType))
+          return false;
+      }
+      else if(!value(b))
+      {
+        return false;
+      }
+      uint64_t align = 0, vol = 0;
+      if(!next(align) || !next(vol))
+        return false;
+      inst.op = Opcode::Store;
+      inst.align = decodeAlign(align);
+      if(vol)
+        inst.flags |= MemoryVolatile;
+      if(atomic)
+      {
+        uint64_t ordering = 0, scope = 0;
+        if(!next(ordering) || !next(scope))
+          return false;
+        inst.flags |= uint32_t(ordering & MemoryOrderingMask) << MemoryOrderingShift;
+        if(scope == 0)
+          inst.flags |= MemorySingleThread;
+      }
+      addOperand(Operand::Value, b);
+      addOperand(Operand::Value, a);
+      break;
+    }
+    case FunctionRecord::INST_EXTRACTVAL:
+    case FunctionRecord::INST_INSERTVAL:
+    {
+      // [agg, indices...] or [agg, val, indices...]
+      const bool insert = IS_KNOWN(record.id, FunctionRecord::INST_INSERTVAL);
+      if(!valueAndType(a, aType))
+        return false;
+      addOperand(Operand::Value, a);
+      if(insert)
+      {
+        if(!valueAndType(b, bType))
+          return false;
+        addOperand(Operand::Value, b);
+      }
+      uint32_t result = aType;
+      while(!atEnd())
+      {
+        next(lit);
+        addOperand(Operand::Literal, uint32_t(lit));
+        result = indexType(result, lit);
+      }
+      if(result == NoID)
+        return false;
+      inst.op = insert ? Opcode::InsertValue : Opcode::ExtractValue;
+      inst.type = insert ? aType : result;
+      break;
+    }
+    case FunctionRecord::INST_CALL:
+    {
+      // [paramattrs, cc, fmf?, fnty?, callee, args...]
+      uint64_t attrs = 0, cc = 0;
+      if(!next(attrs) || !next(cc))
+        return false;
+      inst.op = Opcode::Call;
+      inst.flags = uint32_t(cc);
+      // fast-math flags are present if bit 17 is set, then an explicit type if bit 15 is set
+      if(cc & (1 << 17))
+        next(lit);
+      if(cc & (1 << 15))
+      {
+        uint64_t funcType = 0;
+        if(!next(funcType))
+          return false;
+        inst.auxType = uint32_t(funcType);
+      }
+      if(!valueAndType(a, aType))
+        return false;
+      if(inst.auxType == NoID)
+        inst.auxType = type(aType).inner;
+      if(!validType(inst.auxType) || type(inst.auxType).kind != Type::Function)
+        return false;
+      addOperand(Operand::Value, a);
+
+      const Type &funcType = type(inst.auxType);
+      for(uint32_t param : funcType.members)
+      {
+        const Type::Kind kind = validType(param) ? type(param).kind : Type::Unknown;
+        if(kind == Type::Label)
+        {
+          // blocks are absolute
+          if(!next(lit))
+            return false;
+          addOperand(Operand::Block, uint32_t(lit));
+        }
+        else if(kind == Type::Metadata)
+        {
+          // metadata is numbered separately, but still encoded relative to the next value
+          if(!value(b))
+            return false;
+          addOperand(Operand::Metadata, b);
+        }
+        else
+        {
+          if(!value(b))
+            return false;
+          addOperand(Operand::Value, b);
+        }
+      }
+      // anything else is a vararg, with its type
+      while(funcType.vararg && !atEnd())
+      {
+        if(!valueAndType(b, bType))
+          return false;
+        addOperand(Operand::Value, b);
+      }
+      inst.type = funcType.inner;
+      break;
+    }
+    case FunctionRecord::INST_FENCE:
+    {
+      // [ordering, synchscope]
+      uint64_t ordering = 0, scope = 0;
+      if(!next(ordering) || !next(scope))
+        return false;
+      inst.op = Opcode::Fence;
+      inst.flags = uint32_t(ordering & MemoryOrderingMask) << MemoryOrderingShift;
+      if(scope == 0)
+        inst.flags |= MemorySingleThread;
+      break;
+    }
+    case FunctionRecord::INST_ATOMICRMW:
+    {
+      // [ptr, val, op, vol, ordering, synchscope]
+      uint64_t op = 0, vol = 0, ordering = 0, scope = 0;
+      if(!valueAndType(a, aType) || !value(b) || !next(op) || !next(vol) || !next(ordering) ||
+         !next(scope))
+        return false;
+      inst.op = Opcode::AtomicRMW;
+      inst.predicate = uint32_t(op);
+      if(vol)
+        inst.flags |= MemoryVolatile;
+      inst.flags |= uint32_t(ordering & MemoryOrderingMask) << MemoryOrderingShift;
+      if(scope == 0)
+        inst.flags |= MemorySingleThread;
+      inst.type = type(aType).inner;
+      addOperand(Operand::Value, a);
+      addOperand(Operand::Value, b);
+      break;
+    }
+    case FunctionRecord::INST_CMPXCHG:
+    {
+      // [ptr, cmp, new, vol, successordering, synchscope, failureordering, weak]
+      uint64_t vol = 0, ordering = 0, scope = 0, failure = 0, weak = 0;
+      if(!valueAndType(a, aType) || !valueAndType(b, bType) || !value(c) || !next(vol) ||
+         !next(ordering) || !next(scope) || !next(failure) || !next(weak))
+        return false;
+      inst.op = Opcode::CmpXchg;
+      if(vol)
+        inst.flags |= MemoryVolatile;
+      if(weak)
+        inst.flags |= MemoryWeak;
+      inst.flags |= uint32_t(ordering & MemoryOrderingMask) << MemoryOrderingShift;
+      inst.flags |= uint32_t(failure & MemoryOrderingMask) << MemoryFailureOrderingShift;
+      if(scope == 0)
+        inst.flags |= MemorySingleThread;
+      // returns the loaded value and whether it succeeded
+      Type pair;
+      pair.kind = Type::Struct;
+      pair.members.push_back(bType);
+      pair.members.push_back(m.m_BoolType);
+      inst.type = m.FindType(pair);
+      addOperand(Operand::Value, a);
+      addOperand(Operand::Value, b);
+      addOperand(Operand::Value, c);
+      break;
+    }
+    default:
+      // invokes, exception handling and the like don't exist in DXIL
+      return false;
+  }
+
+  if(inst.op == Opcode::Unknown)
+    return false;
+
+  // every value needs a type from the table, so anything we couldn't find is malformed. Calls
+  // always have one, but it may be void
+  switch(inst.op)
+  {
+    case Opcode::Ret:
+    case Opcode::Br:
+    case Opcode::Switch:
+    case Opcode::Unreachable:
+    case Opcode::Store:
+    case Opcode::Fence: return true;
+    default: return validType(inst.type);
+  }
+}
+};    // namespace DXIL
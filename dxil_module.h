@@ -0,0 +1,341 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "llvm_decoder.h"
+
+namespace DXIL
+{
+class Output;
+class Program;
+class ThreadPool;
+
+// for type, value, block and function references that aren't set
+static const uint32_t NoID = ~0U;
+
+struct Type
+{
+  enum Kind : uint8_t
+  {
+    Unknown,
+    Void,
+    Float,
+    Integer,
+    Pointer,
+    Array,
+    Vector,
+    Struct,
+    Function,
+    Label,
+    Metadata,
+  };
+
+  Kind kind = Unknown;
+  // structs that are packed, functions that are varargs
+  bool packed = false;
+  bool vararg = false;
+  // integer and float types
+  uint32_t bitWidth = 0;
+  // pointer types
+  uint32_t addrSpace = 0;
+  // array and vector types
+  uint64_t count = 0;
+  // the element type of arrays and vectors, the pointee of pointers, and functions' return type
+  uint32_t inner = NoID;
+  // struct members, or function parameters
+  std::vector<uint32_t> members;
+  // named structs only, otherwise empty
+  std::string name;
+};
+
+enum class ValueKind : uint8_t
+{
+  GlobalVariable,
+  Function,
+  Alias,
+  Constant,
+  Argument,
+  Instruction,
+};
+
+// every value in the bitcode's numbering. Module values (globals then constants) come first, then
+// each function's values (arguments, constants then instructions) continue the numbering
+struct Value
+{
+  ValueKind kind;
+  uint32_t type;
+  // index into the module's globals or constants, or the function's constants or instructions,
+  // or the argument number
+  uint32_t index;
+};
+
+struct GlobalValue
+{
+  // GlobalVariable, Function or Alias
+  ValueKind kind;
+  // the type of the variable, or the function's type. The value itself is a pointer to this
+  uint32_t valueType = NoID;
+  uint32_t type = NoID;
+  std::string name;
+  uint32_t linkage = 0;
+  uint32_t align = 0;
+  bool isConstant = false;
+  // functions without a body, and variables without an initializer
+  bool isDeclaration = false;
+  // value ID of the initializer for variables, or the aliasee for aliases
+  uint32_t initializer = NoID;
+  // for functions with bodies, the index into the module's functions
+  uint32_t function = NoID;
+};
+
+// constants point straight at their record, so the program they came from must outlive them
+struct Constant
+{
+  uint32_t type;
+  const LLVMBC::BlockOrRecord *record;
+};
+
+enum class Opcode : uint8_t
+{
+  Unknown,
+
+  Ret,
+  Br,
+  Switch,
+  Unreachable,
+
+  Add,
+  FAdd,
+  Sub,
+  FSub,
+  Mul,
+  FMul,
+  UDiv,
+  SDiv,
+  FDiv,
+  URem,
+  SRem,
+  FRem,
+  Shl,
+  LShr,
+  AShr,
+  And,
+  Or,
+  Xor,
+
+  Alloca,
+  Load,
+  Store,
+  GetElementPtr,
+  Fence,
+  CmpXchg,
+  AtomicRMW,
+
+  Trunc,
+  ZExt,
+  SExt,
+  FPToUI,
+  FPToSI,
+  UIToFP,
+  SIToFP,
+  FPTrunc,
+  FPExt,
+  PtrToInt,
+  IntToPtr,
+  BitCast,
+  AddrSpaceCast,
+
+  ICmp,
+  FCmp,
+  Phi,
+  Call,
+  Select,
+  ExtractElement,
+  InsertElement,
+  ShuffleVector,
+  ExtractValue,
+  InsertValue,
+};
+
+const char *OpcodeName(Opcode op);
+
+struct Operand
+{
+  enum Kind : uint8_t
+  {
+    // a value ID
+    Value,
+    // a basic block index in the function
+    Block,
+    // a metadata ID, for metadata passed as a call argument
+    Metadata,
+    // a plain number, e.g. an extractvalue index
+    Literal,
+  };
+
+  Kind kind;
+  uint32_t id;
+};
+
+// how volatile and atomic properties are packed into Instruction::flags for memory operations
+enum MemoryFlags : uint32_t
+{
+  MemoryVolatile = 0x1,
+  MemoryWeak = 0x2,
+  MemorySingleThread = 0x4,
+  // the ordering (or success ordering for cmpxchg), then the failure ordering for cmpxchg
+  MemoryOrderingShift = 4,
+  MemoryFailureOrderingShift = 8,
+  MemoryOrderingMask = 0xf,
+};
+
+struct Instruction
+{
+  Opcode op = Opcode::Unknown;
+  // the result's type and value ID, or NoID for instructions with no result
+  uint32_t type = NoID;
+  uint32_t value = NoID;
+  // the comparison predicate, or the atomicrmw operation
+  uint32_t predicate = 0;
+  // as in the record: wrap/exact/fast-math flags for binary operators, inbounds for GEPs, and the
+  // calling convention flags for calls. For memory operations see the MemoryFlags below
+  uint32_t flags = 0;
+  // in bytes, for alloca/load/store
+  uint32_t align = 0;
+  // the allocated type for alloca, source element type for GEP, or function type for calls
+  uint32_t auxType = NoID;
+  // into Function::operands. Operands are in the order they're written in assembly, so for example
+  // phis alternate value and block, and switches have the condition then the default block
+  uint32_t firstOperand = 0;
+  uint32_t numOperands = 0;
+};
+
+struct Function
+{
+  // index into the module's globals
+  uint32_t global = NoID;
+  const LLVMBC::BlockOrRecord *block = NULL;
+
+  // the value ID of the first argument. Arguments, then constants, then instructions follow
+  uint32_t firstValue = 0;
+  uint32_t numArgs = 0;
+  // indexed by value ID - firstValue
+  std::vector<Value> values;
+  std::vector<Constant> constants;
+  std::vector<Instruction> instructions;
+  std::vector<Operand> operands;
+  // the index of the first instruction in each basic block
+  std::vector<uint32_t> blocks;
+
+  // names from the function's symbol table, empty for unnamed values and blocks. Indexed the same
+  // as values and blocks
+  std::vector<std::string> valueNames;
+  std::vector<std::string> blockNames;
+
+  // if the body couldn't be fully decoded, why. Everything up to that point is still valid
+  const char *error = NULL;
+};
+
+// a typed view of a decoded program: the types, globals, constants and instructions with their
+// operands resolved to absolute value IDs. Built from an unfiltered program, which must outlive it.
+class Module
+{
+public:
+  // if pool is set, function bodies are decoded on it concurrently
+  Module(const Program &program, ThreadPool *pool = NULL);
+
+  const Program &GetProgram() const { return m_Program; }
+
+  // where anything at module level couldn't be decoded. Functions track their own errors
+  const char *GetError() const { return m_Error; }
+
+  uint32_t GetVersion() const { return m_Version; }
+  const std::string &GetTriple() const { return m_Triple; }
+  const std::string &GetDataLayout() const { return m_DataLayout; }
+
+  const std::vector<Type> &GetTypes() const { return m_Types; }
+  const std::vector<GlobalValue> &GetGlobals() const { return m_Globals; }
+  const std::vector<Constant> &GetConstants() const { return m_Constants; }
+  const std::vector<Function> &GetFunctions() const { return m_Functions; }
+
+  // module-level values only, function values are in each function
+  const std::vector<Value> &GetValues() const { return m_Values; }
+  uint32_t NumModuleValues() const { return uint32_t(m_Values.size()); }
+
+  // the value with this ID, looking in the function for IDs past the module values. NULL if the ID
+  // is out of range
+  const Value *GetValue(const Function &func, uint32_t valueID) const;
+  // NULL if the value isn't a constant
+  const Constant *GetConstant(const Function &func, uint32_t valueID) const;
+  // false if the value isn't a constant integer that fits in 64 bits
+  bool GetConstantInt(const Function &func, uint32_t valueID, int64_t &value) const;
+
+  // floats and vectors of floats
+  bool IsFloat(uint32_t type) const;
+
+private:
+  void ParseTypes(const LLVMBC::BlockOrRecord &block);
+  void ParseGlobal(const LLVMBC::BlockOrRecord &record);
+  void ParseSymbols(const LLVMBC::BlockOrRecord &block);
+  void ParseConstants(const LLVMBC::BlockOrRecord &block, std::vector<Constant> &constants,
+                      std::vector<Value> &values) const;
+
+  uint32_t PointerTo(uint32_t type, uint32_t addrSpace) const;
+  uint32_t FindType(const Type &type) const;
+
+  const Program &m_Program;
+  const char *m_Error = NULL;
+
+  uint32_t m_Version = 0;
+  std::string m_Triple;
+  std::string m_DataLayout;
+
+  std::vector<Type> m_Types;
+  // for finding the results of GEPs and the like, which are only given implicitly
+  std::map<std::pair<uint32_t, uint32_t>, uint32_t> m_PointerTypes;
+  uint32_t m_BoolType = NoID;
+
+  std::vector<GlobalValue> m_Globals;
+  std::vector<Constant> m_Constants;
+  std::vector<Value> m_Values;
+  std::vector<Function> m_Functions;
+
+  friend class FunctionParser;
+};
+
+// signed VBRs in records store the sign in the bottom bit
+inline int64_t DecodeSigned(uint64_t v)
+{
+  if(v & 1)
+    return v == 1 ? INT64_MIN : -int64_t(v >> 1);
+  return int64_t(v >> 1);
+}
+};    // namespace DXIL
@@ -0,0 +1,69 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "common.h"
+
+namespace DXIL
+{
+// a sink for all text output, so that callers decide where it goes and nothing is printed
+// directly to stdout.
+class Output
+{
+public:
+  virtual ~Output() {}
+  virtual void Write(const char *str, size_t length) = 0;
+
+  void Write(const char *str) { Write(str, strlen(str)); }
+  void Printf(const char *fmt, ...) PRINTF_FORMAT(2, 3);
+};
+
+class FileOutput : public Output
+{
+public:
+  FileOutput(FILE *f) : m_File(f) {}
+  void Write(const char *str, size_t length) override { fwrite(str, 1, length, m_File); }
+  using Output::Write;
+
+private:
+  FILE *m_File;
+};
+
+class StringOutput : public Output
+{
+public:
+  void Write(const char *str, size_t length) override { m_String.append(str, length); }
+  using Output::Write;
+
+  const std::string &GetString() const { return m_String; }
+  void Clear() { m_String.clear(); }
+
+private:
+  std::string m_String;
+};
+};    // namespace DXIL
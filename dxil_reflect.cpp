@@ -0,0 +1,291 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxil_reflect.h"
+#include <string.h>
+#include "dxbc_container.h"
+#include "dxil_output.h"
+
+namespace DXIL
+{
+// from DxilContainer.h
+struct ProgramSignatureHeader
+{
+  uint32_t ParamCount;
+  uint32_t ParamOffset;
+};
+
+struct ProgramSignatureElement
+{
+  uint32_t Stream;
+  uint32_t SemanticName;    // Offset to the name from the start of the chunk data
+  uint32_t SemanticIndex;
+  uint32_t SystemValue;
+  uint32_t CompType;
+  uint32_t Register;
+  uint8_t Mask;
+  uint8_t RWMask;    // NeverWrites_Mask for outputs, AlwaysReads_Mask for inputs
+  uint16_t Pad;
+  uint32_t MinPrecision;
+};
+
+// from DxilPipelineStateValidation.h - only the parts common to all versions
+struct PSVResourceBindInfo0
+{
+  uint32_t ResType;
+  uint32_t Space;
+  uint32_t LowerBound;
+  uint32_t UpperBound;
+};
+
+static void ReflectSignature(const DXBCChunkHeader *chunk, std::vector<SignatureElement> &sig)
+{
+  if(!chunk || chunk->dataLength < sizeof(ProgramSignatureHeader))
+    return;
+
+  const byte *data = (const byte *)(chunk + 1);
+  const size_t length = chunk->dataLength;
+
+  const ProgramSignatureHeader *header = (const ProgramSignatureHeader *)data;
+
+  if(header->ParamOffset > length ||
+     header->ParamCount > (length - header->ParamOffset) / sizeof(ProgramSignatureElement))
+    return;
+
+  const byte *elements = data + header->ParamOffset;
+
+  sig.resize(header->ParamCount);
+  for(uint32_t i = 0; i < header->ParamCount; i++)
+  {
+    // the offset isn't guaranteed to be aligned
+    ProgramSignatureElement el;
+    memcpy(&el, elements + i * sizeof(el), sizeof(el));
+
+    SignatureElement &dst = sig[i];
+
+    dst.semanticName = "";
+    // the name must be NULL terminated inside the chunk
+    if(el.SemanticName < length && memchr(data + el.SemanticName, 0, length - el.SemanticName))
+      dst.semanticName = (const char *)(data + el.SemanticName);
+
+    dst.semanticIndex = el.SemanticIndex;
+    dst.systemValue = el.SystemValue;
+    dst.compType = el.CompType;
+    dst.registerIndex = el.Register;
+    dst.mask = el.Mask;
+    dst.rwMask = el.RWMask;
+    dst.stream = el.Stream;
+    dst.minPrecision = el.MinPrecision;
+  }
+}
+
+static void ReflectResources(const DXBCChunkHeader *chunk, std::vector<ResourceBinding> &resources)
+{
+  if(!chunk)
+    return;
+
+  const byte *data = (const byte *)(chunk + 1);
+  const byte *end = data + chunk->dataLength;
+
+  auto readUInt = [&data, end](uint32_t &val) {
+    if(end - data < (ptrdiff_t)sizeof(uint32_t))
+      return false;
+    memcpy(&val, data, sizeof(uint32_t));
+    data += sizeof(uint32_t);
+    return true;
+  };
+
+  // the runtime info is versioned by size, we don't need anything in it so skip it whole
+  uint32_t runtimeInfoSize = 0;
+  if(!readUInt(runtimeInfoSize) || runtimeInfoSize > uint32_t(end - data))
+    return;
+  data += runtimeInfoSize;
+
+  uint32_t resourceCount = 0;
+  if(!readUInt(resourceCount) || resourceCount == 0)
+    return;
+
+  // likewise the bind info is versioned by size, but always starts with the same data
+  uint32_t bindInfoSize = 0;
+  if(!readUInt(bindInfoSize) || bindInfoSize < sizeof(PSVResourceBindInfo0) ||
+     resourceCount > uint32_t(end - data) / bindInfoSize)
+    return;
+
+  resources.resize(resourceCount);
+  for(uint32_t i = 0; i < resourceCount; i++, data += bindInfoSize)
+  {
+    PSVResourceBindInfo0 bind;
+    memcpy(&bind, data, sizeof(bind));
+
+    resources[i].type = ResourceType(bind.ResType);
+    resources[i].space = bind.Space;
+    resources[i].lowerBound = bind.LowerBound;
+    resources[i].upperBound = bind.UpperBound;
+  }
+}
+
+bool Reflect(const void *bytes, size_t length, Reflection &refl)
+{
+  DXBC::Container container(bytes, length);
+
+  if(!container.IsValid())
+    return false;
+
+  const DXBCChunkHeader *dxil = container.FindBestDXILChunk();
+
+  // we only need the program header, not the bitcode that follows it
+  if(!dxil || dxil->dataLength < sizeof(ProgramHeader))
+    return false;
+
+  const ProgramHeader *header = (const ProgramHeader *)(dxil + 1);
+  if(header->DxilMagic != MAKE_FOURCC('D', 'X', 'I', 'L'))
+    return false;
+
+  refl.shaderType = header->ProgramType;
+  refl.shaderModelMajor = (header->ProgramVersion & 0xf0) >> 4;
+  refl.shaderModelMinor = header->ProgramVersion & 0xf;
+  refl.dxilVersion = header->DxilVersion;
+  refl.hasDebugInfo = (dxil->fourcc == MAKE_FOURCC('I', 'L', 'D', 'B'));
+
+  const DXBCChunkHeader *chunk = container.FindChunk(MAKE_FOURCC('S', 'F', 'I', '0'));
+  if(chunk && chunk->dataLength >= sizeof(Features))
+  {
+    refl.hasFeatures = true;
+    memcpy(&refl.features, chunk + 1, sizeof(Features));
+  }
+
+  chunk = container.FindChunk(MAKE_FOURCC('I', 'L', 'D', 'N'));
+  if(chunk)
+  {
+    DebugName name(chunk + 1, chunk->dataLength);
+    if(name.name[0])
+      refl.debugName = name.name;
+  }
+
+  ReflectResources(container.FindChunk(MAKE_FOURCC('P', 'S', 'V', '0')), refl.resources);
+
+  ReflectSignature(container.FindChunk(MAKE_FOURCC('I', 'S', 'G', '1')), refl.inputSig);
+  ReflectSignature(container.FindChunk(MAKE_FOURCC('O', 'S', 'G', '1')), refl.outputSig);
+  ReflectSignature(container.FindChunk(MAKE_FOURCC('P', 'S', 'G', '1')), refl.patchConstantSig);
+
+  return true;
+}
+
+const char *ResourceTypeName(ResourceType type)
+{
+  switch(type)
+  {
+    case ResourceType::Invalid: return "Invalid";
+    case ResourceType::Sampler: return "Sampler";
+    case ResourceType::CBV: return "CBV";
+    case ResourceType::SRVTyped: return "SRVTyped";
+    case ResourceType::SRVRaw: return "SRVRaw";
+    case ResourceType::SRVStructured: return "SRVStructured";
+    case ResourceType::UAVTyped: return "UAVTyped";
+    case ResourceType::UAVRaw: return "UAVRaw";
+    case ResourceType::UAVStructured: return "UAVStructured";
+    case ResourceType::UAVStructuredWithCounter: return "UAVStructuredWithCounter";
+  }
+
+  return "Unknown";
+}
+
+static void PrintSignature(Output &out, const char *name, const std::vector<SignatureElement> &sig)
+{
+  if(sig.empty())
+    return;
+
+  out.Printf("; %s signature:\n", name);
+  for(const SignatureElement &el : sig)
+  {
+    char mask[5] = "____";
+    for(int c = 0; c < 4; c++)
+      if(el.mask & (1 << c))
+        mask[c] = "xyzw"[c];
+
+    out.Printf(";   %s%u register %u mask %s sysvalue %u comptype %u stream %u\n", el.semanticName,
+               el.semanticIndex, el.registerIndex, mask, el.systemValue, el.compType, el.stream);
+  }
+}
+
+void PrintReflection(const Reflection &refl, Output &out)
+{
+  static const char *featureNames[] = {
+      "Double-precision floating point",
+      "Raw and Structured buffers",
+      "UAVs at every shader stage",
+      "64 UAV slots",
+      "Minimum-precision data types",
+      "Double-precision extensions for 11.1",
+      "Shader extensions for 11.1",
+      "Comparison filtering for feature level 9",
+      "Tiled resources",
+      "PS Output Stencil Ref",
+      "PS Inner Coverage",
+      "Typed UAV Load Additional Formats",
+      "Raster Ordered UAVs",
+      "SV_RenderTargetArrayIndex or SV_ViewportArrayIndex from any shader feeding rasterizer",
+      "Wave level operations",
+      "64-Bit integer",
+      "View Instancing",
+      "Barycentrics",
+      "Use native low precision",
+      "Shading Rate",
+      "Raytracing tier 1.1 features",
+      "Sampler feedback",
+  };
+
+  out.Printf("; %s Shader, compiled under SM%u.%u, DXIL version %u.%u%s\n",
+             ShaderTypeName(refl.shaderType), refl.shaderModelMajor, refl.shaderModelMinor,
+             refl.dxilVersion >> 8, refl.dxilVersion & 0xff,
+             refl.hasDebugInfo ? ", with debug info" : "");
+
+  if(refl.debugName)
+    out.Printf("; shader debug name: %s\n", refl.debugName);
+
+  if(refl.hasFeatures)
+  {
+    out.Printf("; features:\n");
+    for(size_t i = 0; i < sizeof(featureNames) / sizeof(featureNames[0]); i++)
+    {
+      if(uint64_t(refl.features) & (1ULL << i))
+        out.Printf(";   %s\n", featureNames[i]);
+    }
+  }
+
+  if(!refl.resources.empty())
+  {
+    out.Printf("; resources:\n");
+    for(const ResourceBinding &res : refl.resources)
+    {
+      out.Printf(";   %s space %u registers [%u, %u]\n", ResourceTypeName(res.type), res.space,
+                 res.lowerBound, res.upperBound);
+    }
+  }
+
+  PrintSignature(out, "input", refl.inputSig);
+  PrintSignature(out, "output", refl.outputSig);
+  PrintSignature(out, "patch constant", refl.patchConstantSig);
+}
+};    // namespace DXIL
@@ -0,0 +1,100 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include "dxil_inspect.h"
+
+namespace DXIL
+{
+// from DxilPipelineStateValidation.h
+enum class ResourceType : uint32_t
+{
+  Invalid = 0,
+  Sampler,
+  CBV,
+  SRVTyped,
+  SRVRaw,
+  SRVStructured,
+  UAVTyped,
+  UAVRaw,
+  UAVStructured,
+  UAVStructuredWithCounter,
+};
+
+const char *ResourceTypeName(ResourceType type);
+
+struct ResourceBinding
+{
+  ResourceType type;
+  uint32_t space;
+  uint32_t lowerBound;
+  uint32_t upperBound;
+};
+
+struct SignatureElement
+{
+  // points into the container's signature chunk, so the lifetime is limited.
+  const char *semanticName;
+  uint32_t semanticIndex;
+  uint32_t systemValue;
+  uint32_t compType;
+  uint32_t registerIndex;
+  uint8_t mask;
+  uint8_t rwMask;
+  uint32_t stream;
+  uint32_t minPrecision;
+};
+
+// everything that can be determined purely from the container chunks and the program header,
+// without touching the bitcode.
+struct Reflection
+{
+  uint16_t shaderType = 0;
+  uint32_t shaderModelMajor = 0;
+  uint32_t shaderModelMinor = 0;
+  uint32_t dxilVersion = 0;
+
+  bool hasDebugInfo = false;
+
+  bool hasFeatures = false;
+  Features features = Features(0);
+
+  // points into the container's ILDN chunk, so the lifetime is limited.
+  const char *debugName = NULL;
+
+  std::vector<ResourceBinding> resources;
+
+  std::vector<SignatureElement> inputSig;
+  std::vector<SignatureElement> outputSig;
+  std::vector<SignatureElement> patchConstantSig;
+};
+
+// fills out refl from the container. Returns false if the container is invalid or there is no
+// DXIL program in it.
+bool Reflect(const void *bytes, size_t length, Reflection &refl);
+
+void PrintReflection(const Reflection &refl, Output &out);
+};    // namespace DXIL
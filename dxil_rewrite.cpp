@@ -0,0 +1,72 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxil_rewrite.h"
+#include <string.h>
+#include "dxil_inspect.h"
+
+namespace DXIL
+{
+ProgramRewriter::ProgramRewriter(const Program &program)
+    : LLVMBC::BitcodeRewriter(program.GetBitcode(), program.GetBitcodeSize(), program.GetRoot()),
+      m_Program(program)
+{
+}
+
+bool ProgramRewriter::WriteProgram(std::vector<byte> &out)
+{
+  if(m_Program.GetStatus().Failed() || !m_Program.GetHeader())
+  {
+    m_Error = "The program couldn't be decoded";
+    return false;
+  }
+
+  if(m_Program.IsFiltered())
+  {
+    m_Error = "Only part of the program was decoded";
+    return false;
+  }
+
+  // the header and anything up to the bitcode is kept as it is
+  const byte *start = (const byte *)m_Program.GetHeader();
+  const size_t bitcodeOffset = size_t(m_Program.GetBitcode() - start);
+
+  const size_t base = out.size();
+  out.insert(out.end(), start, start + bitcodeOffset);
+
+  if(!Write(out))
+  {
+    out.resize(base);
+    return false;
+  }
+
+  ProgramHeader header;
+  memcpy(&header, out.data() + base, sizeof(header));
+  header.BitcodeSize = uint32_t(out.size() - base - bitcodeOffset);
+  header.SizeInUint32 = uint32_t((out.size() - base + 3) / 4);
+  memcpy(out.data() + base, &header, sizeof(header));
+
+  return true;
+}
+};    // namespace DXIL
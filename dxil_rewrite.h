@@ -0,0 +1,51 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include "common.h"
+#include "llvm_bitwriter.h"
+
+namespace DXIL
+{
+class Program;
+
+// edits a decoded program's bitcode, see LLVMBC::BitcodeRewriter. Edits name entries in the
+// program's tree, which must have been decoded without a filter. The program and the bytes it was
+// decoded from must outlive the rewriter.
+class ProgramRewriter : public LLVMBC::BitcodeRewriter
+{
+public:
+  explicit ProgramRewriter(const Program &program);
+
+  // appends the program as it goes in a DXIL chunk: its header with the sizes fixed up for the new
+  // bitcode, then the bitcode. The program is taken to end with its bitcode, as DXC writes it.
+  // Nothing is appended if it fails
+  bool WriteProgram(std::vector<byte> &out);
+
+private:
+  const Program &m_Program;
+};
+};    // namespace DXIL
@@ -0,0 +1,713 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxil_server.h"
+#include <errno.h>
+
+#if defined(_WIN32)
+
+namespace DXIL
+{
+bool RunServer(const ServerConfig &config)
+{
+  errno = ENOSYS;
+  return false;
+}
+};    // namespace DXIL
+
+#else
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "dxbc_container.h"
+#include "dxil_formats.h"
+#include "dxil_inspect.h"
+#include "dxil_output.h"
+#include "dxil_reflect.h"
+
+namespace DXIL
+{
+enum class ServerOp
+{
+  Reflect,
+  Dump,
+  Stats,
+  Count,
+};
+
+static const char *serverOpNames[] = {"reflect", "dump", "stats"};
+
+// longer lines than this are refused, rather than buffered without limit
+static const size_t MaxRequestLength = 4096;
+// descriptors received but not yet used by a request. Any more than this are closed on arrival
+static const size_t MaxPendingDescriptors = 16;
+// latency percentiles are over this many of the most recent requests of each operation
+static const size_t LatencyWindow = 4096;
+
+// a read-only mapping of a descriptor sent by a client. Only sealed memfds are mapped: the client
+// could otherwise shrink the object while it's mapped, faulting the whole server, or change it
+// after it has been checked
+class SharedBuffer
+{
+public:
+  SharedBuffer() {}
+  ~SharedBuffer()
+  {
+    if(m_Data)
+      munmap(m_Data, m_Size);
+  }
+
+  SharedBuffer(const SharedBuffer &) = delete;
+  SharedBuffer &operator=(const SharedBuffer &) = delete;
+
+  static bool IsSealed(int fd)
+  {
+#if defined(F_GET_SEALS)
+    const int seals = fcntl(fd, F_GET_SEALS);
+    return seals >= 0 && (seals & F_SEAL_SHRINK) && (seals & F_SEAL_WRITE);
+#else
+    (void)fd;
+    return false;
+#endif
+  }
+
+  // the descriptor must be sealed
+  bool Open(int fd)
+  {
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0)
+      return false;
+
+    void *data = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED)
+      return false;
+
+    m_Data = data;
+    m_Size = size_t(st.st_size);
+    return true;
+  }
+
+  const byte *Data() const { return (const byte *)m_Data; }
+  size_t Size() const { return m_Size; }
+
+private:
+  void *m_Data = NULL;
+  size_t m_Size = 0;
+};
+
+// reads a whole file into memory. A mapping could be truncated or rewritten by whatever produced
+// the file while it's being decoded, which would fault or confuse the server
+static bool readFile(const std::string &filename, std::vector<byte> &data)
+{
+  const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd < 0)
+    return false;
+
+  struct stat st;
+  const bool ok = fstat(fd, &st) == 0;
+
+  // if the file changes size while it's read, whatever was read is decoded
+  size_t have = 0;
+  if(ok)
+  {
+    data.resize(size_t(st.st_size));
+    while(have < data.size())
+    {
+      ssize_t numRead = pread(fd, data.data() + have, data.size() - have, off_t(have));
+      if(numRead < 0 && errno == EINTR)
+        continue;
+      if(numRead <= 0)
+        break;
+      have += size_t(numRead);
+    }
+    data.resize(have);
+  }
+
+  const int err = errno;
+  close(fd);
+  errno = err;
+  return ok;
+}
+
+// the key for a container's results: the operation, the container's header up to and including
+// its hash, and a digest of the rest of the bytes. Nothing the client claims is trusted
+static std::string cacheKey(ServerOp op, const byte *data, size_t size)
+{
+  uint8_t digest[16];
+  DXBC::ComputeContainerHash(data, size, digest);
+
+  const size_t headerBytes = offsetof(DXBCFileHeader, majorVersion);
+
+  std::string key;
+  key.push_back(char(op));
+  key.append((const char *)data, headerBytes);
+  key.append((const char *)digest, sizeof(digest));
+  return key;
+}
+
+// results by cacheKey, evicting the least recently used past the size limit. Each container is kept
+// along with its results and compared on a hit, so two that share a digest never share results
+class ResultCache
+{
+public:
+  explicit ResultCache(size_t maxBytes) : m_MaxBytes(maxBytes) {}
+
+  std::shared_ptr<const std::string> Find(const std::string &key, const byte *data, size_t size)
+  {
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    auto it = m_Index.find(key);
+    if(it == m_Index.end())
+      return NULL;
+
+    const std::string &container = it->second->container;
+    if(container.size() != size || memcmp(container.data(), data, size) != 0)
+      return NULL;
+
+    m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+    return it->second->result;
+  }
+
+  void Add(const std::string &key, const byte *data, size_t size,
+           std::shared_ptr<const std::string> result)
+  {
+    if(result->size() + size > m_MaxBytes)
+      return;
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+
+    // another client may have decoded the same container at the same time
+    if(m_Index.find(key) != m_Index.end())
+      return;
+
+    m_Entries.emplace_front();
+    Entry &entry = m_Entries.front();
+    entry.key = key;
+    entry.container.assign((const char *)data, size);
+    entry.result = result;
+
+    m_Index[key] = m_Entries.begin();
+    m_Bytes += entry.Size();
+
+    while(m_Bytes > m_MaxBytes)
+    {
+      m_Bytes -= m_Entries.back().Size();
+      m_Index.erase(m_Entries.back().key);
+      m_Entries.pop_back();
+    }
+  }
+
+  void GetSize(size_t &entries, size_t &bytes)
+  {
+    std::lock_guard<std::mutex> lock(m_Lock);
+    entries = m_Entries.size();
+    bytes = m_Bytes;
+  }
+
+private:
+  struct Entry
+  {
+    std::string key;
+    std::string container;
+    std::shared_ptr<const std::string> result;
+
+    size_t Size() const { return container.size() + result->size(); }
+  };
+  typedef std::list<Entry> EntryList;
+
+  std::mutex m_Lock;
+  size_t m_MaxBytes;
+  size_t m_Bytes = 0;
+  // most recently used first
+  EntryList m_Entries;
+  std::unordered_map<std::string, EntryList::iterator> m_Index;
+};
+
+class Server
+{
+public:
+  explicit Server(const ServerConfig &config) : m_Config(config), m_Cache(config.cacheSize)
+  {
+    m_Start = std::chrono::steady_clock::now();
+  }
+
+  // blocks while the most clients are already connected
+  void AcquireClient();
+  void ServeClient(int sock);
+
+private:
+  bool HandleRequest(int sock, const std::string &line, std::vector<int> &descriptors);
+  bool Process(ServerOp op, const byte *data, size_t size,
+               std::shared_ptr<const std::string> &result, std::string &error);
+  void WriteServerStats(Output &out);
+  void RecordLatency(ServerOp op, uint64_t micros);
+
+  ServerConfig m_Config;
+  ResultCache m_Cache;
+  std::chrono::steady_clock::time_point m_Start;
+
+  std::mutex m_ClientLock;
+  std::condition_variable m_ClientDone;
+  uint32_t m_NumClients = 0;
+
+  std::mutex m_StatsLock;
+  uint64_t m_NumRequests = 0;
+  uint64_t m_NumErrors = 0;
+  uint64_t m_NumCacheHits = 0;
+  struct Latencies
+  {
+    uint64_t count = 0;
+    // a ring of the most recent, oldest at count % LatencyWindow once it's full
+    std::vector<uint64_t> recent;
+  } m_Latencies[size_t(ServerOp::Count)];
+};
+
+static bool sendAll(int sock, const char *data, size_t length)
+{
+  while(length > 0)
+  {
+    ssize_t numSent = write(sock, data, length);
+    if(numSent < 0 && errno == EINTR)
+      continue;
+    if(numSent <= 0)
+      return false;
+
+    data += numSent;
+    length -= size_t(numSent);
+  }
+
+  return true;
+}
+
+static bool sendResponse(int sock, bool ok, const char *data, size_t length)
+{
+  char header[32];
+  int headerLength = snprintf(header, sizeof(header), "%s %llu\n", ok ? "ok" : "error",
+                              (unsigned long long)length);
+
+  return sendAll(sock, header, size_t(headerLength)) && sendAll(sock, data, length);
+}
+
+// reads whatever is available, adding any descriptors sent with it to the end of descriptors
+static ssize_t receive(int sock, char *buf, size_t size, std::vector<int> &descriptors)
+{
+  iovec iov = {buf, size};
+
+  union
+  {
+    cmsghdr align;
+    char data[CMSG_SPACE(sizeof(int) * MaxPendingDescriptors)];
+  } control;
+
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data;
+  msg.msg_controllen = sizeof(control.data);
+
+  int flags = 0;
+#if defined(MSG_CMSG_CLOEXEC)
+  flags |= MSG_CMSG_CLOEXEC;
+#endif
+
+  ssize_t numRead;
+  do
+  {
+    numRead = recvmsg(sock, &msg, flags);
+  } while(numRead < 0 && errno == EINTR);
+
+  if(numRead < 0)
+    return numRead;
+
+  for(cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+  {
+    if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+
+    const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for(size_t i = 0; i < count; i++)
+    {
+      int fd;
+      memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+
+      if(descriptors.size() < MaxPendingDescriptors)
+        descriptors.push_back(fd);
+      else
+        close(fd);
+    }
+  }
+
+  return numRead;
+}
+
+void Server::AcquireClient()
+{
+  std::unique_lock<std::mutex> lock(m_ClientLock);
+  m_ClientDone.wait(lock, [this]() { return m_NumClients < std::max(m_Config.maxClients, 1U); });
+  m_NumClients++;
+}
+
+void Server::ServeClient(int sock)
+{
+  std::string pending;
+  std::vector<int> descriptors;
+  char buf[4096];
+
+  for(;;)
+  {
+    size_t end = pending.find('\n');
+    if(end == std::string::npos)
+    {
+      if(pending.size() > MaxRequestLength)
+      {
+        const char message[] = "request too long";
+        sendResponse(sock, false, message, sizeof(message) - 1);
+        break;
+      }
+
+      ssize_t numRead = receive(sock, buf, sizeof(buf), descriptors);
+      if(numRead <= 0)
+        break;
+
+      pending.append(buf, size_t(numRead));
+      continue;
+    }
+
+    std::string line = pending.substr(0, end);
+    pending.erase(0, end + 1);
+
+    if(!line.empty() && line.back() == '\r')
+      line.pop_back();
+
+    if(!HandleRequest(sock, line, descriptors))
+      break;
+  }
+
+  for(int fd : descriptors)
+    close(fd);
+  close(sock);
+
+  {
+    std::lock_guard<std::mutex> lock(m_ClientLock);
+    m_NumClients--;
+  }
+  m_ClientDone.notify_one();
+}
+
+bool Server::HandleRequest(int sock, const std::string &line, std::vector<int> &descriptors)
+{
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  {
+    std::lock_guard<std::mutex> lock(m_StatsLock);
+    m_NumRequests++;
+  }
+
+  if(line == "stats")
+  {
+    StringOutput out;
+    WriteServerStats(out);
+    return sendResponse(sock, true, out.GetString().data(), out.GetString().size());
+  }
+
+  ServerOp op = ServerOp::Count;
+  size_t opLength = 0;
+  for(size_t i = 0; i < size_t(ServerOp::Count); i++)
+  {
+    opLength = strlen(serverOpNames[i]);
+    if(line.compare(0, opLength, serverOpNames[i]) == 0 && line.size() > opLength &&
+       line[opLength] == ' ')
+    {
+      op = ServerOp(i);
+      break;
+    }
+  }
+
+  std::string error;
+  std::shared_ptr<const std::string> result;
+
+  if(op == ServerOp::Count)
+  {
+    error = "unknown request";
+  }
+  else if(line.compare(opLength, 6, " path ") == 0 && line.size() > opLength + 6)
+  {
+    const std::string filename = line.substr(opLength + 6);
+
+    std::vector<byte> file;
+    if(!readFile(filename, file))
+      error = "couldn't read file " + filename + ": " + strerror(errno);
+    else
+      Process(op, file.data(), file.size(), result, error);
+  }
+  else if(line.compare(opLength, std::string::npos, " fd") == 0)
+  {
+    if(descriptors.empty())
+    {
+      error = "no descriptor was sent with the request";
+    }
+    else
+    {
+      // descriptors are used in the order they arrived
+      const int fd = descriptors.front();
+      descriptors.erase(descriptors.begin());
+
+      SharedBuffer buffer;
+      if(!SharedBuffer::IsSealed(fd))
+        error = "descriptor must be a memfd sealed with F_SEAL_SHRINK and F_SEAL_WRITE";
+      else if(!buffer.Open(fd))
+        error = std::string("couldn't map descriptor: ") + strerror(errno);
+      else
+        Process(op, buffer.Data(), buffer.Size(), result, error);
+
+      close(fd);
+    }
+  }
+  else
+  {
+    error = "expected 'path FILE' or 'fd' after the operation";
+  }
+
+  bool sent;
+  if(result)
+    sent = sendResponse(sock, true, result->data(), result->size());
+  else
+    sent = sendResponse(sock, false, error.data(), error.size());
+
+  if(result)
+  {
+    const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+    RecordLatency(op, uint64_t(
+                          std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+  }
+  else
+  {
+    std::lock_guard<std::mutex> lock(m_StatsLock);
+    m_NumErrors++;
+  }
+
+  return sent;
+}
+
+bool Server::Process(ServerOp op, const byte *data, size_t size,
+                     std::shared_ptr<const std::string> &result, std::string &error)
+{
+  DXBC::Container container(data, size);
+
+  if(!container.IsValid())
+  {
+    error = "invalid DXBC container";
+    return false;
+  }
+
+  const std::string key = cacheKey(op, data, size);
+
+  result = m_Cache.Find(key, data, size);
+  if(result)
+  {
+    std::lock_guard<std::mutex> lock(m_StatsLock);
+    m_NumCacheHits++;
+    return true;
+  }
+
+  if(!container.FindBestDXILChunk())
+  {
+    error = "couldn't find DXIL chunk";
+    return false;
+  }
+
+  StringOutput out;
+
+  if(op == ServerOp::Reflect)
+  {
+    Reflection refl;
+    if(!Reflect(data, size, refl))
+    {
+      error = "couldn't find DXIL chunk";
+      return false;
+    }
+
+    PrintReflection(refl, out);
+  }
+  else
+  {
+    LLVMBC::BitcodeStats stats;
+    Program dxil(container, op == ServerOp::Stats ? &stats : NULL, NULL);
+
+    LLVMBC::DecodeStatus status = dxil.GetStatus();
+    if(status.Failed())
+    {
+      char message[128];
+      snprintf(message, sizeof(message), "couldn't decode DXIL: %s at bit %llu",
+               LLVMBC::DecodeErrorString(status.error), (unsigned long long)status.bitOffset);
+      error = message;
+      return false;
+    }
+
+    if(op == ServerOp::Stats)
+      PrintStats(stats, out);
+    else
+      WriteJSON(dxil, out);
+  }
+
+  result = std::make_shared<const std::string>(out.GetString());
+
+  m_Cache.Add(key, data, size, result);
+
+  return true;
+}
+
+void Server::RecordLatency(ServerOp op, uint64_t micros)
+{
+  std::lock_guard<std::mutex> lock(m_StatsLock);
+
+  Latencies &latencies = m_Latencies[size_t(op)];
+  if(latencies.recent.size() < LatencyWindow)
+    latencies.recent.push_back(micros);
+  else
+    latencies.recent[latencies.count % LatencyWindow] = micros;
+  latencies.count++;
+}
+
+void Server::WriteServerStats(Output &out)
+{
+  size_t cacheEntries = 0, cacheBytes = 0;
+  m_Cache.GetSize(cacheEntries, cacheBytes);
+
+  uint32_t numClients = 0;
+  {
+    std::lock_guard<std::mutex> lock(m_ClientLock);
+    numClients = m_NumClients;
+  }
+
+  const std::chrono::steady_clock::duration uptime = std::chrono::steady_clock::now() - m_Start;
+
+  std::lock_guard<std::mutex> lock(m_StatsLock);
+
+  out.Printf("{\"uptime\":%llu,\"clients\":%u,\"requests\":%llu,\"errors\":%llu,",
+             (unsigned long long)std::chrono::duration_cast<std::chrono::seconds>(uptime).count(),
+             numClients, (unsigned long long)m_NumRequests, (unsigned long long)m_NumErrors);
+  out.Printf("\"cache\":{\"hits\":%llu,\"entries\":%llu,\"bytes\":%llu},\"latency\":{",
+             (unsigned long long)m_NumCacheHits, (unsigned long long)cacheEntries,
+             (unsigned long long)cacheBytes);
+
+  std::vector<uint64_t> sorted;
+  for(size_t i = 0; i < size_t(ServerOp::Count); i++)
+  {
+    const Latencies &latencies = m_Latencies[i];
+
+    sorted = latencies.recent;
+    std::sort(sorted.begin(), sorted.end());
+
+    // nearest rank, so every percentile is a latency that was actually seen
+    uint64_t percentiles[3] = {};
+    const uint32_t ranks[3] = {50, 90, 99};
+    for(size_t p = 0; p < 3 && !sorted.empty(); p++)
+      percentiles[p] = sorted[(sorted.size() * ranks[p] + 99) / 100 - 1];
+
+    out.Printf("%s\"%s\":{\"count\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu}",
+               i > 0 ? "," : "", serverOpNames[i], (unsigned long long)latencies.count,
+               (unsigned long long)percentiles[0], (unsigned long long)percentiles[1],
+               (unsigned long long)percentiles[2],
+               (unsigned long long)(sorted.empty() ? 0 : sorted.back()));
+  }
+
+  out.Printf("}}\n");
+}
+
+bool RunServer(const ServerConfig &config)
+{
+  // a client hanging up mid-response should only end that client
+  signal(SIGPIPE, SIG_IGN);
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+
+  if(!config.socketPath || strlen(config.socketPath) >= sizeof(addr.sun_path))
+  {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+
+  strcpy(addr.sun_path, config.socketPath);
+
+  // a socket left behind by a server that was killed would stop this one binding. Anything else
+  // at the path is left alone
+  struct stat st;
+  if(lstat(config.socketPath, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(config.socketPath);
+
+  int listenSock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(listenSock < 0)
+    return false;
+
+  if(bind(listenSock, (const sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenSock, 64) != 0)
+  {
+    int err = errno;
+    close(listenSock);
+    errno = err;
+    return false;
+  }
+
+  // never destroyed, since client threads run detached for as long as the process does
+  Server *server = new Server(config);
+
+  for(;;)
+  {
+    server->AcquireClient();
+
+    int sock;
+    do
+    {
+      sock = accept(listenSock, NULL, NULL);
+
+      // e.g. out of descriptors. Wait for some to be closed rather than spinning
+      if(sock < 0 && errno != EINTR && errno != ECONNABORTED)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    } while(sock < 0);
+
+    std::thread(&Server::ServeClient, server, sock).detach();
+  }
+}
+};    // namespace DXIL
+
+#endif
@@ -0,0 +1,60 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// a long-running decoder that answers requests over a Unix domain socket, so tools that decode
+// often don't pay for process startup and cold caches each time. Requests are single lines of
+// text, and each connection's requests are answered in order:
+//
+//   reflect path FILE   the container's reflection, as --reflect prints it
+//   dump path FILE      a JSON dump of the program, as --format json writes it
+//   stats path FILE     the program's bitcode statistics, as --stats prints them
+//   OP fd               as above, for a container in a memfd sent along with the request as
+//                       SCM_RIGHTS. The whole object is the container, and it must be sealed with
+//                       F_SEAL_SHRINK and F_SEAL_WRITE so it can't change while it's decoded
+//   stats               the server's own statistics as a JSON object, including percentiles of
+//                       each operation's latency in microseconds
+//
+// each response is a line, "ok LENGTH" or "error LENGTH", followed by LENGTH bytes of the result
+// or of the error message.
+namespace DXIL
+{
+struct ServerConfig
+{
+  const char *socketPath = NULL;
+  // the most clients served at once, each on its own thread. Any more wait to be accepted
+  uint32_t maxClients = 64;
+  // results are kept by a digest of the container, along with a copy of it, up to this many bytes
+  // of both in total
+  size_t cacheSize = 64 * 1024 * 1024;
+};
+
+// serves requests until the process is killed. Only returns, with errno set, if the socket
+// couldn't be set up or Unix domain sockets aren't available
+bool RunServer(const ServerConfig &config);
+};    // namespace DXIL
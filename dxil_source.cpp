@@ -0,0 +1,120 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxil_source.h"
+#include "dxil_bitcode.h"
+#include "dxil_inspect.h"
+#include "dxil_metadata.h"
+#include "dxil_output.h"
+#include "trace.h"
+
+namespace DXIL
+{
+#define IS_KNOWN(val, KnownID) (decltype(KnownID)(val) == KnownID)
+
+// the string operands of a node, e.g. !{!"file.hlsl", !"contents"}. Anything that isn't a string
+// is skipped
+static void getNodeStrings(const MetadataIndex &metadata, uint32_t nodeID,
+                           std::vector<SourceString> &strings)
+{
+  const LLVMBC::BlockOrRecord *node = metadata.GetNode(nodeID);
+  if(!node || !(IS_KNOWN(node->id, MetaDataRecord::NODE) ||
+                IS_KNOWN(node->id, MetaDataRecord::DISTINCT_NODE)))
+    return;
+
+  for(size_t i = 0; i < node->ops.size(); i++)
+  {
+    SourceString str;
+    if(metadata.GetStringData(MetadataIndex::OptionalRef(*node, i), str.data, str.length))
+      strings.push_back(str);
+  }
+}
+
+bool ExtractSource(const Program &program, EmbeddedSource &source)
+{
+  TRACE_SCOPE("Extract source");
+
+  source = EmbeddedSource();
+
+  MetadataIndex metadata(program.GetRoot());
+
+  std::vector<SourceString> strings;
+
+  // named node operands are plain IDs, not offset by one like in other records
+  if(const LLVMBC::OpList *contents = metadata.GetNamed("dx.source.contents"))
+  {
+    // one node per file, with its name then its contents
+    for(uint64_t nodeID : *contents)
+    {
+      strings.clear();
+      getNodeStrings(metadata, uint32_t(nodeID), strings);
+      if(strings.size() >= 2)
+        source.files.push_back({strings[0], strings[1]});
+    }
+  }
+
+  if(const LLVMBC::OpList *defines = metadata.GetNamed("dx.source.defines"))
+  {
+    for(uint64_t nodeID : *defines)
+      getNodeStrings(metadata, uint32_t(nodeID), source.defines);
+  }
+
+  if(const LLVMBC::OpList *args = metadata.GetNamed("dx.source.args"))
+  {
+    for(uint64_t nodeID : *args)
+      getNodeStrings(metadata, uint32_t(nodeID), source.args);
+  }
+
+  if(const LLVMBC::OpList *mainFileName = metadata.GetNamed("dx.source.mainFileName"))
+  {
+    strings.clear();
+    if(!mainFileName->empty())
+      getNodeStrings(metadata, uint32_t((*mainFileName)[0]), strings);
+    if(!strings.empty())
+      source.mainFileName = strings[0];
+  }
+
+  return !source.files.empty();
+}
+
+void PrintSourceSummary(const EmbeddedSource &source, Output &out)
+{
+  if(source.mainFileName.data)
+    out.Printf("main file: %.*s\n", (int)source.mainFileName.length, source.mainFileName.data);
+
+  out.Printf("defines:");
+  for(const SourceString &define : source.defines)
+    out.Printf(" %.*s", (int)define.length, define.data);
+  out.Printf("\n");
+
+  out.Printf("args:");
+  for(const SourceString &arg : source.args)
+    out.Printf(" %.*s", (int)arg.length, arg.data);
+  out.Printf("\n");
+
+  for(const SourceFileContents &file : source.files)
+    out.Printf("file %.*s: %llu bytes\n", (int)file.name.length, file.name.data,
+               (unsigned long long)file.contents.length);
+}
+};    // namespace DXIL
@@ -0,0 +1,68 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace DXIL
+{
+class Output;
+class Program;
+
+// a string from the program's metadata, pointing at its characters where they were decoded. Not
+// NUL terminated
+struct SourceString
+{
+  const char *data = NULL;
+  size_t length = 0;
+
+  std::string str() const { return std::string(data, length); }
+};
+
+struct SourceFileContents
+{
+  SourceString name;
+  SourceString contents;
+};
+
+// the shader source, defines and arguments DXC embeds in debug programs' named metadata. Nothing
+// is copied, so the program and the bytes it was decoded from must outlive this
+struct EmbeddedSource
+{
+  SourceString mainFileName;
+  std::vector<SourceFileContents> files;
+  std::vector<SourceString> defines;
+  std::vector<SourceString> args;
+};
+
+// only needs the program's module-level metadata block, so the rest can be filtered out when
+// decoding. Returns false if there's no embedded source
+bool ExtractSource(const Program &program, EmbeddedSource &source);
+
+// prints the main file, defines, arguments and the size of each file, not their contents
+void PrintSourceSummary(const EmbeddedSource &source, Output &out);
+};    // namespace DXIL
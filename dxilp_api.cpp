@@ -0,0 +1,640 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "dxilp_api.h"
+#include <stddef.h>
+#include <algorithm>
+#include <new>
+#include <utility>
+#include <vector>
+#include "dxbc_container.h"
+#include "dxil_inspect.h"
+#include "dxil_output.h"
+#include "dxil_reflect.h"
+#include "llvm_decoder.h"
+
+struct DXILP_Container
+{
+  DXILP_Container(const void *b, size_t l) : container(b, l), bytes(b), length(l) {}
+
+  DXBC::Container container;
+  const void *bytes;
+  size_t length;
+};
+
+struct DXILP_Program
+{
+  DXILP_Program(const DXBC::Container &container, const DXIL::ProgramFilter *filter)
+      : program(container, NULL, filter)
+  {
+  }
+  DXILP_Program(const void *bytes, size_t length, const DXIL::ProgramFilter *filter)
+      : program(bytes, length, NULL, filter)
+  {
+  }
+
+  DXIL::Program program;
+};
+
+struct DXILP_NodeIterator
+{
+  const LLVMBC::BlockOrRecord *root = NULL;
+  bool started = false;
+  // each block being walked, with the index of its next child
+  std::vector<std::pair<const LLVMBC::BlockOrRecord *, size_t>> stack;
+};
+
+struct DXILP_Reflection
+{
+  DXIL::Reflection refl;
+};
+
+// nodes are handed out as the decoded tree's own blocks and records
+static const LLVMBC::BlockOrRecord *toNode(const DXILP_Node *node)
+{
+  return (const LLVMBC::BlockOrRecord *)node;
+}
+
+static const DXILP_Node *fromNode(const LLVMBC::BlockOrRecord *node)
+{
+  return (const DXILP_Node *)node;
+}
+
+#define FIELD_END(T, member) (offsetof(T, member) + sizeof(((T *)NULL)->member))
+
+// the size of each struct in the first version of the API, to the end of its last member. Callers
+// built against a newer header pass more, so members added after these must be checked against
+// structSize before they're read or written
+static size_t firstVersionSize(const DXILP_DecodeOptions *)
+{
+  return FIELD_END(DXILP_DecodeOptions, function);
+}
+
+static size_t firstVersionSize(const DXILP_DecodeStatus *)
+{
+  return FIELD_END(DXILP_DecodeStatus, bitOffset);
+}
+
+static size_t firstVersionSize(const DXILP_ProgramInfo *)
+{
+  return FIELD_END(DXILP_ProgramInfo, debugName);
+}
+
+static size_t firstVersionSize(const DXILP_ReflectionInfo *)
+{
+  return FIELD_END(DXILP_ReflectionInfo, debugName);
+}
+
+static size_t firstVersionSize(const DXILP_ResourceBinding *)
+{
+  return FIELD_END(DXILP_ResourceBinding, upperBound);
+}
+
+static size_t firstVersionSize(const DXILP_SignatureElement *)
+{
+  return FIELD_END(DXILP_SignatureElement, minPrecision);
+}
+
+// structs from callers must hold at least the first version's members
+template <typename T>
+static bool validStruct(const T *s)
+{
+  return s && s->structSize >= firstVersionSize(s);
+}
+
+class CallbackOutput : public DXIL::Output
+{
+public:
+  CallbackOutput(DXILP_WriteCallback write, void *userData) : m_Write(write), m_UserData(userData)
+  {
+  }
+  void Write(const char *str, size_t length) override { m_Write(m_UserData, str, length); }
+  using Output::Write;
+
+private:
+  DXILP_WriteCallback m_Write;
+  void *m_UserData;
+};
+
+static DXILP_Result decodeProgram(const DXBC::Container *container, const void *bytes,
+                                  size_t length, const DXILP_DecodeOptions *options,
+                                  DXILP_Program **program, DXILP_DecodeStatus *status)
+{
+  if(!program || (options && !validStruct(options)) || (status && !validStruct(status)))
+    return DXILP_InvalidArgument;
+
+  *program = NULL;
+
+  if(options &&
+     ((options->numBlocks && !options->blocks) || (options->numRecords && !options->records)))
+    return DXILP_InvalidArgument;
+
+  DXIL::ProgramFilter filter;
+  DXILP_Program *ret = NULL;
+
+  // nothing may throw across the C interface, and running out of memory on a hostile program is
+  // the only way decoding can
+  try
+  {
+    if(options)
+    {
+      filter.blocks.assign(options->blocks, options->blocks + options->numBlocks);
+      filter.records.assign(options->records, options->records + options->numRecords);
+      filter.function = options->function;
+    }
+
+    if(container)
+      ret = new DXILP_Program(*container, options ? &filter : NULL);
+    else
+      ret = new DXILP_Program(bytes, length, options ? &filter : NULL);
+  }
+  catch(const std::bad_alloc &)
+  {
+    return DXILP_OutOfMemory;
+  }
+
+  LLVMBC::DecodeStatus decodeStatus = ret->program.GetStatus();
+
+  if(status)
+  {
+    status->error = uint32_t(decodeStatus.error);
+    status->message = LLVMBC::DecodeErrorString(decodeStatus.error);
+    status->bitOffset = decodeStatus.bitOffset;
+  }
+
+  if(decodeStatus.Failed())
+  {
+    delete ret;
+    return DXILP_DecodeFailed;
+  }
+
+  *program = ret;
+  return DXILP_Success;
+}
+
+extern "C" {
+
+DXILP_API uint32_t DXILP_CC DXILP_GetAPIVersion(void)
+{
+  return DXILP_API_VERSION;
+}
+
+DXILP_API const char *DXILP_CC DXILP_GetResultString(DXILP_Result result)
+{
+  switch(result)
+  {
+    case DXILP_Success: return "Success";
+    case DXILP_InvalidArgument: return "Invalid argument";
+    case DXILP_InvalidContainer: return "Invalid DXBC container";
+    case DXILP_NoDXIL: return "No DXIL program in the container";
+    case DXILP_DecodeFailed: return "Couldn't decode DXIL";
+    case DXILP_DumpFailed: return "Couldn't dump DXIL in the requested format";
+    case DXILP_OutOfMemory: return "Out of memory";
+  }
+
+  return "Unknown result";
+}
+
+DXILP_API const char *DXILP_CC DXILP_GetBlockName(uint32_t blockID)
+{
+  return DXIL::BlockName(blockID);
+}
+
+DXILP_API const char *DXILP_CC DXILP_GetRecordName(uint32_t blockID, uint32_t recordID)
+{
+  return DXIL::RecordName(blockID, recordID);
+}
+
+DXILP_API DXILP_Result DXILP_CC DXILP_OpenContainer(const void *bytes, size_t length,
+                                                    DXILP_Container **container)
+{
+  if(!bytes || !container)
+    return DXILP_InvalidArgument;
+
+  *container = NULL;
+
+  DXILP_Container *ret = new(std::nothrow) DXILP_Container(bytes, length);
+  if(!ret)
+    return DXILP_OutOfMemory;
+
+  if(!ret->container.IsValid())
+  {
+    delete ret;
+    return DXILP_InvalidContainer;
+  }
+
+  *container = ret;
+  return DXILP_Success;
+}
+
+DXILP_API void DXILP_CC DXILP_FreeContainer(DXILP_Container *container)
+{
+  delete container;
+}
+
+DXILP_API uint32_t DXILP_CC DXILP_GetNumChunks(const DXILP_Container *container)
+{
+  return container ? container->container.NumChunks() : 0;
+}
+
+DXILP_API DXILP_Result DXILP_CC DXILP_GetChunk(const DXILP_Container *container, uint32_t idx,
+                                               uint32_t *fourcc, const void **data,
+                                               uint32_t *length)
+{
+  if(!container || !fourcc || !data || !length)
+    return DXILP_InvalidArgument;
+
+  const DXBCChunkHeader *chunk = container->container.GetChunk(idx);
+  if(!chunk)
+    return DXILP_InvalidArgument;
+
+  *fourcc = chunk->fourcc;
+  *data = chunk + 1;
+  *length = chunk->dataLength;
+  return DXILP_Success;
+}
+
+DXILP_API DXILP_Result DXILP_CC DXILP_DecodeProgram(const DXILP_Container *container,
+                                                    const DXILP_DecodeOptions *options,
+                                                    DXILP_Program **program,
+                                                    DXILP_DecodeStatus *status)
+{
+  if(!container)
+    return DXILP_InvalidArgument;
+
+  if(!container->container.FindBestDXILChunk())
+    return DXILP_NoDXIL;
+
+  return decodeProgram(&container->container, NULL, 0, options, program, status);
+}
+
+DXILP_API DXILP_Result DXILP_CC DXILP_DecodeBareProgram(const void *bytes, size_t length,
+                                                        const DXILP_DecodeOptions *options,
+                                                        DXILP_Program **program,
+                                                        DXILP_DecodeStatus *status)
+{
+  if(!bytes)
+    return DXILP_InvalidArgument;
+
+  return decodeProgram(NULL, bytes, length, options, program, status);
+}
+
+DXILP_API void DXILP_CC DXILP_FreeProgram(DXILP_Program *program)
+{
+  delete program;
+}
+
+DXILP_API DXILP_Result DXILP_CC DXILP_GetProgramInfo(const DXILP_Program *program,
+                                                     DXILP_ProgramInfo *info)
+{
+  if(!program || !validStruct(info))
+    return DXILP_InvalidArgument;
+
+  const DXIL::Program &p = program->program;
+  info->shaderType = p.GetShaderType();
+  info->shaderTypeName = DXIL::ShaderTypeName(p.GetShaderType());
+  info->shaderModelMajor = p.GetShaderModelMajor();
+  info->shaderModelMinor = p.GetShaderModelMinor();
+  info->features = uint64_t(p.GetFeatures());
+  info->debugName = p.GetDebugName();
+  return DXILP_Success;
+}
+
+DXILP_API DXILP_Result DXILP_CC DXILP_DumpProgram(const DXILP_Program *program,
+                                                  DXILP_DumpFormat format,
+                                                  DXILP_WriteCallback write, void *userData)
+{
+  if(!program || !write)
+    return DXILP_InvalidArgument;
+
+  DXIL::DumpFormat dumpFormat;
+  switch(format)
+  {
+    case DXILP_DumpText: dumpFormat = DXIL::DumpFormat::Text; break;
+    case DXILP_DumpJSON: dumpFormat = DXIL::DumpFormat::JSON; break;
+    case DXILP_DumpBinary: dumpFormat = DXIL::DumpFormat::Binary; break;
+    case DXILP_DumpDisassembly: dumpFormat = DXIL::DumpFormat::Disassembly; break;
+    default: return DXILP_InvalidArgument;
+  }
+
+  CallbackOutput out(write, userData);
+
+  try
+  {
+    if(!program->program.Dump(out, dumpFormat))
+      return DXILP_DumpFailed;
+  }
+  catch(const std::bad_alloc &)
+  {
+    return DXILP_OutOfMemory;
+  }
+
+  return DXILP_Success;
+}
+
+DXILP_API const DXILP_Node *DXILP_CC DXILP_GetRootNode(const DXILP_Program *program)
+{
+  return program ? fromNode(&program->program.GetRoot()) : NULL;
+}
+
+DXILP_API uint32_t DXILP_CC DXILP_IsBlock(const DXILP_Node *node)
+{
+  return node && toNode(node)->IsBlock() ? 1 : 0;
+}
+
+DXILP_API uint32_t DXILP_CC DXILP_GetNodeID(const DXILP_Node *node)
+{
+  return node ? toNode(node)->id : ~0U;
+}
+
+DXILP_API uint32_t DXILP_CC DXILP_GetNumChildren(const DXILP_Node *node)
+{
+  return node ? uint32_t(toNode(node)->children.size()) : 0;
+}
+
+DXILP_API const DXILP_Node *DXILP_CC DXILP_GetChild(const DXILP_Node *node, uint32_t idx)
+{
+  if(!node || idx >= toNode(node)->children.size())
+    return NULL;
+
+  return fromNode(&toNode(node)->children[idx]);
+}
+
+DXILP_API uint32_t DXILP_CC DXILP_GetNumOps(const DXILP_Node *node)
+{
+  return node ? uint32_t(toNode(node)->ops.size()) : 0;
+}
+
+DXILP_API uint64_t DXILP_CC DXILP_GetOp(const DXILP_Node *node, uint32_t idx)
+{
+  if(!node || idx >= toNode(node)->ops.size())
+    return 0;
+
+  return toNode(node)->ops[idx];
+}
+
+DXILP_API uint32_t DXILP_CC DXILP_GetOps(const DXILP_Node *node, uint32_t first, uint32_t count,
+                                         uint64_t *ops)
+{
+  if(!node || !ops)
+    return 0;
+
+  const LLVMBC::OpList &list = toNode(node)->ops;
+  if(first >= list.size())
+    return 0;
+
+  const uint32_t numOps = uint32_t(std::min<size_t>(count, list.size() - first));
+  for(uint32_t i = 0; i < numOps; i++)
+    ops[i] = list[first + i];
+
+  return numOps;
+}
+
+DXILP_API uint32_t DXILP_CC DXILP_GetBlob(const DXILP_Node *node, const void **data,
+                                          size_t *length)
+{
+  if(!node || !data || !length || !toNode(node)->blob)
+    return 0;
+
+  *data = toNode(node)->blob;
+  *length = toNode(node)->blobLength;
+  return 1;
+}
+
+DXILP_API DXILP_Result DXILP_CC DXILP_IterateNodes(const DXILP_Node *root,
+                                                   DXILP_NodeIterator **iterator)
+{
+  if(!root || !iterator)
+    return DXILP_InvalidArgument;
+
+  *iterator = new(std::nothrow) DXILP_NodeIterator;
+  if(!*iterator)
+    return DXILP_OutOfMemory;
+
+  (*iterator)->root = toNode(root);
+  return DXILP_Success;
+}
+
+DXILP_API void DXILP_CC DXILP_FreeNodeIterator(DXILP_NodeIterator *iterator)
+{
+  delete iterator;
+}
+
+DXILP_API uint32_t DXILP_CC DXILP_NextNode(DXILP_NodeIterator *iterator, const DXILP_Node **node,
+                                           uint32_t *depth, uint32_t *parentID)
+{
+  if(!iterator || !node)
+    return 0;
+
+  const LLVMBC::BlockOrRecord *next = NULL;
+  uint32_t nextDepth = 0, nextParent = ~0U;
+
+  if(!iterator->started)
+  {
+    iterator->started = true;
+    next = iterator->root;
+  }
+  else
+  {
+    while(!iterator->stack.empty())
+    {
+      std::pair<const LLVMBC::BlockOrRecord *, size_t> &top = iterator->stack.back();
+      if(top.second < top.first->children.size())
+      {
+        next = &top.first->children[top.second++];
+        nextDepth = uint32_t(iterator->stack.size());
+        nextParent = top.first->id;
+        break;
+      }
+
+      iterator->stack.pop_back();
+    }
+  }
+
+  if(!next)
+    return 0;
+
+  if(next->IsBlock())
+  {
+    try
+    {
+      iterator->stack.push_back(std::make_pair(next, size_t(0)));
+    }
+    catch(const std::bad_alloc &)
+    {
+      return 0;
+    }
+  }
+
+  *node = fromNode(next);
+  if(depth)
+    *depth = nextDepth;
+  if(parentID)
+    *parentID = nextParent;
+  return 1;
+}
+
+DXILP_API DXILP_Result DXILP_CC DXILP_Reflect(const DXILP_Container *container,
+                                              DXILP_Reflection **reflection)
+{
+  if(!container || !reflection)
+    return DXILP_InvalidArgument;
+
+  *reflection = NULL;
+
+  DXILP_Reflection *ret = new(std::nothrow) DXILP_Reflection;
+  if(!ret)
+    return DXILP_OutOfMemory;
+
+  bool reflected = false;
+
+  try
+  {
+    reflected = DXIL::Reflect(container->bytes, container->length, ret->refl);
+  }
+  catch(const std::bad_alloc &)
+  {
+    delete ret;
+    return DXILP_OutOfMemory;
+  }
+
+  if(!reflected)
+  {
+    delete ret;
+    return DXILP_NoDXIL;
+  }
+
+  *reflection = ret;
+  return DXILP_Success;
+}
+
+DXILP_API void DXILP_CC DXILP_FreeReflection(DXILP_Reflection *reflection)
+{
+  delete reflection;
+}
+
+DXILP_API DXILP_Result DXILP_CC DXILP_GetReflectionInfo(const DXILP_Reflection *reflection,
+                                                        DXILP_ReflectionInfo *info)
+{
+  if(!reflection || !validStruct(info))
+    return DXILP_InvalidArgument;
+
+  const DXIL::Reflection &refl = reflection->refl;
+  info->shaderType = refl.shaderType;
+  info->shaderTypeName = DXIL::ShaderTypeName(refl.shaderType);
+  info->shaderModelMajor = refl.shaderModelMajor;
+  info->shaderModelMinor = refl.shaderModelMinor;
+  info->dxilVersion = refl.dxilVersion;
+  info->hasDebugInfo = refl.hasDebugInfo ? 1 : 0;
+  info->hasFeatures = refl.hasFeatures ? 1 : 0;
+  info->features = uint64_t(refl.features);
+  info->debugName = refl.debugName;
+  return DXILP_Success;
+}
+
+DXILP_API uint32_t DXILP_CC DXILP_GetNumResources(const DXILP_Reflection *reflection)
+{
+  return reflection ? uint32_t(reflection->refl.resources.size()) : 0;
+}
+
+DXILP_API DXILP_Result DXILP_CC DXILP_GetResource(const DXILP_Reflection *reflection, uint32_t idx,
+                                                  DXILP_ResourceBinding *binding)
+{
+  if(!reflection || !validStruct(binding) || idx >= reflection->refl.resources.size())
+    return DXILP_InvalidArgument;
+
+  const DXIL::ResourceBinding &res = reflection->refl.resources[idx];
+  binding->type = uint32_t(res.type);
+  binding->typeName = DXIL::ResourceTypeName(res.type);
+  binding->space = res.space;
+  binding->lowerBound = res.lowerBound;
+  binding->upperBound = res.upperBound;
+  return DXILP_Success;
+}
+
+static const std::vector<DXIL::SignatureElement> *getSignature(const DXILP_Reflection *reflection,
+                                                               DXILP_SignatureType type)
+{
+  if(!reflection)
+    return NULL;
+
+  switch(type)
+  {
+    case DXILP_InputSignature: return &reflection->refl.inputSig;
+    case DXILP_OutputSignature: return &reflection->refl.outputSig;
+    case DXILP_PatchConstantSignature: return &reflection->refl.patchConstantSig;
+  }
+
+  return NULL;
+}
+
+DXILP_API uint32_t DXILP_CC DXILP_GetNumSignatureElements(const DXILP_Reflection *reflection,
+                                                          DXILP_SignatureType type)
+{
+  const std::vector<DXIL::SignatureElement> *sig = getSignature(reflection, type);
+  return sig ? uint32_t(sig->size()) : 0;
+}
+
+DXILP_API DXILP_Result DXILP_CC DXILP_GetSignatureElement(const DXILP_Reflection *reflection,
+                                                          DXILP_SignatureType type, uint32_t idx,
+                                                          DXILP_SignatureElement *element)
+{
+  const std::vector<DXIL::SignatureElement> *sig = getSignature(reflection, type);
+  if(!sig || !validStruct(element) || idx >= sig->size())
+    return DXILP_InvalidArgument;
+
+  const DXIL::SignatureElement &el = (*sig)[idx];
+  element->semanticName = el.semanticName;
+  element->semanticIndex = el.semanticIndex;
+  element->systemValue = el.systemValue;
+  element->compType = el.compType;
+  element->registerIndex = el.registerIndex;
+  element->mask = el.mask;
+  element->rwMask = el.rwMask;
+  element->stream = el.stream;
+  element->minPrecision = el.minPrecision;
+  return DXILP_Success;
+}
+
+DXILP_API DXILP_Result DXILP_CC DXILP_PrintReflection(const DXILP_Reflection *reflection,
+                                                      DXILP_WriteCallback write, void *userData)
+{
+  if(!reflection || !write)
+    return DXILP_InvalidArgument;
+
+  CallbackOutput out(write, userData);
+
+  try
+  {
+    DXIL::PrintReflection(reflection->refl, out);
+  }
+  catch(const std::bad_alloc &)
+  {
+    return DXILP_OutOfMemory;
+  }
+
+  return DXILP_Success;
+}
+
+}    // extern "C"
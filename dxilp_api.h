@@ -0,0 +1,245 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// a C interface to the container parser and the DXIL decoder, for embedding in other languages
+// without running the executable. Nothing passed in is copied: containers and programs point into
+// the caller's bytes, which must outlive every handle made from them. Every handle is freed with
+// its own call, and anything returned from a handle lives as long as it does.
+//
+// handles may be used from any thread, and different handles concurrently, but a single handle
+// must not be used by two threads at once.
+
+#if defined(_WIN32)
+#if defined(DXILP_EXPORTS)
+#define DXILP_API __declspec(dllexport)
+#else
+#define DXILP_API __declspec(dllimport)
+#endif
+#define DXILP_CC __cdecl
+#else
+#define DXILP_API __attribute__((visibility("default")))
+#define DXILP_CC
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bumped whenever anything here changes incompatibly
+#define DXILP_API_VERSION 1
+
+typedef enum DXILP_Result
+{
+  DXILP_Success = 0,
+  DXILP_InvalidArgument,
+  DXILP_InvalidContainer,
+  DXILP_NoDXIL,
+  DXILP_DecodeFailed,
+  DXILP_DumpFailed,
+  DXILP_OutOfMemory,
+} DXILP_Result;
+
+typedef enum DXILP_DumpFormat
+{
+  DXILP_DumpText = 0,
+  DXILP_DumpJSON,
+  DXILP_DumpBinary,
+  DXILP_DumpDisassembly,
+} DXILP_DumpFormat;
+
+typedef enum DXILP_SignatureType
+{
+  DXILP_InputSignature = 0,
+  DXILP_OutputSignature,
+  DXILP_PatchConstantSignature,
+} DXILP_SignatureType;
+
+typedef struct DXILP_Container DXILP_Container;
+typedef struct DXILP_Program DXILP_Program;
+// a block or record in a program, owned by the program
+typedef struct DXILP_Node DXILP_Node;
+typedef struct DXILP_NodeIterator DXILP_NodeIterator;
+typedef struct DXILP_Reflection DXILP_Reflection;
+
+// output is written through this in pieces, in order
+typedef void(DXILP_CC *DXILP_WriteCallback)(void *userData, const char *data, size_t length);
+
+// structs that may grow take their size as the first member, set by the caller, so older callers
+// keep working with newer libraries
+
+// restricts decoding to part of a program, as ProgramFilter does. Zero-initialise and set
+// function to ~0U to keep every function
+typedef struct DXILP_DecodeOptions
+{
+  uint32_t structSize;
+  const uint32_t *blocks;
+  uint32_t numBlocks;
+  const uint32_t *records;
+  uint32_t numRecords;
+  uint32_t function;
+} DXILP_DecodeOptions;
+
+typedef struct DXILP_DecodeStatus
+{
+  uint32_t structSize;
+  // one of LLVMBC::DecodeError, 0 on success
+  uint32_t error;
+  const char *message;
+  uint64_t bitOffset;
+} DXILP_DecodeStatus;
+
+typedef struct DXILP_ProgramInfo
+{
+  uint32_t structSize;
+  uint32_t shaderType;
+  const char *shaderTypeName;
+  uint32_t shaderModelMajor;
+  uint32_t shaderModelMinor;
+  uint64_t features;
+  // NULL if the container has no debug name
+  const char *debugName;
+} DXILP_ProgramInfo;
+
+typedef struct DXILP_ReflectionInfo
+{
+  uint32_t structSize;
+  uint32_t shaderType;
+  const char *shaderTypeName;
+  uint32_t shaderModelMajor;
+  uint32_t shaderModelMinor;
+  uint32_t dxilVersion;
+  uint32_t hasDebugInfo;
+  uint32_t hasFeatures;
+  uint64_t features;
+  const char *debugName;
+} DXILP_ReflectionInfo;
+
+typedef struct DXILP_ResourceBinding
+{
+  uint32_t structSize;
+  uint32_t type;
+  const char *typeName;
+  uint32_t space;
+  uint32_t lowerBound;
+  uint32_t upperBound;
+} DXILP_ResourceBinding;
+
+typedef struct DXILP_SignatureElement
+{
+  uint32_t structSize;
+  const char *semanticName;
+  uint32_t semanticIndex;
+  uint32_t systemValue;
+  uint32_t compType;
+  uint32_t registerIndex;
+  uint32_t mask;
+  uint32_t rwMask;
+  uint32_t stream;
+  uint32_t minPrecision;
+} DXILP_SignatureElement;
+
+DXILP_API uint32_t DXILP_CC DXILP_GetAPIVersion(void);
+DXILP_API const char *DXILP_CC DXILP_GetResultString(DXILP_Result result);
+
+// names of known blocks and records, or NULL
+DXILP_API const char *DXILP_CC DXILP_GetBlockName(uint32_t blockID);
+DXILP_API const char *DXILP_CC DXILP_GetRecordName(uint32_t blockID, uint32_t recordID);
+
+// containers
+DXILP_API DXILP_Result DXILP_CC DXILP_OpenContainer(const void *bytes, size_t length,
+                                                    DXILP_Container **container);
+DXILP_API void DXILP_CC DXILP_FreeContainer(DXILP_Container *container);
+DXILP_API uint32_t DXILP_CC DXILP_GetNumChunks(const DXILP_Container *container);
+DXILP_API DXILP_Result DXILP_CC DXILP_GetChunk(const DXILP_Container *container, uint32_t idx,
+                                               uint32_t *fourcc, const void **data,
+                                               uint32_t *length);
+
+// programs. The best DXIL program in the container is decoded, or with DecodeBareProgram a
+// program header and bitcode without any container. options and status may be NULL. On failure
+// no program is returned, and status says why
+DXILP_API DXILP_Result DXILP_CC DXILP_DecodeProgram(const DXILP_Container *container,
+                                                    const DXILP_DecodeOptions *options,
+                                                    DXILP_Program **program,
+                                                    DXILP_DecodeStatus *status);
+DXILP_API DXILP_Result DXILP_CC DXILP_DecodeBareProgram(const void *bytes, size_t length,
+                                                        const DXILP_DecodeOptions *options,
+                                                        DXILP_Program **program,
+                                                        DXILP_DecodeStatus *status);
+DXILP_API void DXILP_CC DXILP_FreeProgram(DXILP_Program *program);
+DXILP_API DXILP_Result DXILP_CC DXILP_GetProgramInfo(const DXILP_Program *program,
+                                                     DXILP_ProgramInfo *info);
+DXILP_API DXILP_Result DXILP_CC DXILP_DumpProgram(const DXILP_Program *program,
+                                                  DXILP_DumpFormat format,
+                                                  DXILP_WriteCallback write, void *userData);
+
+// the decoded tree. The root is the module block
+DXILP_API const DXILP_Node *DXILP_CC DXILP_GetRootNode(const DXILP_Program *program);
+DXILP_API uint32_t DXILP_CC DXILP_IsBlock(const DXILP_Node *node);
+DXILP_API uint32_t DXILP_CC DXILP_GetNodeID(const DXILP_Node *node);
+DXILP_API uint32_t DXILP_CC DXILP_GetNumChildren(const DXILP_Node *node);
+DXILP_API const DXILP_Node *DXILP_CC DXILP_GetChild(const DXILP_Node *node, uint32_t idx);
+DXILP_API uint32_t DXILP_CC DXILP_GetNumOps(const DXILP_Node *node);
+DXILP_API uint64_t DXILP_CC DXILP_GetOp(const DXILP_Node *node, uint32_t idx);
+// copies up to count ops starting at first into ops, and returns how many were copied
+DXILP_API uint32_t DXILP_CC DXILP_GetOps(const DXILP_Node *node, uint32_t first, uint32_t count,
+                                         uint64_t *ops);
+// returns 0 if the record has no blob
+DXILP_API uint32_t DXILP_CC DXILP_GetBlob(const DXILP_Node *node, const void **data,
+                                          size_t *length);
+
+// walks every node under root, root first, then each child before its siblings. parentID is
+// ~0U for root itself
+DXILP_API DXILP_Result DXILP_CC DXILP_IterateNodes(const DXILP_Node *root,
+                                                   DXILP_NodeIterator **iterator);
+DXILP_API void DXILP_CC DXILP_FreeNodeIterator(DXILP_NodeIterator *iterator);
+// returns 0 once every node has been visited, or if there's no memory to go deeper
+DXILP_API uint32_t DXILP_CC DXILP_NextNode(DXILP_NodeIterator *iterator, const DXILP_Node **node,
+                                           uint32_t *depth, uint32_t *parentID);
+
+// reflection, from the container chunks without decoding the bitcode
+DXILP_API DXILP_Result DXILP_CC DXILP_Reflect(const DXILP_Container *container,
+                                              DXILP_Reflection **reflection);
+DXILP_API void DXILP_CC DXILP_FreeReflection(DXILP_Reflection *reflection);
+DXILP_API DXILP_Result DXILP_CC DXILP_GetReflectionInfo(const DXILP_Reflection *reflection,
+                                                        DXILP_ReflectionInfo *info);
+DXILP_API uint32_t DXILP_CC DXILP_GetNumResources(const DXILP_Reflection *reflection);
+DXILP_API DXILP_Result DXILP_CC DXILP_GetResource(const DXILP_Reflection *reflection, uint32_t idx,
+                                                  DXILP_ResourceBinding *binding);
+DXILP_API uint32_t DXILP_CC DXILP_GetNumSignatureElements(const DXILP_Reflection *reflection,
+                                                          DXILP_SignatureType type);
+DXILP_API DXILP_Result DXILP_CC DXILP_GetSignatureElement(const DXILP_Reflection *reflection,
+                                                          DXILP_SignatureType type, uint32_t idx,
+                                                          DXILP_SignatureElement *element);
+// as --reflect prints it
+DXILP_API DXILP_Result DXILP_CC DXILP_PrintReflection(const DXILP_Reflection *reflection,
+                                                      DXILP_WriteCallback write, void *userData);
+
+#ifdef __cplusplus
+}    // extern "C"
+#endif
@@ -0,0 +1,304 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "llvm_bitreader.h"
+#include "cpu_features.h"
+
+#if DXILP_X86
+#include <immintrin.h>
+#endif
+
+namespace LLVMBC
+{
+const char Char6Table[65] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789._";
+
+// eight char6 values take up 48 bits, which we can always get from an unaligned 64-bit load even
+// when the first one starts part-way into a byte.
+static const size_t CharsPerWord = 8;
+static const size_t BitsPerWord = CharsPerWord * 6;
+
+static inline uint64_t load64(const byte *bits, size_t bitOffset)
+{
+  uint64_t ret;
+  memcpy(&ret, bits + bitOffset / 8, sizeof(ret));
+  return ret >> (bitOffset % 8);
+}
+
+static inline bool canLoad64(size_t bitOffset, size_t length)
+{
+  return bitOffset / 8 + 8 <= length;
+}
+
+// the number of whole words we can load from the given starting bit without going past length
+static inline size_t numLoadableWords(size_t bitOffset, size_t length, size_t count)
+{
+  if(length < 8)
+    return 0;
+
+  // the last word's load must start no later than 8 bytes before the end
+  const size_t lastStart = (length - 8) * 8 + 7;
+  if(bitOffset > lastStart)
+    return 0;
+
+  const size_t fits = (lastStart - bitOffset) / BitsPerWord + 1;
+  const size_t wanted = count / CharsPerWord;
+
+  return fits < wanted ? fits : wanted;
+}
+
+static size_t DecodeChar6Scalar(const byte *bits, size_t bitOffset, size_t numWords, char *dst)
+{
+  for(size_t w = 0; w < numWords; w++)
+  {
+    const uint64_t val = load64(bits, bitOffset + w * BitsPerWord);
+
+    for(size_t c = 0; c < CharsPerWord; c++)
+      dst[w * CharsPerWord + c] = Char6Table[(val >> (c * 6)) & 0x3f];
+  }
+
+  return numWords * CharsPerWord;
+}
+
+#if DXILP_X86
+DXILP_TARGET("ssse3")
+static size_t DecodeChar6SSSE3(const byte *bits, size_t bitOffset, size_t numWords, char *dst)
+{
+  // each word is loaded into one half of the register, with its 8 values in the low 6 bytes. Every
+  // group of 3 bytes holds 4 values, so shuffle the two bytes containing each value into its own
+  // 16-bit lane.
+  const __m128i shuffleLo = _mm_setr_epi8(0, 1, 0, 1, 1, 2, 1, 2, 3, 4, 3, 4, 4, 5, 4, 5);
+  const __m128i shuffleHi = _mm_setr_epi8(8, 9, 8, 9, 9, 10, 9, 10, 11, 12, 11, 12, 12, 13, 12, 13);
+
+  // the values in each lane start at bit 0, 6, 4 and 2. Shift each one up so its top bit is bit 15
+  // then shift them all back down by 10 to leave just the value.
+  const __m128i mul =
+      _mm_setr_epi16(1 << 10, 1 << 4, 1 << 6, 1 << 0, 1 << 10, 1 << 4, 1 << 6, 1 << 0);
+
+  // map 0-63 to characters by starting from 'a' and adjusting at each range boundary
+  const __m128i base = _mm_set1_epi8('a');
+  const __m128i after25 = _mm_set1_epi8(25), fixUpper = _mm_set1_epi8('A' - 26 - 'a');
+  const __m128i after51 = _mm_set1_epi8(51), fixDigit = _mm_set1_epi8(('0' - 52) - ('A' - 26));
+  const __m128i after61 = _mm_set1_epi8(61), fixDot = _mm_set1_epi8(('.' - 62) - ('0' - 52));
+  const __m128i after62 = _mm_set1_epi8(62), fixUnderscore = _mm_set1_epi8(('_' - 63) - ('.' - 62));
+
+  size_t w = 0;
+  for(; w + 2 <= numWords; w += 2)
+  {
+    const uint64_t lo = load64(bits, bitOffset + w * BitsPerWord);
+    const uint64_t hi = load64(bits, bitOffset + (w + 1) * BitsPerWord);
+
+    const __m128i packed = _mm_set_epi64x((long long)hi, (long long)lo);
+
+    __m128i loVals = _mm_shuffle_epi8(packed, shuffleLo);
+    __m128i hiVals = _mm_shuffle_epi8(packed, shuffleHi);
+
+    loVals = _mm_srli_epi16(_mm_mullo_epi16(loVals, mul), 10);
+    hiVals = _mm_srli_epi16(_mm_mullo_epi16(hiVals, mul), 10);
+
+    const __m128i vals = _mm_packus_epi16(loVals, hiVals);
+
+    __m128i chars = _mm_add_epi8(vals, base);
+    chars = _mm_add_epi8(chars, _mm_and_si128(_mm_cmpgt_epi8(vals, after25), fixUpper));
+    chars = _mm_add_epi8(chars, _mm_and_si128(_mm_cmpgt_epi8(vals, after51), fixDigit));
+    chars = _mm_add_epi8(chars, _mm_and_si128(_mm_cmpgt_epi8(vals, after61), fixDot));
+    chars = _mm_add_epi8(chars, _mm_and_si128(_mm_cmpgt_epi8(vals, after62), fixUnderscore));
+
+    _mm_storeu_si128((__m128i *)(dst + w * CharsPerWord), chars);
+  }
+
+  // an odd word left over
+  return w * CharsPerWord +
+         DecodeChar6Scalar(bits, bitOffset + w * BitsPerWord, numWords - w, dst + w * CharsPerWord);
+}
+#endif
+
+size_t DecodeChar6Array(const byte *bits, size_t bitOffset, size_t length, char *dst, size_t count)
+{
+  const size_t numWords = numLoadableWords(bitOffset, length, count);
+
+  if(numWords == 0)
+    return 0;
+
+#if DXILP_X86
+  if(GetCPUFeatures().ssse3)
+    return DecodeChar6SSSE3(bits, bitOffset, numWords, dst);
+#endif
+
+  return DecodeChar6Scalar(bits, bitOffset, numWords, dst);
+}
+
+// a single 64-bit load has at least 57 valid bits after shifting off the partial byte. Any value
+// that fits in that many bits is decoded from the window, anything longer is left to the caller.
+static const size_t WindowBits = 57;
+
+static inline uint64_t lowMask(size_t bits)
+{
+  return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+// mask with the given bits set in each group of groupBitSize bits that fits in the window
+static inline uint64_t groupMask(size_t groupBitSize, uint64_t groupBits)
+{
+  uint64_t ret = 0;
+  for(size_t g = 0; g + groupBitSize <= WindowBits; g += groupBitSize)
+    ret |= groupBits << g;
+  return ret;
+}
+
+static size_t DecodeVBRScalar(const byte *bits, size_t bitOffset, size_t length,
+                              size_t groupBitSize, uint64_t *dst, size_t count, size_t &consumed)
+{
+  const uint64_t hibit = 1ULL << (groupBitSize - 1);
+  const uint64_t lobits = hibit - 1;
+  const uint64_t groupbits = lowMask(groupBitSize);
+
+  size_t pos = bitOffset;
+  size_t i = 0;
+  for(; i < count && canLoad64(pos, length); i++)
+  {
+    const uint64_t window = load64(bits, pos);
+
+    uint64_t val = 0;
+    size_t used = 0;
+    bool complete = false;
+    while(used + groupBitSize <= WindowBits)
+    {
+      const uint64_t chunk = (window >> used) & groupbits;
+      val |= (chunk & lobits) << (used / groupBitSize * (groupBitSize - 1));
+      used += groupBitSize;
+
+      if((chunk & hibit) == 0)
+      {
+        complete = true;
+        break;
+      }
+    }
+
+    // ran out of window before the value finished
+    if(!complete)
+      break;
+
+    dst[i] = val;
+    pos += used;
+  }
+
+  consumed = pos - bitOffset;
+  return i;
+}
+
+#if DXILP_X64
+// the lowest clear continuation bit marks the end of the value, which gives its length directly.
+// pext then gathers the payload bits of all its groups straight into the value.
+DXILP_TARGET("bmi,bmi2")
+static size_t DecodeVBRBMI2(const byte *bits, size_t bitOffset, size_t length, size_t groupBitSize,
+                            uint64_t *dst, size_t count, size_t &consumed)
+{
+  const uint64_t hibit = 1ULL << (groupBitSize - 1);
+  const uint64_t hiMask = groupMask(groupBitSize, hibit);
+  const uint64_t loMask = groupMask(groupBitSize, hibit - 1);
+
+  size_t pos = bitOffset;
+  size_t i = 0;
+  for(; i < count && canLoad64(pos, length); i++)
+  {
+    const uint64_t window = load64(bits, pos);
+
+    // if no group in the window ends the value this is 65
+    const size_t used = size_t(_tzcnt_u64(_andn_u64(window, hiMask))) + 1;
+    if(used > WindowBits)
+      break;
+
+    dst[i] = _pext_u64(window, _bzhi_u64(loMask, (unsigned int)used));
+    pos += used;
+  }
+
+  consumed = pos - bitOffset;
+  return i;
+}
+
+// runs of single-group values (small operands are by far the most common) are split out four at
+// a time with variable shifts. Anything else is done one at a time as above.
+DXILP_TARGET("avx2,bmi,bmi2")
+static size_t DecodeVBRAVX2(const byte *bits, size_t bitOffset, size_t length, size_t groupBitSize,
+                            uint64_t *dst, size_t count, size_t &consumed)
+{
+  const uint64_t hibit = 1ULL << (groupBitSize - 1);
+  const uint64_t hiMask = groupMask(groupBitSize, hibit);
+  const uint64_t loMask = groupMask(groupBitSize, hibit - 1);
+
+  // continuation bits of the first four groups
+  const uint64_t hiMask4 = hiMask & lowMask(groupBitSize * 4);
+
+  const long long n = (long long)groupBitSize;
+  const __m256i shifts = _mm256_setr_epi64x(0, n, n * 2, n * 3);
+  const __m256i lobits = _mm256_set1_epi64x((long long)(hibit - 1));
+
+  size_t pos = bitOffset;
+  size_t i = 0;
+  while(i < count && canLoad64(pos, length))
+  {
+    const uint64_t window = load64(bits, pos);
+
+    if(i + 4 <= count && (window & hiMask4) == 0)
+    {
+      __m256i vals = _mm256_srlv_epi64(_mm256_set1_epi64x((long long)window), shifts);
+      vals = _mm256_and_si256(vals, lobits);
+      _mm256_storeu_si256((__m256i *)(dst + i), vals);
+
+      i += 4;
+      pos += groupBitSize * 4;
+      continue;
+    }
+
+    const size_t used = size_t(_tzcnt_u64(_andn_u64(window, hiMask))) + 1;
+    if(used > WindowBits)
+      break;
+
+    dst[i] = _pext_u64(window, _bzhi_u64(loMask, (unsigned int)used));
+    pos += used;
+    i++;
+  }
+
+  consumed = pos - bitOffset;
+  return i;
+}
+#endif
+
+size_t DecodeVBRArray(const byte *bits, size_t bitOffset, size_t length, size_t groupBitSize,
+                      uint64_t *dst, size_t count, size_t &consumed)
+{
+  assert(groupBitSize >= 2 && groupBitSize <= 8);
+
+#if DXILP_X64
+  const CPUFeatures &cpu = GetCPUFeatures();
+  if(cpu.avx2 && cpu.bmi1 && cpu.bmi2)
+    return DecodeVBRAVX2(bits, bitOffset, length, groupBitSize, dst, count, consumed);
+  if(cpu.bmi1 && cpu.bmi2)
+    return DecodeVBRBMI2(bits, bitOffset, length, groupBitSize, dst, count, consumed);
+#endif
+
+  return DecodeVBRScalar(bits, bitOffset, length, groupBitSize, dst, count, consumed);
+}
+
+};    // namespace LLVMBC
@@ -29,6 +29,18 @@
 
 namespace LLVMBC
 {
+// maps each 6-bit value to its character
+extern const char Char6Table[65];
+
+// decodes as many of count char6 values as can be done in bulk without reading past length bytes
+// from bits, starting bitOffset bits in. Returns how many were decoded, the caller does the rest.
+size_t DecodeChar6Array(const byte *bits, size_t bitOffset, size_t length, char *dst, size_t count);
+
+// decodes VBR values in bulk the same way, stopping early at any value that is too long to decode
+// in one go. consumed is set to the number of bits used by the values that were decoded.
+size_t DecodeVBRArray(const byte *bits, size_t bitOffset, size_t length, size_t groupBitSize,
+                      uint64_t *dst, size_t count, size_t &consumed);
+
 class BitReader
 {
 public:
@@ -39,25 +51,44 @@ public:
   size_t ByteOffset() { return m_Bits - m_Start; }
   size_t BitOffset() { return ByteOffset() * 8 + m_Offset; }
   size_t ByteLength() { return m_End - m_Start; }
+  size_t RemainingBits() { return size_t(m_End - m_Bits) * 8 - m_Offset; }
+  // once any read goes out of bounds the reader is failed, and all further reads return 0
+  bool Failed() const { return m_Failed; }
+  // moves to a bit offset from the start, clearing any failure so a read can be tried again
+  void Seek(size_t bitOffset)
+  {
+    assert(bitOffset <= ByteLength() * 8);
+    m_Bits = m_Start + bitOffset / 8;
+    m_Offset = bitOffset % 8;
+    m_Failed = false;
+    m_FailedOffset = 0;
+  }
+  size_t FailedBitOffset() const { return m_FailedOffset; }
   char c6()
   {
     byte c = 0;
     ReadBits(6, &c);
 
-    if(c >= 0 && c <= 25)
-      return char('a' + c);
-    else if(c >= 26 && c <= 51)
-      return char('A' + c - 26);
-    else if(c >= 52 && c <= 61)
-      return char('0' + c - 52);
-    else if(c == 62)
-      return '.';
-    else if(c == 63)
-      return '_';
+    // every 6-bit value is a valid character, so there's nothing to check
+    return Char6Table[c];
+  }
+
+  // decode a run of count char6 values, in bulk where possible
+  void c6(char *dst, size_t count)
+  {
+    if(count > RemainingBits() / 6)
+    {
+      Fail();
+      memset(dst, 0, count);
+      return;
+    }
 
-    assert(false && "Unexpected 6-bit char");
+    size_t done = DecodeChar6Array(m_Bits, m_Offset, size_t(m_End - m_Bits), dst, count);
+    Skip(done * 6);
 
-    return '?';
+    // bulk decoding stops short of the end of the stream, the rest is done one at a time
+    for(; done < count; done++)
+      dst[done] = c6();
   }
 
   template <typename T>
@@ -65,7 +96,11 @@ public:
   {
     byte scratch[8] = {};
 
-    assert(bitWidth <= 64);
+    if(bitWidth > 64)
+    {
+      Fail();
+      return T(0);
+    }
 
     ReadBits(bitWidth, scratch);
 
@@ -79,7 +114,13 @@ public:
   {
     uint64_t ret = 0;
 
-    assert(groupBitSize <= 8 && "Only chunk sizes up to 8 supported");
+    // only chunk sizes up to 8 supported
+    if(groupBitSize < 2 || groupBitSize > 8)
+    {
+      Fail();
+      return T(0);
+    }
+
     byte scratch = 0;
 
     const byte hibit = 1 << (groupBitSize - 1);
@@ -88,9 +129,14 @@ public:
     uint64_t shift = 0;
     do
     {
-      ReadBits(groupBitSize, &scratch);
+      // a malformed VBR could continue forever, stop as soon as it can't fit in 64 bits
+      if(shift >= 64)
+      {
+        Fail();
+        return T(0);
+      }
 
-      assert(groupBitSize + shift <= 64);
+      ReadBits(groupBitSize, &scratch);
 
       ret += (uint64_t(scratch & lobits) << shift);
 
@@ -99,11 +145,42 @@ public:
 
     // check for overflow of the return type
     const uint64_t mask = ((1ULL << (sizeof(T) * 8 - 1)) - 1) << 1 | 1;
-    assert((ret & mask) == ret);
+    if((ret & mask) != ret)
+    {
+      Fail();
+      return T(0);
+    }
 
     return T(ret);
   }
 
+  // decode a run of count VBR values, in bulk where possible
+  void vbr(uint64_t *dst, size_t count, const size_t groupBitSize)
+  {
+    if(groupBitSize < 2 || groupBitSize > 8)
+    {
+      Fail();
+      memset(dst, 0, count * sizeof(uint64_t));
+      return;
+    }
+
+    size_t done = 0;
+    while(done < count && !m_Failed)
+    {
+      size_t bits = 0;
+      done += DecodeVBRArray(m_Bits, m_Offset, size_t(m_End - m_Bits), groupBitSize, dst + done,
+                             count - done, bits);
+      Skip(bits);
+
+      // the bulk decode stopped at a long value or near the end of the stream, do one by hand
+      if(done < count)
+        dst[done++] = vbr<uint64_t>(groupBitSize);
+    }
+
+    if(done < count)
+      memset(dst + done, 0, (count - done) * sizeof(uint64_t));
+  }
+
   template <typename T>
   T svbr(size_t groupBitSize)
   {
@@ -142,6 +219,14 @@ public:
     // align to dword boundary
     align32bits();
 
+    if(m_Failed || bloblen > size_t(m_End - m_Bits))
+    {
+      Fail();
+      blobptr = NULL;
+      bloblen = 0;
+      return;
+    }
+
     // the blob is at m_Bits now
     blobptr = m_Bits;
 
@@ -159,13 +244,52 @@ public:
     const size_t byteOffs = ByteOffset();
     const size_t alignedByteOffs = (byteOffs + 0x3) & ~0x3;
 
+    if(alignedByteOffs > ByteLength())
+    {
+      Fail();
+      return;
+    }
+
     // advance by N bytes to dword align the stream
     m_Bits += (alignedByteOffs - byteOffs);
   }
 
+  // skips whole dwords from a dword-aligned position, e.g. the rest of a block
+  void SkipDwords(size_t count)
+  {
+    if(m_Failed || m_Offset != 0 || count > size_t(m_End - m_Bits) / 4)
+    {
+      Fail();
+      return;
+    }
+
+    m_Bits += count * 4;
+  }
+
 private:
   const byte *m_Bits, *m_Start, *m_End;
   size_t m_Offset;
+  bool m_Failed = false;
+  size_t m_FailedOffset = 0;
+
+  void Fail()
+  {
+    if(!m_Failed)
+      m_FailedOffset = BitOffset();
+
+    // jump to the end so that every subsequent read fails too
+    m_Failed = true;
+    m_Bits = m_End;
+    m_Offset = 0;
+  }
+
+  // skip bits that have already been consumed by a bulk decode
+  void Skip(size_t N)
+  {
+    const size_t bits = m_Offset + N;
+    m_Bits += bits / 8;
+    m_Offset = bits % 8;
+  }
 
   void Advance(size_t N)
   {
@@ -183,106 +307,53 @@ private:
 
   void ReadBits(size_t remaining, byte *dst)
   {
-    size_t dstoffs = 0;
-
-    // if we're already partway through a byte, read as many bits as we need and we can
-    if(m_Offset != 0)
+    // bounds check once for the whole read, rather than each byte as we go
+    if(remaining > RemainingBits())
     {
-      const size_t avail = 8 - m_Offset;
-
-      if(avail == remaining)
-      {
-        // if we have just enough in this byte, great! shift and mask off, and update the offset
-
-        // grab the bits into the low end
-        *dst = (*m_Bits >> m_Offset);
-
-        Advance(remaining);
+      Fail();
+      memset(dst, 0, (remaining + 7) / 8);
+      return;
+    }
 
-        return;
-      }
-      else if(avail > remaining)
-      {
-        // we have more than enough. Similar to above but we need to mask out only the bits we need.
+    // we never read more than 64 bits at once, so accumulate into a uint64_t
+    assert(remaining <= 64);
 
-        // grab the bits into the low end and mask
-        *dst = (*m_Bits >> m_Offset) & ((1 << remaining) - 1);
+    const size_t numBytes = (remaining + 7) / 8;
 
-        Advance(remaining);
+    uint64_t val = 0;
+    size_t got = 0;
 
-        return;
-      }
-      else
-      {
-        // we don't have enough. Consume what we can then continue
-        *dst = (*m_Bits >> m_Offset);
+    // if we're already partway through a byte, read as many bits as we need and we can
+    if(m_Offset != 0)
+    {
+      const size_t avail = 8 - m_Offset;
+      got = avail < remaining ? avail : remaining;
 
-        dstoffs = avail;
-        remaining -= avail;
+      // grab the bits into the low end and mask
+      val = (*m_Bits >> m_Offset) & ((1U << got) - 1);
 
-        Advance(avail);
-      }
+      Advance(got);
     }
-    else
+
+    // we're now at the start of a byte if there's anything left to read. Read whole bytes
+    while(remaining - got >= 8)
     {
-      // ensure if we didn't read any bits that the byte is zeroed out, so we can OR on bits below
-      // without needing to worry
-      *dst = 0;
+      val |= uint64_t(*m_Bits) << got;
+      m_Bits++;
+      got += 8;
     }
 
-    // we're now at the start of a byte since we read any remainder above.
-    assert(m_Offset == 0);
-
-    // if we have to read whole bytes, do that here.
-    if(remaining >= 8)
+    // take the low-order bits that we want from the last byte, with no more than 7 left to read
+    if(got < remaining)
     {
-      if(dstoffs == 0)
-      {
-        // if dstoffs is 0 then it's an easy case, we can just copy all the whole bytes into *dst
-        memcpy(dst, m_Bits, remaining / 8);
-
-        // manual advance
-        m_Bits += (remaining / 8);
+      const size_t last = remaining - got;
+      val |= uint64_t(*m_Bits & ((1U << last) - 1)) << got;
 
-        // make sure we read any sub-byte remainder
-        remaining &= 0x7;
-      }
-      else
-      {
-        while(remaining > 8)
-        {
-          // manual advance
-          const byte cur = *m_Bits;
-          m_Bits++;
-
-          remaining -= 8;
-
-          // dstoffs doesn't change because we wrap around to the same offset in the next byte.
-          // However we do need to shuffle the bits in cur around to add what will fit into the
-          // current byte, and then the remainder into the next byte.
-          *dst |= (cur << dstoffs);
-          dst++;
-          *dst = (cur >> (8 - dstoffs));
-        }
-      }
+      // consume the bits we used
+      Advance(last);
     }
 
-    // if nothing remains, return
-    if(remaining == 0)
-      return;
-
-    // we should now have no more than than 7 bits to read
-    assert(remaining < 8);
-
-    // this is the mask to get only the bits we want
-    const byte mask = ((1 << remaining) - 1);
-
-    // take the bits that we want from the next byte (knowing we want the low-order bits), and shift
-    // them into where they should go.
-    *dst |= (*m_Bits & mask) << dstoffs;
-
-    // consume the bits we used
-    Advance(remaining);
+    memcpy(dst, &val, numBytes);
   }
 };
 
@@ -0,0 +1,484 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "llvm_bitwriter.h"
+#include <string.h>
+#include <algorithm>
+#include "llvm_bitreader.h"
+#include "trace.h"
+
+namespace LLVMBC
+{
+// as the decoder reads it, before any block has set a width
+static const size_t TopLevelAbbrevWidth = 2;
+// new blocks only use the builtin abbrev IDs
+static const size_t NewBlockAbbrevWidth = 2;
+
+// reads up to 56 bits without touching any byte past the last one they're in
+static uint64_t readBits(const byte *bits, uint64_t bitOffset, size_t count)
+{
+  const size_t shift = size_t(bitOffset % 8);
+  uint64_t ret = 0;
+  memcpy(&ret, bits + bitOffset / 8, (shift + count + 7) / 8);
+  return (ret >> shift) & ((1ULL << count) - 1);
+}
+
+void BitWriter::fixed(size_t bitWidth, uint64_t value)
+{
+  // never more than 7 bits are held back, so 56 can always be added at once
+  if(bitWidth > 56)
+  {
+    fixed(32, value & 0xffffffffU);
+    fixed(bitWidth - 32, value >> 32);
+    return;
+  }
+
+  m_Acc |= (value & ((1ULL << bitWidth) - 1)) << m_AccBits;
+  m_AccBits += bitWidth;
+
+  while(m_AccBits >= 8)
+  {
+    m_Out.push_back(byte(m_Acc));
+    m_Acc >>= 8;
+    m_AccBits -= 8;
+  }
+}
+
+void BitWriter::vbr(size_t groupBitSize, uint64_t value)
+{
+  const uint64_t hibit = 1ULL << (groupBitSize - 1);
+
+  while(value >= hibit)
+  {
+    fixed(groupBitSize, (value & (hibit - 1)) | hibit);
+    value >>= groupBitSize - 1;
+  }
+
+  fixed(groupBitSize, value);
+}
+
+void BitWriter::align32bits()
+{
+  fixed((32 - BitOffset() % 32) % 32, 0);
+}
+
+void BitWriter::CopyBits(const byte *bits, uint64_t bitOffset, uint64_t numBits)
+{
+  // finish the byte being written first, after which nothing is held back
+  if(m_AccBits > 0 && numBits > 0)
+  {
+    const size_t count = size_t(std::min<uint64_t>(numBits, 8 - m_AccBits));
+    fixed(count, readBits(bits, bitOffset, count));
+    bitOffset += count;
+    numBits -= count;
+  }
+
+  if(numBits >= 8 && bitOffset % 8 == 0)
+  {
+    const byte *src = bits + bitOffset / 8;
+    const size_t numBytes = size_t(numBits / 8);
+    m_Out.insert(m_Out.end(), src, src + numBytes);
+    bitOffset += numBytes * 8;
+    numBits -= numBytes * 8;
+  }
+  else if(numBits >= 56)
+  {
+    // each unaligned load gives 56 bits after shifting, which is 7 whole bytes. Loads have to stay
+    // within the bytes being copied
+    const uint64_t firstByte = bitOffset / 8;
+    const uint64_t endByte = (bitOffset + numBits + 7) / 8;
+    size_t count = size_t(numBits / 56);
+    if(endByte < firstByte + 8)
+      count = 0;
+    else
+      count = std::min(count, size_t((endByte - firstByte - 8) / 7 + 1));
+
+    // each store writes a whole word, the last byte of which is overwritten by the next
+    const size_t pos = m_Out.size();
+    m_Out.resize(pos + count * 7 + 1);
+
+    const byte *src = bits + firstByte;
+    byte *dst = m_Out.data() + pos;
+    const size_t shift = size_t(bitOffset % 8);
+    const uint64_t mask = (1ULL << 56) - 1;
+    for(size_t i = 0; i < count; i++)
+    {
+      uint64_t word;
+      memcpy(&word, src + i * 7, sizeof(word));
+      word = (word >> shift) & mask;
+      memcpy(dst + i * 7, &word, sizeof(word));
+    }
+
+    m_Out.resize(pos + count * 7);
+    bitOffset += uint64_t(count) * 56;
+    numBits -= uint64_t(count) * 56;
+  }
+
+  while(numBits > 0)
+  {
+    const size_t count = size_t(std::min<uint64_t>(numBits, 56));
+    fixed(count, readBits(bits, bitOffset, count));
+    bitOffset += count;
+    numBits -= count;
+  }
+}
+
+void BitWriter::Patch32(size_t bitOffset, uint32_t value)
+{
+  assert(bitOffset % 32 == 0 && bitOffset + 32 <= (m_Out.size() - m_Base) * 8);
+  memcpy(m_Out.data() + m_Base + bitOffset / 8, &value, sizeof(value));
+}
+
+void BitWriter::Flush()
+{
+  if(m_AccBits > 0)
+  {
+    m_Out.push_back(byte(m_Acc));
+    m_Acc = 0;
+    m_AccBits = 0;
+  }
+}
+
+BitcodeRewriter::BitcodeRewriter(const byte *bitcode, size_t length, const BlockOrRecord &root)
+    : m_Bitcode(bitcode), m_Length(length), m_Root(root)
+{
+}
+
+BitcodeRewriter::Edit &BitcodeRewriter::edit(const BlockOrRecord &original)
+{
+  // entries that weren't decoded have nothing to find them by when writing
+  if(original.bitLength == 0)
+    m_Error = "Edited entry wasn't decoded from the bitcode";
+
+  return m_Edits[original.bitOffset];
+}
+
+void BitcodeRewriter::Replace(const BlockOrRecord &original, BlockOrRecord replacement)
+{
+  Edit &e = edit(original);
+  e.replace = true;
+  e.remove = false;
+  e.replacement = std::move(replacement);
+}
+
+void BitcodeRewriter::Remove(const BlockOrRecord &original)
+{
+  Edit &e = edit(original);
+  e.remove = true;
+  e.replace = false;
+  e.replacement = BlockOrRecord();
+}
+
+void BitcodeRewriter::InsertBefore(const BlockOrRecord &original, BlockOrRecord entry)
+{
+  edit(original).before.push_back(std::move(entry));
+}
+
+void BitcodeRewriter::Append(const BlockOrRecord &block, BlockOrRecord entry)
+{
+  if(!block.IsBlock())
+    m_Error = "Appended to a record";
+
+  edit(block).append.push_back(std::move(entry));
+}
+
+bool BitcodeRewriter::Write(std::vector<byte> &out)
+{
+  if(m_Error)
+    return false;
+
+  TRACE_SCOPE("BitcodeRewriter::Write");
+
+  // the top-level block follows the magic, and only its contents can be changed
+  if(m_Length < 4 || m_Root.bitLength == 0 || m_Root.bitOffset != 32)
+  {
+    m_Error = "Nothing was decoded to rewrite";
+    return false;
+  }
+
+  auto root = m_Edits.find(m_Root.bitOffset);
+  if(root != m_Edits.end() &&
+     (root->second.remove || root->second.replace || !root->second.before.empty()))
+  {
+    m_Error = "The top-level block can only be appended to";
+    return false;
+  }
+
+  m_Applied = 0;
+
+  // most of the bitcode is normally copied across as it is
+  out.reserve(out.size() + m_Length);
+
+  BitWriter w(out);
+  w.CopyBits(m_Bitcode, 0, 32);
+
+  if(m_Edits.empty() ? !copyBlock(m_Root, TopLevelAbbrevWidth, w)
+                     : !rewriteBlock(m_Root, TopLevelAbbrevWidth, w))
+    return false;
+
+  if(m_Applied != m_Edits.size())
+  {
+    m_Error = "Edited entry isn't in the tree, or is inside a block that was replaced or removed";
+    return false;
+  }
+
+  return true;
+}
+
+bool BitcodeRewriter::hasEditsWithin(const BlockOrRecord &block) const
+{
+  const uint64_t end = block.bitOffset + block.bitLength + uint64_t(block.blockDwordLength) * 32;
+
+  auto it = m_Edits.upper_bound(block.bitOffset);
+  if(it != m_Edits.end() && it->first < end)
+    return true;
+
+  auto own = m_Edits.find(block.bitOffset);
+  return own != m_Edits.end() && !own->second.append.empty();
+}
+
+bool BitcodeRewriter::readHeader(const BlockOrRecord &block, size_t parentWidth,
+                                 BlockHeader &header)
+{
+  const uint64_t totalBits = uint64_t(m_Length) * 8;
+
+  header.contentStart = block.bitOffset + block.bitLength;
+  header.contentEnd = header.contentStart + uint64_t(block.blockDwordLength) * 32;
+
+  if(block.bitLength == 0 || !block.IsBlock() || header.contentStart % 32 != 0 ||
+     header.contentEnd > totalBits)
+  {
+    m_Error = "Block doesn't match the bitcode";
+    return false;
+  }
+
+  // the abbrev width isn't kept in the tree, so the header is read again
+  const size_t firstByte = size_t(block.bitOffset / 8);
+  BitReader r(m_Bitcode + firstByte, size_t(header.contentStart / 8) - firstByte);
+  r.fixed<uint32_t>(block.bitOffset % 8);
+
+  const uint32_t abbrevID = r.fixed<uint32_t>(parentWidth);
+  const uint32_t id = r.vbr<uint32_t>(8);
+  header.abbrevWidth = r.vbr<size_t>(4);
+  header.headerBits = r.BitOffset() - block.bitOffset % 8;
+
+  if(r.Failed() || abbrevID != ENTER_SUBBLOCK || id != block.id || header.abbrevWidth == 0 ||
+     header.abbrevWidth > 32 || header.headerBits + 32 > block.bitLength)
+  {
+    m_Error = "Block doesn't match the bitcode";
+    return false;
+  }
+
+  return true;
+}
+
+bool BitcodeRewriter::findEndBlock(uint64_t bitOffset, uint64_t end, size_t abbrevWidth,
+                                   uint64_t &endBlock)
+{
+  const uint64_t base = bitOffset - bitOffset % 8;
+  BitReader r(m_Bitcode + base / 8, size_t((end - base) / 8));
+  r.fixed<uint32_t>(bitOffset % 8);
+
+  while(!r.Failed())
+  {
+    const uint64_t pos = base + r.BitOffset();
+    const uint32_t abbrevID = r.fixed<uint32_t>(abbrevWidth);
+
+    if(r.Failed())
+      break;
+
+    if(abbrevID == END_BLOCK)
+    {
+      endBlock = pos;
+      return true;
+    }
+
+    // abbrev definitions are the only entries left out of the tree, so they're skipped over and
+    // anything else means the tree was filtered
+    if(abbrevID != DEFINE_ABBREV)
+      break;
+
+    const uint32_t numOps = r.vbr<uint32_t>(5);
+    for(uint32_t i = 0; i < numOps && !r.Failed(); i++)
+    {
+      if(r.fixed<bool>(1))
+      {
+        r.vbr<uint64_t>(8);
+      }
+      else
+      {
+        const AbbrevEncoding encoding = r.fixed<AbbrevEncoding>(3);
+        if(encoding == AbbrevEncoding::Fixed || encoding == AbbrevEncoding::VBR)
+          r.vbr<uint64_t>(5);
+      }
+    }
+  }
+
+  m_Error = "Block contents don't match the tree, it may have been filtered";
+  return false;
+}
+
+bool BitcodeRewriter::copyBlock(const BlockOrRecord &block, size_t parentWidth, BitWriter &w)
+{
+  BlockHeader header;
+  if(!readHeader(block, parentWidth, header))
+    return false;
+
+  // the header can start anywhere in a dword, so it's copied up to where it's aligned and then
+  // aligned again here. The length and contents after that are whole dwords
+  w.CopyBits(m_Bitcode, block.bitOffset, header.headerBits);
+  w.align32bits();
+  w.CopyBits(m_Bitcode, header.contentStart - 32, header.contentEnd - header.contentStart + 32);
+  return true;
+}
+
+bool BitcodeRewriter::rewriteBlock(const BlockOrRecord &block, size_t parentWidth, BitWriter &w)
+{
+  BlockHeader header;
+  if(!readHeader(block, parentWidth, header))
+    return false;
+
+  w.CopyBits(m_Bitcode, block.bitOffset, header.headerBits);
+  w.align32bits();
+  const size_t lengthOffset = w.BitOffset();
+  w.fixed(32, 0);
+
+  // untouched records, and the abbrev definitions between them, are copied in runs. Untouched
+  // sub-blocks only join a run while the output is at the same point in a dword as the original,
+  // otherwise their contents have to be realigned
+  uint64_t run = header.contentStart;
+  uint64_t last = header.contentStart;
+  for(const BlockOrRecord &child : block.children)
+  {
+    const uint64_t childEnd =
+        child.bitOffset + child.bitLength + uint64_t(child.blockDwordLength) * 32;
+
+    if(child.bitLength == 0 || child.bitOffset < last || childEnd > header.contentEnd)
+    {
+      m_Error = "Block doesn't match the bitcode";
+      return false;
+    }
+
+    last = childEnd;
+
+    auto it = m_Edits.find(child.bitOffset);
+    const Edit *e = it != m_Edits.end() ? &it->second : NULL;
+
+    if(!e && (child.IsRecord() || ((w.BitOffset() - run) % 32 == 0 && !hasEditsWithin(child))))
+      continue;
+
+    w.CopyBits(m_Bitcode, run, child.bitOffset - run);
+    run = childEnd;
+
+    if(e)
+    {
+      m_Applied++;
+
+      for(const BlockOrRecord &entry : e->before)
+        if(!writeNew(entry, header.abbrevWidth, w))
+          return false;
+
+      if(e->remove)
+        continue;
+
+      if(e->replace)
+      {
+        if(!writeNew(e->replacement, header.abbrevWidth, w))
+          return false;
+        continue;
+      }
+    }
+
+    bool ok = true;
+    if(child.IsRecord())
+      w.CopyBits(m_Bitcode, child.bitOffset, child.bitLength);
+    else if(hasEditsWithin(child))
+      ok = rewriteBlock(child, header.abbrevWidth, w);
+    else
+      ok = copyBlock(child, header.abbrevWidth, w);
+
+    if(!ok)
+      return false;
+  }
+
+  uint64_t endBlock = 0;
+  if(!findEndBlock(last, header.contentEnd, header.abbrevWidth, endBlock))
+    return false;
+
+  w.CopyBits(m_Bitcode, run, endBlock - run);
+
+  // a block's own edit is counted where it's replaced or inserted before, unless it's the root
+  auto own = m_Edits.find(block.bitOffset);
+  if(own != m_Edits.end())
+  {
+    if(&block == &m_Root)
+      m_Applied++;
+
+    for(const BlockOrRecord &entry : own->second.append)
+      if(!writeNew(entry, header.abbrevWidth, w))
+        return false;
+  }
+
+  w.fixed(header.abbrevWidth, END_BLOCK);
+  w.align32bits();
+  w.Patch32(lengthOffset, uint32_t((w.BitOffset() - lengthOffset) / 32 - 1));
+  return true;
+}
+
+bool BitcodeRewriter::writeNew(const BlockOrRecord &entry, size_t parentWidth, BitWriter &w)
+{
+  if(entry.IsRecord())
+  {
+    // a blob can only be written through an abbrev
+    if(entry.blob)
+    {
+      m_Error = "New records can't have blobs";
+      return false;
+    }
+
+    w.fixed(parentWidth, UNABBREV_RECORD);
+    w.vbr(6, entry.id);
+    w.vbr(6, entry.ops.size());
+    for(uint64_t op : entry.ops)
+      w.vbr(6, op);
+    return true;
+  }
+
+  w.fixed(parentWidth, ENTER_SUBBLOCK);
+  w.vbr(8, entry.id);
+  w.vbr(4, NewBlockAbbrevWidth);
+  w.align32bits();
+  const size_t lengthOffset = w.BitOffset();
+  w.fixed(32, 0);
+
+  for(const BlockOrRecord &child : entry.children)
+    if(!writeNew(child, NewBlockAbbrevWidth, w))
+      return false;
+
+  w.fixed(NewBlockAbbrevWidth, END_BLOCK);
+  w.align32bits();
+  w.Patch32(lengthOffset, uint32_t((w.BitOffset() - lengthOffset) / 32 - 1));
+  return true;
+}
+};    // namespace LLVMBC
@@ -0,0 +1,139 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include "common.h"
+#include "llvm_decoder.h"
+
+namespace LLVMBC
+{
+// appends bits to a byte vector, least significant bit first as bitcode is read. Offsets are from
+// where the writer started, so that alignment is relative to that too.
+class BitWriter
+{
+public:
+  explicit BitWriter(std::vector<byte> &out) : m_Out(out), m_Base(out.size()) {}
+  // anything left part-way through a byte is written out
+  ~BitWriter() { Flush(); }
+
+  size_t BitOffset() const { return (m_Out.size() - m_Base) * 8 + m_AccBits; }
+
+  void fixed(size_t bitWidth, uint64_t value);
+  void vbr(size_t groupBitSize, uint64_t value);
+  void align32bits();
+
+  // copies numBits from bits, starting bitOffset bits in. Whole bytes are copied straight over when
+  // both sides are at the same point in a byte, otherwise they're shifted into place
+  void CopyBits(const byte *bits, uint64_t bitOffset, uint64_t numBits);
+
+  // overwrites a dword already written, e.g. a block's length once its end is known
+  void Patch32(size_t bitOffset, uint32_t value);
+
+  void Flush();
+
+private:
+  std::vector<byte> &m_Out;
+  size_t m_Base;
+
+  // bits not yet written to the vector, never more than 7 between calls
+  uint64_t m_Acc = 0;
+  size_t m_AccBits = 0;
+};
+
+// writes bitcode with edits to its decoded tree, re-encoding only the blocks that were changed.
+// Every other block is copied whole, and records in changed blocks are copied bit for bit with
+// their original abbreviations.
+//
+// edits name an entry of the original tree, which must have been decoded without a filter and is
+// never modified. New entries are encoded from scratch with unabbreviated records, so can't have
+// blobs. New blocks use the narrowest abbrev ID width, and ignore any range their entries have.
+// Records holding offsets into the bitcode itself, like the VSTOFFSET and FNENTRY of newer LLVM
+// versions, are copied as they are and so go stale if anything before what they point to changes.
+class BitcodeRewriter
+{
+public:
+  // the bitcode and the tree decoded from it. Neither is copied, so both must outlive the rewriter
+  BitcodeRewriter(const byte *bitcode, size_t length, const BlockOrRecord &root);
+
+  void Replace(const BlockOrRecord &original, BlockOrRecord replacement);
+  void Remove(const BlockOrRecord &original);
+  // entries inserted before the same one are written in the order they were added
+  void InsertBefore(const BlockOrRecord &original, BlockOrRecord entry);
+  // adds to the end of a block's contents, unless the block is replaced or removed
+  void Append(const BlockOrRecord &block, BlockOrRecord entry);
+
+  bool HasEdits() const { return !m_Edits.empty(); }
+
+  // appends the rewritten bitcode. If it fails, what was appended should be discarded
+  bool Write(std::vector<byte> &out);
+  // why writing failed, or NULL
+  const char *GetError() const { return m_Error; }
+
+protected:
+  const char *m_Error = NULL;
+
+private:
+  struct Edit
+  {
+    bool remove = false;
+    bool replace = false;
+    BlockOrRecord replacement;
+    std::vector<BlockOrRecord> before;
+    std::vector<BlockOrRecord> append;
+  };
+
+  // the block header, as read back from the bitcode
+  struct BlockHeader
+  {
+    size_t abbrevWidth;
+    // the bits before the header is aligned for the block's length
+    uint64_t headerBits;
+    uint64_t contentStart;
+    uint64_t contentEnd;
+  };
+
+  Edit &edit(const BlockOrRecord &original);
+  bool hasEditsWithin(const BlockOrRecord &block) const;
+  bool readHeader(const BlockOrRecord &block, size_t parentWidth, BlockHeader &header);
+  bool findEndBlock(uint64_t bitOffset, uint64_t end, size_t abbrevWidth, uint64_t &endBlock);
+
+  bool copyBlock(const BlockOrRecord &block, size_t parentWidth, BitWriter &w);
+  bool rewriteBlock(const BlockOrRecord &block, size_t parentWidth, BitWriter &w);
+  bool writeNew(const BlockOrRecord &entry, size_t parentWidth, BitWriter &w);
+
+  const byte *m_Bitcode;
+  size_t m_Length;
+  const BlockOrRecord &m_Root;
+
+  // keyed by the bit offset of the entry they apply to, which is unique
+  std::map<uint64_t, Edit> m_Edits;
+  // how many edits were found while writing, to catch any that weren't
+  size_t m_Applied = 0;
+};
+};    // namespace LLVMBC
@@ -23,18 +23,11 @@
  ******************************************************************************/
 
 #include "llvm_decoder.h"
+#include <algorithm>
+#include "trace.h"
 
 namespace LLVMBC
 {
-enum AbbrevId
-{
-  END_BLOCK = 0,
-  ENTER_SUBBLOCK = 1,
-  DEFINE_ABBREV = 2,
-  UNABBREV_RECORD = 3,
-  APPLICATION_ABBREV = 4,
-};
-
 enum class BlockInfoRecord
 {
   SETBID = 1,
@@ -42,48 +35,264 @@ enum class BlockInfoRecord
   SETRECORDNAME = 3,
 };
 
+// limits for malformed input. Neither is approached by real DXIL
+static const size_t MaxBlockDepth = 64;
+static const size_t MaxAbbrevWidth = 32;
+static const size_t MaxBlockInfoID = 1024;
+
+const char *DecodeErrorString(DecodeError err)
+{
+  switch(err)
+  {
+    case DecodeError::None: return "No error";
+    case DecodeError::InvalidContainer: return "Invalid container around bitcode";
+    case DecodeError::InvalidMagic: return "Invalid bitcode magic";
+    case DecodeError::InvalidBitstream: return "Truncated or malformed bitstream";
+    case DecodeError::BlockOutOfBounds: return "Block length out of bounds";
+    case DecodeError::BlockNestingTooDeep: return "Blocks nested too deeply";
+    case DecodeError::InvalidAbbrevWidth: return "Invalid abbreviation ID width";
+    case DecodeError::InvalidAbbrevID: return "Invalid abbreviation ID";
+    case DecodeError::InvalidAbbrevDefinition: return "Invalid abbreviation definition";
+    case DecodeError::InvalidBlockInfo: return "Invalid BLOCKINFO block";
+    case DecodeError::RecordOutOfBounds: return "Record length out of bounds";
+    case DecodeError::InvalidModule: return "Top-level block isn't a single module";
+  }
+
+  return "Unknown error";
+}
+
 BitcodeReader::BitcodeReader(const byte *bitcode, size_t length) : b(bitcode, length)
 {
   uint32_t magic = b.Read<uint32_t>();
 
-  assert(magic == MAKE_FOURCC('B', 'C', 0xC0, 0xDE));
+  if(magic != MAKE_FOURCC('B', 'C', 0xC0, 0xDE))
+    fail(DecodeError::InvalidMagic);
+}
+
+DecodeStatus BitcodeReader::GetStatus() const
+{
+  if(!status.Failed() && b.Failed())
+  {
+    DecodeStatus ret;
+    ret.error = DecodeError::InvalidBitstream;
+    ret.bitOffset = baseBit + b.FailedBitOffset();
+    return ret;
+  }
+
+  return status;
+}
+
+void BitcodeReader::fail(DecodeError err)
+{
+  // only keep the first error, anything after that is likely a knock-on effect
+  if(failed())
+    return;
+
+  status.error = err;
+  status.bitOffset = bitOffset();
 }
 
 BlockOrRecord BitcodeReader::ReadToplevelBlock()
 {
   BlockOrRecord ret;
 
+  if(failed())
+    return ret;
+
+  const size_t startBit = bitOffset();
+
   // should hit ENTER_SUBBLOCK first for top-level block
   uint32_t abbrevID = b.fixed<uint32_t>(abbrevSize());
-  assert(abbrevID == ENTER_SUBBLOCK);
+  if(abbrevID != ENTER_SUBBLOCK)
+  {
+    fail(DecodeError::InvalidAbbrevID);
+    return ret;
+  }
 
-  ReadBlockContents(ret);
+  ret.bitOffset = startBit;
+  ReadBlockContents(ret, ~0U, BlockAction::Descend);
+
+  if(stats && !failed())
+  {
+    stats->numModules++;
+    stats->totalBits += bitOffset() - startBit;
+    countBlock(ret.id, bitOffset() - startBit);
+  }
 
   return ret;
 }
 
+void BitcodeReader::countBlock(uint32_t id, size_t bits)
+{
+  BlockStats &blockStats = stats->blocks[id];
+  blockStats.count++;
+  blockStats.bits += bits;
+}
+
+void BitcodeReader::countEntry(BlockStats &blockStats, uint32_t abbrevID, uint32_t id,
+                               size_t numOps, size_t startBit)
+{
+  // abbrev IDs have been validated by now so this is bounded
+  if(abbrevID >= blockStats.abbrevUses.size())
+    blockStats.abbrevUses.resize(abbrevID + 1);
+  blockStats.abbrevUses[abbrevID]++;
+
+  if(abbrevID == ENTER_SUBBLOCK)
+  {
+    const size_t bits = bitOffset() - startBit;
+    countBlock(id, bits);
+
+    // this block adds its whole size once it ends, so this leaves only the bits it holds directly
+    blockStats.bits -= bits;
+  }
+  else if(abbrevID == UNABBREV_RECORD || abbrevID >= APPLICATION_ABBREV)
+  {
+    RecordStats &recordStats = blockStats.records[id];
+    recordStats.count++;
+    if(abbrevID != UNABBREV_RECORD)
+      recordStats.abbreviated++;
+    recordStats.numOps += numOps;
+    recordStats.bits += bitOffset() - startBit;
+  }
+}
+
+void BitcodeStats::Merge(const BitcodeStats &o)
+{
+  numModules += o.numModules;
+  totalBits += o.totalBits;
+
+  for(const auto &block : o.blocks)
+  {
+    const BlockStats &src = block.second;
+    BlockStats &dst = blocks[block.first];
+
+    dst.count += src.count;
+    dst.bits += src.bits;
+
+    for(const auto &record : src.records)
+    {
+      RecordStats &rdst = dst.records[record.first];
+      rdst.count += record.second.count;
+      rdst.abbreviated += record.second.abbreviated;
+      rdst.numOps += record.second.numOps;
+      rdst.bits += record.second.bits;
+    }
+
+    if(src.abbrevUses.size() > dst.abbrevUses.size())
+      dst.abbrevUses.resize(src.abbrevUses.size());
+    for(size_t i = 0; i < src.abbrevUses.size(); i++)
+      dst.abbrevUses[i] += src.abbrevUses[i];
+  }
+}
+
 bool BitcodeReader::AtEndOfStream()
 {
   return b.ByteOffset() == b.ByteLength();
 }
 
-void BitcodeReader::ReadBlockContents(BlockOrRecord &block)
+// returns the minimum number of bits that an operand with this encoding could take up, for bounds
+// checking array lengths before we start decoding them.
+static size_t minParamBits(const AbbrevParam &param)
 {
-  block.id = b.vbr<uint32_t>(8);
+  switch(param.encoding)
+  {
+    case AbbrevEncoding::Fixed:
+    case AbbrevEncoding::VBR: return (size_t)param.value;
+    case AbbrevEncoding::Char6: return 6;
+    default: break;
+  }
 
-  blockStack.push_back(BlockContext(b.vbr<size_t>(4)));
+  return 0;
+}
 
-  b.align32bits();
-  block.blockDwordLength = b.Read<uint32_t>();
+static bool validAbbrev(const AbbrevDesc &a)
+{
+  // must have at least one param for the code itself, and that can't be an array or blob
+  if(a.params.empty() || a.params[0].encoding == AbbrevEncoding::Array ||
+     a.params[0].encoding == AbbrevEncoding::Blob)
+    return false;
+
+  for(size_t i = 1; i < a.params.size(); i++)
+  {
+    const AbbrevParam &param = a.params[i];
+
+    switch(param.encoding)
+    {
+      case AbbrevEncoding::Literal:
+      case AbbrevEncoding::Char6: break;
+      case AbbrevEncoding::Fixed:
+        if(param.value > 64)
+          return false;
+        break;
+      case AbbrevEncoding::VBR:
+        // we only support chunk sizes up to 8
+        if(param.value < 2 || param.value > 8)
+          return false;
+        break;
+      case AbbrevEncoding::Array:
+      {
+        // must be another param to specify the value type, and it must be the last
+        if(i + 1 != a.params.size() - 1)
+          return false;
+        AbbrevEncoding el = a.params[i + 1].encoding;
+        if(el == AbbrevEncoding::Array || el == AbbrevEncoding::Blob)
+          return false;
+        // skip the element type, it's been validated
+        return true;
+      }
+      case AbbrevEncoding::Blob:
+        // blob must be the last value
+        if(i != a.params.size() - 1)
+          return false;
+        break;
+      default: return false;
+    }
+  }
+
+  return true;
+}
+
+BlockAction BitcodeReader::ReadBlockContents(BlockOrRecord &block, uint32_t parentID,
+                                             BlockAction parentAction)
+{
+  size_t newAbbrevSize = 0;
+  if(!readBlockHeader(block, newAbbrevSize))
+    return BlockAction::Skip;
+
+  TRACE_SCOPE_ARG("ReadBlockContents", "blockID", block.id);
+
+  const BlockAction action =
+      filter ? filter->EnterBlock(block.id, parentID, parentAction) : BlockAction::Decode;
+
+  // BLOCKINFO is block 0, and is read regardless
+  if(action == BlockAction::Skip && block.id != 0)
+  {
+    b.SkipDwords(block.blockDwordLength);
+    return action;
+  }
+
+  const bool keepRecords = (action == BlockAction::Decode);
+
+  pushBlock(block.id, newAbbrevSize);
 
-  // used for blockinfo only
-  BlockInfo *curBlockInfo = NULL;
+  // used for blockinfo only. Indexed since SETBID can resize the table
+  size_t curBlockInfo = SIZE_MAX;
+
+  BlockStats *blockStats = stats ? &stats->blocks[block.id] : NULL;
 
   uint32_t abbrevID = ~0U;
   do
   {
+    const size_t startBit = bitOffset();
+    // what was read, for statistics
+    uint32_t entryID = 0;
+    size_t entryNumOps = 0;
+
     abbrevID = b.fixed<uint32_t>(abbrevSize());
 
+    if(failed())
+      break;
+
     if(abbrevID == END_BLOCK)
     {
       b.align32bits();
@@ -91,142 +300,331 @@ void BitcodeReader::ReadBlockContents(BlockOrRecord &block)
     else if(abbrevID == ENTER_SUBBLOCK)
     {
       BlockOrRecord sub;
+      sub.bitOffset = startBit;
 
-      ReadBlockContents(sub);
+      const BlockAction subAction = ReadBlockContents(sub, block.id, action);
+      entryID = sub.id;
 
-      block.children.push_back(sub);
+      if(subAction != BlockAction::Skip)
+        block.children.push_back(std::move(sub));
     }
     else if(abbrevID == DEFINE_ABBREV)
     {
-      AbbrevDesc a;
+      if(!readAbbrevDefinition(block.id, curBlockInfo))
+        break;
+    }
+    else
+    {
+      BlockOrRecord r;
+      if(!readRecord(abbrevID, block.id, startBit, curBlockInfo, r))
+        break;
 
-      uint32_t numops = b.vbr<uint32_t>(5);
+      entryID = r.id;
+      entryNumOps = r.ops.size();
 
-      a.params.resize(numops);
+      if(keepRecords && (!filter || filter->KeepRecord(block.id, r.id)))
+        block.children.push_back(std::move(r));
+    }
 
-      for(uint32_t i = 0; i < numops; i++)
-      {
-        AbbrevParam &param = a.params[i];
+    if(blockStats && !failed())
+      countEntry(*blockStats, abbrevID, entryID, entryNumOps, startBit);
+  } while(abbrevID != END_BLOCK && !failed());
 
-        bool lit = b.fixed<bool>(1);
+  popBlock();
 
-        if(lit)
-        {
-          param.encoding = AbbrevEncoding::Literal;
-          param.value = b.vbr<uint64_t>(8);
-        }
-        else
-        {
-          param.encoding = b.fixed<AbbrevEncoding>(3);
+  return action;
+}
 
-          if(param.encoding == AbbrevEncoding::Fixed || param.encoding == AbbrevEncoding::VBR)
-          {
-            param.value = b.vbr<uint64_t>(5);
-          }
-        }
-      }
+bool BitcodeReader::readBlockHeader(BlockOrRecord &block, size_t &newAbbrevSize)
+{
+  block.id = b.vbr<uint32_t>(8);
+  newAbbrevSize = b.vbr<size_t>(4);
 
-      if(curBlockInfo)
-        curBlockInfo->abbrevs.push_back(a);
-      else
-        blockStack.back().abbrevs.push_back(a);
+  if(newAbbrevSize == 0 || newAbbrevSize > MaxAbbrevWidth)
+  {
+    fail(DecodeError::InvalidAbbrevWidth);
+    return false;
+  }
+
+  if(blockDepth >= MaxBlockDepth)
+  {
+    fail(DecodeError::BlockNestingTooDeep);
+    return false;
+  }
+
+  b.align32bits();
+  block.blockDwordLength = b.Read<uint32_t>();
+  block.bitLength = uint32_t(bitOffset() - block.bitOffset);
+
+  // check the whole block is in bounds once, up front
+  if(failed() || block.blockDwordLength > remainingBits() / 32)
+  {
+    fail(DecodeError::BlockOutOfBounds);
+    return false;
+  }
+
+  return true;
+}
+
+void BitcodeReader::pushBlock(uint32_t blockID, size_t newAbbrevSize)
+{
+  if(blockDepth == blockStack.size())
+    blockStack.push_back(BlockContext());
+
+  BlockContext &ctx = blockStack[blockDepth];
+  ctx.abbrevSize = newAbbrevSize;
+  ctx.localAbbrevBase = localAbbrevs.size();
+
+  // start with any abbrevs from BLOCKINFO, local ones get appended
+  if(blockID < blockInfo.size())
+    ctx.abbrevs.assign(blockInfo[blockID].abbrevs.begin(), blockInfo[blockID].abbrevs.end());
+  else
+    ctx.abbrevs.clear();
+
+  blockDepth++;
+}
+
+void BitcodeReader::popBlock()
+{
+  blockDepth--;
+
+  // anything defined locally in this block is now unreachable
+  localAbbrevs.resize(blockStack[blockDepth].localAbbrevBase);
+}
+
+bool BitcodeReader::readAbbrevDefinition(uint32_t blockID, size_t curBlockInfo)
+{
+  AbbrevDesc a;
+
+  uint32_t numops = b.vbr<uint32_t>(5);
+
+  // each op is at least four bits, a literal flag and an encoding, so this bounds the allocation
+  if(numops > remainingBits() / 4)
+  {
+    fail(DecodeError::RecordOutOfBounds);
+    return false;
+  }
+
+  a.params.resize(numops);
+
+  for(uint32_t i = 0; i < numops; i++)
+  {
+    AbbrevParam &param = a.params[i];
+
+    bool lit = b.fixed<bool>(1);
+
+    if(lit)
+    {
+      param.encoding = AbbrevEncoding::Literal;
+      param.value = b.vbr<uint64_t>(8);
     }
-    else if(abbrevID == UNABBREV_RECORD)
+    else
     {
-      BlockOrRecord r;
-      r.id = b.vbr<uint32_t>(6);
-      uint32_t numops = b.vbr<uint32_t>(6);
-      r.ops.resize(numops);
-      for(uint32_t i = 0; i < numops; i++)
-        r.ops[i] = b.vbr<uint64_t>(6);
+      param.encoding = b.fixed<AbbrevEncoding>(3);
 
-      if(block.id == 0)    // BLOCKINFO is block 0
+      if(param.encoding == AbbrevEncoding::Fixed || param.encoding == AbbrevEncoding::VBR)
       {
-        switch(BlockInfoRecord(r.id))
+        param.value = b.vbr<uint64_t>(5);
+
+        // zero-width values are always 0, same as a literal
+        if(param.value == 0)
+          param.encoding = AbbrevEncoding::Literal;
+      }
+    }
+  }
+
+  // nothing is defined from a definition that was cut short
+  if(!validAbbrev(a) || failed())
+  {
+    fail(DecodeError::InvalidAbbrevDefinition);
+    return false;
+  }
+
+  if(curBlockInfo < blockInfo.size())
+  {
+    blockInfoAbbrevs.push_back(a);
+    blockInfo[curBlockInfo].abbrevs.push_back(&blockInfoAbbrevs.back());
+  }
+  else if(blockID == 0)    // BLOCKINFO is block 0
+  {
+    fail(DecodeError::InvalidBlockInfo);
+    return false;
+  }
+  else
+  {
+    localAbbrevs.push_back(a);
+    blockStack[blockDepth - 1].abbrevs.push_back(&localAbbrevs.back());
+  }
+
+  return true;
+}
+
+bool BitcodeReader::readRecord(uint32_t abbrevID, uint32_t blockID, size_t startBit,
+                               size_t &curBlockInfo, BlockOrRecord &r)
+{
+  if(abbrevID == UNABBREV_RECORD)
+  {
+    r.id = b.vbr<uint32_t>(6);
+    uint32_t numops = b.vbr<uint32_t>(6);
+
+    // each op is at least 6 bits
+    if(numops > remainingBits() / 6 || numops > OpList::MaxSize)
+    {
+      fail(DecodeError::RecordOutOfBounds);
+      return false;
+    }
+
+    opScratch.resize(numops);
+    b.vbr(opScratch.data(), numops, 6);
+    r.ops.Append(opScratch.data(), numops);
+
+    // BLOCKINFO's state is only changed by records that were read in full
+    if(failed())
+      return false;
+
+    if(blockID == 0)    // BLOCKINFO is block 0
+    {
+      switch(BlockInfoRecord(r.id))
+      {
+        case BlockInfoRecord::SETBID:
         {
-          case BlockInfoRecord::SETBID:
-          {
-            curBlockInfo = &blockInfo[(uint32_t)r.ops[0]];
-            break;
-          }
-          case BlockInfoRecord::BLOCKNAME:
-          {
-            // skipped because this is so rarely used
-            /*
-            for(uint32_t i = 0; i < r.ops.size(); i++)
-              curBlockInfo->blockname.push_back((char)r.ops[i]);
-              */
-            break;
-          }
-          case BlockInfoRecord::SETRECORDNAME:
+          if(r.ops.empty() || r.ops[0] >= MaxBlockInfoID)
           {
-            // skipped because this is so rarely used
-            /*
-            uint32_t record = (uint32_t)r.ops[0];
-            if(record >= curBlockInfo->recordnames.size())
-              curBlockInfo->recordnames.resize(record + 1);
-            r.ops.erase(r.ops.begin());
-            for(uint32_t i = 0; i < r.ops.size(); i++)
-              curBlockInfo->recordnames[record].push_back((char)r.ops[i]);
-              */
-            break;
+            fail(DecodeError::InvalidBlockInfo);
+            return false;
           }
+          curBlockInfo = (size_t)r.ops[0];
+          if(curBlockInfo >= blockInfo.size())
+            blockInfo.resize(curBlockInfo + 1);
+          break;
+        }
+        case BlockInfoRecord::BLOCKNAME:
+        {
+          // skipped because this is so rarely used
+          /*
+          for(uint32_t i = 0; i < r.ops.size(); i++)
+            blockInfo[curBlockInfo].blockname.push_back((char)r.ops[i]);
+            */
+          break;
+        }
+        case BlockInfoRecord::SETRECORDNAME:
+        {
+          // skipped because this is so rarely used
+          /*
+          uint32_t record = (uint32_t)r.ops[0];
+          if(record >= blockInfo[curBlockInfo].recordnames.size())
+            blockInfo[curBlockInfo].recordnames.resize(record + 1);
+          r.ops.erase(r.ops.begin());
+          for(uint32_t i = 0; i < r.ops.size(); i++)
+            blockInfo[curBlockInfo].recordnames[record].push_back((char)r.ops[i]);
+            */
+          break;
         }
       }
-
-      block.children.push_back(r);
     }
-    else
-    {
-      const AbbrevDesc &a = getAbbrev(block.id, abbrevID);
 
-      BlockOrRecord r;
+    return setRecordRange(r, startBit);
+  }
 
-      // should have at least one param for the code itself
-      assert(!a.params.empty());
+  const AbbrevDesc *abbrev = getAbbrev(abbrevID);
 
-      r.id = (uint32_t)decodeAbbrevParam(a.params[0]);
+  if(!abbrev)
+  {
+    fail(DecodeError::InvalidAbbrevID);
+    return false;
+  }
 
-      // process the rest of the operands - since some might be arrays we don't know until we
-      // process it how many ops the record will end up with but it will be at least one per
-      // parameter.
-      r.ops.reserve(a.params.size() - 1);
-      for(size_t i = 1; i < a.params.size(); i++)
-      {
-        const AbbrevParam &param = a.params[i];
+  const AbbrevDesc &a = *abbrev;
 
-        if(param.encoding == AbbrevEncoding::Array)
-        {
-          // must be another param to specify the value type, and it must be the last
-          assert(i + 1 == a.params.size() - 1);
-          const AbbrevParam &elType = a.params[i + 1];
+  r.id = (uint32_t)decodeAbbrevParam(a.params[0]);
 
-          size_t arrayLen = b.vbr<size_t>(6);
+  // process the rest of the operands - since some might be arrays we don't know until we
+  // process it how many ops the record will end up with but it will be at least one per
+  // parameter.
+  r.ops.reserve(a.params.size() - 1);
+  for(size_t i = 1; i < a.params.size(); i++)
+  {
+    const AbbrevParam &param = a.params[i];
 
-          for(size_t el = 0; el < arrayLen; el++)
-            r.ops.push_back(decodeAbbrevParam(elType));
+    if(param.encoding == AbbrevEncoding::Array)
+    {
+      // abbrev definitions are validated so this is the last param and the element type
+      // follows it
+      const AbbrevParam &elType = a.params[i + 1];
 
-          break;
-        }
-        else if(param.encoding == AbbrevEncoding::Blob)
-        {
-          // blob must be the last value
-          assert(i == a.params.size() - 1);
-          b.ReadBlob(r.blob, r.blobLength);
+      size_t arrayLen = b.vbr<size_t>(6);
 
-          break;
+      // zero-sized elements still count as one bit here, to put some bound on the array
+      const size_t minBits = minParamBits(elType);
+      if(arrayLen > remainingBits() / (minBits ? minBits : 1) ||
+         arrayLen > OpList::MaxSize - r.ops.size())
+      {
+        fail(DecodeError::RecordOutOfBounds);
+        return false;
+      }
+
+      if(elType.encoding == AbbrevEncoding::Char6)
+      {
+        // strings are common enough to be worth decoding in bulk, and normally go straight into
+        // byte-wide ops unless an earlier operand was larger.
+        if(r.ops.Width() == 1)
+        {
+          b.c6((char *)r.ops.AppendBytes(arrayLen), arrayLen);
         }
         else
         {
-          r.ops.push_back(decodeAbbrevParam(param));
+          for(size_t el = 0; el < arrayLen; el++)
+            r.ops.push_back(uint8_t(b.c6()));
         }
       }
+      else if(elType.encoding == AbbrevEncoding::VBR)
+      {
+        opScratch.resize(arrayLen);
+        b.vbr(opScratch.data(), arrayLen, elType.value);
+        r.ops.Append(opScratch.data(), arrayLen);
+      }
+      else
+      {
+        for(size_t el = 0; el < arrayLen; el++)
+          r.ops.push_back(decodeAbbrevParam(elType));
+      }
 
-      block.children.push_back(r);
+      break;
     }
-  } while(abbrevID != END_BLOCK);
+    else if(param.encoding == AbbrevEncoding::Blob)
+    {
+      // blob is validated to be the last value
+      size_t blobLength = 0;
+      b.ReadBlob(r.blob, blobLength);
+      r.blobLength = uint32_t(blobLength);
 
-  blockStack.pop_back();
+      break;
+    }
+    else
+    {
+      r.ops.push_back(decodeAbbrevParam(param));
+    }
+  }
+
+  if(failed())
+    return false;
+
+  return setRecordRange(r, startBit);
+}
+
+bool BitcodeReader::setRecordRange(BlockOrRecord &r, size_t startBit)
+{
+  // ranges are kept to 32 bits, which only a blob of over 512MB could need more than
+  const size_t bits = bitOffset() - startBit;
+  if(bits > 0xffffffffU)
+  {
+    fail(DecodeError::RecordOutOfBounds);
+    return false;
+  }
+
+  r.bitOffset = startBit;
+  r.bitLength = uint32_t(bits);
+  return true;
 }
 
 uint64_t BitcodeReader::decodeAbbrevParam(const AbbrevParam &param)
@@ -248,30 +646,231 @@ uint64_t BitcodeReader::decodeAbbrevParam(const AbbrevParam &param)
 
 size_t BitcodeReader::abbrevSize() const
 {
-  if(blockStack.empty())
+  if(blockDepth == 0)
     return 2;
-  return blockStack.back().abbrevSize;
+  return blockStack[blockDepth - 1].abbrevSize;
 }
 
-const AbbrevDesc &BitcodeReader::getAbbrev(uint32_t blockId, uint32_t abbrevID)
+const AbbrevDesc *BitcodeReader::getAbbrev(uint32_t abbrevID) const
 {
-  const BlockInfo &info = blockInfo[blockId];
-
   // IDs start at the first application specified ID. Rebase to that to get 0-base indices
   assert(abbrevID >= APPLICATION_ABBREV);
   abbrevID -= APPLICATION_ABBREV;
 
-  // IDs are first assigned to those permanently from BLOCKINFO
-  if(abbrevID < info.abbrevs.size())
-    return info.abbrevs[abbrevID];
+  // the BLOCKINFO and local abbrevs were merged on block entry, so this is a single lookup
+  const std::vector<const AbbrevDesc *> &abbrevs = blockStack[blockDepth - 1].abbrevs;
+
+  if(abbrevID >= abbrevs.size())
+    return NULL;
+
+  return abbrevs[abbrevID];
+}
+
+bool StreamingBitcodeReader::Push(const void *data, size_t length)
+{
+  TRACE_SCOPE("StreamingBitcodeReader::Push");
+
+  if(GetStatus().Failed() || length > m_Length - m_Pushed)
+    return false;
+
+  // drop what's been decoded past, keeping the buffer's start dword aligned
+  const size_t consumed = (m_Position / 32) * 4 - m_BufferStart;
+  if(consumed > 0)
+  {
+    m_Buffer.erase(m_Buffer.begin(), m_Buffer.begin() + consumed);
+    m_BufferStart += consumed;
+  }
+
+  m_Buffer.insert(m_Buffer.end(), (const byte *)data, (const byte *)data + length);
+  m_Pushed += length;
+
+  BitcodeReader &r = m_Reader;
+  r.b = BitReader(m_Buffer.data(), m_Buffer.size());
+  r.baseBit = m_BufferStart * 8;
+  r.pendingBits = (m_Length - m_Pushed) * 8;
+
+  // an entry spread over many pushes would be decoded again on each one, so it waits until there
+  // could be enough data to get twice as far as last time
+  if(r.pendingBits > 0 && m_Pushed * 8 < m_RetryBits)
+    return true;
+
+  while(!m_Complete)
+  {
+    const size_t startBit = m_Position;
+    r.b.Seek(startBit - r.baseBit);
+
+    if(decodeEntry())
+    {
+      m_Position = r.bitOffset();
+      continue;
+    }
+
+    // an error in the bitcode, or in running out of data when there's no more to come
+    if(r.status.Failed() || r.pendingBits == 0)
+      return false;
+
+    // otherwise the entry is read again from its start once there's more
+    const size_t failedBit = r.baseBit + r.b.FailedBitOffset();
+    m_RetryBits = std::max(failedBit + 1, startBit + 2 * (failedBit - startBit));
+    r.b.Seek(startBit - r.baseBit);
+    break;
+  }
+
+  return true;
+}
+
+bool StreamingBitcodeReader::decodeEntry()
+{
+  BitcodeReader &r = m_Reader;
+  const size_t startBit = r.bitOffset();
+
+  if(!m_ReadMagic)
+  {
+    uint32_t magic = r.b.Read<uint32_t>();
+    if(r.failed())
+      return false;
+
+    if(magic != MAKE_FOURCC('B', 'C', 0xC0, 0xDE))
+    {
+      r.fail(DecodeError::InvalidMagic);
+      return false;
+    }
+
+    m_ReadMagic = true;
+    return true;
+  }
+
+  uint32_t abbrevID = r.b.fixed<uint32_t>(r.abbrevSize());
+  if(r.failed())
+    return false;
+
+  // should hit ENTER_SUBBLOCK first for top-level block
+  if(m_Open.empty())
+  {
+    if(abbrevID != ENTER_SUBBLOCK)
+    {
+      r.fail(DecodeError::InvalidAbbrevID);
+      return false;
+    }
+
+    return enterBlock(startBit, ~0U, BlockAction::Descend);
+  }
+
+  OpenBlock &open = m_Open.back();
+
+  if(abbrevID == END_BLOCK)
+  {
+    r.b.align32bits();
+    if(r.failed())
+      return false;
+
+    r.popBlock();
+    endBlock();
+    return true;
+  }
+
+  if(abbrevID == ENTER_SUBBLOCK)
+    return enterBlock(startBit, open.block.id, open.action);
+
+  if(abbrevID == DEFINE_ABBREV)
+    return r.readAbbrevDefinition(open.block.id, open.curBlockInfo);
+
+  BlockOrRecord record;
+  if(!r.readRecord(abbrevID, open.block.id, startBit, open.curBlockInfo, record))
+    return false;
+
+  if(open.action != BlockAction::Decode ||
+     (r.filter && !r.filter->KeepRecord(open.block.id, record.id)))
+    return true;
+
+  // the blob points into the buffer, which won't be kept. Only blobs in the tree are copied
+  if(record.blob)
+  {
+    m_Blobs.emplace_back((const char *)record.blob, record.blobLength);
+    record.blob = (const byte *)m_Blobs.back().data();
+  }
+
+  open.block.children.push_back(std::move(record));
+
+  if(m_Listener)
+    m_Listener->RecordDecoded(open.block, open.block.children.back());
+
+  return true;
+}
+
+bool StreamingBitcodeReader::enterBlock(size_t startBit, uint32_t parentID,
+                                        BlockAction parentAction)
+{
+  BitcodeReader &r = m_Reader;
+
+  // the block is read in place, and taken off again if it isn't entered
+  m_Open.push_back(OpenBlock());
+  OpenBlock &open = m_Open.back();
+  open.block.bitOffset = startBit;
+  open.curBlockInfo = SIZE_MAX;
+
+  size_t newAbbrevSize = 0;
+  if(!r.readBlockHeader(open.block, newAbbrevSize))
+  {
+    m_Open.pop_back();
+    return false;
+  }
+
+  if(m_FilteredBit != startBit)
+  {
+    m_FilteredBit = startBit;
+    m_FilteredAction = r.filter ? r.filter->EnterBlock(open.block.id, parentID, parentAction)
+                                : BlockAction::Decode;
+  }
+
+  open.action = m_FilteredAction;
+
+  // BLOCKINFO is block 0, and is read regardless. Skipping waits until all of the block is here
+  if(open.action == BlockAction::Skip && open.block.id != 0)
+  {
+    r.b.SkipDwords(open.block.blockDwordLength);
+
+    const bool ok = !r.failed();
+
+    // a skipped top-level block is still the result, just with nothing in it
+    if(ok && m_Open.size() == 1)
+    {
+      m_Root = std::move(open.block);
+      m_Complete = true;
+    }
+
+    m_Open.pop_back();
+    return ok;
+  }
+
+  r.pushBlock(open.block.id, newAbbrevSize);
+  return true;
+}
+
+void StreamingBitcodeReader::endBlock()
+{
+  OpenBlock done = std::move(m_Open.back());
+  m_Open.pop_back();
+
+  if(m_Open.empty())
+  {
+    m_Root = std::move(done.block);
+    m_Complete = true;
+
+    if(m_Listener)
+      m_Listener->BlockDecoded(m_Root);
+    return;
+  }
 
-  // block-local IDs start after the BLOCKINFO ones
-  abbrevID -= (uint32_t)info.abbrevs.size();
+  // BLOCKINFO is decoded even when it's skipped, but left out of the tree
+  if(done.action == BlockAction::Skip)
+    return;
 
-  assert(!blockStack.empty());
-  assert(abbrevID < blockStack.back().abbrevs.size());
+  BlockOrRecord &parent = m_Open.back().block;
+  parent.children.push_back(std::move(done.block));
 
-  return blockStack.back().abbrevs[abbrevID];
+  if(m_Listener)
+    m_Listener->BlockDecoded(parent.children.back());
 }
 
 };    // namespace LLVMBC
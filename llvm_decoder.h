@@ -24,12 +24,55 @@
 
 #pragma once
 
+#include <deque>
 #include <map>
+#include <string>
 #include <vector>
 #include "llvm_bitreader.h"
+#include "llvm_oplist.h"
 
 namespace LLVMBC
 {
+enum class DecodeError : uint32_t
+{
+  None = 0,
+  // the data around the bitcode (e.g. the DXIL program header) is invalid
+  InvalidContainer,
+  InvalidMagic,
+  // read past the end of the data, or a malformed VBR
+  InvalidBitstream,
+  BlockOutOfBounds,
+  BlockNestingTooDeep,
+  InvalidAbbrevWidth,
+  InvalidAbbrevID,
+  InvalidAbbrevDefinition,
+  InvalidBlockInfo,
+  RecordOutOfBounds,
+  // the top-level block isn't a single MODULE_BLOCK
+  InvalidModule,
+};
+
+const char *DecodeErrorString(DecodeError err);
+
+struct DecodeStatus
+{
+  DecodeError error = DecodeError::None;
+  // the bit offset in the bitcode where the error was detected
+  size_t bitOffset = 0;
+
+  bool Failed() const { return error != DecodeError::None; }
+};
+
+// the abbrev IDs every block has, before any it defines
+enum AbbrevId
+{
+  END_BLOCK = 0,
+  ENTER_SUBBLOCK = 1,
+  DEFINE_ABBREV = 2,
+  UNABBREV_RECORD = 3,
+  APPLICATION_ABBREV = 4,
+};
+
 struct BlockOrRecord
 {
   uint32_t id;
@@ -41,11 +84,17 @@ struct BlockOrRecord
   std::vector<BlockOrRecord> children;
 
   // if a record, the ops
-  std::vector<uint64_t> ops;
+  OpList ops;
   // if this is an abbreviated record with a blob, this is the last operand
   // this points into the overall byte storage, so the lifetime is limited.
   const byte *blob = NULL;
-  size_t blobLength = 0;
+  uint32_t blobLength = 0;
+
+  // where this was decoded from, in bits from the start of the bitcode, starting at its abbrev ID.
+  // A record's length covers all of it, a block's only its header, up to where its contents start.
+  // Both are 0 for entries that weren't decoded, e.g. ones made to be written
+  uint32_t bitLength = 0;
+  uint64_t bitOffset = 0;
 };
 
 enum class AbbrevEncoding : uint8_t
@@ -74,9 +123,12 @@ struct AbbrevDesc
 // the temporary context while pushing/popping blocks
 struct BlockContext
 {
-  BlockContext(size_t size) : abbrevSize(size) {}
-  size_t abbrevSize;
-  std::vector<AbbrevDesc> abbrevs;
+  size_t abbrevSize = 0;
+  // every abbrev usable in this block indexed by (abbrevID - APPLICATION_ABBREV). The ones from
+  // BLOCKINFO come first, then any defined locally in the block.
+  std::vector<const AbbrevDesc *> abbrevs;
+  // the size of the reader's local abbrev storage when this block was entered, to pop back to
+  size_t localAbbrevBase = 0;
 };
 
 // the permanent block info defined by BLOCKINFO
@@ -84,9 +136,64 @@ struct BlockInfo
 {
   // std::string blockname;
   // std::vector<std::string> recordnames;
-  std::vector<AbbrevDesc> abbrevs;
+  std::vector<const AbbrevDesc *> abbrevs;
+};
+
+struct RecordStats
+{
+  uint64_t count = 0;
+  uint64_t abbreviated = 0;
+  uint64_t numOps = 0;
+  uint64_t bits = 0;
+};
+
+struct BlockStats
+{
+  uint64_t count = 0;
+  // including the header, but not any sub-blocks
+  uint64_t bits = 0;
+  // indexed by record code
+  std::map<uint32_t, RecordStats> records;
+  // indexed by abbrev ID, including the builtin ones
+  std::vector<uint64_t> abbrevUses;
+};
+
+// where the bits go in one or more modules, like llvm-bcanalyzer -stats
+struct BitcodeStats
+{
+  uint64_t numModules = 0;
+  uint64_t totalBits = 0;
+  // indexed by block ID
+  std::map<uint32_t, BlockStats> blocks;
+
+  void Merge(const BitcodeStats &o);
 };
 
+enum class BlockAction
+{
+  // decode the block and everything in it
+  Decode,
+  // decode the block's own records only to step over them, and filter its sub-blocks
+  Descend,
+  // jump over the block using its length, without looking inside
+  Skip,
+};
+
+// chooses which parts of the bitcode end up in the decoded tree. Skipped blocks and records that
+// aren't kept are left out of the tree entirely.
+class DecodeFilter
+{
+public:
+  virtual ~DecodeFilter() {}
+  // called when each block is entered. For the top-level block parentID is ~0U and the parent
+  // action is Descend
+  virtual BlockAction EnterBlock(uint32_t blockID, uint32_t parentID, BlockAction parentAction) = 0;
+  // called for each record in a block that is being decoded
+  virtual bool KeepRecord(uint32_t blockID, uint32_t recordID) = 0;
+};
+
+class StreamingBitcodeReader;
+
 class BitcodeReader
 {
 public:
@@ -94,16 +201,163 @@ public:
   BlockOrRecord ReadToplevelBlock();
   bool AtEndOfStream();
 
+  // if set, statistics are accumulated here while decoding. If decoding fails they will be partial
+  void SetStats(BitcodeStats *s) { stats = s; }
+
+  // if set, only what the filter keeps is decoded. BLOCKINFO is always read since later blocks need
+  // its abbrevs, even if it's then left out of the tree. Statistics count a skipped block's bits
+  // against the block as a whole.
+  void SetFilter(DecodeFilter *f) { filter = f; }
+
+  // all input is treated as untrusted. On any error decoding stops and the partial results should
+  // be discarded.
+  DecodeStatus GetStatus() const;
+
 private:
+  friend class StreamingBitcodeReader;
+
+  // for StreamingBitcodeReader, which reads the magic itself once it has arrived
+  BitcodeReader() : b(NULL, 0) {}
+
   BitReader b;
+  DecodeStatus status;
+
+  // when streaming, b only covers what's buffered of the bitcode. This is where that starts, and
+  // how much of the bitcode is still to come. Offsets and bounds checks are always of the whole
+  size_t baseBit = 0;
+  size_t pendingBits = 0;
+  size_t bitOffset() { return baseBit + b.BitOffset(); }
+  size_t remainingBits() { return b.RemainingBits() + pendingBits; }
+
+  bool failed() const { return status.Failed() || b.Failed(); }
+  void fail(DecodeError err);
+
+  BlockAction ReadBlockContents(BlockOrRecord &block, uint32_t parentID, BlockAction parentAction);
+
+  // the pieces of a block that both readers share. Reading an entry only changes any state once
+  // all of it has been read, so one cut short by the end of the data can be read again
+  bool readBlockHeader(BlockOrRecord &block, size_t &newAbbrevSize);
+  void pushBlock(uint32_t blockID, size_t newAbbrevSize);
+  void popBlock();
+  bool readAbbrevDefinition(uint32_t blockID, size_t curBlockInfo);
+  bool readRecord(uint32_t abbrevID, uint32_t blockID, size_t startBit, size_t &curBlockInfo,
+                  BlockOrRecord &r);
 
-  void ReadBlockContents(BlockOrRecord &block);
-  const AbbrevDesc &getAbbrev(uint32_t blockId, uint32_t abbrevID);
+  const AbbrevDesc *getAbbrev(uint32_t abbrevID) const;
   size_t abbrevSize() const;
   uint64_t decodeAbbrevParam(const AbbrevParam &param);
+  bool setRecordRange(BlockOrRecord &r, size_t startBit);
 
+  DecodeFilter *filter = NULL;
+
+  BitcodeStats *stats = NULL;
+  void countBlock(uint32_t id, size_t bits);
+  void countEntry(BlockStats &blockStats, uint32_t abbrevID, uint32_t id, size_t numOps,
+                  size_t startBit);
+
+  // contexts are never popped off the stack, only the depth changes, so that each level keeps its
+  // allocations for the next block entered at that depth.
   std::vector<BlockContext> blockStack;
-  std::map<uint32_t, BlockInfo> blockInfo;
+  size_t blockDepth = 0;
+
+  // indexed directly by block ID
+  std::vector<BlockInfo> blockInfo;
+
+  // the abbrevs themselves are stored here, so that pointers to them stay valid. Local abbrevs are
+  // pushed and popped along with blocks.
+  std::deque<AbbrevDesc> blockInfoAbbrevs;
+  std::deque<AbbrevDesc> localAbbrevs;
+
+  // reused between records for bulk decoding values before they're narrowed into the ops
+  std::vector<uint64_t> opScratch;
+};
+
+// told about each entry as soon as a StreamingBitcodeReader has decoded it, so work on it can start
+// before the rest of the bitcode arrives. Only entries that end up in the tree are passed on, and
+// the references are only valid during the call.
+class DecodeListener
+{
+public:
+  virtual ~DecodeListener() {}
+  // a record just added to the end of its block, which is still being decoded
+  virtual void RecordDecoded(const BlockOrRecord &block, const BlockOrRecord &record) = 0;
+  // a block that has been decoded along with everything in it, the top-level block last
+  virtual void BlockDecoded(const BlockOrRecord &block) = 0;
+};
+
+// decodes bitcode as it arrives in pieces, instead of needing all of it up front. Each push decodes
+// everything the data completes, and the data can end anywhere - part-way through a VBR or a blob
+// included - leaving the entry it ends in to be decoded by a later push. The tree built and any
+// error are the same as from BitcodeReader::ReadToplevelBlock, though errors that look like the
+// data running out aren't reported until all of it has.
+//
+// pushed data is copied, and dropped once decoding has moved past it. Blobs of records kept in the
+// tree are copied out of it and live as long as the reader. Statistics aren't gathered.
+class StreamingBitcodeReader
+{
+public:
+  // the total length must be known up front, e.g. from the program header, so that lengths in the
+  // bitcode are bounds checked exactly as they would be with all of it
+  explicit StreamingBitcodeReader(size_t length) : m_Length(length) {}
+
+  // see BitcodeReader::SetFilter
+  void SetFilter(DecodeFilter *f) { m_Reader.SetFilter(f); }
+  void SetListener(DecodeListener *l) { m_Listener = l; }
+
+  // returns false once decoding has failed, or if the data goes past the length given, in which
+  // case none of it is pushed
+  bool Push(const void *data, size_t length);
+
+  size_t GetBytesPushed() const { return m_Pushed; }
+
+  // true once the top-level block has been decoded. Anything after it is left unread, as with
+  // BitcodeReader::AtEndOfStream
+  bool IsComplete() const { return m_Complete; }
+  bool AtEndOfStream() const { return m_Complete && m_Position == m_Length * 8; }
+  BlockOrRecord &GetToplevelBlock() { return m_Root; }
+
+  DecodeStatus GetStatus() const { return m_Reader.GetStatus(); }
+
+private:
+  struct OpenBlock
+  {
+    BlockOrRecord block;
+    BlockAction action;
+    // used for blockinfo only, as in BitcodeReader::ReadBlockContents
+    size_t curBlockInfo;
+  };
+
+  bool decodeEntry();
+  bool enterBlock(size_t startBit, uint32_t parentID, BlockAction parentAction);
+  void endBlock();
+
+  BitcodeReader m_Reader;
+  DecodeListener *m_Listener = NULL;
+
+  size_t m_Length;
+  size_t m_Pushed = 0;
+
+  // what's been pushed but not yet decoded past, from m_BufferStart bytes into the bitcode. That's
+  // always dword aligned, so alignment within the buffer is the same as within the bitcode
+  std::vector<byte> m_Buffer;
+  size_t m_BufferStart = 0;
+
+  // where the next entry starts, in bits
+  size_t m_Position = 0;
+  // the last entry tried ran out of data, so isn't tried again until this many bits are pushed
+  size_t m_RetryBits = 0;
+
+  bool m_ReadMagic = false;
+  bool m_Complete = false;
+  std::vector<OpenBlock> m_Open;
+  BlockOrRecord m_Root;
+
+  // the filter's choice for the last block header read, so that it's only asked once even if the
+  // block can't be skipped until more data arrives
+  size_t m_FilteredBit = ~size_t(0);
+  BlockAction m_FilteredAction = BlockAction::Decode;
+
+  std::deque<std::string> m_Blobs;
 };
 
 };    // namespace LLVMBC
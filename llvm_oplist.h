@@ -0,0 +1,324 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <iterator>
+#include "common.h"
+
+namespace LLVMBC
+{
+// the operands of a record. Nearly all records have a handful of small operands, so values are
+// stored at the narrowest width (1, 2, 4 or 8 bytes) that fits all of them, widening as needed, and
+// short lists are stored inline with no allocation. Values always read back as uint64_t.
+class OpList
+{
+public:
+  // sizes are kept as 32-bit to keep the list small, so the total bytes at the widest width must fit
+  static const size_t MaxSize = 0xffffffffU / 8;
+
+  class const_iterator
+  {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef uint64_t value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const uint64_t *pointer;
+    typedef uint64_t reference;
+
+    const_iterator(const OpList *list, size_t idx) : m_List(list), m_Idx(idx) {}
+    uint64_t operator*() const { return (*m_List)[m_Idx]; }
+    const_iterator &operator++()
+    {
+      m_Idx++;
+      return *this;
+    }
+    const_iterator operator++(int)
+    {
+      const_iterator ret = *this;
+      m_Idx++;
+      return ret;
+    }
+    bool operator==(const const_iterator &o) const { return m_Idx == o.m_Idx; }
+    bool operator!=(const const_iterator &o) const { return m_Idx != o.m_Idx; }
+
+  private:
+    const OpList *m_List;
+    size_t m_Idx;
+  };
+
+  OpList() {}
+  ~OpList() { release(); }
+  OpList(const OpList &o) { copyFrom(o); }
+  OpList(OpList &&o) { moveFrom(o); }
+  OpList &operator=(const OpList &o)
+  {
+    if(this != &o)
+    {
+      m_Size = 0;
+      copyFrom(o);
+    }
+    return *this;
+  }
+  OpList &operator=(OpList &&o)
+  {
+    if(this != &o)
+    {
+      release();
+      moveFrom(o);
+    }
+    return *this;
+  }
+
+  size_t size() const { return m_Size; }
+  bool empty() const { return m_Size == 0; }
+  uint64_t operator[](size_t i) const { return load(storage(), i, m_Width); }
+  uint64_t back() const { return (*this)[m_Size - 1]; }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, m_Size); }
+
+  // the bytes per value currently stored, and the raw storage at that width
+  size_t Width() const { return m_Width; }
+  const byte *Data() const { return storage(); }
+
+  void clear()
+  {
+    m_Size = 0;
+    m_Width = 1;
+  }
+
+  void reserve(size_t count) { grow(count * m_Width); }
+
+  // any new values are zero
+  void resize(size_t count)
+  {
+    if(count > m_Size)
+    {
+      grow(count * m_Width);
+      memset(storage() + m_Size * m_Width, 0, (count - m_Size) * m_Width);
+    }
+    m_Size = uint32_t(count);
+  }
+
+  void push_back(uint64_t val)
+  {
+    const uint8_t width = widthFor(val);
+    if(width > m_Width)
+      widen(width);
+
+    grow((m_Size + 1) * m_Width);
+    store(storage(), m_Size, m_Width, val);
+    m_Size++;
+  }
+
+  void Append(const uint64_t *vals, size_t count)
+  {
+    uint64_t all = 0;
+    for(size_t i = 0; i < count; i++)
+      all |= vals[i];
+
+    const uint8_t width = widthFor(all);
+    if(width > m_Width)
+      widen(width);
+
+    grow((m_Size + count) * m_Width);
+
+    byte *dst = storage();
+    switch(m_Width)
+    {
+      case 1:
+        for(size_t i = 0; i < count; i++)
+          store(dst, m_Size + i, 1, vals[i]);
+        break;
+      case 2:
+        for(size_t i = 0; i < count; i++)
+          store(dst, m_Size + i, 2, vals[i]);
+        break;
+      case 4:
+        for(size_t i = 0; i < count; i++)
+          store(dst, m_Size + i, 4, vals[i]);
+        break;
+      default: memcpy(dst + m_Size * 8, vals, count * 8); break;
+    }
+    m_Size += uint32_t(count);
+  }
+
+  // only valid while the width is 1 byte. Appends count values and returns the storage for the
+  // caller to fill in directly.
+  byte *AppendBytes(size_t count)
+  {
+    assert(m_Width == 1);
+    grow(m_Size + count);
+    byte *ret = storage() + m_Size;
+    m_Size += uint32_t(count);
+    return ret;
+  }
+
+private:
+  // enough for 16 byte-sized values or 4 dword-sized values, which covers the vast majority
+  static const size_t InlineBytes = 16;
+
+  union
+  {
+    byte m_Inline[InlineBytes];
+    byte *m_Heap;
+  };
+  uint32_t m_Size = 0;
+  // never more than InlineBytes while inline, always more once on the heap
+  uint32_t m_CapacityBytes = InlineBytes;
+  uint8_t m_Width = 1;
+
+  bool isInline() const { return m_CapacityBytes == InlineBytes; }
+  byte *storage() { return isInline() ? m_Inline : m_Heap; }
+  const byte *storage() const { return isInline() ? m_Inline : m_Heap; }
+
+  static uint8_t widthFor(uint64_t val)
+  {
+    if(val <= 0xff)
+      return 1;
+    if(val <= 0xffff)
+      return 2;
+    if(val <= 0xffffffff)
+      return 4;
+    return 8;
+  }
+
+  static uint64_t load(const byte *data, size_t i, size_t width)
+  {
+    switch(width)
+    {
+      case 1: return data[i];
+      case 2:
+      {
+        uint16_t ret;
+        memcpy(&ret, data + i * 2, sizeof(ret));
+        return ret;
+      }
+      case 4:
+      {
+        uint32_t ret;
+        memcpy(&ret, data + i * 4, sizeof(ret));
+        return ret;
+      }
+      default:
+      {
+        uint64_t ret;
+        memcpy(&ret, data + i * 8, sizeof(ret));
+        return ret;
+      }
+    }
+  }
+
+  static void store(byte *data, size_t i, size_t width, uint64_t val)
+  {
+    switch(width)
+    {
+      case 1: data[i] = byte(val); break;
+      case 2:
+      {
+        uint16_t v = uint16_t(val);
+        memcpy(data + i * 2, &v, sizeof(v));
+        break;
+      }
+      case 4:
+      {
+        uint32_t v = uint32_t(val);
+        memcpy(data + i * 4, &v, sizeof(v));
+        break;
+      }
+      default: memcpy(data + i * 8, &val, sizeof(val)); break;
+    }
+  }
+
+  void grow(size_t bytes)
+  {
+    if(bytes <= m_CapacityBytes)
+      return;
+
+    assert(bytes <= MaxSize * 8);
+
+    size_t newCapacity = size_t(m_CapacityBytes) * 2;
+    if(newCapacity < bytes)
+      newCapacity = bytes;
+    if(newCapacity > MaxSize * 8)
+      newCapacity = MaxSize * 8;
+
+    byte *mem = new byte[newCapacity];
+    memcpy(mem, storage(), m_Size * m_Width);
+
+    if(!isInline())
+      delete[] m_Heap;
+
+    m_Heap = mem;
+    m_CapacityBytes = uint32_t(newCapacity);
+  }
+
+  void widen(uint8_t width)
+  {
+    grow(m_Size * width);
+
+    // work from the back so that nothing is overwritten before it's been read
+    byte *data = storage();
+    for(size_t i = m_Size; i-- > 0;)
+      store(data, i, width, load(data, i, m_Width));
+
+    m_Width = width;
+  }
+
+  void release()
+  {
+    if(!isInline())
+      delete[] m_Heap;
+
+    m_CapacityBytes = InlineBytes;
+    m_Size = 0;
+    m_Width = 1;
+  }
+
+  // expects to be empty
+  void copyFrom(const OpList &o)
+  {
+    m_Width = o.m_Width;
+    grow(o.m_Size * o.m_Width);
+    memcpy(storage(), o.storage(), o.m_Size * o.m_Width);
+    m_Size = o.m_Size;
+  }
+
+  // expects to be empty and inline. Takes either the inline values or the heap pointer
+  void moveFrom(OpList &o)
+  {
+    memcpy(m_Inline, o.m_Inline, InlineBytes);
+    m_Size = o.m_Size;
+    m_CapacityBytes = o.m_CapacityBytes;
+    m_Width = o.m_Width;
+
+    o.m_CapacityBytes = InlineBytes;
+    o.m_Size = 0;
+    o.m_Width = 1;
+  }
+};
+
+};    // namespace LLVMBC
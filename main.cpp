@@ -22,113 +22,1155 @@
  * THE SOFTWARE.
  ******************************************************************************/
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 #include "common.h"
+#include "dxbc_container.h"
+#include "dxbc_pack.h"
+#include "dxil_bitcode.h"
+#include "dxil_cfg.h"
 #include "dxil_inspect.h"
+#include "dxil_lines.h"
+#include "dxil_liveness.h"
+#include "dxil_module.h"
+#include "dxil_output.h"
+#include "dxil_reflect.h"
+#include "dxil_server.h"
+#include "dxil_source.h"
+#include "mapped_file.h"
+#include "prefetch_reader.h"
+#include "thread_pool.h"
+#include "trace.h"
 
-struct DXBCFileHeader
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+
+struct Options
 {
-  uint32_t fourcc;          // "DXBC"
-  uint8_t hashValue[16];    // unknown hash function and data
-  uint16_t majorVersion;
-  uint16_t minorVersion;
-  uint32_t fileLength;
-  uint32_t numChunks;
-  // uint32 chunkOffsets[numChunks]; follows
+  bool reflectOnly = false;
+  bool stream = false;
+  DXIL::DumpFormat format = DXIL::DumpFormat::Text;
+  // if set programs aren't dumped, only their statistics are gathered here
+  LLVMBC::BitcodeStats *stats = NULL;
+  // if set only part of each program is decoded
+  const DXIL::ProgramFilter *filter = NULL;
+  // for formats that can work on several functions at once
+  DXIL::ThreadPool *pool = NULL;
+  // if set the line table is printed instead of a dump, or if lineFile is set only the
+  // instructions on that line
+  bool lines = false;
+  const char *lineFile = NULL;
+  uint32_t line = 0;
+  // if set each function's control flow, or its peak liveness, is printed instead of a dump
+  bool cfg = false;
+  bool pressure = false;
+  // set when the output for several files follows one another, so each starts with its name
+  bool fileHeaders = false;
+  // if set the embedded source files are written under this directory instead of a dump
+  const char *sourceDir = NULL;
+  // if set only the container with this name is processed from packs
+  const char *entry = NULL;
 };
 
-struct DXBCChunkHeader
+static bool ParseNumber(const char *str, uint32_t &value)
+{
+  char *end = NULL;
+  errno = 0;
+  unsigned long ret = strtoul(str, &end, 0);
+  if(end == str || *end != 0 || errno != 0 || ret >= ~0U)
+    return false;
+
+  value = (uint32_t)ret;
+  return true;
+}
+
+// FILE:LINE, splitting on the last colon so Windows paths with drive letters still work
+static bool ParseFileLine(char *str, const char *&file, uint32_t &line)
+{
+  char *colon = strrchr(str, ':');
+  if(!colon || colon == str || !ParseNumber(colon + 1, line))
+    return false;
+
+  *colon = 0;
+  file = str;
+  return true;
+}
+
+// exactly four characters, e.g. ILDB
+static bool ParseFourCC(const char *str, uint32_t &fourcc)
+{
+  if(strlen(str) != 4)
+    return false;
+
+  fourcc = MAKE_FOURCC(str[0], str[1], str[2], str[3]);
+  return true;
+}
+
+// blocks can be given by ID, or by the name they're dumped with
+static bool ParseBlockID(const char *str, uint32_t &id)
+{
+  if(ParseNumber(str, id))
+    return true;
+
+  for(uint32_t i = 0; i < 64; i++)
+  {
+    const char *name = DXIL::BlockName(i);
+    if(name && !strcmp(name, str))
+    {
+      id = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// names from the metadata are made relative to the output directory, dropping any drive, root
+// and . or .. components, so nothing can be written outside it
+static std::string SourceOutputPath(const char *dir, const DXIL::SourceString &name)
+{
+  std::string path = dir;
+  std::string component;
+
+  size_t i = 0;
+  if(name.length >= 2 && name.data[1] == ':')
+    i = 2;
+
+  for(; i <= name.length; i++)
+  {
+    const char c = i < name.length ? name.data[i] : '/';
+    if(c == '/' || c == '\\')
+    {
+      if(!component.empty() && component != "." && component != "..")
+        path += "/" + component;
+      component.clear();
+    }
+    else
+    {
+      component += c ? c : '_';
+    }
+  }
+
+  return path;
+}
+
+// creates every directory leading up to the file, ignoring any that already exist
+static void MakeParentDirectories(const std::string &path)
+{
+  for(size_t i = 1; i < path.size(); i++)
+  {
+    if(path[i] != '/')
+      continue;
+
+    const std::string parent = path.substr(0, i);
+#if defined(_WIN32)
+    _mkdir(parent.c_str());
+#else
+    mkdir(parent.c_str(), 0755);
+#endif
+  }
+}
+
+static int WriteSource(const DXIL::EmbeddedSource &source, const char *dir)
+{
+  for(const DXIL::SourceFileContents &file : source.files)
+  {
+    const std::string path = SourceOutputPath(dir, file.name);
+    if(path.size() == strlen(dir))
+    {
+      fprintf(stderr, "Skipping embedded source file with no usable name\n");
+      continue;
+    }
+
+    MakeParentDirectories(path);
+
+    // written straight from where the metadata was decoded
+    FILE *f = fopen(path.c_str(), "wb");
+    if(f == NULL || fwrite(file.contents.data, 1, file.contents.length, f) != file.contents.length)
+    {
+      fprintf(stderr, "Couldn't write source file %s: %i\n", path.c_str(), errno);
+      if(f)
+        fclose(f);
+      return 2;
+    }
+
+    fclose(f);
+  }
+
+  return 0;
+}
+
+static int ProcessContainer(const byte *data, size_t size, const Options &opts)
+{
+  DXBC::Container container(data, size);
+
+  if(!container.IsValid())
+  {
+    fprintf(stderr, "Invalid DXBC file\n");
+    return 3;
+  }
+
+  if(!container.FindBestDXILChunk())
+  {
+    fprintf(stderr, "Couldn't find DXIL chunk\n");
+    return 4;
+  }
+
+  DXIL::FileOutput out(stdout);
+
+  if(opts.reflectOnly)
+  {
+    DXIL::Reflection refl;
+    if(!DXIL::Reflect(data, size, refl))
+    {
+      fprintf(stderr, "Couldn't find DXIL chunk\n");
+      return 4;
+    }
+
+    DXIL::PrintReflection(refl, out);
+    return 0;
+  }
+
+  LLVMBC::BitcodeStats programStats;
+  DXIL::Program dxil(container, opts.stats ? &programStats : NULL, opts.filter);
+
+  LLVMBC::DecodeStatus status = dxil.GetStatus();
+  if(status.Failed())
+  {
+    fprintf(stderr, "Couldn't decode DXIL: %s at bit %llu\n",
+            LLVMBC::DecodeErrorString(status.error), (unsigned long long)status.bitOffset);
+    return 5;
+  }
+
+  // only programs that decoded successfully are counted
+  if(opts.stats)
+  {
+    opts.stats->Merge(programStats);
+    return 0;
+  }
+
+  if(opts.sourceDir)
+  {
+    DXIL::EmbeddedSource source;
+    if(!DXIL::ExtractSource(dxil, source))
+    {
+      fprintf(stderr, "No embedded source found\n");
+      return 7;
+    }
+
+    DXIL::PrintSourceSummary(source, out);
+    return WriteSource(source, opts.sourceDir);
+  }
+
+  if(opts.lines)
+  {
+    DXIL::LineTable lines(dxil);
+
+    if(!opts.lineFile)
+    {
+      DXIL::PrintLineTable(lines, out);
+      return 0;
+    }
+
+    std::vector<DXIL::InstructionRange> instructions;
+    lines.FindInstructions(opts.lineFile, opts.line, instructions);
+    for(const DXIL::InstructionRange &range : instructions)
+      out.Printf("function %u: [%u, %u)\n", range.function, range.first, range.end);
+    return 0;
+  }
+
+  if(opts.cfg || opts.pressure)
+  {
+    DXIL::Module module(dxil, opts.pool);
+    if(module.GetError())
+    {
+      fprintf(stderr, "Couldn't read module: %s\n", module.GetError());
+      return 6;
+    }
+
+    if(opts.cfg)
+      DXIL::PrintControlFlow(module, out, opts.pool);
+    else
+      DXIL::PrintRegisterPressure(module, out, opts.pool);
+    return 0;
+  }
+
+  if(!dxil.Dump(out, opts.format, opts.pool))
+  {
+    fprintf(stderr, "Couldn't dump DXIL in the requested format\n");
+    return 6;
+  }
+
+  return 0;
+}
+
+// reads the next container from a stream of back-to-back containers, framed by the fileLength in
+// each header. The buffer is re-used between calls so it only ever grows to the largest container.
+// Returns false at a clean end of stream, or on error with an error code in ret.
+static bool ReadStreamedContainer(FILE *f, std::vector<byte> &buffer, int &ret)
+{
+  TRACE_SCOPE("Read streamed container");
+
+  ret = 0;
+
+  DXBCFileHeader header;
+  size_t numRead = fread(&header, 1, sizeof(header), f);
+
+  // nothing more in the stream
+  if(numRead == 0 && feof(f))
+    return false;
+
+  if(numRead != sizeof(header) || header.fourcc != MAKE_FOURCC('D', 'X', 'B', 'C') ||
+     header.fileLength < sizeof(header))
+  {
+    fprintf(stderr, "Invalid DXBC container in stream\n");
+    ret = 3;
+    return false;
+  }
+
+  if(buffer.size() < sizeof(header))
+    buffer.resize(sizeof(header));
+
+  memcpy(buffer.data(), &header, sizeof(header));
+
+  // the length isn't trusted, so the buffer only grows as data actually arrives. At most it's
+  // twice what was read, rather than whatever a bogus header claims
+  size_t have = sizeof(header);
+  while(have < header.fileLength)
+  {
+    const size_t want = std::min<size_t>(header.fileLength, std::max<size_t>(have * 2, 64 * 1024));
+    if(buffer.size() < want)
+      buffer.resize(want);
+
+    const size_t toRead = want - have;
+    numRead = fread(buffer.data() + have, 1, toRead, f);
+    have += numRead;
+
+    if(numRead != toRead)
+      break;
+  }
+
+  if(have != header.fileLength)
+  {
+    fprintf(stderr, "Truncated DXBC container in stream\n");
+    ret = 2;
+    return false;
+  }
+
+  return true;
+}
+
+static int ProcessStream(FILE *f, const Options &opts)
+{
+  std::vector<byte> buffer;
+
+  int ret = 0;
+  uint32_t numContainers = 0;
+  while(ReadStreamedContainer(f, buffer, ret))
+  {
+    const DXBCFileHeader *header = (const DXBCFileHeader *)buffer.data();
+
+    // machine-readable formats are self-delimiting and mustn't have anything mixed in
+    if(!opts.stats &&
+       (opts.format == DXIL::DumpFormat::Text || opts.format == DXIL::DumpFormat::Disassembly))
+      printf("; container %u, %u bytes\n", numContainers, header->fileLength);
+
+    // process this one as soon as it's complete, before reading any more of the stream
+    int containerRet = ProcessContainer(buffer.data(), header->fileLength, opts);
+    if(containerRet != 0)
+      ret = containerRet;
+
+    numContainers++;
+
+    fflush(stdout);
+  }
+
+  return ret;
+}
+
+// containers are decoded straight out of the pack's bytes
+static int ProcessPackData(const char *filename, const byte *bytes, size_t length,
+                           const Options &opts)
+{
+  DXBC::PackReader pack(bytes, length);
+  if(!pack.IsValid())
+  {
+    fprintf(stderr, "Invalid pack file %s\n", filename);
+    return 3;
+  }
+
+  if(opts.entry)
+  {
+    const DXBCPackEntry *entry = pack.Find(opts.entry);
+    const byte *data = entry ? pack.GetData(*entry) : NULL;
+    if(!data)
+    {
+      fprintf(stderr, "No container named %s in %s\n", opts.entry, filename);
+      return 4;
+    }
+
+    return ProcessContainer(data, entry->length, opts);
+  }
+
+  int ret = 0;
+  pack.ForEach(0, pack.NumEntries(), [&](const char *name, const byte *data, size_t length) {
+    if(!opts.stats &&
+       (opts.format == DXIL::DumpFormat::Text || opts.format == DXIL::DumpFormat::Disassembly))
+      printf("; container %s, %u bytes\n", name, (uint32_t)length);
+
+    int containerRet = ProcessContainer(data, length, opts);
+    if(containerRet != 0)
+      ret = containerRet;
+
+    fflush(stdout);
+  });
+
+  return ret;
+}
+
+static int ProcessPack(const char *filename, const Options &opts)
 {
-  uint32_t fourcc;
-  uint32_t dataLength;
-  // byte data[dataLength]; follows
+  MappedFile file;
+  if(!file.Open(filename))
+  {
+    fprintf(stderr, "Couldn't map file %s: %i\n", filename, errno);
+    return 2;
+  }
+
+  return ProcessPackData(filename, file.Data(), file.Size(), opts);
+}
+
+static int BuildPack(const char *packFilename, const std::vector<const char *> &filenames)
+{
+  DXBC::PackWriter writer;
+  if(!writer.Open(packFilename))
+  {
+    fprintf(stderr, "Couldn't open pack file %s: %i\n", packFilename, errno);
+    return 2;
+  }
+
+  for(const char *filename : filenames)
+  {
+    MappedFile file;
+    if(!file.Open(filename))
+    {
+      fprintf(stderr, "Couldn't map file %s: %i\n", filename, errno);
+      return 2;
+    }
+
+    // containers are named by the path they were given as
+    if(!writer.Add(filename, file.Data(), file.Size()))
+    {
+      fprintf(stderr, "Couldn't add %s to the pack, it's invalid or a duplicate\n", filename);
+      return 3;
+    }
+  }
+
+  if(!writer.Finish())
+  {
+    fprintf(stderr, "Couldn't write pack file %s: %i\n", packFilename, errno);
+    return 2;
+  }
+
+  return 0;
+}
+
+static bool IsDirectory(const char *path)
+{
+  struct stat st;
+  return stat(path, &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+// every file under a directory and its subdirectories, as paths relative to it
+static bool ListFiles(const std::string &dir, const std::string &relative,
+                      std::vector<std::string> &files)
+{
+#if defined(_WIN32)
+  _finddata_t found;
+  intptr_t handle = _findfirst((dir + "/*").c_str(), &found);
+  if(handle == -1)
+    return false;
+
+  bool ok = true;
+  do
+  {
+    const std::string name = found.name;
+    if(name == "." || name == "..")
+      continue;
+
+    if(found.attrib & _A_SUBDIR)
+      ok = ListFiles(dir + "/" + name, relative + name + "/", files) && ok;
+    else
+      files.push_back(relative + name);
+  } while(_findnext(handle, &found) == 0);
+
+  _findclose(handle);
+  return ok;
+#else
+  DIR *d = opendir(dir.c_str());
+  if(d == NULL)
+    return false;
+
+  bool ok = true;
+  while(const dirent *entry = readdir(d))
+  {
+    const std::string name = entry->d_name;
+    if(name == "." || name == "..")
+      continue;
+
+    const std::string path = dir + "/" + name;
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0)
+      continue;
+
+    if(S_ISDIR(st.st_mode))
+      ok = ListFiles(path, relative + name + "/", files) && ok;
+    else if(S_ISREG(st.st_mode))
+      files.push_back(relative + name);
+  }
+
+  closedir(d);
+  return ok;
+#endif
+}
+
+// chunks to drop from or set in every container rewritten
+struct ChunkEdits
+{
+  std::vector<uint32_t> strip;
+  std::vector<std::pair<uint32_t, const char *>> set;
 };
 
-DXIL::DebugName *debug_name = NULL;
-DXIL::Features features;
+struct RewriteJob
+{
+  std::string input;
+  std::string output;
+  // filled in by the rewrite
+  int ret = 0;
+  std::string error;
+  uint64_t sizeIn = 0;
+  uint64_t sizeOut = 0;
+};
 
-int main(int argc, char **argv)
+static void RewriteContainer(RewriteJob &job, const ChunkEdits &edits,
+                             const std::vector<MappedFile> &setFiles)
 {
-  if(argc != 2)
+  std::vector<byte> rewritten;
+
   {
-    fprintf(stderr, "Usage: %s [file.dxbc]\n", argv[0]);
-    return 1;
+    MappedFile file;
+    if(!file.Open(job.input.c_str()))
+    {
+      job.ret = 2;
+      job.error = "Couldn't map file " + job.input + ": " + std::to_string(errno);
+      return;
+    }
+
+    DXBC::ContainerWriter writer(DXBC::Container(file.Data(), file.Size()));
+
+    for(uint32_t fourcc : edits.strip)
+      writer.Remove(fourcc);
+    for(size_t i = 0; i < edits.set.size(); i++)
+      writer.Set(edits.set[i].first, setFiles[i].Data(), setFiles[i].Size());
+
+    if(!writer.Write(rewritten))
+    {
+      job.ret = 3;
+      job.error = "Invalid DXBC file " + job.input;
+      return;
+    }
+
+    job.sizeIn = file.Size();
+    job.sizeOut = rewritten.size();
+
+    // the mapping is closed before writing, so a file can be rewritten in place
+  }
+
+  MakeParentDirectories(job.output);
+
+  FILE *f = fopen(job.output.c_str(), "wb");
+  if(f == NULL || fwrite(rewritten.data(), 1, rewritten.size(), f) != rewritten.size())
+  {
+    job.ret = 2;
+    job.error = "Couldn't write file " + job.output + ": " + std::to_string(errno);
+  }
+
+  if(f)
+    fclose(f);
+}
+
+// writes each container given with its chunks edited, under outDir. Files in directories that are
+// given keep their path relative to the directory, other files just their name. Every container
+// is rewritten on the pool if there is one, with any errors reported in order afterwards
+static int RewriteContainers(const std::vector<const char *> &filenames, const char *outDir,
+                             const ChunkEdits &edits, DXIL::ThreadPool *pool)
+{
+  // the chunks set are shared by every container
+  std::vector<MappedFile> setFiles(edits.set.size());
+  for(size_t i = 0; i < edits.set.size(); i++)
+  {
+    if(!setFiles[i].Open(edits.set[i].second))
+    {
+      fprintf(stderr, "Couldn't map file %s: %i\n", edits.set[i].second, errno);
+      return 2;
+    }
+  }
+
+  std::vector<RewriteJob> jobs;
+  for(const char *filename : filenames)
+  {
+    if(IsDirectory(filename))
+    {
+      std::vector<std::string> files;
+      if(!ListFiles(filename, std::string(), files))
+      {
+        fprintf(stderr, "Couldn't list directory %s: %i\n", filename, errno);
+        return 2;
+      }
+
+      for(const std::string &file : files)
+      {
+        jobs.push_back(RewriteJob());
+        jobs.back().input = std::string(filename) + "/" + file;
+        jobs.back().output = std::string(outDir) + "/" + file;
+      }
+    }
+    else
+    {
+      const char *name = filename;
+      for(const char *c = filename; *c; c++)
+        if(*c == '/' || *c == '\\')
+          name = c + 1;
+
+      jobs.push_back(RewriteJob());
+      jobs.back().input = filename;
+      jobs.back().output = std::string(outDir) + "/" + name;
+    }
+  }
+
+  auto rewrite = [&](size_t i) { RewriteContainer(jobs[i], edits, setFiles); };
+
+  if(pool)
+  {
+    pool->ParallelFor(jobs.size(), rewrite);
+  }
+  else
+  {
+    for(size_t i = 0; i < jobs.size(); i++)
+      rewrite(i);
+  }
+
+  int ret = 0;
+  uint32_t numRewritten = 0;
+  uint64_t sizeIn = 0, sizeOut = 0;
+  for(const RewriteJob &job : jobs)
+  {
+    if(job.ret != 0)
+    {
+      fprintf(stderr, "%s\n", job.error.c_str());
+      ret = job.ret;
+      continue;
+    }
+
+    numRewritten++;
+    sizeIn += job.sizeIn;
+    sizeOut += job.sizeOut;
+  }
+
+  fprintf(stderr, "Rewrote %u of %u containers, %llu bytes to %llu\n", numRewritten,
+          uint32_t(jobs.size()), (unsigned long long)sizeIn, (unsigned long long)sizeOut);
+
+  return ret;
+}
+
+static int ProcessFile(const char *filename, const Options &opts)
+{
+  // reading from stdin is always a stream, since we can't know the size up front
+  if(!strcmp(filename, "-"))
+  {
+#if defined(_WIN32)
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    return ProcessStream(stdin, opts);
   }
 
-  FILE *f = fopen(argv[1], "rb");
+  FILE *f = fopen(filename, "rb");
   if(f == NULL)
   {
-    fprintf(stderr, "Couldn't open file %s: %i\n", argv[1], errno);
+    fprintf(stderr, "Couldn't open file %s: %i\n", filename, errno);
     return 2;
   }
 
-  fseek(f, 0, SEEK_END);
-  long size = ftell(f);
-  fseek(f, 0, SEEK_SET);
+  if(opts.stream)
+  {
+    int ret = ProcessStream(f, opts);
+
+    fclose(f);
+
+    return ret;
+  }
+
+  // packs are mapped rather than read, so only the containers used are ever paged in
+  uint32_t fourcc = 0;
+  if(fread(&fourcc, 1, sizeof(fourcc), f) == sizeof(fourcc) &&
+     fourcc == MAKE_FOURCC('D', 'X', 'P', 'K'))
+  {
+    fclose(f);
+    return ProcessPack(filename, opts);
+  }
 
   std::vector<byte> buffer;
-  buffer.resize((size_t)size);
+  size_t numRead = 0;
+
+  {
+    TRACE_SCOPE("Read file");
 
-  size_t numRead = fread(&buffer[0], 1, buffer.size(), f);
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
 
-  fclose(f);
+    buffer.resize((size_t)size);
+
+    numRead = fread(&buffer[0], 1, buffer.size(), f);
+
+    fclose(f);
+  }
 
   if(numRead != buffer.size())
   {
-    fprintf(stderr, "Couldn't fully read file %s: %i\n", argv[1], errno);
+    fprintf(stderr, "Couldn't fully read file %s: %i\n", filename, errno);
     return 2;
   }
 
-  const byte *ptr = buffer.data();
-  const DXBCFileHeader *header = (const DXBCFileHeader *)ptr;
+  if(opts.fileHeaders)
+    printf("; file %s\n", filename);
 
-  if(buffer.size() < sizeof(*header) || header->fileLength != buffer.size() ||
-     header->fourcc != MAKE_FOURCC('D', 'X', 'B', 'C'))
+  return ProcessContainer(buffer.data(), buffer.size(), opts);
+}
+
+// packs are recognised by name when reading ahead, since checking their magic would mean a
+// blocking read of every file before any were queued
+static bool IsPackFilename(const char *filename)
+{
+  const size_t length = strlen(filename);
+  return length >= 5 && !strcmp(filename + length - 5, ".pack");
+}
+
+// reads the files ahead of processing them, so waiting on storage overlaps with decoding. Output
+// is in the order the files were given. Only statistics, which are merged into one total, take
+// files in whatever order their reads finish. Packs are mapped where they come instead, as they
+// are on their own, so only loose containers are read ahead
+static int ProcessPrefetched(const std::vector<const char *> &filenames, uint32_t queueDepth,
+                             bool allowUring, const Options &opts)
+{
+  std::vector<const char *> looseFilenames;
+  for(const char *filename : filenames)
   {
-    fprintf(stderr, "Invalid DXBC file\n");
-    return 3;
+    if(!IsPackFilename(filename))
+      looseFilenames.push_back(filename);
   }
 
-  const uint32_t *offsets = (const uint32_t *)(header + 1);
+  PrefetchReader reader(looseFilenames, queueDepth, allowUring, opts.stats == NULL);
 
-  const DXBCChunkHeader *best_dxil_chunk = NULL;
+  int ret = 0;
+  for(const char *listed : filenames)
+  {
+    int fileRet = 0;
+    if(IsPackFilename(listed))
+    {
+      fileRet = ProcessPack(listed, opts);
+      if(fileRet != 0)
+        ret = fileRet;
+      continue;
+    }
 
-  DXIL::Program *dxil = NULL;
+    // in order this is the listed file, otherwise whichever finished first
+    PrefetchedFile file;
+    reader.Next(file);
+    const char *filename = looseFilenames[file.index];
 
-  for(uint32_t chunkIdx = 0; chunkIdx < header->numChunks; chunkIdx++)
-  {
-    const DXBCChunkHeader *chunk = (const DXBCChunkHeader *)(ptr + offsets[chunkIdx]);
+    if(file.error != 0)
+    {
+      fprintf(stderr, "Couldn't read file %s: %i\n", filename, file.error);
+      fileRet = 2;
+    }
+    else if(file.data.size() >= sizeof(uint32_t) &&
+            *(const uint32_t *)file.data.data() == MAKE_FOURCC('D', 'X', 'P', 'K'))
+    {
+      // a pack under another name has been read whole already, so it's used from memory
+      fileRet = ProcessPackData(filename, file.data.data(), file.data.size(), opts);
+    }
+    else
+    {
+      if(opts.fileHeaders)
+        printf("; file %s\n", filename);
+
+      fileRet = ProcessContainer(file.data.data(), file.data.size(), opts);
+    }
+
+    if(fileRet != 0)
+      ret = fileRet;
+  }
+
+  fprintf(stderr, "Read %llu bytes from %llu files with %s, waited %.1fms for input\n",
+          (unsigned long long)reader.GetBytesRead(), (unsigned long long)looseFilenames.size(),
+          reader.GetBackendName(), double(reader.GetStallMicroseconds()) / 1000.0);
+
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  Options opts;
+  DXIL::ProgramFilter filter;
+  bool statsMode = false;
+  const char *traceFilename = NULL;
+  const char *packFilename = NULL;
+  const char *socketPath = NULL;
+  const char *outDir = NULL;
+  ChunkEdits chunkEdits;
+  std::vector<const char *> filenames;
+  bool usage = false;
+  uint32_t numThreads = 0;
+  uint32_t queueDepth = 16;
+  bool allowUring = true;
 
-    if(chunk->fourcc == MAKE_FOURCC('D', 'X', 'I', 'L'))
+  for(int i = 1; i < argc; i++)
+  {
+    if(!strcmp(argv[i], "--reflect"))
+    {
+      opts.reflectOnly = true;
+    }
+    else if(!strcmp(argv[i], "--stream"))
+    {
+      opts.stream = true;
+    }
+    else if(!strcmp(argv[i], "--stats"))
+    {
+      statsMode = true;
+    }
+    else if(!strcmp(argv[i], "--trace") && i + 1 < argc)
+    {
+      traceFilename = argv[++i];
+    }
+    else if(!strcmp(argv[i], "--format") && i + 1 < argc)
+    {
+      i++;
+      if(!strcmp(argv[i], "text"))
+        opts.format = DXIL::DumpFormat::Text;
+      else if(!strcmp(argv[i], "json"))
+        opts.format = DXIL::DumpFormat::JSON;
+      else if(!strcmp(argv[i], "binary"))
+        opts.format = DXIL::DumpFormat::Binary;
+      else if(!strcmp(argv[i], "disasm"))
+        opts.format = DXIL::DumpFormat::Disassembly;
+      else
+        usage = true;
+    }
+    else if(!strcmp(argv[i], "--block") && i + 1 < argc)
+    {
+      uint32_t id = 0;
+      if(ParseBlockID(argv[++i], id))
+        filter.blocks.push_back(id);
+      else
+        usage = true;
+      opts.filter = &filter;
+    }
+    else if(!strcmp(argv[i], "--record") && i + 1 < argc)
+    {
+      uint32_t code = 0;
+      if(ParseNumber(argv[++i], code))
+        filter.records.push_back(code);
+      else
+        usage = true;
+      opts.filter = &filter;
+    }
+    else if(!strcmp(argv[i], "--function") && i + 1 < argc)
+    {
+      if(!ParseNumber(argv[++i], filter.function))
+        usage = true;
+      opts.filter = &filter;
+    }
+    else if(!strcmp(argv[i], "--lines"))
+    {
+      opts.lines = true;
+    }
+    else if(!strcmp(argv[i], "--cfg"))
+    {
+      opts.cfg = true;
+    }
+    else if(!strcmp(argv[i], "--pressure"))
+    {
+      opts.pressure = true;
+    }
+    else if(!strcmp(argv[i], "--line") && i + 1 < argc)
     {
-      // only use DXIL if we don't already have debug DXIL
-      if(!best_dxil_chunk)
-        best_dxil_chunk = chunk;
+      if(!ParseFileLine(argv[++i], opts.lineFile, opts.line))
+        usage = true;
+      opts.lines = true;
     }
-    else if(chunk->fourcc == MAKE_FOURCC('S', 'F', 'I', '0'))
+    else if(!strcmp(argv[i], "--pack") && i + 1 < argc)
     {
-      features = *(DXIL::Features *)(chunk + 1);
+      packFilename = argv[++i];
     }
-    else if(chunk->fourcc == MAKE_FOURCC('I', 'L', 'D', 'N'))
+    else if(!strcmp(argv[i], "--serve") && i + 1 < argc)
     {
-      debug_name = new DXIL::DebugName(chunk + 1, chunk->dataLength);
+      socketPath = argv[++i];
     }
-    else if(chunk->fourcc == MAKE_FOURCC('I', 'L', 'D', 'B'))
+    else if(!strcmp(argv[i], "--entry") && i + 1 < argc)
     {
-      // debug DXIL is always the best
-      best_dxil_chunk = chunk;
+      opts.entry = argv[++i];
+    }
+    else if(!strcmp(argv[i], "--source") && i + 1 < argc)
+    {
+      opts.sourceDir = argv[++i];
+    }
+    else if(!strcmp(argv[i], "--strip") && i + 1 < argc)
+    {
+      uint32_t fourcc = 0;
+      if(ParseFourCC(argv[++i], fourcc))
+        chunkEdits.strip.push_back(fourcc);
+      else
+        usage = true;
+    }
+    else if(!strcmp(argv[i], "--set") && i + 2 < argc)
+    {
+      uint32_t fourcc = 0;
+      if(ParseFourCC(argv[++i], fourcc))
+        chunkEdits.set.push_back({fourcc, argv[i + 1]});
+      else
+        usage = true;
+      i++;
+    }
+    else if(!strcmp(argv[i], "--out") && i + 1 < argc)
+    {
+      outDir = argv[++i];
+    }
+    else if(!strcmp(argv[i], "--threads") && i + 1 < argc)
+    {
+      if(!ParseNumber(argv[++i], numThreads))
+        usage = true;
+    }
+    else if(!strcmp(argv[i], "--readahead") && i + 1 < argc)
+    {
+      if(!ParseNumber(argv[++i], queueDepth))
+        usage = true;
+    }
+    else if(!strcmp(argv[i], "--io") && i + 1 < argc)
+    {
+      i++;
+      if(!strcmp(argv[i], "auto"))
+        allowUring = true;
+      else if(!strcmp(argv[i], "threads"))
+        allowUring = false;
+      else
+        usage = true;
+    }
+    else if(!strcmp(argv[i], "--trace") || !strcmp(argv[i], "--format") ||
+            !strcmp(argv[i], "--block") || !strcmp(argv[i], "--record") ||
+            !strcmp(argv[i], "--function") || !strcmp(argv[i], "--threads") ||
+            !strcmp(argv[i], "--line") || !strcmp(argv[i], "--source") ||
+            !strcmp(argv[i], "--pack") || !strcmp(argv[i], "--entry") ||
+            !strcmp(argv[i], "--serve") || !strcmp(argv[i], "--readahead") ||
+            !strcmp(argv[i], "--io") || !strcmp(argv[i], "--strip") ||
+            !strcmp(argv[i], "--set") || !strcmp(argv[i], "--out"))
+    {
+      usage = true;
+    }
+    else
+    {
+      filenames.push_back(argv[i]);
     }
   }
 
-  if(best_dxil_chunk)
-    dxil = new DXIL::Program(best_dxil_chunk + 1, best_dxil_chunk->dataLength);
+  // with no file, a stream can still be read from stdin
+  if(filenames.empty() && opts.stream)
+    filenames.push_back("-");
+
+  // the server takes its files from requests, so nothing else can be given with it
+  const bool serveOnly = socketPath && filenames.empty() && !opts.reflectOnly && !statsMode &&
+                         !opts.filter && !opts.lines && !opts.cfg && !opts.pressure &&
+                         !opts.sourceDir && !opts.entry && !packFilename && !traceFilename &&
+                         !outDir && opts.format == DXIL::DumpFormat::Text;
 
-  if(!dxil)
+  // only statistics, register pressure, packing and rewriting can be given several files, and the
+  // formats only apply to dumps. Chunks can only be edited when rewriting
+  if(usage || (socketPath && !serveOnly) || (!socketPath && filenames.empty()) ||
+     (filenames.size() > 1 && !statsMode && !opts.pressure && !packFilename && !outDir) ||
+     (opts.reflectOnly && statsMode) || (opts.reflectOnly && opts.filter) ||
+     ((opts.reflectOnly || statsMode) && opts.format != DXIL::DumpFormat::Text) ||
+     (opts.filter && opts.format == DXIL::DumpFormat::Disassembly) ||
+     ((opts.lines || opts.sourceDir || opts.cfg || opts.pressure) &&
+      (opts.reflectOnly || statsMode || opts.filter || opts.format != DXIL::DumpFormat::Text)) ||
+     (int(opts.lines) + int(opts.sourceDir != NULL) + int(opts.cfg) + int(opts.pressure) > 1) ||
+     (packFilename && (opts.reflectOnly || statsMode || opts.stream || opts.filter || opts.lines ||
+                       opts.cfg || opts.pressure || opts.sourceDir || opts.entry ||
+                       opts.format != DXIL::DumpFormat::Text)) ||
+     (!outDir && (!chunkEdits.strip.empty() || !chunkEdits.set.empty())) ||
+     (outDir && (opts.reflectOnly || statsMode || opts.stream || opts.filter || opts.lines ||
+                 opts.cfg || opts.pressure || opts.sourceDir || opts.entry || packFilename ||
+                 opts.format != DXIL::DumpFormat::Text)))
   {
-    fprintf(stderr, "Couldn't find DXIL chunk\n");
-    return 4;
+    fprintf(stderr,
+            "Usage: %s [--reflect | --stats | --format text|json|binary|disasm] [--stream] "
+            "[--block ID|NAME]... [--record CODE]... [--function N] [--threads N] "
+            "[--lines | --line FILE:LINE | --source DIR | --cfg | --pressure] [--entry NAME] "
+            "[--readahead N] [--io auto|threads] [--trace out.json] "
+            "[file.dxbc | file.pack | -]...\n",
+            argv[0]);
+    fprintf(stderr, "       %s --pack out.pack file.dxbc...\n", argv[0]);
+    fprintf(stderr,
+            "       %s [--strip FOURCC]... [--set FOURCC FILE]... [--threads N] --out DIR "
+            "(file.dxbc | DIR)...\n",
+            argv[0]);
+    fprintf(stderr, "       %s --serve socket [--threads N]\n", argv[0]);
+    fprintf(stderr, "  --reflect   Only print reflection data from the container, not bitcode\n");
+    fprintf(stderr, "  --stats     Print bitcode statistics, aggregated over all files given\n");
+    fprintf(stderr, "  --format    Dump as text (default), JSON, packed binary or LLVM assembly\n");
+    fprintf(stderr, "  --stream    Read back-to-back containers from the file, or stdin\n");
+    fprintf(stderr, "  --block     Only decode blocks with this ID or name, e.g. METADATA_BLOCK\n");
+    fprintf(stderr, "  --record    Only decode records with this code, within those blocks\n");
+    fprintf(stderr, "  --function  Only decode the function block at this index\n");
+    fprintf(stderr, "  --threads   Threads to disassemble, --cfg, --pressure or --out on, 0 for\n");
+    fprintf(stderr, "              all (the default). With --serve, the most clients at once\n");
+    fprintf(stderr, "  --lines     Print each function's source line table\n");
+    fprintf(stderr, "  --line      Print the instructions from a source line, in each function\n");
+    fprintf(stderr, "  --source    Write the source embedded in debug info under a directory\n");
+    fprintf(stderr, "  --cfg       Print each function's control flow, dominators and loops\n");
+    fprintf(stderr, "  --pressure  Print the most values and registers live at once in each\n");
+    fprintf(stderr, "              function\n");
+    fprintf(stderr, "  --entry     Only process the container with this name from packs\n");
+    fprintf(stderr, "  --readahead Reads to keep in flight when given several files, 0 for none\n");
+    fprintf(stderr, "  --io        Read ahead with io_uring where available (auto), or threads\n");
+    fprintf(stderr, "  --pack      Write the files given into one pack file instead\n");
+    fprintf(stderr, "  --out       Rewrite each container, and every one under each directory,\n");
+    fprintf(stderr, "              into this directory with the chunks below edited, rehashed\n");
+    fprintf(stderr, "  --strip     Drop every chunk with this fourcc, e.g. ILDB, ILDN or PRIV\n");
+    fprintf(stderr, "  --set       Replace the chunk with this fourcc, or add it, with a file\n");
+    fprintf(stderr, "  --serve     Answer requests on a Unix domain socket, see dxil_server.h\n");
+    fprintf(stderr, "  --trace     Write a Chrome trace of where the time went\n");
+    return 1;
   }
 
-  return 0;
-}
\ No newline at end of file
+  if(socketPath)
+  {
+    DXIL::ServerConfig config;
+    config.socketPath = socketPath;
+    if(numThreads != 0)
+      config.maxClients = numThreads;
+
+    DXIL::RunServer(config);
+
+    fprintf(stderr, "Couldn't serve on socket %s: %i\n", socketPath, errno);
+    return 2;
+  }
+
+#if defined(_WIN32)
+  if(opts.format == DXIL::DumpFormat::Binary)
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+  if(traceFilename)
+  {
+    if(!DXILP_TRACING)
+      fprintf(stderr, "Built without DXILP_TRACING, the trace will be empty\n");
+
+    Trace::Start();
+  }
+
+  LLVMBC::BitcodeStats stats;
+  if(statsMode)
+    opts.stats = &stats;
+
+  if(opts.pressure && filenames.size() > 1)
+    opts.fileHeaders = true;
+
+  // the line table only needs debug metadata and function bodies, the rest can be skipped over
+  if(opts.lines)
+  {
+    filter.blocks.push_back(uint32_t(DXIL::KnownBlocks::METADATA_BLOCK));
+    filter.blocks.push_back(uint32_t(DXIL::KnownBlocks::FUNCTION_BLOCK));
+    opts.filter = &filter;
+  }
+
+  // the embedded source is all in named metadata at module level, so function bodies are skipped
+  if(opts.sourceDir)
+  {
+    filter.blocks.push_back(uint32_t(DXIL::KnownBlocks::METADATA_BLOCK));
+    filter.moduleLevel = true;
+    opts.filter = &filter;
+  }
+
+  // the pool is made once up front and shared by every program
+  std::unique_ptr<DXIL::ThreadPool> pool;
+  if((opts.format == DXIL::DumpFormat::Disassembly || opts.cfg || opts.pressure || outDir) &&
+     numThreads != 1)
+  {
+    pool.reset(new DXIL::ThreadPool(numThreads));
+    opts.pool = pool.get();
+  }
+
+  // in statistics mode keep going past any failed file, so the rest of the corpus is counted
+  int ret = 0;
+  if(packFilename)
+  {
+    ret = BuildPack(packFilename, filenames);
+  }
+  else if(outDir)
+  {
+    ret = RewriteContainers(filenames, outDir, chunkEdits, opts.pool);
+  }
+  else if(filenames.size() > 1 && queueDepth > 0 && !opts.stream &&
+          std::find_if(filenames.begin(), filenames.end(),
+                       [](const char *f) { return !strcmp(f, "-"); }) == filenames.end())
+  {
+    ret = ProcessPrefetched(filenames, queueDepth, allowUring, opts);
+  }
+  else
+  {
+    for(const char *filename : filenames)
+    {
+      int fileRet = ProcessFile(filename, opts);
+      if(fileRet != 0)
+        ret = fileRet;
+    }
+  }
+
+  if(statsMode)
+  {
+    DXIL::FileOutput out(stdout);
+    DXIL::PrintStats(stats, out);
+  }
+
+  if(traceFilename)
+  {
+    FILE *f = fopen(traceFilename, "w");
+    if(f == NULL)
+    {
+      fprintf(stderr, "Couldn't open trace file %s: %i\n", traceFilename, errno);
+      return 2;
+    }
+
+    DXIL::FileOutput out(f);
+    Trace::WriteChromeTrace(out);
+
+    fclose(f);
+  }
+
+  return ret;
+}
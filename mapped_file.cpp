@@ -0,0 +1,142 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const char *filename)
+{
+  Close();
+
+  HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+  if(file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if(!GetFileSizeEx(file, &size))
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  m_File = file;
+
+  // empty files can't be mapped, but there's nothing to read anyway
+  if(size.QuadPart == 0)
+    return true;
+
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if(mapping == NULL)
+  {
+    Close();
+    return false;
+  }
+
+  m_Mapping = mapping;
+
+  m_Data = (const byte *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if(m_Data == NULL)
+  {
+    Close();
+    return false;
+  }
+
+  m_Size = (size_t)size.QuadPart;
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if(m_Data)
+    UnmapViewOfFile(m_Data);
+  if(m_Mapping)
+    CloseHandle((HANDLE)m_Mapping);
+  if(m_File)
+    CloseHandle((HANDLE)m_File);
+
+  m_Data = NULL;
+  m_Size = 0;
+  m_Mapping = NULL;
+  m_File = NULL;
+}
+
+#else
+
+bool MappedFile::Open(const char *filename)
+{
+  Close();
+
+  int fd = open(filename, O_RDONLY);
+  if(fd < 0)
+    return false;
+
+  struct stat st;
+  if(fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  // empty files can't be mapped, but there's nothing to read anyway
+  if(st.st_size == 0)
+  {
+    close(fd);
+    return true;
+  }
+
+  void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  // the mapping keeps its own reference to the file
+  close(fd);
+
+  if(data == MAP_FAILED)
+    return false;
+
+  m_Data = (const byte *)data;
+  m_Size = (size_t)st.st_size;
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if(m_Data)
+    munmap((void *)m_Data, m_Size);
+
+  m_Data = NULL;
+  m_Size = 0;
+}
+
+#endif
@@ -0,0 +1,637 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "prefetch_reader.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "trace.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define DXILP_IO_URING 1
+#endif
+#endif
+
+#if !defined(DXILP_IO_URING)
+#define DXILP_IO_URING 0
+#endif
+
+#if DXILP_IO_URING
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+class PrefetchReader::Backend
+{
+public:
+  virtual ~Backend() {}
+  virtual bool Next(PrefetchedFile &file) = 0;
+  virtual const char *GetName() const = 0;
+
+protected:
+  Backend(uint32_t queueDepth, bool inOrder)
+      : m_QueueDepth(std::max(queueDepth, 1U)), m_InOrder(inOrder)
+  {
+  }
+
+  // in order, files are never read more than the depth ahead of the next one to be returned, so
+  // that one slow file can't leave everything after it waiting in memory
+  bool CanStartRead(size_t index) const
+  {
+    return !m_InOrder || index < m_NumReturned + m_QueueDepth;
+  }
+
+  bool IsNextReady() { return findNextReady() != m_Ready.end(); }
+
+  // takes the next file to return out of those that are ready, if it's there
+  bool TakeNextReady(PrefetchedFile &file)
+  {
+    std::deque<PrefetchedFile>::iterator it = findNextReady();
+    if(it == m_Ready.end())
+      return false;
+
+    file = std::move(*it);
+    m_Ready.erase(it);
+    m_NumReturned++;
+    return true;
+  }
+
+  const uint32_t m_QueueDepth;
+  const bool m_InOrder;
+  size_t m_NumReturned = 0;
+  // files that have been read but not yet returned, in the order they finished
+  std::deque<PrefetchedFile> m_Ready;
+
+private:
+  std::deque<PrefetchedFile>::iterator findNextReady()
+  {
+    if(!m_InOrder)
+      return m_Ready.begin();
+
+    return std::find_if(m_Ready.begin(), m_Ready.end(), [this](const PrefetchedFile &file) {
+      return file.index == m_NumReturned;
+    });
+  }
+};
+
+// reads are capped so a huge file can't overflow a single request's length
+static const size_t MaxReadLength = 1 << 30;
+
+// each thread opens and reads one file at a time, while the consumer takes whichever are done
+class ThreadBackend : public PrefetchReader::Backend
+{
+public:
+  ThreadBackend(const std::vector<const char *> &filenames, uint32_t queueDepth, bool inOrder)
+      : Backend(queueDepth, inOrder), m_Filenames(filenames)
+  {
+    const size_t numThreads = std::min<size_t>(m_QueueDepth, filenames.size());
+    for(size_t i = 0; i < numThreads; i++)
+      m_Threads.emplace_back(&ThreadBackend::ThreadMain, this);
+  }
+
+  ~ThreadBackend()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_Lock);
+      m_Shutdown = true;
+    }
+    m_SlotFree.notify_all();
+
+    for(std::thread &t : m_Threads)
+      t.join();
+  }
+
+  bool Next(PrefetchedFile &file) override
+  {
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    if(m_NumReturned == m_Filenames.size())
+      return false;
+
+    m_FileReady.wait(lock, [this]() { return IsNextReady(); });
+    TakeNextReady(file);
+
+    // a slot in the queue has freed up for the next read
+    m_SlotFree.notify_one();
+    return true;
+  }
+
+  const char *GetName() const override { return "threads"; }
+
+private:
+  void ThreadMain()
+  {
+    std::unique_lock<std::mutex> lock(m_Lock);
+
+    for(;;)
+    {
+      // files being read and files read but not yet taken both count against the depth
+      m_SlotFree.wait(lock, [this]() {
+        return m_Shutdown || m_NextFile == m_Filenames.size() ||
+               (m_Ready.size() + m_NumReading < m_QueueDepth && CanStartRead(m_NextFile));
+      });
+
+      if(m_Shutdown || m_NextFile == m_Filenames.size())
+        return;
+
+      PrefetchedFile file;
+      file.index = m_NextFile++;
+      m_NumReading++;
+
+      lock.unlock();
+      ReadFile(m_Filenames[file.index], file);
+      lock.lock();
+
+      m_NumReading--;
+      m_Ready.push_back(std::move(file));
+      m_FileReady.notify_one();
+    }
+  }
+
+  static void ReadFile(const char *filename, PrefetchedFile &file)
+  {
+    FILE *f = fopen(filename, "rb");
+    if(f == NULL)
+    {
+      file.error = errno;
+      return;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if(size < 0)
+    {
+      file.error = errno;
+      fclose(f);
+      return;
+    }
+
+    file.data.resize((size_t)size);
+    if(fread(file.data.data(), 1, file.data.size(), f) != file.data.size())
+      file.error = ferror(f) ? errno : EIO;
+
+    fclose(f);
+  }
+
+  const std::vector<const char *> &m_Filenames;
+  std::vector<std::thread> m_Threads;
+
+  std::mutex m_Lock;
+  std::condition_variable m_SlotFree;
+  std::condition_variable m_FileReady;
+  bool m_Shutdown = false;
+  size_t m_NextFile = 0;
+  size_t m_NumReading = 0;
+};
+
+#if DXILP_IO_URING
+
+// drives an io_uring directly with the raw system calls, so there's no dependency on liburing.
+// Everything happens on the consumer's thread: Next tops up the submission queue, then sleeps in
+// the kernel until at least one read completes if nothing is ready yet.
+class UringBackend : public PrefetchReader::Backend
+{
+public:
+  UringBackend(const std::vector<const char *> &filenames, uint32_t queueDepth, bool inOrder)
+      : Backend(queueDepth, inOrder), m_Filenames(filenames)
+  {
+    io_uring_params params = {};
+    m_Ring = (int)syscall(__NR_io_uring_setup, m_QueueDepth, &params);
+    if(m_Ring < 0)
+      return;
+
+    // the rings can be shared in one mapping on newer kernels, but mapping them separately works
+    // everywhere
+    m_SQRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    m_CQRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_SQEsSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    m_SQRing = mmap(NULL, m_SQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Ring,
+                    IORING_OFF_SQ_RING);
+    m_CQRing = mmap(NULL, m_CQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Ring,
+                    IORING_OFF_CQ_RING);
+    void *sqes = mmap(NULL, m_SQEsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Ring,
+                      IORING_OFF_SQES);
+
+    if(m_SQRing == MAP_FAILED || m_CQRing == MAP_FAILED || sqes == MAP_FAILED)
+    {
+      if(sqes != MAP_FAILED)
+        munmap(sqes, m_SQEsSize);
+      Release();
+      return;
+    }
+
+    byte *sq = (byte *)m_SQRing;
+    m_SQTail = (uint32_t *)(sq + params.sq_off.tail);
+    m_SQMask = *(uint32_t *)(sq + params.sq_off.ring_mask);
+    m_SQArray = (uint32_t *)(sq + params.sq_off.array);
+    m_SQEs = (io_uring_sqe *)sqes;
+
+    byte *cq = (byte *)m_CQRing;
+    m_CQHead = (uint32_t *)(cq + params.cq_off.head);
+    m_CQTail = (uint32_t *)(cq + params.cq_off.tail);
+    m_CQMask = *(uint32_t *)(cq + params.cq_off.ring_mask);
+    m_CQEs = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // never more in flight than the submission queue holds, so the completion queue can't overflow
+    m_Requests.resize(std::min(m_QueueDepth, params.sq_entries));
+    for(size_t i = 0; i < m_Requests.size(); i++)
+      m_FreeRequests.push_back(m_Requests.size() - 1 - i);
+  }
+
+  ~UringBackend()
+  {
+    // reads still in flight are written into our buffers, so they must finish first
+    while(m_Ring >= 0 && m_NumInFlight > 0 && !m_Failed)
+    {
+      Submit(true);
+      if(!m_Failed)
+        Reap();
+    }
+
+    for(Request &req : m_Requests)
+    {
+      if(req.fd >= 0)
+        close(req.fd);
+    }
+
+    // reads abandoned when the ring failed may still land in their buffers, so those are never
+    // freed. Moving the requests keeps every buffer and iovec where the kernel was told it is
+    if(m_NumInFlight > 0)
+      (void)new std::vector<Request>(std::move(m_Requests));
+
+    if(m_SQEs)
+      munmap(m_SQEs, m_SQEsSize);
+    Release();
+  }
+
+  bool IsValid() const { return m_Ring >= 0; }
+
+  bool Next(PrefetchedFile &file) override
+  {
+    for(;;)
+    {
+      if(!m_Failed)
+      {
+        StartReads();
+
+        // new reads are submitted straight away so they run while the caller is busy, and only if
+        // nothing is ready yet does this wait for a completion in the same call
+        const bool wait = !IsNextReady() && m_NumInFlight > 0;
+        if(m_NumUnsubmitted > 0 || wait)
+          Submit(wait);
+
+        // once the ring has failed, everything it will complete has been reaped already
+        if(!m_Failed)
+          Reap();
+      }
+
+      if(TakeNextReady(file))
+        return true;
+
+      if(m_Failed)
+      {
+        // the fallback reads in ascending order, so in order the next file is always its next
+        if(!m_Fallback)
+          StartFallback();
+
+        PrefetchedFile read;
+        if(!m_Fallback->Next(read))
+          return false;
+
+        read.index = m_FallbackIndices[read.index];
+        m_Ready.push_back(std::move(read));
+        continue;
+      }
+
+      if(m_NumInFlight == 0 && m_NextFile == m_Filenames.size())
+        return false;
+    }
+  }
+
+  const char *GetName() const override { return m_Fallback ? m_Fallback->GetName() : "io_uring"; }
+
+private:
+  struct Request
+  {
+    int fd = -1;
+    PrefetchedFile file;
+    size_t numRead = 0;
+    iovec iov = {};
+  };
+
+  void Release()
+  {
+    if(m_SQRing && m_SQRing != MAP_FAILED)
+      munmap(m_SQRing, m_SQRingSize);
+    if(m_CQRing && m_CQRing != MAP_FAILED)
+      munmap(m_CQRing, m_CQRingSize);
+    if(m_Ring >= 0)
+      close(m_Ring);
+
+    m_SQRing = m_CQRing = NULL;
+    m_SQEs = NULL;
+    m_Ring = -1;
+  }
+
+  int Enter(uint32_t toSubmit, uint32_t minComplete, uint32_t flags)
+  {
+    return (int)syscall(__NR_io_uring_enter, m_Ring, toSubmit, minComplete, flags, NULL, 0);
+  }
+
+  void Submit(bool wait)
+  {
+    int numSubmitted = Enter(m_NumUnsubmitted, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+    if(numSubmitted >= 0)
+      m_NumUnsubmitted -= uint32_t(numSubmitted);
+    else if(errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      FailRing();
+  }
+
+  // opens files and queues their reads until the queue is full
+  void StartReads()
+  {
+    while(!m_FreeRequests.empty() && m_NextFile < m_Filenames.size() &&
+          CanStartRead(m_NextFile))
+    {
+      PrefetchedFile file;
+      file.index = m_NextFile++;
+
+      int fd = open(m_Filenames[file.index], O_RDONLY | O_CLOEXEC);
+      struct stat st;
+      if(fd < 0 || fstat(fd, &st) != 0)
+      {
+        file.error = errno;
+        if(fd >= 0)
+          close(fd);
+        m_Ready.push_back(std::move(file));
+        continue;
+      }
+
+      // nothing to read, so it's done already
+      if(st.st_size == 0)
+      {
+        close(fd);
+        m_Ready.push_back(std::move(file));
+        continue;
+      }
+
+      const size_t idx = m_FreeRequests.back();
+      m_FreeRequests.pop_back();
+
+      Request &req = m_Requests[idx];
+      req.fd = fd;
+      req.file = std::move(file);
+      req.file.data.resize(size_t(st.st_size));
+      req.numRead = 0;
+
+      m_NumInFlight++;
+      QueueRead(idx);
+    }
+  }
+
+  // queues a read of whatever is left of the request's file
+  void QueueRead(size_t idx)
+  {
+    Request &req = m_Requests[idx];
+    req.iov.iov_base = req.file.data.data() + req.numRead;
+    req.iov.iov_len = std::min(req.file.data.size() - req.numRead, MaxReadLength);
+
+    // only this thread writes the tail, but the kernel reads it
+    const uint32_t tail = *m_SQTail;
+    const uint32_t slot = tail & m_SQMask;
+
+    io_uring_sqe &sqe = m_SQEs[slot];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = req.fd;
+    sqe.off = req.numRead;
+    sqe.addr = (uint64_t)(uintptr_t)&req.iov;
+    sqe.len = 1;
+    sqe.user_data = idx;
+
+    m_SQArray[slot] = slot;
+    __atomic_store_n(m_SQTail, tail + 1, __ATOMIC_RELEASE);
+    m_NumUnsubmitted++;
+  }
+
+  void Reap()
+  {
+    uint32_t head = *m_CQHead;
+    const uint32_t tail = __atomic_load_n(m_CQTail, __ATOMIC_ACQUIRE);
+
+    for(; head != tail; head++)
+    {
+      const io_uring_cqe &cqe = m_CQEs[head & m_CQMask];
+      const size_t idx = size_t(cqe.user_data);
+      Request &req = m_Requests[idx];
+
+      if(m_Failed && (cqe.res == -EINTR || cqe.res == -EAGAIN ||
+                      (cqe.res > 0 && req.numRead + size_t(cqe.res) < req.file.data.size())))
+      {
+        // nothing more is queued once the ring has failed, so the fallback reads it again
+        Retry(idx);
+      }
+      else if(cqe.res == -EINTR || cqe.res == -EAGAIN)
+      {
+        QueueRead(idx);
+      }
+      else if(cqe.res < 0)
+      {
+        req.file.error = -cqe.res;
+        Complete(idx);
+      }
+      else if(cqe.res == 0)
+      {
+        // the file shrank after we sized it
+        req.file.data.resize(req.numRead);
+        Complete(idx);
+      }
+      else
+      {
+        req.numRead += size_t(cqe.res);
+        if(req.numRead < req.file.data.size())
+          QueueRead(idx);
+        else
+          Complete(idx);
+      }
+    }
+
+    __atomic_store_n(m_CQHead, head, __ATOMIC_RELEASE);
+  }
+
+  void Complete(size_t idx)
+  {
+    Request &req = m_Requests[idx];
+    close(req.fd);
+    req.fd = -1;
+
+    m_Ready.push_back(std::move(req.file));
+    m_FreeRequests.push_back(idx);
+    m_NumInFlight--;
+  }
+
+  // hands a request's file to the fallback once the kernel is done with its buffer
+  void Retry(size_t idx)
+  {
+    Request &req = m_Requests[idx];
+    close(req.fd);
+    req.fd = -1;
+
+    m_Retries.push_back(req.file.index);
+    req.file = PrefetchedFile();
+    m_FreeRequests.push_back(idx);
+    m_NumInFlight--;
+  }
+
+  // the ring can't be entered any more. No new reads are queued, but those the kernel has already
+  // taken still write into their buffers, so this keeps waiting for them for as long as the ring
+  // allows. Any it can't wait for are abandoned, and their buffers are never handed out
+  void FailRing()
+  {
+    m_Failed = true;
+
+    while(m_NumInFlight > 0)
+    {
+      int numSubmitted = Enter(m_NumUnsubmitted, 1, IORING_ENTER_GETEVENTS);
+      if(numSubmitted >= 0)
+        m_NumUnsubmitted -= uint32_t(numSubmitted);
+      else if(errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        break;
+
+      Reap();
+    }
+
+    for(size_t idx = 0; idx < m_Requests.size(); idx++)
+    {
+      if(m_Requests[idx].fd >= 0)
+        m_Retries.push_back(m_Requests[idx].file.index);
+    }
+  }
+
+  // reads every file the ring didn't finish with blocking reads instead
+  void StartFallback()
+  {
+    m_FallbackIndices = m_Retries;
+    for(; m_NextFile < m_Filenames.size(); m_NextFile++)
+      m_FallbackIndices.push_back(m_NextFile);
+    std::sort(m_FallbackIndices.begin(), m_FallbackIndices.end());
+
+    for(size_t index : m_FallbackIndices)
+      m_FallbackNames.push_back(m_Filenames[index]);
+
+    m_Fallback.reset(new ThreadBackend(m_FallbackNames, m_QueueDepth, m_InOrder));
+  }
+
+  const std::vector<const char *> &m_Filenames;
+
+  int m_Ring = -1;
+  void *m_SQRing = NULL;
+  void *m_CQRing = NULL;
+  size_t m_SQRingSize = 0;
+  size_t m_CQRingSize = 0;
+  size_t m_SQEsSize = 0;
+
+  uint32_t *m_SQTail = NULL;
+  uint32_t m_SQMask = 0;
+  uint32_t *m_SQArray = NULL;
+  io_uring_sqe *m_SQEs = NULL;
+
+  uint32_t *m_CQHead = NULL;
+  uint32_t *m_CQTail = NULL;
+  uint32_t m_CQMask = 0;
+  io_uring_cqe *m_CQEs = NULL;
+
+  std::vector<Request> m_Requests;
+  std::vector<size_t> m_FreeRequests;
+  size_t m_NextFile = 0;
+  size_t m_NumInFlight = 0;
+  uint32_t m_NumUnsubmitted = 0;
+
+  bool m_Failed = false;
+  // files whose reads were dropped when the ring failed
+  std::vector<size_t> m_Retries;
+  // the fallback's filenames, and the index of each in m_Filenames
+  std::vector<const char *> m_FallbackNames;
+  std::vector<size_t> m_FallbackIndices;
+  std::unique_ptr<ThreadBackend> m_Fallback;
+};
+
+#endif
+
+PrefetchReader::PrefetchReader(const std::vector<const char *> &filenames, uint32_t queueDepth,
+                               bool allowUring, bool inOrder)
+{
+#if DXILP_IO_URING
+  // io_uring can be missing from older kernels, or blocked by seccomp in containers
+  if(allowUring)
+  {
+    std::unique_ptr<UringBackend> uring(new UringBackend(filenames, queueDepth, inOrder));
+    if(uring->IsValid())
+      m_Backend = std::move(uring);
+  }
+#endif
+
+  if(!m_Backend)
+    m_Backend.reset(new ThreadBackend(filenames, queueDepth, inOrder));
+}
+
+PrefetchReader::~PrefetchReader()
+{
+}
+
+bool PrefetchReader::Next(PrefetchedFile &file)
+{
+  TRACE_SCOPE("Wait for input");
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  bool ret = m_Backend->Next(file);
+  if(ret)
+    m_BytesRead += file.data.size();
+
+  m_StallMicroseconds += uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count());
+  return ret;
+}
+
+const char *PrefetchReader::GetBackendName() const
+{
+  return m_Backend->GetName();
+}
@@ -0,0 +1,76 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "common.h"
+
+struct PrefetchedFile
+{
+  // index into the filenames the reader was given
+  size_t index = 0;
+  // 0 on success, otherwise the errno from opening or reading the file
+  int error = 0;
+  std::vector<byte> data;
+};
+
+// reads a list of files ahead of whoever is processing them, keeping up to queueDepth reads in
+// flight so that waiting on storage overlaps with decoding. Files are returned in the order their
+// reads complete, or if inOrder is set, in the order they were given in. Then no file is read more
+// than queueDepth ahead of the next one to be returned.
+//
+// on Linux the reads are submitted through io_uring where the kernel allows it, unless allowUring
+// is false. Otherwise a thread per outstanding read does ordinary blocking reads, as it does for
+// whatever is left if the ring fails partway through.
+class PrefetchReader
+{
+public:
+  PrefetchReader(const std::vector<const char *> &filenames, uint32_t queueDepth,
+                 bool allowUring = true, bool inOrder = false);
+  ~PrefetchReader();
+
+  PrefetchReader(const PrefetchReader &) = delete;
+  PrefetchReader &operator=(const PrefetchReader &) = delete;
+
+  // blocks until another file has been read. Returns false once every file has been returned
+  bool Next(PrefetchedFile &file);
+
+  // "io_uring" or "threads"
+  const char *GetBackendName() const;
+
+  // time spent inside Next, i.e. the caller waiting on input rather than doing its own work
+  uint64_t GetStallMicroseconds() const { return m_StallMicroseconds; }
+  uint64_t GetBytesRead() const { return m_BytesRead; }
+
+  class Backend;
+
+private:
+  std::unique_ptr<Backend> m_Backend;
+  uint64_t m_StallMicroseconds = 0;
+  uint64_t m_BytesRead = 0;
+};
@@ -0,0 +1,125 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "thread_pool.h"
+
+namespace DXIL
+{
+ThreadPool::ThreadPool(uint32_t numThreads)
+{
+  if(numThreads == 0)
+    numThreads = std::thread::hardware_concurrency();
+
+  // the calling thread does its share, so only start the extras
+  for(uint32_t i = 1; i < numThreads; i++)
+    m_Workers.push_back(std::thread(&ThreadPool::WorkerMain, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Shutdown = true;
+  }
+
+  m_WorkReady.notify_all();
+
+  for(std::thread &t : m_Workers)
+    t.join();
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)> &func)
+{
+  if(count == 0)
+    return;
+
+  // not worth waking anyone for
+  if(m_Workers.empty() || count == 1)
+  {
+    for(size_t i = 0; i < count; i++)
+      func(i);
+    return;
+  }
+
+  std::lock_guard<std::mutex> callLock(m_CallLock);
+
+  {
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Func = &func;
+    m_Count = count;
+    m_Next = 0;
+    m_Finished = 0;
+    m_Generation++;
+  }
+
+  m_WorkReady.notify_all();
+
+  RunJobs();
+
+  std::unique_lock<std::mutex> lock(m_Lock);
+  m_WorkDone.wait(lock, [this]() { return m_Finished == m_Count; });
+
+  // workers that wake late see no work left, and never touch func
+  m_Func = NULL;
+}
+
+void ThreadPool::RunJobs()
+{
+  std::unique_lock<std::mutex> lock(m_Lock);
+
+  while(m_Next < m_Count)
+  {
+    const size_t index = m_Next++;
+    const std::function<void(size_t)> &func = *m_Func;
+
+    lock.unlock();
+    func(index);
+    lock.lock();
+
+    if(++m_Finished == m_Count)
+      m_WorkDone.notify_all();
+  }
+}
+
+void ThreadPool::WorkerMain()
+{
+  uint64_t seenGeneration = 0;
+
+  for(;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_Lock);
+      m_WorkReady.wait(lock,
+                       [&]() { return m_Shutdown || m_Generation != seenGeneration; });
+
+      if(m_Shutdown)
+        return;
+
+      seenGeneration = m_Generation;
+    }
+
+    RunJobs();
+  }
+}
+};    // namespace DXIL
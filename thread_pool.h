@@ -0,0 +1,78 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace DXIL
+{
+// a fixed set of worker threads for running many small independent jobs, e.g. one per function.
+// The threads live as long as the pool so batches don't pay for thread creation.
+class ThreadPool
+{
+public:
+  // 0 picks one thread per hardware thread. The calling thread counts as one of them
+  explicit ThreadPool(uint32_t numThreads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  uint32_t NumThreads() const { return uint32_t(m_Workers.size() + 1); }
+
+  // calls func(i) for every i in [0, count), spread over the pool and the calling thread, and
+  // returns once every call has finished. Calls from different threads are run one after another,
+  // and func must not call back into the pool.
+  void ParallelFor(size_t count, const std::function<void(size_t)> &func);
+
+private:
+  void WorkerMain();
+  void RunJobs();
+
+  std::vector<std::thread> m_Workers;
+
+  // held for the whole of a ParallelFor, so only one runs at a time
+  std::mutex m_CallLock;
+
+  std::mutex m_Lock;
+  std::condition_variable m_WorkReady;
+  std::condition_variable m_WorkDone;
+
+  // the current batch. Indices are handed out under the lock, which is cheap next to the jobs
+  const std::function<void(size_t)> *m_Func = NULL;
+  size_t m_Count = 0;
+  size_t m_Next = 0;
+  size_t m_Finished = 0;
+  // bumped for each batch, so sleeping workers can tell a new one has started
+  uint64_t m_Generation = 0;
+  bool m_Shutdown = false;
+};
+};    // namespace DXIL
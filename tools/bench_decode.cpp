@@ -0,0 +1,94 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+// times decoding each container given, to measure the cost of changes to the decoder such as the
+// bounds checking. Not part of the projects, build it with e.g.
+//   g++ -std=c++14 -O2 -pthread -I.. bench_decode.cpp $(ls ../*.cpp | grep -v main.cpp)
+//     -o bench_decode
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "dxbc_container.h"
+#include "dxil_inspect.h"
+#include "mapped_file.h"
+
+int main(int argc, char **argv)
+{
+  if(argc < 2)
+  {
+    fprintf(stderr, "Usage: %s [--runs N] file.dxbc [file.dxbc ...]\n", argv[0]);
+    return 1;
+  }
+
+  int runs = 20;
+  int first = 1;
+  if(argc > 3 && !strcmp(argv[1], "--runs"))
+  {
+    runs = atoi(argv[2]);
+    first = 3;
+  }
+
+  int ret = 0;
+  for(int i = first; i < argc; i++)
+  {
+    MappedFile file;
+    if(!file.Open(argv[i]))
+    {
+      fprintf(stderr, "Couldn't open %s\n", argv[i]);
+      ret = 1;
+      continue;
+    }
+
+    DXBC::Container container(file.Data(), file.Size());
+
+    // the best run is the least disturbed by anything else on the machine, the mean shows spread
+    double best = 1e30, total = 0.0;
+    for(int r = 0; r < runs; r++)
+    {
+      auto start = std::chrono::high_resolution_clock::now();
+      DXIL::Program program(container);
+      auto end = std::chrono::high_resolution_clock::now();
+
+      if(program.GetStatus().Failed())
+      {
+        fprintf(stderr, "Couldn't decode %s\n", argv[i]);
+        ret = 1;
+        break;
+      }
+
+      const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+      best = ms < best ? ms : best;
+      total += ms;
+    }
+
+    if(total > 0.0)
+      printf("%s: %zu bytes, best %.3f ms, mean %.3f ms over %d runs\n", argv[i], file.Size(),
+             best, total / runs, runs);
+  }
+
+  return ret;
+}
@@ -0,0 +1,72 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+// libFuzzer target for decoding untrusted shaders. Not part of the projects, build it with e.g.
+//   clang++ -std=c++14 -g -O1 -fsanitize=fuzzer,address,undefined -I.. fuzz_decode.cpp
+//     $(ls ../*.cpp | grep -v main.cpp) -o fuzz_decode
+// and run it over a directory of containers as the corpus.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dxbc_container.h"
+#include "dxil_inspect.h"
+#include "dxil_output.h"
+#include "dxil_reflect.h"
+#include "llvm_decoder.h"
+
+namespace
+{
+// everything is formatted, but nothing is kept
+class NullOutput : public DXIL::Output
+{
+public:
+  void Write(const char *, size_t) override {}
+  using Output::Write;
+};
+};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  // as a whole container, which is how shaders arrive
+  DXBC::Container container(data, size);
+  if(container.IsValid())
+  {
+    DXIL::Reflection refl;
+    DXIL::Reflect(data, size, refl);
+
+    DXIL::Program program(container);
+    if(!program.GetStatus().Failed())
+    {
+      NullOutput out;
+      program.Dump(out, DXIL::DumpFormat::Text);
+      program.Dump(out, DXIL::DumpFormat::Disassembly);
+    }
+  }
+
+  // and as bare bitcode, so that mutations reach the decoder without needing a valid container
+  LLVMBC::BitcodeReader reader(data, size);
+  reader.ReadToplevelBlock();
+
+  return 0;
+}
@@ -0,0 +1,137 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "trace.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "dxil_output.h"
+
+namespace Trace
+{
+struct Event
+{
+  const char *name;
+  const char *argName;
+  uint64_t arg;
+  int64_t start;
+  int64_t duration;
+};
+
+// each thread records into its own buffer so there's no contention while tracing. The buffers are
+// owned by the registry so they outlive their threads.
+struct ThreadBuffer
+{
+  uint32_t tid;
+  std::vector<Event> events;
+};
+
+static std::atomic<bool> started(false);
+static std::chrono::steady_clock::time_point startTime;
+
+static std::mutex registryLock;
+static std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+static thread_local ThreadBuffer *threadBuffer = NULL;
+
+static ThreadBuffer *GetThreadBuffer()
+{
+  if(threadBuffer == NULL)
+  {
+    std::lock_guard<std::mutex> lock(registryLock);
+    registry.emplace_back(new ThreadBuffer());
+    threadBuffer = registry.back().get();
+    threadBuffer->tid = uint32_t(registry.size());
+  }
+
+  return threadBuffer;
+}
+
+static int64_t Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                              startTime)
+      .count();
+}
+
+void Start()
+{
+  startTime = std::chrono::steady_clock::now();
+  started.store(true, std::memory_order_release);
+}
+
+bool IsStarted()
+{
+  return started.load(std::memory_order_relaxed);
+}
+
+void Scope::Begin(const char *name, const char *argName, uint64_t arg)
+{
+  m_Name = name;
+  m_ArgName = argName;
+  m_Arg = arg;
+  m_Start = Now();
+}
+
+void Scope::End()
+{
+  const int64_t end = Now();
+
+  Event ev = {m_Name, m_ArgName, m_Arg, m_Start, end - m_Start};
+  GetThreadBuffer()->events.push_back(ev);
+}
+
+void WriteChromeTrace(DXIL::Output &out)
+{
+  std::lock_guard<std::mutex> lock(registryLock);
+
+  out.Write("{\"traceEvents\":[\n");
+
+  bool first = true;
+  for(const std::unique_ptr<ThreadBuffer> &buf : registry)
+  {
+    out.Printf("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+               "\"args\":{\"name\":\"thread %u\"}}",
+               first ? "" : ",\n", buf->tid, buf->tid);
+    first = false;
+
+    // timestamps are in microseconds, but fractions are allowed
+    for(const Event &ev : buf->events)
+    {
+      out.Printf(",\n{\"name\":\"%s\",\"cat\":\"dxilp\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                 "\"ts\":%.3f,\"dur\":%.3f",
+                 ev.name, buf->tid, double(ev.start) / 1000.0, double(ev.duration) / 1000.0);
+
+      if(ev.argName)
+        out.Printf(",\"args\":{\"%s\":%llu}", ev.argName, (unsigned long long)ev.arg);
+
+      out.Write("}");
+    }
+  }
+
+  out.Write("\n]}\n");
+}
+};    // namespace Trace
@@ -0,0 +1,95 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// build with DXILP_TRACING=1 to compile in the instrumentation scopes. Otherwise they compile to
+// nothing, and a trace only has what was recorded by hand.
+#if !defined(DXILP_TRACING)
+#define DXILP_TRACING 0
+#endif
+
+namespace DXIL
+{
+class Output;
+};
+
+namespace Trace
+{
+// nothing is recorded until this is called, so compiled-in scopes cost one check until then
+void Start();
+bool IsStarted();
+
+// writes everything recorded so far as Chrome trace-event JSON, with a track for each thread that
+// recorded anything. Only call this once all threads being traced have finished.
+void WriteChromeTrace(DXIL::Output &out);
+
+// times its own lifetime, with an optional argument to tell different instances apart. The name
+// must be a string literal or otherwise live until the trace is written.
+class Scope
+{
+public:
+  Scope(const char *name) : Scope(name, NULL, 0) {}
+  Scope(const char *name, const char *argName, uint64_t arg)
+  {
+    if(IsStarted())
+      Begin(name, argName, arg);
+  }
+  ~Scope()
+  {
+    if(m_Name)
+      End();
+  }
+
+private:
+  const char *m_Name = NULL;
+  const char *m_ArgName = NULL;
+  uint64_t m_Arg = 0;
+  int64_t m_Start = 0;
+
+  void Begin(const char *name, const char *argName, uint64_t arg);
+  void End();
+};
+};    // namespace Trace
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+
+#if DXILP_TRACING
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, argName, arg) \
+  Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name, argName, arg)
+#else
+#define TRACE_SCOPE(name) \
+  do                      \
+  {                       \
+  } while(0)
+#define TRACE_SCOPE_ARG(name, argName, arg) \
+  do                                        \
+  {                                         \
+  } while(0)
+#endif